@@ -3829,6 +3829,47 @@ todo_wine
     ok(dwret == ERROR_SUCCESS, "got %u\n", dwret);
 }
 
+static DWORD enum_tree( HKEY hkey, int depth )
+{
+    char name[MAX_PATH];
+    DWORD i, len, count = 1;
+    HKEY subkey;
+
+    for (i = 0; ; i++)
+    {
+        len = sizeof(name);
+        if (RegEnumValueA( hkey, i, name, &len, NULL, NULL, NULL, NULL )) break;
+        count++;
+    }
+    if (!depth) return count;
+    for (i = 0; ; i++)
+    {
+        len = sizeof(name);
+        if (RegEnumKeyExA( hkey, i, name, &len, NULL, NULL, NULL, NULL )) break;
+        if (RegOpenKeyExA( hkey, name, 0, KEY_READ, &subkey )) continue;
+        count += enum_tree( subkey, depth - 1 );
+        RegCloseKey( subkey );
+    }
+    return count;
+}
+
+static void test_enum_tree(void)
+{
+    DWORD count, count2;
+    HKEY hkey;
+    LONG ret;
+
+    ret = RegOpenKeyExA( HKEY_LOCAL_MACHINE, "Software", 0, KEY_READ, &hkey );
+    ok( !ret, "RegOpenKeyExA failed: %d\n", ret );
+    if (ret) return;
+
+    /* the first pass may have to load the keys, the second one only reads them */
+    count = enum_tree( hkey, 3 );
+    count2 = enum_tree( hkey, 3 );
+    ok( count == count2, "got %u entries, then %u\n", count, count2 );
+    RegCloseKey( hkey );
+}
+
 START_TEST(registry)
 {
     /* Load pointers for functions that are not available in all Windows versions */
@@ -3865,6 +3906,7 @@ START_TEST(registry)
     test_RegOpenCurrentUser();
     test_RegNotifyChangeKeyValue();
     test_RegQueryValueExPerformanceData();
+    test_enum_tree();
 
     /* cleanup */
     delete_key( hkey_main );
@@ -1298,6 +1298,124 @@ static void test_Loader(void)
     section.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
 }
 
+#define IMAGE_LAYOUT_DATA_SIZE  0x800000
+
+/* check that images with sections stored at their virtual address are mapped correctly */
+static void test_image_file_layout(void)
+{
+    IMAGE_NT_HEADERS nt_header = nt_header_template;
+    IMAGE_SECTION_HEADER sections[2];
+    MEMORY_BASIC_INFORMATION info;
+    char dll_name[MAX_PATH];
+    BYTE buffer[0x200];
+    HANDLE hfile;
+    HMODULE module;
+    BYTE *ptr, *data;
+    DWORD dummy, i;
+    BOOL ret;
+
+    data = VirtualAlloc( NULL, IMAGE_LAYOUT_DATA_SIZE, MEM_COMMIT, PAGE_READWRITE );
+    memset( data, 0x5a, IMAGE_LAYOUT_DATA_SIZE );
+
+    nt_header.FileHeader.NumberOfSections = 2;
+    nt_header.FileHeader.Characteristics = IMAGE_FILE_EXECUTABLE_IMAGE | IMAGE_FILE_DLL | IMAGE_FILE_RELOCS_STRIPPED;
+    nt_header.OptionalHeader.SectionAlignment = page_size;
+    nt_header.OptionalHeader.FileAlignment = page_size;
+    nt_header.OptionalHeader.SizeOfHeaders = page_size;
+    nt_header.OptionalHeader.SizeOfImage = page_size + IMAGE_LAYOUT_DATA_SIZE + 3 * page_size;
+
+    /* the last page of the first section is padding in the file */
+    memset( sections, 0, sizeof(sections) );
+    memcpy( sections[0].Name, ".rdata", 6 );
+    sections[0].Misc.VirtualSize = IMAGE_LAYOUT_DATA_SIZE;
+    sections[0].VirtualAddress = page_size;
+    sections[0].SizeOfRawData = IMAGE_LAYOUT_DATA_SIZE - page_size;
+    sections[0].PointerToRawData = page_size;
+    sections[0].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+
+    /* the second section is mostly uninitialized */
+    memcpy( sections[1].Name, ".data", 5 );
+    sections[1].Misc.VirtualSize = 3 * page_size;
+    sections[1].VirtualAddress = page_size + IMAGE_LAYOUT_DATA_SIZE;
+    sections[1].SizeOfRawData = 0x200;
+    sections[1].PointerToRawData = page_size + IMAGE_LAYOUT_DATA_SIZE;
+    sections[1].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+
+    create_test_dll_sections( &dos_header, &nt_header, sections, data, dll_name );
+
+    /* fill the padding with garbage, it must not show up in the mapped image */
+    hfile = CreateFileA( dll_name, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "failed to open %s err %u\n", dll_name, GetLastError() );
+    SetFilePointer( hfile, IMAGE_LAYOUT_DATA_SIZE, NULL, FILE_BEGIN );
+    ret = WriteFile( hfile, data, page_size, &dummy, NULL );
+    ok( ret, "WriteFile error %d\n", GetLastError() );
+    CloseHandle( hfile );
+
+    module = LoadLibraryA( dll_name );
+    ok( module != NULL, "LoadLibrary(%s) failed %u\n", dll_name, GetLastError() );
+    if (!module) goto done;
+
+    ptr = (BYTE *)module + page_size;
+    for (i = 0; i < IMAGE_LAYOUT_DATA_SIZE - page_size; i++) if (ptr[i] != 0x5a) break;
+    ok( i == IMAGE_LAYOUT_DATA_SIZE - page_size, "wrong data at offset %x\n", i );
+    for (; i < IMAGE_LAYOUT_DATA_SIZE + 3 * page_size; i++)
+    {
+        if (i >= IMAGE_LAYOUT_DATA_SIZE && i < IMAGE_LAYOUT_DATA_SIZE + 0x200) continue;
+        if (ptr[i]) break;
+    }
+    ok( i == IMAGE_LAYOUT_DATA_SIZE + 3 * page_size, "data not cleared at offset %x\n", i );
+
+    /* the section protections are applied over the cleared pages */
+    ret = VirtualQuery( ptr, &info, sizeof(info) );
+    ok( ret, "VirtualQuery failed %u\n", GetLastError() );
+    ok( info.Protect == PAGE_READONLY, "wrong protection %x\n", info.Protect );
+    ok( info.RegionSize == IMAGE_LAYOUT_DATA_SIZE, "wrong region size %lx\n", info.RegionSize );
+    ok( info.Type == MEM_IMAGE, "wrong type %x\n", info.Type );
+    ret = VirtualQuery( ptr + IMAGE_LAYOUT_DATA_SIZE, &info, sizeof(info) );
+    ok( ret, "VirtualQuery failed %u\n", GetLastError() );
+    ok( info.Protect == PAGE_WRITECOPY, "wrong protection %x\n", info.Protect );
+    ok( info.RegionSize == 3 * page_size, "wrong region size %lx\n", info.RegionSize );
+
+    /* writes to the image stay private */
+    memset( ptr + IMAGE_LAYOUT_DATA_SIZE, 0xa5, sizeof(buffer) );
+    ptr[IMAGE_LAYOUT_DATA_SIZE + 2 * page_size] = 0xa5;
+    hfile = CreateFileA( dll_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "failed to open %s err %u\n", dll_name, GetLastError() );
+    SetFilePointer( hfile, page_size + IMAGE_LAYOUT_DATA_SIZE, NULL, FILE_BEGIN );
+    ret = ReadFile( hfile, buffer, sizeof(buffer), &dummy, NULL );
+    ok( ret, "ReadFile error %d\n", GetLastError() );
+    ok( dummy == sizeof(buffer), "read %u bytes\n", dummy );
+    for (i = 0; i < sizeof(buffer); i++) if (buffer[i] == 0xa5) break;
+    ok( i == sizeof(buffer), "image write reached the file at offset %x\n", i );
+    CloseHandle( hfile );
+
+    ret = VirtualQuery( ptr + IMAGE_LAYOUT_DATA_SIZE, &info, sizeof(info) );
+    ok( ret, "VirtualQuery failed %u\n", GetLastError() );
+    ok( info.Protect == PAGE_READWRITE, "wrong protection %x\n", info.Protect );
+    ok( info.RegionSize == page_size, "wrong region size %lx\n", info.RegionSize );
+
+    FreeLibrary( module );
+    DeleteFileA( dll_name );
+
+    /* a section past the end of the image must not be mapped */
+    nt_header.FileHeader.NumberOfSections = 1;
+    nt_header.OptionalHeader.SizeOfImage = 3 * page_size;
+    sections[0].Misc.VirtualSize = page_size;
+    sections[0].VirtualAddress = 16 * page_size;
+    sections[0].SizeOfRawData = page_size;
+    sections[0].PointerToRawData = 16 * page_size;
+    create_test_dll_sections( &dos_header, &nt_header, sections, data, dll_name );
+
+    SetLastError( 0xdeadbeef );
+    module = LoadLibraryA( dll_name );
+    ok( !module, "LoadLibrary(%s) succeeded\n", dll_name );
+    if (module) FreeLibrary( module );
+
+done:
+    VirtualFree( data, 0, MEM_RELEASE );
+    DeleteFileA( dll_name );
+}
+
 static void test_filenames(void)
 {
     IMAGE_NT_HEADERS nt_header = nt_header_template;
@@ -3721,6 +3839,7 @@ START_TEST(loader)
     test_ImportDescriptors();
     test_section_access();
     test_import_resolution();
+    test_image_file_layout();
     test_ExitProcess();
     test_InMemoryOrderModuleList();
 }
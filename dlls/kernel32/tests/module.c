@@ -304,6 +304,49 @@ static void testGetProcAddress_Wrong(void)
     ok( GetLastError() == ERROR_MOD_NOT_FOUND, "Expected ERROR_MOD_NOT_FOUND, got %d\n", GetLastError() );
 }
 
+static void testGetProcAddress_Exports(void)
+{
+    HMODULE kernel32 = GetModuleHandleA( "kernel32.dll" );
+    HMODULE ntdll = GetModuleHandleA( "ntdll.dll" );
+    const IMAGE_NT_HEADERS *nt;
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names;
+    const WORD *ordinals;
+    FARPROC fp, fp2;
+    DWORD i;
+
+    nt = (const IMAGE_NT_HEADERS *)((const char *)kernel32 + ((const IMAGE_DOS_HEADER *)kernel32)->e_lfanew);
+    exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)kernel32 +
+              nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
+    names = (const DWORD *)((const char *)kernel32 + exports->AddressOfNames);
+    ordinals = (const WORD *)((const char *)kernel32 + exports->AddressOfNameOrdinals);
+    ok( exports->NumberOfNames > 0, "no exports found\n" );
+
+    /* lookups by name and by ordinal must agree, forwarded exports included */
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        const char *name = (const char *)kernel32 + names[i];
+
+        fp = GetProcAddress( kernel32, name );
+        fp2 = GetProcAddress( kernel32, (LPCSTR)(ULONG_PTR)(ordinals[i] + exports->Base) );
+        ok( fp == fp2, "%s: got %p by name, %p by ordinal\n", name, fp, fp2 );
+    }
+
+    fp = GetProcAddress( ntdll, "RtlAllocateHeap" );
+    ok( fp != NULL, "RtlAllocateHeap not found\n" );
+    fp2 = GetProcAddress( kernel32, "HeapAlloc" );
+    ok( fp2 == fp, "HeapAlloc forward resolved to %p, expected %p\n", fp2, fp );
+    fp2 = GetProcAddress( kernel32, "HeapAlloc" );
+    ok( fp2 == fp, "HeapAlloc forward resolved to %p, expected %p\n", fp2, fp );
+
+    SetLastError( 0xdeadbeef );
+    fp = GetProcAddress( kernel32, "heapalloc" );
+    ok( !fp, "heapalloc should not be found\n" );
+    ok( GetLastError() == ERROR_PROC_NOT_FOUND, "Expected ERROR_PROC_NOT_FOUND, got %d\n", GetLastError() );
+    fp = GetProcAddress( kernel32, "HeapAllocX" );
+    ok( !fp, "HeapAllocX should not be found\n" );
+}
+
 static void testLoadLibraryEx(void)
 {
     CHAR path[MAX_PATH];
@@ -1041,6 +1084,7 @@ START_TEST(module)
     testNestedLoadLibraryA();
     testLoadLibraryA_Wrong();
     testGetProcAddress_Wrong();
+    testGetProcAddress_Exports();
     testLoadLibraryEx();
     test_LoadLibraryEx_search_flags();
     testGetModuleHandleEx();
@@ -3365,6 +3365,66 @@ static void test_TransactNamedPipe(void)
     CloseHandle(server);
 }
 
+/* data path of connected byte mode pipes, which may bypass the server */
+static void test_byte_mode_data(void)
+{
+    OVERLAPPED overlapped, overlapped2;
+    HANDLE server, client;
+    char buf[64], read_buf[64];
+    DWORD read_bytes;
+    BOOL res;
+
+    memset(buf, 0x5a, sizeof(buf));
+
+    /* peeking and the available data count */
+    create_overlapped_pipe(PIPE_TYPE_BYTE, &client, &server);
+    overlapped_write_sync(client, buf, 10);
+    overlapped_write_sync(client, buf, 20);
+    test_peek_pipe(server, 30, 30, 0);
+
+    /* a zero-length read with data available doesn't consume anything */
+    overlapped_read_sync(server, read_buf, 0, 0, FALSE);
+    test_peek_pipe(server, 30, 30, 0);
+    overlapped_read_sync(server, read_buf, 5, 5, FALSE);
+    test_peek_pipe(server, 25, 25, 0);
+    overlapped_read_sync(server, read_buf, sizeof(read_buf), 25, FALSE);
+    ok(!memcmp(read_buf, buf, 25), "wrong data\n");
+    test_peek_pipe(server, 0, 0, 0);
+
+    /* a zero-length read on an empty pipe waits for data */
+    overlapped_read_async(server, read_buf, 0, &overlapped);
+    overlapped_write_sync(client, buf, 1);
+    test_overlapped_result(server, &overlapped, 0, FALSE);
+    test_peek_pipe(server, 1, 1, 0);
+    overlapped_read_sync(server, read_buf, sizeof(read_buf), 1, FALSE);
+
+    /* DisconnectNamedPipe fails the pending reads of both ends */
+    overlapped_read_async(server, read_buf, sizeof(read_buf), &overlapped);
+    overlapped_read_async(client, read_buf, sizeof(read_buf), &overlapped2);
+    res = DisconnectNamedPipe(server);
+    ok(res, "DisconnectNamedPipe failed: %u\n", GetLastError());
+    test_overlapped_failure(server, &overlapped, ERROR_PIPE_NOT_CONNECTED);
+    test_overlapped_failure(client, &overlapped2, ERROR_PIPE_NOT_CONNECTED);
+    CloseHandle(client);
+    CloseHandle(server);
+
+    /* the data written before the peer was closed can still be read */
+    create_overlapped_pipe(PIPE_TYPE_BYTE, &client, &server);
+    overlapped_write_sync(client, buf, 10);
+    CloseHandle(client);
+    test_peek_pipe(server, 10, 10, 0);
+    overlapped_read_sync(server, read_buf, sizeof(read_buf), 10, FALSE);
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    read_bytes = 0xdeadbeef;
+    res = ReadFile(server, read_buf, sizeof(read_buf), &read_bytes, &overlapped);
+    ok(!res && GetLastError() == ERROR_BROKEN_PIPE, "ReadFile returned %x(%u)\n", res, GetLastError());
+    ok(!read_bytes, "read_bytes %u\n", read_bytes);
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(server);
+}
+
 static HANDLE create_overlapped_server( OVERLAPPED *overlapped )
 {
     HANDLE pipe;
@@ -3733,6 +3793,7 @@ START_TEST(pipe)
     test_overlapped_transport(TRUE, TRUE);
     test_overlapped_transport(FALSE, FALSE);
     test_TransactNamedPipe();
+    test_byte_mode_data();
     test_namedpipe_process_id();
     test_namedpipe_session_id();
 }
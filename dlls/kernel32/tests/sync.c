@@ -619,6 +619,188 @@ static void test_semaphore(void)
     CloseHandle( handle );
 }
 
+static HANDLE ping_event, pong_event, contended_sem;
+static LONG contended_count;
+
+static DWORD WINAPI event_ping_pong_thread( void *param )
+{
+    DWORD i, ret, count = (DWORD_PTR)param;
+
+    for (i = 0; i < count; i++)
+    {
+        ret = WaitForSingleObject( ping_event, 5000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+        SetEvent( pong_event );
+    }
+    return 0;
+}
+
+static DWORD WINAPI semaphore_contention_thread( void *param )
+{
+    DWORD i, ret, count = (DWORD_PTR)param;
+
+    for (i = 0; i < count; i++)
+    {
+        ret = WaitForSingleObject( contended_sem, 5000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+        InterlockedIncrement( &contended_count );
+        ReleaseSemaphore( contended_sem, 1, NULL );
+    }
+    return 0;
+}
+
+static DWORD WINAPI pulse_wait_thread( void *param )
+{
+    return WaitForSingleObject( param, 10000 );
+}
+
+static void test_pulse_waiters( BOOL manual )
+{
+    HANDLE event, threads[2];
+    DWORD i, ret, code;
+
+    event = CreateEventW( NULL, manual, FALSE, NULL );
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread( NULL, 0, pulse_wait_thread, event, 0, NULL );
+
+    /* pulse until a waiter is released, the threads may not be waiting yet */
+    for (i = 0; i < 500; i++)
+    {
+        PulseEvent( event );
+        if (WaitForMultipleObjects( ARRAY_SIZE(threads), threads, manual, 10 ) != WAIT_TIMEOUT) break;
+    }
+    ok( i < 500, "%s event: no waiter got the pulse\n", manual ? "manual" : "auto" );
+    ok( WaitForSingleObject( event, 0 ) == WAIT_TIMEOUT, "event still signaled\n" );
+
+    if (!manual)
+    {
+        /* only one of the waiters may be released by each pulse */
+        ret = WaitForMultipleObjects( ARRAY_SIZE(threads), threads, TRUE, 100 );
+        ok( ret == WAIT_TIMEOUT, "both waiters released by a single pulse\n" );
+        SetEvent( event );
+    }
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+    {
+        ret = WaitForSingleObject( threads[i], 10000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+        GetExitCodeThread( threads[i], &code );
+        ok( code == WAIT_OBJECT_0, "waiter %u returned %u\n", i, code );
+        CloseHandle( threads[i] );
+    }
+    CloseHandle( event );
+}
+
+static void test_infinite_wait_apc(void)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[MAX_PATH];
+    HANDLE ready;
+    NTSTATUS status;
+    SIZE_T size;
+    DWORD ret;
+    void *base;
+    char **argv;
+    int i;
+
+    ready = CreateEventA( NULL, FALSE, FALSE, "test_infinite_wait_apc" );
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" sync infinite_wait", argv[0] );
+    ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( ready, 10000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+
+    /* memory operations in another process are system APCs, which must get through a blocking wait */
+    for (i = 0; i < 10; i++)
+    {
+        base = NULL;
+        size = 0x1000;
+        status = pNtAllocateVirtualMemory( pi.hProcess, &base, 0, &size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+        ok( !status, "NtAllocateVirtualMemory failed %08x\n", status );
+        size = 0;
+        status = pNtFreeVirtualMemory( pi.hProcess, &base, &size, MEM_RELEASE );
+        ok( !status, "NtFreeVirtualMemory failed %08x\n", status );
+    }
+
+    TerminateProcess( pi.hProcess, 0 );
+    winetest_wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+    CloseHandle( ready );
+}
+
+static void test_signal_wait(void)
+{
+    static const DWORD count = 100;
+    HANDLE threads[4], handles[2];
+    DWORD i, ret;
+    LONG prev;
+
+    ping_event = CreateEventW( NULL, FALSE, FALSE, NULL );
+    pong_event = CreateEventW( NULL, FALSE, FALSE, NULL );
+
+    SetEvent( ping_event );
+    ret = WaitForSingleObject( ping_event, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    ret = WaitForSingleObject( ping_event, 0 );
+    ok( ret == WAIT_TIMEOUT, "auto-reset event still signaled, ret %u\n", ret );
+
+    /* ping-pong between two threads */
+    threads[0] = CreateThread( NULL, 0, event_ping_pong_thread, (void *)(DWORD_PTR)count, 0, NULL );
+    for (i = 0; i < count; i++)
+    {
+        SetEvent( ping_event );
+        ret = WaitForSingleObject( pong_event, 5000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    }
+    ret = WaitForSingleObject( threads[0], 5000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    CloseHandle( threads[0] );
+
+    /* mixing single waits with multiple waits on the same objects */
+    threads[0] = CreateThread( NULL, 0, event_ping_pong_thread, (void *)(DWORD_PTR)count, 0, NULL );
+    handles[0] = pong_event;
+    handles[1] = threads[0];
+    for (i = 0; i < count; i++)
+    {
+        SetEvent( ping_event );
+        ret = WaitForMultipleObjects( 2, handles, FALSE, 5000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %u\n", ret );
+    }
+    ret = WaitForSingleObject( threads[0], 5000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    CloseHandle( threads[0] );
+
+    CloseHandle( ping_event );
+    CloseHandle( pong_event );
+
+    /* contended semaphore used as a lock */
+    contended_sem = CreateSemaphoreW( NULL, 1, 1, NULL );
+    contended_count = 0;
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread( NULL, 0, semaphore_contention_thread, (void *)(DWORD_PTR)count, 0, NULL );
+    ret = WaitForMultipleObjects( ARRAY_SIZE(threads), threads, TRUE, 20000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %u\n", ret );
+    for (i = 0; i < ARRAY_SIZE(threads); i++) CloseHandle( threads[i] );
+    ok( contended_count == count * ARRAY_SIZE(threads), "got count %d\n", contended_count );
+
+    ret = ReleaseSemaphore( contended_sem, 1, &prev );
+    ok( !ret, "ReleaseSemaphore succeeded\n" );
+    ok( GetLastError() == ERROR_TOO_MANY_POSTS, "wrong error %u\n", GetLastError() );
+    ret = WaitForSingleObject( contended_sem, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    ret = ReleaseSemaphore( contended_sem, 1, &prev );
+    ok( ret, "ReleaseSemaphore failed %u\n", GetLastError() );
+    ok( prev == 0, "got previous count %d\n", prev );
+    CloseHandle( contended_sem );
+
+    test_pulse_waiters( TRUE );
+    test_pulse_waiters( FALSE );
+    test_infinite_wait_apc();
+}
+
 static void test_waitable_timer(void)
 {
     HANDLE handle, handle2;
@@ -2673,6 +2855,12 @@ START_TEST(sync)
         {
             for (;;) SleepEx(INFINITE, TRUE);
         }
+        if (!strcmp(argv[2], "infinite_wait"))
+        {
+            HANDLE event = CreateEventA( NULL, FALSE, FALSE, NULL );
+            SetEvent( OpenEventA( EVENT_MODIFY_STATE, FALSE, "test_infinite_wait_apc" ));
+            WaitForSingleObject( event, INFINITE );
+        }
         return;
     }
 
@@ -2687,6 +2875,7 @@ START_TEST(sync)
     test_timer_queue();
     test_WaitForSingleObject();
     test_WaitForMultipleObjects();
+    test_signal_wait();
     test_initonce();
     test_condvars_base();
     test_condvars_consumer_producer();
@@ -51,6 +51,7 @@ static PVOID  (WINAPI *pRtlAddVectoredExceptionHandler)(ULONG, PVECTORED_EXCEPTI
 static ULONG  (WINAPI *pRtlRemoveVectoredExceptionHandler)(PVOID);
 static BOOL   (WINAPI *pGetProcessDEPPolicy)(HANDLE, LPDWORD, PBOOL);
 static BOOL   (WINAPI *pIsWow64Process)(HANDLE, PBOOL);
+static SIZE_T (WINAPI *pGetLargePageMinimum)(void);
 static NTSTATUS (WINAPI *pNtProtectVirtualMemory)(HANDLE, PVOID *, SIZE_T *, ULONG, ULONG *);
 static NTSTATUS (WINAPI *pNtAllocateVirtualMemory)(HANDLE, PVOID *, ULONG, SIZE_T *, ULONG, ULONG);
 static NTSTATUS (WINAPI *pNtFreeVirtualMemory)(HANDLE, PVOID *, SIZE_T *, ULONG);
@@ -1849,6 +1850,51 @@ static DWORD CALLBACK read_pipe( void *arg )
     return 0;
 }
 
+static void test_write_watch_rounds(void)
+{
+    static const SIZE_T size = 1024 * 1024;
+    ULONG_PTR count, pages = size / si.dwPageSize;
+    DWORD round, errors = 0;
+    void **results;
+    ULONG granularity, i;
+    char *base;
+    UINT ret;
+
+    if (!pGetWriteWatch || !pResetWriteWatch)
+    {
+        win_skip( "GetWriteWatch not supported\n" );
+        return;
+    }
+
+    base = VirtualAlloc( 0, size, MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    if (!base)
+    {
+        win_skip( "MEM_WRITE_WATCH not supported\n" );
+        return;
+    }
+    results = HeapAlloc( GetProcessHeap(), 0, pages * sizeof(*results) );
+
+    /* like a garbage collector: dirty part of the heap, then collect the written pages */
+    for (round = 0; round < 8; round++)
+    {
+        for (i = round % 4; i < pages; i += 4) base[i * si.dwPageSize] = round;
+        count = pages;
+        ret = pGetWriteWatch( WRITE_WATCH_FLAG_RESET, base, size, results, &count, &granularity );
+        ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+        if (count != (pages - round % 4 + 3) / 4) errors++;
+        else if (count && results[0] != base + (round % 4) * si.dwPageSize) errors++;
+    }
+    ok( !errors, "got %u rounds with wrong results\n", errors );
+
+    count = pages;
+    ret = pGetWriteWatch( 0, base, size, results, &count, &granularity );
+    ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+    ok( !count, "got count %lu\n", count );
+
+    HeapFree( GetProcessHeap(), 0, results );
+    VirtualFree( base, 0, MEM_RELEASE );
+}
+
 static void test_write_watch(void)
 {
     static const char pipename[] = "\\\\.\\pipe\\test_write_watch_pipe";
@@ -3454,6 +3500,115 @@ static BOOL is_mem_writable(DWORD prot)
     }
 }
 
+#define PROTECT_ITERATIONS 1000
+
+static DWORD WINAPI protect_thread( void *arg )
+{
+    DWORD i, old_prot, errors = 0;
+    char *mem;
+
+    mem = VirtualAlloc( NULL, 0x10000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    if (!mem) return PROTECT_ITERATIONS;
+
+    for (i = 0; i < PROTECT_ITERATIONS; i++)
+    {
+        mem[i % 0x10000] = i;
+        if (!VirtualProtect( mem, 0x1000, PAGE_EXECUTE_READ, &old_prot ) || old_prot != PAGE_READWRITE)
+            errors++;
+        if (!VirtualProtect( mem, 0x1000, PAGE_READWRITE, &old_prot ) || old_prot != PAGE_EXECUTE_READ)
+            errors++;
+        /* setting the same protection again */
+        if (!VirtualProtect( mem, 0x1000, PAGE_READWRITE, &old_prot ) || old_prot != PAGE_READWRITE)
+            errors++;
+        mem[i % 0x1000] = i;
+    }
+    VirtualFree( mem, 0, MEM_RELEASE );
+
+    for (i = 0; i < PROTECT_ITERATIONS / 10; i++)
+    {
+        if (!(mem = VirtualAlloc( NULL, 0x10000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE )))
+        {
+            errors++;
+            continue;
+        }
+        mem[0] = 1;
+        /* commit already committed memory */
+        if (VirtualAlloc( mem, 0x1000, MEM_COMMIT, PAGE_READWRITE ) != mem) errors++;
+        mem[1] = 1;
+        if (!VirtualFree( mem, 0, MEM_RELEASE )) errors++;
+    }
+    return errors;
+}
+
+static void test_VirtualProtect_threads(void)
+{
+    HANDLE threads[NUM_THREADS];
+    DWORD i, exit_code;
+
+    for (i = 0; i < NUM_THREADS; i++)
+    {
+        threads[i] = CreateThread( NULL, 0, protect_thread, NULL, 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed %u\n", GetLastError() );
+    }
+    for (i = 0; i < NUM_THREADS; i++)
+    {
+        WaitForSingleObject( threads[i], INFINITE );
+        GetExitCodeThread( threads[i], &exit_code );
+        ok( !exit_code, "thread %u got %u errors\n", i, exit_code );
+        CloseHandle( threads[i] );
+    }
+}
+
+static void test_large_pages(void)
+{
+    MEMORY_BASIC_INFORMATION info;
+    SIZE_T size, ret;
+    char *mem;
+
+    if (!pGetLargePageMinimum)
+    {
+        win_skip( "GetLargePageMinimum not supported\n" );
+        return;
+    }
+    size = pGetLargePageMinimum();
+    if (!size)
+    {
+        skip( "large pages not supported\n" );
+        return;
+    }
+    ok( !(size & (size - 1)), "large page size %lx is not a power of 2\n", size );
+    ok( size > si.dwPageSize, "large page size %lx is too small\n", size );
+
+    mem = VirtualAlloc( NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+    if (!mem)
+    {
+        ok( GetLastError() == ERROR_PRIVILEGE_NOT_HELD || GetLastError() == ERROR_NO_SYSTEM_RESOURCES,
+            "VirtualAlloc failed %u\n", GetLastError() );
+        skip( "no large pages available\n" );
+        return;
+    }
+    ok( !((ULONG_PTR)mem & (size - 1)), "%p is not aligned to %lx\n", mem, size );
+    mem[0] = 1;
+    mem[size - 1] = 1;
+    ret = VirtualQuery( mem, &info, sizeof(info) );
+    ok( ret == sizeof(info), "VirtualQuery failed %u\n", GetLastError() );
+    ok( info.AllocationBase == mem, "got base %p\n", info.AllocationBase );
+    ok( info.RegionSize >= size, "got size %lx\n", info.RegionSize );
+    ok( info.State == MEM_COMMIT, "got state %x\n", info.State );
+    ok( info.Protect == PAGE_READWRITE, "got protection %x\n", info.Protect );
+    ok( VirtualFree( mem, 0, MEM_RELEASE ), "VirtualFree failed %u\n", GetLastError() );
+
+    /* the size must be a multiple of the large page size */
+    mem = VirtualAlloc( NULL, size + si.dwPageSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+    ok( !mem, "VirtualAlloc succeeded\n" );
+    if (mem) VirtualFree( mem, 0, MEM_RELEASE );
+
+    /* large pages can't be reserved without being committed */
+    mem = VirtualAlloc( NULL, size, MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE );
+    ok( !mem, "VirtualAlloc succeeded\n" );
+    if (mem) VirtualFree( mem, 0, MEM_RELEASE );
+}
+
 static void test_VirtualAlloc_protection(void)
 {
     static const struct test_data
@@ -4380,6 +4535,7 @@ START_TEST(virtual)
     pResetWriteWatch = (void *) GetProcAddress(hkernel32, "ResetWriteWatch");
     pGetProcessDEPPolicy = (void *)GetProcAddress( hkernel32, "GetProcessDEPPolicy" );
     pIsWow64Process = (void *)GetProcAddress( hkernel32, "IsWow64Process" );
+    pGetLargePageMinimum = (void *)GetProcAddress( hkernel32, "GetLargePageMinimum" );
     pNtAreMappedFilesTheSame = (void *)GetProcAddress( hntdll, "NtAreMappedFilesTheSame" );
     pNtCreateSection = (void *)GetProcAddress( hntdll, "NtCreateSection" );
     pNtMapViewOfSection = (void *)GetProcAddress( hntdll, "NtMapViewOfSection" );
@@ -4402,6 +4558,8 @@ START_TEST(virtual)
     test_CreateFileMapping_protection();
     test_VirtualAlloc_protection();
     test_VirtualProtect();
+    test_VirtualProtect_threads();
+    test_large_pages();
     test_VirtualAllocEx();
     test_VirtualAlloc();
     test_MapViewOfFile();
@@ -4412,6 +4570,7 @@ START_TEST(virtual)
     test_IsBadWritePtr();
     test_IsBadCodePtr();
     test_write_watch();
+    test_write_watch_rounds();
 #if defined(__i386__) || defined(__x86_64__)
     test_stack_commit();
 #endif
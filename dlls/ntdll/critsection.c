@@ -101,13 +101,18 @@ static inline NTSTATUS fast_wait( RTL_CRITICAL_SECTION *crit, int timeout )
 
     timespec.tv_sec  = timeout;
     timespec.tv_nsec = 0;
+    local_completion_thread_blocked( TRUE );
     while ((val = interlocked_cmpxchg( (int *)&crit->LockSemaphore, 0, 1 )) != 1)
     {
         /* note: this may wait longer than specified in case of signals or */
         /*       multiple wake-ups, but that shouldn't be a problem */
         if (futex_wait( (int *)&crit->LockSemaphore, val, &timespec ) == -1 && errno == ETIMEDOUT)
+        {
+            local_completion_thread_blocked( FALSE );
             return STATUS_TIMEOUT;
+        }
     }
+    local_completion_thread_blocked( FALSE );
     return STATUS_WAIT_0;
 }
 
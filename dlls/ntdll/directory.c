@@ -178,27 +178,67 @@ struct dir_data_buffer
 struct dir_data_names
 {
     const WCHAR *long_name;          /* long file name in Unicode */
-    const WCHAR *short_name;         /* short file name in Unicode */
+    const WCHAR *short_name;         /* short file name in Unicode, NULL if not generated yet */
     const char  *unix_name;          /* Unix file name in host encoding */
 };
 
 struct dir_data
 {
+    unsigned int            ref;     /* number of handles using it, plus one if shared */
+    struct list             entry;   /* entry in the list of shared directory data */
     unsigned int            size;    /* size of the names array */
     unsigned int            count;   /* count of used entries in the names array */
-    unsigned int            pos;     /* current reading position in the names array */
     struct file_identity    id;      /* directory file identity */
+    ULONGLONG               mtime;   /* directory modification time when it was read */
+    UNICODE_STRING          mask;    /* mask used to read the directory */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
 };
 
+struct dir_data_handle
+{
+    struct dir_data        *data;    /* directory data, possibly shared with other handles */
+    unsigned int            pos;     /* current reading position in the names array */
+};
+
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
 
-static struct dir_data **dir_data_cache;
+static struct dir_data_handle *dir_data_cache;
 static unsigned int dir_data_cache_size;
 
+#define MAX_SHARED_DIR_DATA 4        /* max. number of directory listings kept for reuse */
+
+static struct list shared_dir_data = LIST_INIT( shared_dir_data );
+static unsigned int shared_dir_data_count;
+
+/* cache of the names of recently searched directories, for case-insensitive lookups */
+
+struct dir_cache_name
+{
+    struct dir_cache_name  *next;    /* next name in the hash bucket */
+    unsigned int            hash;    /* hash of the Unicode name */
+    unsigned int            len;     /* length of the Unicode name in chars */
+    WCHAR                   name[1]; /* Unicode name, followed by the Unix name */
+};
+
+struct dir_cache
+{
+    struct list             entry;   /* entry in the list of cached directories, most recent first */
+    struct file_identity    id;      /* directory file identity */
+    ULONGLONG               mtime;   /* directory modification time when it was read */
+    unsigned int            count;   /* number of names */
+    unsigned int            size;    /* size of the hash table */
+    struct dir_cache_name **hash;    /* hash table of names */
+};
+
+#define DIR_CACHE_MAX_DIRS  16       /* max. number of cached directories */
+#define DIR_CACHE_MIN_HASH  64       /* initial size of the hash table */
+
+static struct list dir_cache_list = LIST_INIT( dir_cache_list );
+static unsigned int dir_cache_count;
+
 static BOOL show_dot_files;
 static RTL_RUN_ONCE init_once = RTL_RUN_ONCE_INIT;
 
@@ -216,6 +256,15 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION dir_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+static RTL_CRITICAL_SECTION dir_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_cache_critsect_debug =
+{
+    0, 0, &dir_cache_section,
+    { &dir_cache_critsect_debug.ProcessLocksList, &dir_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_cache_section") }
+};
+static RTL_CRITICAL_SECTION dir_cache_section = { &dir_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
 
 /* check if a given Unicode char is OK in a DOS short name */
 static inline BOOL is_invalid_dos_char( WCHAR ch )
@@ -355,7 +404,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
         data->names = names;
     }
 
-    if (short_name[0])
+    if (!short_name) names[data->count].short_name = NULL;
+    else if (short_name[0])
     {
         if (!(names[data->count].short_name = add_dir_data_nameW( data, short_name ))) return FALSE;
     }
@@ -367,22 +417,87 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
-/* free the complete directory data structure */
+static ULONGLONG get_dir_mtime( const struct stat *st )
+{
+    ULONGLONG mtime = (ULONGLONG)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    mtime += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    mtime += st->st_mtimespec.tv_nsec;
+#endif
+    return mtime;
+}
+
+/* check if a directory has been modified too recently to trust its modification time */
+static BOOL is_dir_recently_modified( const struct stat *st )
+{
+    ULONGLONG mtime = get_dir_mtime( st ), now, margin;
+    LARGE_INTEGER time;
+    ULONG seconds;
+
+    NtQuerySystemTime( &time );
+    RtlTimeToSecondsSince1970( &time, &seconds );
+    now = (ULONGLONG)seconds * 1000000000 + (time.QuadPart % 10000000) * 100;
+
+    /* file systems with a coarse time resolution don't store nanoseconds */
+    margin = (mtime % 1000000000) ? 100000000 : 2000000000;
+    return mtime + margin > now;
+}
+
+/* release a reference to the directory data structure, freeing it when unused */
 static void free_dir_data( struct dir_data *data )
 {
     struct dir_data_buffer *buffer, *next;
 
-    if (!data) return;
+    if (!data || --data->ref) return;
 
     for (buffer = data->buffer; buffer; buffer = next)
     {
         next = buffer->next;
         RtlFreeHeap( GetProcessHeap(), 0, buffer );
     }
+    RtlFreeHeap( GetProcessHeap(), 0, data->mask.Buffer );
     RtlFreeHeap( GetProcessHeap(), 0, data->names );
     RtlFreeHeap( GetProcessHeap(), 0, data );
 }
 
+/* find the data of a directory that was listed with the same mask and hasn't changed since */
+static struct dir_data *find_shared_dir_data( const struct stat *st, const UNICODE_STRING *mask )
+{
+    struct dir_data *data;
+
+    LIST_FOR_EACH_ENTRY( data, &shared_dir_data, struct dir_data, entry )
+    {
+        if (data->id.dev != st->st_dev || data->id.ino != st->st_ino) continue;
+        if (mask ? !data->mask.Buffer || data->mask.Length != mask->Length ||
+                   memcmp( data->mask.Buffer, mask->Buffer, mask->Length )
+                 : data->mask.Buffer != NULL) continue;
+        if (data->mtime != get_dir_mtime( st )) continue;
+        list_remove( &data->entry );
+        list_add_head( &shared_dir_data, &data->entry );
+        data->ref++;
+        return data;
+    }
+    return NULL;
+}
+
+/* keep the data of a directory around for other handles listing it */
+static void add_shared_dir_data( struct dir_data *data )
+{
+    struct dir_data *old;
+
+    list_add_head( &shared_dir_data, &data->entry );
+    data->ref++;
+    if (++shared_dir_data_count > MAX_SHARED_DIR_DATA)
+    {
+        old = LIST_ENTRY( list_tail( &shared_dir_data ), struct dir_data, entry );
+        list_remove( &old->entry );
+        list_init( &old->entry );
+        shared_dir_data_count--;
+        free_dir_data( old );
+    }
+}
+
 
 /* support for a directory queue for filesystem searches */
 
@@ -1431,6 +1546,19 @@ static BOOLEAN match_filename( const UNICODE_STRING *name_str, const UNICODE_STR
 }
 
 
+/* generate the short name of a file if it needs one; return its length */
+static int get_short_file_name( const UNICODE_STRING *long_name, WCHAR *short_name )
+{
+    BOOLEAN spaces;
+    int len = 0;
+
+    if (!RtlIsNameLegalDOS8Dot3( long_name, NULL, &spaces ) || spaces)
+        len = hash_short_file_name( long_name, short_name );
+    short_name[len] = 0;
+    return len;
+}
+
+
 /***********************************************************************
  *           append_entry
  *
@@ -1458,16 +1586,14 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
                                      short_nameW, ARRAY_SIZE( short_nameW ) - 1 );
         if (short_len == -1) short_len = ARRAY_SIZE( short_nameW ) - 1;
         for (i = 0; i < short_len; i++) short_nameW[i] = toupperW( short_nameW[i] );
+        short_nameW[short_len] = 0;
     }
-    else  /* generate a short name if necessary */
+    else if (mask && !match_filename( &str, mask ))
     {
-        BOOLEAN spaces;
-
-        short_len = 0;
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-            short_len = hash_short_file_name( &str, short_nameW );
+        /* the short name is only generated when we need it to match the mask */
+        short_len = get_short_file_name( &str, short_nameW );
     }
-    short_nameW[short_len] = 0;
+    else return add_dir_data_names( data, long_nameW, NULL, long_name );
 
     TRACE( "long %s short %s mask %s\n",
            debugstr_w( long_nameW ), debugstr_w( short_nameW ), debugstr_us( mask ));
@@ -1485,19 +1611,35 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
 }
 
 
+/* retrieve the short name of a directory entry, generating it if needed */
+static int get_dir_data_short_name( const struct dir_data_names *names, WCHAR *short_name )
+{
+    UNICODE_STRING str;
+
+    if (names->short_name)
+    {
+        strcpyW( short_name, names->short_name );
+        return strlenW( short_name );
+    }
+    RtlInitUnicodeString( &str, names->long_name );
+    return get_short_file_name( &str, short_name );
+}
+
+
 /***********************************************************************
  *           get_dir_data_entry
  *
  * Return a directory entry from the cached data.
  */
-static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, IO_STATUS_BLOCK *io,
-                                    ULONG max_length, FILE_INFORMATION_CLASS class,
+static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, unsigned int pos, void *info_ptr,
+                                    IO_STATUS_BLOCK *io, ULONG max_length, FILE_INFORMATION_CLASS class,
                                     union file_directory_info **last_info )
 {
-    const struct dir_data_names *names = &dir_data->names[dir_data->pos];
+    const struct dir_data_names *names = &dir_data->names[pos];
     union file_directory_info *info;
     struct stat st;
     ULONG name_len, start, dir_size, attributes;
+    WCHAR short_name[13];
 
     if (get_file_info( names->unix_name, &st, &attributes ) == -1)
     {
@@ -1552,15 +1694,15 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
 
     case FileBothDirectoryInformation:
         info->both.EaSize = 0; /* FIXME */
-        info->both.ShortNameLength = strlenW( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->both.ShortName, names->short_name, info->both.ShortNameLength );
+        info->both.ShortNameLength = get_dir_data_short_name( names, short_name ) * sizeof(WCHAR);
+        memcpy( info->both.ShortName, short_name, info->both.ShortNameLength );
         info->both.FileNameLength = name_len;
         break;
 
     case FileIdBothDirectoryInformation:
         info->id_both.EaSize = 0; /* FIXME */
-        info->id_both.ShortNameLength = strlenW( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->id_both.ShortName, names->short_name, info->id_both.ShortNameLength );
+        info->id_both.ShortNameLength = get_dir_data_short_name( names, short_name ) * sizeof(WCHAR);
+        memcpy( info->id_both.ShortName, short_name, info->id_both.ShortNameLength );
         info->id_both.FileNameLength = name_len;
         break;
 
@@ -1830,9 +1972,24 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
     struct stat st;
     NTSTATUS status;
     unsigned int i;
+    BOOL shareable = FALSE;
+
+    /* reuse the data of another handle if the directory hasn't been modified since */
+    if (!fstat( fd, &st ))
+    {
+        if ((data = find_shared_dir_data( &st, mask )))
+        {
+            TRACE( "mask %s reusing %u files\n", debugstr_us( mask ), data->count );
+            *data_ret = data;
+            return STATUS_SUCCESS;
+        }
+        shareable = !is_dir_recently_modified( &st );
+    }
 
     if (!(data = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data) )))
         return STATUS_NO_MEMORY;
+    data->ref = 1;
+    list_init( &data->entry );
 
     if ((status = read_directory_data( data, fd, mask )))
     {
@@ -1855,7 +2012,19 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         if (data->count < data->size)
             RtlReAllocateHeap( GetProcessHeap(), HEAP_REALLOC_IN_PLACE_ONLY, data->names,
                                data->count * sizeof(*data->names) );
-        if (!fstat( fd, &st ))
+        if (shareable)
+        {
+            data->id.dev = st.st_dev;
+            data->id.ino = st.st_ino;
+            data->mtime  = get_dir_mtime( &st );
+            if (mask && (data->mask.Buffer = RtlAllocateHeap( GetProcessHeap(), 0, mask->Length )))
+            {
+                memcpy( data->mask.Buffer, mask->Buffer, mask->Length );
+                data->mask.Length = data->mask.MaximumLength = mask->Length;
+            }
+            if (!mask || data->mask.Buffer) add_shared_dir_data( data );
+        }
+        else if (!fstat( fd, &st ))
         {
             data->id.dev = st.st_dev;
             data->id.ino = st.st_ino;
@@ -1876,7 +2045,7 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
  *
  * Retrieve the cached directory data, or initialize it if necessary.
  */
-static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret, int fd,
+static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data_handle **data_ret, int fd,
                                      const UNICODE_STRING *mask )
 {
     unsigned int i;
@@ -1894,8 +2063,9 @@ static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret,
             int free_idx = free_entries[i];
             if (free_idx < dir_data_cache_size)
             {
-                free_dir_data( dir_data_cache[free_idx] );
-                dir_data_cache[free_idx] = NULL;
+                free_dir_data( dir_data_cache[free_idx].data );
+                dir_data_cache[free_idx].data = NULL;
+                dir_data_cache[free_idx].pos = 0;
             }
         }
     }
@@ -1910,7 +2080,7 @@ static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret,
     if (entry >= dir_data_cache_size)
     {
         unsigned int size = max( dir_data_cache_initial_size, max( dir_data_cache_size * 2, entry + 1 ) );
-        struct dir_data **new_cache;
+        struct dir_data_handle *new_cache;
 
         if (dir_data_cache)
             new_cache = RtlReAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, dir_data_cache,
@@ -1922,9 +2092,9 @@ static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret,
         dir_data_cache_size = size;
     }
 
-    if (!dir_data_cache[entry]) status = init_cached_dir_data( &dir_data_cache[entry], fd, mask );
+    if (!dir_data_cache[entry].data) status = init_cached_dir_data( &dir_data_cache[entry].data, fd, mask );
 
-    *data_ret = dir_data_cache[entry];
+    *data_ret = &dir_data_cache[entry];
     return status;
 }
 
@@ -1943,7 +2113,7 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
                                       BOOLEAN restart_scan )
 {
     int cwd, fd, needs_close;
-    struct dir_data *data;
+    struct dir_data_handle *dir;
     NTSTATUS status;
 
     TRACE("(%p %p %p %p %p %p 0x%08x 0x%08x 0x%08x %s 0x%08x\n",
@@ -1993,16 +2163,16 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
     cwd = open( ".", O_RDONLY );
     if (fchdir( fd ) != -1)
     {
-        if (!(status = get_cached_dir_data( handle, &data, fd, mask )))
+        if (!(status = get_cached_dir_data( handle, &dir, fd, mask )))
         {
             union file_directory_info *last_info = NULL;
 
-            if (restart_scan) data->pos = 0;
+            if (restart_scan) dir->pos = 0;
 
-            while (!status && data->pos < data->count)
+            while (!status && dir->pos < dir->data->count)
             {
-                status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info );
-                if (!status || status == STATUS_BUFFER_OVERFLOW) data->pos++;
+                status = get_dir_data_entry( dir->data, dir->pos, buffer, io, length, info_class, &last_info );
+                if (!status || status == STATUS_BUFFER_OVERFLOW) dir->pos++;
                 if (single_entry) break;
             }
 
@@ -2024,6 +2194,169 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+/* hash a file name for the directory cache, ignoring case */
+static unsigned int hash_dir_cache_name( const WCHAR *name, int len )
+{
+    unsigned int hash = 0;
+
+    while (len--) hash = hash * 33 + tolowerW( *name++ );
+    return hash;
+}
+
+static void free_dir_cache( struct dir_cache *cache )
+{
+    struct dir_cache_name *name, *next;
+    unsigned int i;
+
+    list_remove( &cache->entry );
+    dir_cache_count--;
+    for (i = 0; i < cache->size; i++)
+    {
+        for (name = cache->hash[i]; name; name = next)
+        {
+            next = name->next;
+            RtlFreeHeap( GetProcessHeap(), 0, name );
+        }
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+/* add a name to a directory cache, growing the hash table as needed */
+static BOOL add_dir_cache_name( struct dir_cache *cache, const WCHAR *nameW, int len, const char *unix_name )
+{
+    struct dir_cache_name *name, *next, **hash;
+    unsigned int i, unix_len = strlen( unix_name ) + 1;
+
+    if (cache->count >= cache->size)
+    {
+        unsigned int size = cache->size * 2;
+
+        if (!(hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*hash) )))
+            return FALSE;
+        for (i = 0; i < cache->size; i++)
+        {
+            for (name = cache->hash[i]; name; name = next)
+            {
+                next = name->next;
+                name->next = hash[name->hash % size];
+                hash[name->hash % size] = name;
+            }
+        }
+        RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+        cache->hash = hash;
+        cache->size = size;
+    }
+
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0,
+                                  offsetof( struct dir_cache_name, name[len] ) + unix_len )))
+        return FALSE;
+    name->hash = hash_dir_cache_name( nameW, len );
+    name->len  = len;
+    memcpy( name->name, nameW, len * sizeof(WCHAR) );
+    memcpy( name->name + len, unix_name, unix_len );
+    name->next = cache->hash[name->hash % cache->size];
+    cache->hash[name->hash % cache->size] = name;
+    cache->count++;
+    return TRUE;
+}
+
+/* look for a name in a directory cache, ignoring case */
+static const char *find_dir_cache_name( const struct dir_cache *cache, const WCHAR *nameW, int len )
+{
+    unsigned int hash = hash_dir_cache_name( nameW, len );
+    const struct dir_cache_name *name;
+
+    for (name = cache->hash[hash % cache->size]; name; name = name->next)
+    {
+        if (name->hash != hash || name->len != len) continue;
+        if (!memicmpW( name->name, nameW, len )) return (const char *)(name->name + len);
+    }
+    return NULL;
+}
+
+/* read all the names of a directory into a new cache entry */
+static struct dir_cache *create_dir_cache( const char *unix_name, const struct stat *st )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache *cache;
+    struct dirent *de;
+    DIR *dir;
+    int ret;
+
+    if (!(dir = opendir( unix_name ))) return NULL;
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*cache) ))) goto failed;
+    cache->id.dev = st->st_dev;
+    cache->id.ino = st->st_ino;
+    cache->mtime  = get_dir_mtime( st );
+    cache->count  = 0;
+    cache->size   = DIR_CACHE_MIN_HASH;
+    if (!(cache->hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                         cache->size * sizeof(*cache->hash) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        goto failed;
+    }
+    list_add_head( &dir_cache_list, &cache->entry );
+    dir_cache_count++;
+
+    while ((de = readdir( dir )))
+    {
+        ret = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (ret <= 0) continue;
+        /* keep the first of the names that only differ in case, like the uncached search */
+        if (find_dir_cache_name( cache, buffer, ret )) continue;
+        if (!add_dir_cache_name( cache, buffer, ret, de->d_name ))
+        {
+            free_dir_cache( cache );
+            goto failed;
+        }
+    }
+    closedir( dir );
+
+    if (dir_cache_count > DIR_CACHE_MAX_DIRS)
+        free_dir_cache( LIST_ENTRY( list_tail( &dir_cache_list ), struct dir_cache, entry ));
+    return cache;
+
+failed:
+    closedir( dir );
+    return NULL;
+}
+
+/***********************************************************************
+ *           get_dir_cache
+ *
+ * Get the cached names of a directory, reading it if necessary.
+ * dir_cache_section must be held by caller.
+ */
+static struct dir_cache *get_dir_cache( const char *unix_name )
+{
+    struct dir_cache *cache;
+    struct stat st;
+
+    if (stat( unix_name, &st ) == -1) return NULL;
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (cache->id.dev != st.st_dev || cache->id.ino != st.st_ino) continue;
+        if (cache->mtime == get_dir_mtime( &st ))
+        {
+            list_remove( &cache->entry );
+            list_add_head( &dir_cache_list, &cache->entry );
+            return cache;
+        }
+        free_dir_cache( cache );
+        break;
+    }
+
+    /* a change within the resolution of the modification time would go unnoticed,
+     * so don't cache directories that have just been modified */
+    if (is_dir_recently_modified( &st )) return NULL;
+
+    return create_dir_cache( unix_name, &st );
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2040,6 +2373,8 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     DIR *dir;
     struct dirent *de;
     struct stat st;
+    struct dir_cache *cache;
+    const char *cached_name;
     int ret, used_default;
 
     /* try a shortcut for this directory */
@@ -2075,6 +2410,27 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
+    /* look for it in the cached directory names */
+
+    RtlEnterCriticalSection( &dir_cache_section );
+    if ((cache = get_dir_cache( unix_name )))
+    {
+        if ((cached_name = find_dir_cache_name( cache, name, length )))
+        {
+            unix_name[pos - 1] = '/';
+            strcpy( unix_name + pos, cached_name );
+            RtlLeaveCriticalSection( &dir_cache_section );
+            goto success;
+        }
+        /* short names are not cached, we still need to read the directory for them */
+        if (!is_name_8_dot_3)
+        {
+            RtlLeaveCriticalSection( &dir_cache_section );
+            goto not_found;
+        }
+    }
+    RtlLeaveCriticalSection( &dir_cache_section );
+
     /* now look for it through the directory */
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
@@ -30,6 +30,12 @@
 #ifdef HAVE_LINUX_MAJOR_H
 # include <linux/major.h>
 #endif
+#ifdef HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_STATVFS_H
 # include <sys/statvfs.h>
 #endif
@@ -42,6 +48,9 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
@@ -500,6 +509,14 @@ NTSTATUS FILE_GetNtStatus(void)
     }
 }
 
+/* check if data can be read from the socket of a byte mode pipe, without reading it */
+static int peek_pipe_data( int fd )
+{
+    char dummy;
+
+    return recv( fd, &dummy, 1, MSG_PEEK | MSG_DONTWAIT );
+}
+
 /***********************************************************************
  *             FILE_AsyncReadService      (INTERNAL)
  */
@@ -516,7 +533,10 @@ static NTSTATUS FILE_AsyncReadService( void *user, IO_STATUS_BLOCK *iosb, NTSTAT
                                           &needs_close, NULL, NULL )))
             break;
 
-        result = virtual_locked_read(fd, &fileio->buffer[fileio->already], fileio->count-fileio->already);
+        if (fileio->count)
+            result = virtual_locked_read(fd, &fileio->buffer[fileio->already], fileio->count-fileio->already);
+        else  /* zero-length pipe read, wait for data to be available */
+            result = peek_pipe_data( fd );
         if (needs_close) close( fd );
 
         if (result < 0)
@@ -530,6 +550,10 @@ static NTSTATUS FILE_AsyncReadService( void *user, IO_STATUS_BLOCK *iosb, NTSTAT
         {
             status = fileio->already ? STATUS_SUCCESS : STATUS_PIPE_BROKEN;
         }
+        else if (!fileio->count)
+        {
+            status = STATUS_SUCCESS;
+        }
         else
         {
             fileio->already += result;
@@ -709,6 +733,7 @@ static NTSTATUS get_io_timeouts( HANDLE handle, enum server_fd_type type, ULONG
         break;
     case FD_TYPE_SOCKET:
     case FD_TYPE_CHAR:
+    case FD_TYPE_PIPE:
         if (is_read) timeouts->interval = 0;  /* return as soon as we got something */
         break;
     default:
@@ -761,6 +786,7 @@ static NTSTATUS get_io_avail_mode( HANDLE handle, enum server_fd_type type, BOOL
     case FD_TYPE_MAILSLOT:
     case FD_TYPE_SOCKET:
     case FD_TYPE_CHAR:
+    case FD_TYPE_PIPE:
         *avail_mode = TRUE;
         break;
     default:
@@ -801,6 +827,314 @@ static NTSTATUS register_async_file_read( HANDLE handle, HANDLE event,
 }
 
 
+/***********************************************************************
+ *           io_uring support
+ *
+ * When WINEIOURING is set in the environment, overlapped reads and writes
+ * at an explicit offset on regular files are queued to an io_uring instead
+ * of being performed synchronously by the calling thread, so that an
+ * application can keep many requests in flight. A dedicated thread reaps
+ * the completions and reports them through the event and completion port.
+ *
+ * Only requests that signal an event and don't use an APC routine are
+ * handled this way; everything else goes through the normal path.
+ */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) \
+    && defined(IORING_FEAT_SINGLE_MMAP)
+
+#define URING_ENTRIES 256
+
+struct uring_request
+{
+    HANDLE           handle;      /* our own file handle for the completion port, 0 if none */
+    HANDLE           event;       /* event to signal on completion */
+    IO_STATUS_BLOCK *io;          /* caller's status block */
+    ULONG_PTR        cvalue;      /* completion value, 0 if none */
+    int              fd;          /* our own unix fd for the request */
+    BOOL             is_read;     /* read or write request */
+    ULONGLONG        offset;      /* file offset */
+    struct iovec     iov;         /* buffer */
+};
+
+static struct
+{
+    int                  fd;       /* io_uring fd, -1 if not available */
+    unsigned int         entries;  /* number of submission queue entries */
+    unsigned int         inflight; /* number of requests not completed yet */
+    unsigned int        *sq_head;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring = { -1 };
+
+static RTL_CRITICAL_SECTION uring_section;
+static RTL_CRITICAL_SECTION_DEBUG uring_section_debug =
+{
+    0, 0, &uring_section,
+    { &uring_section_debug.ProcessLocksList, &uring_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": uring_section") }
+};
+static RTL_CRITICAL_SECTION uring_section = { &uring_section_debug, -1, 0, 0, 0, 0 };
+
+/* report the result of a completed request */
+static void uring_complete( struct uring_request *req, int res )
+{
+    NTSTATUS status;
+    ULONG info = 0;
+
+    /* the kernel can't fault in pages protected by write watches, retry from user space */
+    if (res == -EFAULT)
+    {
+        if (req->is_read)
+            res = virtual_locked_pread( req->fd, req->iov.iov_base, req->iov.iov_len, req->offset );
+        else
+            res = pwrite( req->fd, req->iov.iov_base, req->iov.iov_len, req->offset );
+        if (res == -1) res = -errno;
+    }
+
+    if (res >= 0)
+    {
+        info = res;
+        status = (res || !req->is_read || !req->iov.iov_len) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+    }
+    else if (res == -EFAULT && !req->is_read) status = STATUS_INVALID_USER_BUFFER;
+    else
+    {
+        errno = -res;
+        status = FILE_GetNtStatus();
+    }
+
+    TRACE( "%p: status %08x info %u\n", req->io, status, info );
+    close( req->fd );
+    req->io->Information = info;
+    __sync_synchronize();
+    req->io->u.Status = status;
+    NtSetEvent( req->event, NULL );
+    if (req->cvalue)
+    {
+        NTDLL_AddCompletion( req->handle, req->cvalue, status, info, TRUE );
+        NtClose( req->handle );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, req );
+
+    RtlEnterCriticalSection( &uring_section );
+    uring.inflight--;
+    RtlLeaveCriticalSection( &uring_section );
+}
+
+/* thread reaping the completion queue */
+static void CALLBACK uring_thread_proc( void *arg )
+{
+    struct uring_request *req;
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    int res;
+
+    for (;;)
+    {
+        head = *uring.cq_head;
+        if (head == *(volatile unsigned int *)uring.cq_tail)
+        {
+            syscall( __NR_io_uring_enter, uring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 );
+            continue;
+        }
+        __sync_synchronize();
+        cqe = &uring.cqes[head & *uring.cq_mask];
+        req = (struct uring_request *)(ULONG_PTR)cqe->user_data;
+        res = cqe->res;
+        __sync_synchronize();
+        *uring.cq_head = head + 1;
+        uring_complete( req, res );
+    }
+}
+
+/* create the ring and its completion thread on first use */
+static BOOL uring_init(void)
+{
+    static volatile int initialized;
+    struct io_uring_params params;
+    const char *env;
+    size_t size;
+    char *ptr;
+    HANDLE thread;
+    int fd;
+
+    if (initialized) return uring.fd != -1;
+
+    RtlEnterCriticalSection( &uring_section );
+    if (initialized) goto done;
+
+    if (!(env = getenv( "WINEIOURING" )) || !atoi( env )) goto done;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1)
+    {
+        WARN( "io_uring not available, errno %d\n", errno );
+        goto done;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        WARN( "io_uring too old, features %x\n", params.features );
+        close( fd );
+        goto done;
+    }
+
+    size = max( params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) );
+    if ((ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING )) == MAP_FAILED)
+    {
+        close( fd );
+        goto done;
+    }
+    if ((uring.sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd, IORING_OFF_SQES )) == MAP_FAILED)
+    {
+        munmap( ptr, size );
+        close( fd );
+        goto done;
+    }
+
+    uring.entries  = params.sq_entries;
+    uring.sq_head  = (unsigned int *)(ptr + params.sq_off.head);
+    uring.sq_tail  = (unsigned int *)(ptr + params.sq_off.tail);
+    uring.sq_mask  = (unsigned int *)(ptr + params.sq_off.ring_mask);
+    uring.sq_array = (unsigned int *)(ptr + params.sq_off.array);
+    uring.cq_head  = (unsigned int *)(ptr + params.cq_off.head);
+    uring.cq_tail  = (unsigned int *)(ptr + params.cq_off.tail);
+    uring.cq_mask  = (unsigned int *)(ptr + params.cq_off.ring_mask);
+    uring.cqes     = (struct io_uring_cqe *)(ptr + params.cq_off.cqes);
+    uring.fd       = fd;
+
+    if (RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                             uring_thread_proc, NULL, &thread, NULL ))
+    {
+        munmap( uring.sqes, params.sq_entries * sizeof(struct io_uring_sqe) );
+        munmap( ptr, size );
+        close( fd );
+        uring.fd = -1;
+        goto done;
+    }
+    NtClose( thread );
+    TRACE( "using io_uring with %u entries\n", uring.entries );
+
+done:
+    initialized = 1;
+    RtlLeaveCriticalSection( &uring_section );
+    return uring.fd != -1;
+}
+
+/***********************************************************************
+ *           uring_submit
+ *
+ * Queue a read or write on a regular file to the io_uring.
+ * Returns STATUS_PENDING on success, STATUS_NOT_SUPPORTED if the request
+ * has to be performed synchronously instead.
+ * The request keeps its own copies of the fd and file handle, since the
+ * caller may close them before it completes.
+ */
+static NTSTATUS uring_submit( HANDLE handle, HANDLE event, IO_STATUS_BLOCK *io, ULONG_PTR cvalue,
+                              int fd, int needs_close, BOOL is_read, void *buffer, ULONG length,
+                              ULONGLONG offset )
+{
+    struct uring_request *req;
+    struct io_uring_sqe *sqe;
+    unsigned int tail, index;
+    int ret;
+
+    if (!uring_init()) return STATUS_NOT_SUPPORTED;
+    if (!(req = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*req) ))) return STATUS_NOT_SUPPORTED;
+
+    req->handle       = 0;
+    req->event        = event;
+    req->io           = io;
+    req->cvalue       = cvalue;
+    req->is_read      = is_read;
+    req->offset       = offset;
+    req->iov.iov_base = buffer;
+    req->iov.iov_len  = length;
+
+    if ((req->fd = dup( fd )) == -1)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, req );
+        return STATUS_NOT_SUPPORTED;
+    }
+    if (cvalue && NtDuplicateObject( NtCurrentProcess(), handle, NtCurrentProcess(), &req->handle,
+                                     0, 0, DUPLICATE_SAME_ACCESS ))
+        goto failed;
+
+    RtlEnterCriticalSection( &uring_section );
+    if (uring.inflight >= uring.entries)
+    {
+        RtlLeaveCriticalSection( &uring_section );
+        goto failed;
+    }
+    uring.inflight++;
+
+    /* the request can complete as soon as it's submitted */
+    io->u.Status = STATUS_PENDING;
+    io->Information = 0;
+    NtResetEvent( event, NULL );
+
+    tail = *uring.sq_tail;
+    index = tail & *uring.sq_mask;
+    sqe = &uring.sqes[index];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode    = is_read ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->fd        = req->fd;
+    sqe->off       = offset;
+    sqe->addr      = (ULONG_PTR)&req->iov;
+    sqe->len       = 1;
+    sqe->user_data = (ULONG_PTR)req;
+    uring.sq_array[index] = index;
+    __sync_synchronize();
+    *uring.sq_tail = ++tail;
+
+    /* submit right away, so that nothing is left in the queue if it fails */
+    while ((ret = syscall( __NR_io_uring_enter, uring.fd, tail - *(volatile unsigned int *)uring.sq_head,
+                           0, 0, NULL, 0 )) == -1 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        ;
+    if (*(volatile unsigned int *)uring.sq_head != tail)
+    {
+        /* the kernel didn't take it, take the entry back and let the caller do it synchronously */
+        WARN( "io_uring_enter failed, ret %d errno %d\n", ret, errno );
+        *uring.sq_tail = tail - 1;
+        uring.inflight--;
+        RtlLeaveCriticalSection( &uring_section );
+        goto failed;
+    }
+    RtlLeaveCriticalSection( &uring_section );
+    if (needs_close) close( fd );
+
+    TRACE( "%p: queued %s of %u bytes at %s\n", io, is_read ? "read" : "write",
+           length, wine_dbgstr_longlong( offset ));
+    return STATUS_PENDING;
+
+failed:
+    if (req->handle) NtClose( req->handle );
+    close( req->fd );
+    RtlFreeHeap( GetProcessHeap(), 0, req );
+    return STATUS_NOT_SUPPORTED;
+}
+
+#else  /* HAVE_LINUX_IO_URING_H */
+
+static NTSTATUS uring_submit( HANDLE handle, HANDLE event, IO_STATUS_BLOCK *io, ULONG_PTR cvalue,
+                              int fd, int needs_close, BOOL is_read, void *buffer, ULONG length,
+                              ULONGLONG offset )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+#endif  /* HAVE_LINUX_IO_URING_H */
+
+
 /******************************************************************************
  *  NtReadFile					[NTDLL.@]
  *  ZwReadFile					[NTDLL.@]
@@ -863,6 +1197,11 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
+            if (async_read && hEvent && !apc &&
+                uring_submit( hFile, hEvent, io_status, cvalue, unix_handle, needs_close,
+                              TRUE, buffer, length, offset->QuadPart ) == STATUS_PENDING)
+                return STATUS_PENDING;
+
             /* async I/O doesn't make sense on regular files */
             while ((result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
@@ -904,6 +1243,39 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
         }
     }
 
+    if (type == FD_TYPE_PIPE && !length)
+    {
+        /* a zero-length read on a byte mode pipe waits until data is available */
+        while ((result = peek_pipe_data( unix_handle )) == -1)
+        {
+            struct pollfd pfd;
+
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN)
+            {
+                status = FILE_GetNtStatus();
+                goto err;
+            }
+            if (async_read)
+            {
+                status = register_async_file_read( hFile, hEvent, apc, apc_user, io_status,
+                                                   buffer, 0, 0, TRUE );
+                goto err;
+            }
+            if (hEvent) NtResetEvent( hEvent, NULL );
+            pfd.fd = unix_handle;
+            pfd.events = POLLIN;
+            poll( &pfd, 1, -1 );
+        }
+        if (!result)
+        {
+            status = STATUS_PIPE_BROKEN;
+            goto err;
+        }
+        status = STATUS_SUCCESS;
+        goto done;
+    }
+
     for (;;)
     {
         if ((result = virtual_locked_read( unix_handle, (char *)buffer + total, length - total )) >= 0)
@@ -1013,7 +1385,7 @@ err:
         if (status != STATUS_PENDING && hEvent) NtResetEvent( hEvent, NULL );
     }
 
-    if (send_completion) NTDLL_AddCompletion( hFile, cvalue, status, total );
+    if (send_completion) NTDLL_AddCompletion( hFile, cvalue, status, total, FALSE );
 
     return status;
 }
@@ -1088,7 +1460,7 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
     if (event) NtSetEvent( event, NULL );
     if (apc) NtQueueApcThread( GetCurrentThread(), (PNTAPCFUNC)apc,
                                (ULONG_PTR)apc_user, (ULONG_PTR)io_status, 0 );
-    if (send_completion) NTDLL_AddCompletion( file, cvalue, status, total );
+    if (send_completion) NTDLL_AddCompletion( file, cvalue, status, total, FALSE );
 
     return STATUS_PENDING;
 
@@ -1266,6 +1638,11 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
                 goto done;
             }
 
+            if (async_write && hEvent && !apc &&
+                uring_submit( hFile, hEvent, io_status, cvalue, unix_handle, needs_close,
+                              FALSE, (void *)buffer, length, off ) == STATUS_PENDING)
+                return STATUS_PENDING;
+
             /* async I/O doesn't make sense on regular files */
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
             {
@@ -1407,7 +1784,7 @@ err:
         if (status != STATUS_PENDING && hEvent) NtResetEvent( hEvent, NULL );
     }
 
-    if (send_completion) NTDLL_AddCompletion( hFile, cvalue, status, total );
+    if (send_completion) NTDLL_AddCompletion( hFile, cvalue, status, total, FALSE );
 
     return status;
 }
@@ -1499,7 +1876,7 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         if (status != STATUS_PENDING && event) NtResetEvent( event, NULL );
     }
 
-    if (send_completion) NTDLL_AddCompletion( file, cvalue, status, total );
+    if (send_completion) NTDLL_AddCompletion( file, cvalue, status, total, FALSE );
 
     return status;
 }
@@ -2640,6 +3017,8 @@ NTSTATUS WINAPI NtSetInformationFile(HANDLE handle, PIO_STATUS_BLOCK io,
         {
             FILE_COMPLETION_INFORMATION *info = ptr;
 
+            local_completion_to_server( info->CompletionPort );
+
             SERVER_START_REQ( set_completion_info )
             {
                 req->handle   = wine_server_obj_handle( handle );
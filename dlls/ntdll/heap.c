@@ -164,6 +164,7 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    struct tagLFH   *lfh;           /* Low-fragmentation front end, if enabled */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -178,6 +179,53 @@ typedef struct tagHEAP
 #define HEAP_VALIDATE_ALL     0x20000000
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
+/* Low-fragmentation heap front end: small blocks are served from 64K bins
+ * dedicated to a single size class. Free blocks are kept on a lock-free list
+ * per size class, so that the heap lock is only needed to carve new blocks. */
+
+#define LFH_BIN_SIZE          0x10000     /* size of a bin, must match the allocation granularity */
+#define LFH_SMALL_SIZE        0x100       /* ALIGNMENT granularity up to this size */
+#define LFH_MAX_SIZE          0x400       /* 0x80 granularity up to this size */
+#define LFH_LARGE_STEP        0x80
+#define LFH_NB_SMALL_CLASSES  (LFH_SMALL_SIZE / ALIGNMENT)
+#define LFH_NB_CLASSES        (LFH_NB_SMALL_CLASSES + (LFH_MAX_SIZE - LFH_SMALL_SIZE) / LFH_LARGE_STEP)
+#define LFH_HASH_SIZE         8192        /* max number of bins per heap, must be a power of 2 */
+#define LFH_MAX_BINS          (LFH_HASH_SIZE * 3 / 4)
+#define LFH_CARVE_COUNT       32          /* number of blocks to carve at a time */
+
+#define ARENA_LFH_MAGIC       0x48464c    /* magic of in-use blocks in a bin */
+#define ARENA_LFH_FREE_MAGIC  0x46464c    /* magic of free blocks in a bin */
+#define LFH_BIN_MAGIC         ((DWORD)('L' | ('F'<<8) | ('H'<<16) | ('B'<<24)))
+
+/* flags that require the blocks to go through the normal heap */
+#define HEAP_LFH_DISABLE_FLAGS (HEAP_NO_SERIALIZE | HEAP_SHARED | HEAP_TAIL_CHECKING_ENABLED | \
+                                HEAP_FREE_CHECKING_ENABLED | HEAP_PAGE_ALLOCS | HEAP_VALIDATE)
+
+struct lfh_bin
+{
+    DWORD            magic;       /* LFH_BIN_MAGIC */
+    DWORD            class;       /* size class of the blocks */
+    DWORD            block_size;  /* size of user data of the blocks */
+    DWORD            count;       /* number of blocks in the bin */
+};
+
+#define LFH_FIRST_BLOCK  (((sizeof(struct lfh_bin) + ALIGNMENT - 1) & ~(ALIGNMENT - 1)) + ALIGNMENT)
+
+typedef struct
+{
+    SLIST_HEADER     free_list;   /* free blocks of this class */
+    struct lfh_bin  *bin;         /* bin currently being carved, protected by the heap lock */
+    DWORD            next;        /* index of the first never used block in that bin */
+    DWORD            block_size;  /* size of user data of the blocks */
+} LFH_CLASS;
+
+typedef struct tagLFH
+{
+    LFH_CLASS        classes[LFH_NB_CLASSES];
+    DWORD            nb_bins;               /* number of bins, protected by the heap lock */
+    struct lfh_bin  *volatile bins[LFH_HASH_SIZE];   /* hash table of bins, indexed by address */
+} LFH;
+
 static HEAP *processHeap;  /* main process heap */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
@@ -870,6 +918,373 @@ static BOOL validate_large_arena( HEAP *heap, const ARENA_LARGE *arena, BOOL qui
 }
 
 
+/***********************************************************************
+ *           lfh_get_class
+ *
+ * Get the size class index for a given user data size.
+ */
+static inline unsigned int lfh_get_class( SIZE_T size )
+{
+    if (size <= LFH_SMALL_SIZE) return size ? (size - 1) / ALIGNMENT : 0;
+    return LFH_NB_SMALL_CLASSES + (size - LFH_SMALL_SIZE - 1) / LFH_LARGE_STEP;
+}
+
+static inline DWORD lfh_get_class_size( unsigned int index )
+{
+    if (index < LFH_NB_SMALL_CLASSES) return (index + 1) * ALIGNMENT;
+    return LFH_SMALL_SIZE + (index - LFH_NB_SMALL_CLASSES + 1) * LFH_LARGE_STEP;
+}
+
+static inline unsigned int lfh_hash( const void *ptr )
+{
+    return ((ULONG_PTR)ptr / LFH_BIN_SIZE) & (LFH_HASH_SIZE - 1);
+}
+
+/* return the free list entry of a block in a bin; it is also the user data pointer */
+static inline SLIST_ENTRY *lfh_get_block( struct lfh_bin *bin, DWORD index )
+{
+    return (SLIST_ENTRY *)((char *)bin + LFH_FIRST_BLOCK + index * (bin->block_size + ALIGNMENT));
+}
+
+
+/***********************************************************************
+ *           lfh_find_bin
+ *
+ * Find the bin containing a pointer. This doesn't need the heap lock
+ * since bins are never removed from the hash table while the heap exists.
+ */
+static struct lfh_bin *lfh_find_bin( const HEAP *heap, const void *ptr )
+{
+    const LFH *lfh = heap->lfh;
+    struct lfh_bin *bin, *base = (struct lfh_bin *)((ULONG_PTR)ptr & ~(ULONG_PTR)(LFH_BIN_SIZE - 1));
+    unsigned int i;
+
+    if (!lfh) return NULL;
+    for (i = lfh_hash( base ); (bin = lfh->bins[i]); i = (i + 1) & (LFH_HASH_SIZE - 1))
+        if (bin == base) return bin;
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           lfh_validate_block
+ *
+ * Check that a pointer is a valid in-use block of a bin.
+ */
+static BOOL lfh_validate_block( const HEAP *heap, const struct lfh_bin *bin, const void *ptr )
+{
+    const ARENA_INUSE *arena = (const ARENA_INUSE *)ptr - 1;
+    SIZE_T offset = (const char *)ptr - (const char *)bin;
+    SIZE_T stride = bin->block_size + ALIGNMENT;
+
+    if (offset < LFH_FIRST_BLOCK || (offset - LFH_FIRST_BLOCK) % stride ||
+        (offset - LFH_FIRST_BLOCK) / stride >= bin->count)
+        WARN( "Heap %p: pointer %p is not a block of bin %p\n", heap, ptr, bin );
+    else if (arena->magic == ARENA_LFH_FREE_MAGIC)
+        WARN( "Heap %p: block %p used after free\n", heap, ptr );
+    else if (arena->magic != ARENA_LFH_MAGIC)
+        WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", heap, arena->magic, arena );
+    else if (arena->size > bin->block_size)
+        ERR( "Heap %p: bad size %08x for in-use arena %p\n", heap, arena->size, arena );
+    else
+        return TRUE;
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           lfh_validate_bins
+ *
+ * Check all the blocks of the bins. Must be called with the heap lock held.
+ */
+static BOOL lfh_validate_bins( const HEAP *heap )
+{
+    const LFH *lfh = heap->lfh;
+    struct lfh_bin *bin;
+    unsigned int i;
+    DWORD index, end;
+
+    for (i = 0; i < LFH_HASH_SIZE; i++)
+    {
+        if (!(bin = lfh->bins[i])) continue;
+        if (bin->magic != LFH_BIN_MAGIC || bin->class >= LFH_NB_CLASSES ||
+            bin->block_size != lfh->classes[bin->class].block_size)
+        {
+            ERR( "Heap %p: invalid bin %p\n", heap, bin );
+            return FALSE;
+        }
+        /* the blocks past the carving position of the current bin were never used */
+        end = lfh->classes[bin->class].bin == bin ? lfh->classes[bin->class].next : bin->count;
+        for (index = 0; index < end; index++)
+        {
+            const SLIST_ENTRY *block = lfh_get_block( bin, index );
+            if (((const ARENA_INUSE *)block - 1)->magic == ARENA_LFH_FREE_MAGIC) continue;
+            if (!lfh_validate_block( heap, bin, block )) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           lfh_next_block
+ *
+ * Find the in-use block of the bins that follows ptr, or the first one if
+ * ptr is NULL. Bins are enumerated in hash table order.
+ */
+static void *lfh_next_block( const HEAP *heap, const void *ptr )
+{
+    const LFH *lfh = heap->lfh;
+    struct lfh_bin *bin;
+    unsigned int i = 0;
+    DWORD index = 0;
+    SLIST_ENTRY *block;
+
+    if (!lfh) return NULL;
+    if (ptr)
+    {
+        bin = (struct lfh_bin *)((ULONG_PTR)ptr & ~(ULONG_PTR)(LFH_BIN_SIZE - 1));
+        for (i = lfh_hash( bin ); lfh->bins[i] != bin; i = (i + 1) & (LFH_HASH_SIZE - 1)) ;
+        index = ((const char *)ptr - (const char *)bin - LFH_FIRST_BLOCK) / (bin->block_size + ALIGNMENT) + 1;
+    }
+    for (; i < LFH_HASH_SIZE; i++, index = 0)
+    {
+        if (!(bin = lfh->bins[i])) continue;
+        for (; index < bin->count; index++)
+        {
+            block = lfh_get_block( bin, index );
+            if (((ARENA_INUSE *)block - 1)->magic == ARENA_LFH_MAGIC) return block;
+        }
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           lfh_alloc_bin
+ *
+ * Allocate a new bin for a size class. Must be called with the heap lock held.
+ */
+static struct lfh_bin *lfh_alloc_bin( HEAP *heap, unsigned int index )
+{
+    LFH *lfh = heap->lfh;
+    void *ptr = NULL;
+    SIZE_T size = LFH_BIN_SIZE;
+    struct lfh_bin *bin;
+    unsigned int i;
+
+    if (lfh->nb_bins >= LFH_MAX_BINS) return NULL;
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 0, &size,
+                                 MEM_RESERVE | MEM_COMMIT, get_protection_type( heap->flags )))
+    {
+        WARN( "Could not allocate bin for heap %p\n", heap );
+        return NULL;
+    }
+    if ((ULONG_PTR)ptr & (LFH_BIN_SIZE - 1))
+    {
+        ERR( "Heap %p: bin %p is not properly aligned\n", heap, ptr );
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &ptr, &size, MEM_RELEASE );
+        return NULL;
+    }
+
+    bin = ptr;
+    bin->magic      = LFH_BIN_MAGIC;
+    bin->class      = index;
+    bin->block_size = lfh->classes[index].block_size;
+    bin->count      = (LFH_BIN_SIZE - LFH_FIRST_BLOCK + ALIGNMENT) / (bin->block_size + ALIGNMENT);
+
+    /* make the bin visible to lock-free lookups only once it is initialized */
+    for (i = lfh_hash( bin ); lfh->bins[i]; i = (i + 1) & (LFH_HASH_SIZE - 1)) ;
+    interlocked_xchg_ptr( (void **)&lfh->bins[i], bin );
+    lfh->nb_bins++;
+    return bin;
+}
+
+
+/***********************************************************************
+ *           lfh_carve_blocks
+ *
+ * Refill the free list of a size class from its current bin, allocating
+ * a new bin if needed. Returns one of the new blocks.
+ */
+static SLIST_ENTRY *lfh_carve_blocks( HEAP *heap, unsigned int index )
+{
+    LFH_CLASS *class = &heap->lfh->classes[index];
+    SLIST_ENTRY *entry, *first, *last;
+    struct lfh_bin *bin;
+    DWORD i, count;
+
+    RtlEnterCriticalSection( &heap->critSection );
+
+    /* another thread may have refilled the list while we were waiting for the lock */
+    if ((entry = RtlInterlockedPopEntrySList( &class->free_list ))) goto done;
+
+    if (!(bin = class->bin) || class->next == bin->count)
+    {
+        if (!(bin = lfh_alloc_bin( heap, index ))) goto done;
+        class->bin  = bin;
+        class->next = 0;
+    }
+
+    count = min( bin->count - class->next, LFH_CARVE_COUNT );
+    entry = lfh_get_block( bin, class->next );
+    if (count > 1)
+    {
+        first = last = lfh_get_block( bin, class->next + 1 );
+        ((ARENA_INUSE *)first - 1)->magic = ARENA_LFH_FREE_MAGIC;
+        for (i = 2; i < count; i++)
+        {
+            last = last->Next = lfh_get_block( bin, class->next + i );
+            ((ARENA_INUSE *)last - 1)->magic = ARENA_LFH_FREE_MAGIC;
+        }
+        RtlInterlockedPushListSListEx( &class->free_list, first, last, count - 1 );
+    }
+    class->next += count;
+
+done:
+    RtlLeaveCriticalSection( &heap->critSection );
+    return entry;
+}
+
+
+/***********************************************************************
+ *           lfh_allocate
+ *
+ * Allocate a block from the low-fragmentation front end. Returns NULL if
+ * the block has to be allocated from the normal heap.
+ */
+static void *lfh_allocate( HEAP *heap, DWORD flags, SIZE_T size )
+{
+    unsigned int index;
+    SLIST_ENTRY *entry;
+    ARENA_INUSE *arena;
+
+    if (size > LFH_MAX_SIZE) return NULL;
+
+    index = lfh_get_class( size );
+    if (!(entry = RtlInterlockedPopEntrySList( &heap->lfh->classes[index].free_list )) &&
+        !(entry = lfh_carve_blocks( heap, index )))
+        return NULL;
+
+    arena = (ARENA_INUSE *)entry - 1;
+    arena->size         = size;
+    arena->magic        = ARENA_LFH_MAGIC;
+    arena->unused_bytes = 0;
+    if (flags & HEAP_ZERO_MEMORY) memset( entry, 0, size );
+    return entry;
+}
+
+
+/***********************************************************************
+ *           lfh_free
+ */
+static BOOL lfh_free( HEAP *heap, struct lfh_bin *bin, void *ptr )
+{
+    ARENA_INUSE *arena = (ARENA_INUSE *)ptr - 1;
+
+    if (!lfh_validate_block( heap, bin, ptr )) return FALSE;
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    RtlInterlockedPushEntrySList( &heap->lfh->classes[bin->class].free_list, ptr );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           lfh_reallocate
+ *
+ * Resize a block of a bin, in place if it still fits in the size class.
+ */
+static NTSTATUS lfh_reallocate( HEAP *heap, struct lfh_bin *bin, DWORD flags,
+                                void *ptr, SIZE_T size, void **ret )
+{
+    ARENA_INUSE *arena = (ARENA_INUSE *)ptr - 1;
+    SIZE_T old_size;
+
+    *ret = NULL;
+    if (!lfh_validate_block( heap, bin, ptr )) return STATUS_INVALID_PARAMETER;
+
+    old_size = arena->size;
+    if (size <= bin->block_size)
+    {
+        if ((flags & HEAP_ZERO_MEMORY) && size > old_size)
+            memset( (char *)ptr + old_size, 0, size - old_size );
+        arena->size = size;
+        *ret = ptr;
+        return STATUS_SUCCESS;
+    }
+
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) return STATUS_NO_MEMORY;
+    if (!(*ret = RtlAllocateHeap( heap, flags & HEAP_NO_SERIALIZE, size ))) return STATUS_NO_MEMORY;
+    memcpy( *ret, ptr, old_size );
+    if (flags & HEAP_ZERO_MEMORY) memset( (char *)*ret + old_size, 0, size - old_size );
+    lfh_free( heap, bin, ptr );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           lfh_enable
+ *
+ * Enable the low-fragmentation front end for a heap.
+ */
+static NTSTATUS lfh_enable( HEAP *heap )
+{
+    void *ptr = NULL;
+    SIZE_T size = sizeof(LFH);
+    LFH *lfh;
+    unsigned int i;
+
+    if (heap->lfh) return STATUS_SUCCESS;
+    if (!(heap->flags & HEAP_GROWABLE) || (heap->flags & HEAP_LFH_DISABLE_FLAGS) || RUNNING_ON_VALGRIND)
+        return STATUS_UNSUCCESSFUL;
+
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+        return STATUS_NO_MEMORY;
+
+    lfh = ptr;
+    for (i = 0; i < LFH_NB_CLASSES; i++)
+    {
+        RtlInitializeSListHead( &lfh->classes[i].free_list );
+        lfh->classes[i].block_size = lfh_get_class_size( i );
+    }
+
+    if (interlocked_cmpxchg_ptr( (void **)&heap->lfh, lfh, NULL ))
+    {
+        /* somebody beat us to it */
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &ptr, &size, MEM_RELEASE );
+    }
+    TRACE( "enabled low-fragmentation heap for %p\n", heap );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           lfh_destroy
+ *
+ * Release all the bins of a heap that is being destroyed.
+ */
+static void lfh_destroy( HEAP *heap )
+{
+    SIZE_T size;
+    void *addr;
+    unsigned int i;
+
+    if (!heap->lfh) return;
+    for (i = 0; i < LFH_HASH_SIZE; i++)
+    {
+        if (!(addr = heap->lfh->bins[i])) continue;
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
+    size = 0;
+    addr = heap->lfh;
+    NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    heap->lfh = NULL;
+}
+
+
 /***********************************************************************
  *           HEAP_CreateSubHeap
  */
@@ -1334,6 +1749,7 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
     SUBHEAP *subheap;
     BOOL ret = TRUE;
     const ARENA_LARGE *large_arena;
+    const struct lfh_bin *bin;
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
@@ -1345,7 +1761,9 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
     {
         const ARENA_INUSE *arena = (const ARENA_INUSE *)block - 1;
 
-        if (!(subheap = HEAP_FindSubHeap( heapPtr, arena )) ||
+        if ((bin = lfh_find_bin( heapPtr, block )))
+            ret = lfh_validate_block( heapPtr, bin, block );
+        else if (!(subheap = HEAP_FindSubHeap( heapPtr, arena )) ||
             ((const char *)arena < (char *)subheap->base + subheap->headerSize))
         {
             if (!(large_arena = find_large_block( heapPtr, block )))
@@ -1394,6 +1812,8 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
     LIST_FOR_EACH_ENTRY( large_arena, &heapPtr->large_list, ARENA_LARGE, entry )
         if (!(ret = validate_large_arena( heapPtr, large_arena, quiet ))) break;
 
+    if (ret && heapPtr->lfh) ret = lfh_validate_bins( heapPtr );
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     return ret;
 }
@@ -1527,6 +1947,9 @@ void heap_set_debug_flags( HANDLE handle )
             heap->pending_pos = 0;
         }
     }
+
+    /* the process heap uses the low-fragmentation front end by default */
+    if (heap == processHeap) lfh_enable( heap );
 }
 
 
@@ -1615,6 +2038,8 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     heapPtr->critSection.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heapPtr->critSection );
 
+    lfh_destroy( heapPtr );
+
     LIST_FOR_EACH_ENTRY_SAFE( arena, arena_next, &heapPtr->large_list, ARENA_LARGE, entry )
     {
         list_remove( &arena->entry );
@@ -1683,6 +2108,16 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh)
+    {
+        void *ret = lfh_allocate( heapPtr, flags, size );
+        if (ret)
+        {
+            TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+            return ret;
+        }
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1752,6 +2187,7 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
     ARENA_INUSE *pInUse;
     SUBHEAP *subheap;
     HEAP *heapPtr;
+    struct lfh_bin *bin;
 
     /* Validate the parameters */
 
@@ -1766,6 +2202,19 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    if ((bin = lfh_find_bin( heapPtr, ptr )))
+    {
+        if (!lfh_free( heapPtr, bin, ptr ))
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            TRACE("(%p,%08x,%p): returning FALSE\n", heap, flags, ptr );
+            return FALSE;
+        }
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
@@ -1813,6 +2262,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     HEAP *heapPtr;
     SUBHEAP *subheap;
     SIZE_T oldBlockSize, oldActualSize, rounded_size;
+    struct lfh_bin *bin;
     void *ret;
 
     if (!ptr) return NULL;
@@ -1827,6 +2277,17 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    if ((bin = lfh_find_bin( heapPtr, ptr )))
+    {
+        NTSTATUS status = lfh_reallocate( heapPtr, bin, flags, ptr, size, &ret );
+
+        if (status == STATUS_NO_MEMORY && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( status );
+        if (status) RtlSetLastWin32ErrorAndNtStatusFromNtStatus( status );
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE(flags);
@@ -2027,6 +2488,7 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     SIZE_T ret;
     const ARENA_INUSE *pArena;
     SUBHEAP *subheap;
+    struct lfh_bin *bin;
     HEAP *heapPtr = HEAP_GetPtr( heap );
 
     if (!heapPtr)
@@ -2036,6 +2498,19 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     }
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    if ((bin = lfh_find_bin( heapPtr, ptr )))
+    {
+        if (lfh_validate_block( heapPtr, bin, ptr )) ret = ((const ARENA_INUSE *)ptr - 1)->size;
+        else
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            ret = ~0UL;
+        }
+        TRACE("(%p,%08x,%p): returning %08lx\n", heap, flags, ptr, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     pArena = (const ARENA_INUSE *)ptr - 1;
@@ -2104,6 +2579,13 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
 
     /* FIXME: enumerate large blocks too */
 
+    /* the blocks of the low-fragmentation bins come after all the subheaps */
+    if (entry->lpData && lfh_find_bin( heapPtr, entry->lpData ))
+    {
+        ptr = lfh_next_block( heapPtr, entry->lpData );
+        goto lfh_block;
+    }
+
     /* set ptr to the next arena to be examined */
 
     if (!entry->lpData) /* first call (init) ? */
@@ -2150,10 +2632,9 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         {   /* proceed with next subheap */
             struct list *next = list_next( &heapPtr->subheap_list, &currentheap->entry );
             if (!next)
-            {  /* successfully finished */
-                TRACE("end reached.\n");
-                ret = STATUS_NO_MORE_ENTRIES;
-                goto HW_end;
+            {
+                ptr = lfh_next_block( heapPtr, NULL );
+                goto lfh_block;
             }
             currentheap = LIST_ENTRY( next, SUBHEAP, entry );
             ptr = (char *)currentheap->base + currentheap->headerSize;
@@ -2203,6 +2684,22 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
     }
     ret = STATUS_SUCCESS;
     if (TRACE_ON(heap)) HEAP_DumpEntry(entry);
+    goto HW_end;
+
+lfh_block:
+    if (!ptr)
+    {  /* successfully finished */
+        TRACE("end reached.\n");
+        ret = STATUS_NO_MORE_ENTRIES;
+        goto HW_end;
+    }
+    entry->lpData = ptr;
+    entry->cbData = ((ARENA_INUSE *)ptr - 1)->size;
+    entry->cbOverhead = sizeof(ARENA_INUSE);
+    entry->wFlags = PROCESS_HEAP_ENTRY_BUSY;
+    entry->iRegionIndex = 0;
+    ret = STATUS_SUCCESS;
+    if (TRACE_ON(heap)) HEAP_DumpEntry(entry);
 
 HW_end:
     if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
@@ -2246,6 +2743,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2254,7 +2753,8 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0; /* low-fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2268,6 +2768,26 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* standard heap, the low-fragmentation front end can't be disabled once enabled */
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:  /* low-fragmentation heap */
+            return lfh_enable( heapPtr );
+        default:
+            return STATUS_UNSUCCESSFUL;
+        }
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
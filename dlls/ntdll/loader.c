@@ -27,6 +27,9 @@
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -50,6 +53,7 @@ WINE_DECLARE_DEBUG_CHANNEL(relay);
 WINE_DECLARE_DEBUG_CHANNEL(snoop);
 WINE_DECLARE_DEBUG_CHANNEL(loaddll);
 WINE_DECLARE_DEBUG_CHANNEL(imports);
+WINE_DECLARE_DEBUG_CHANNEL(startup);
 
 #ifdef _WIN64
 #define DEFAULT_SECURITY_COOKIE_64  (((ULONGLONG)0x00002b99 << 32) | 0x2ddfa232)
@@ -93,6 +97,13 @@ static const char * const reason_names[] =
 
 static const WCHAR dllW[] = {'.','d','l','l',0};
 
+/* entry of the export names hash index */
+struct export_hash_entry
+{
+    DWORD hash;   /* hash of the export name */
+    DWORD index;  /* index in the export names table plus one, 0 if unused */
+};
+
 /* internal representation of 32bit modules. per process. */
 typedef struct _wine_modref
 {
@@ -102,8 +113,16 @@ typedef struct _wine_modref
     int                   alloc_deps;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct export_hash_entry *export_hash;  /* hash index of the export names, built on demand */
+    DWORD                 export_hash_mask;
+    FARPROC              *forwards;      /* resolved forwarded exports, indexed by ordinal */
+    unsigned int          forwards_gen;  /* value of forwards_generation when they were resolved */
 } WINE_MODREF;
 
+#define EXPORT_HASH_MIN_NAMES 16  /* don't bother hashing smaller export tables */
+
+static unsigned int forwards_generation;  /* incremented every time a module is unloaded */
+
 /* info about the current builtin dll load */
 /* used to keep track of things across the register_dll constructor call */
 struct builtin_load_info
@@ -134,6 +153,29 @@ static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
+/* time spent in the various loader phases, reported on the startup channel */
+enum load_phase
+{
+    LOAD_PHASE_OTHER,
+    LOAD_PHASE_SEARCH,
+    LOAD_PHASE_MAP,
+    LOAD_PHASE_RELOC,
+    LOAD_PHASE_IMPORTS,
+    LOAD_PHASE_ATTACH,
+    LOAD_PHASE_COUNT
+};
+
+static const char * const load_phase_names[LOAD_PHASE_COUNT] =
+{
+    "other", "search", "map", "relocations", "imports", "attach"
+};
+
+static LONGLONG load_phase_time[LOAD_PHASE_COUNT];
+static enum load_phase current_load_phase;
+static LARGE_INTEGER load_phase_start;
+static LARGE_INTEGER load_start_time;
+static unsigned int load_dll_count;
+
 static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
@@ -160,6 +202,57 @@ static inline void ascii_to_unicode( WCHAR *dst, const char *src, size_t len )
 }
 
 
+/*************************************************************************
+ *		set_load_phase
+ *
+ * Switch the loader timing to a new phase, and return the previous one.
+ * Time is only accounted to the innermost phase, so nested dll loads
+ * don't get counted twice.
+ */
+static enum load_phase set_load_phase( enum load_phase phase )
+{
+    enum load_phase prev = current_load_phase;
+    LARGE_INTEGER now;
+
+    if (!TRACE_ON(startup)) return prev;
+
+    NtQueryPerformanceCounter( &now, NULL );
+    if (load_phase_start.QuadPart) load_phase_time[prev] += now.QuadPart - load_phase_start.QuadPart;
+    else load_start_time = now;
+    load_phase_start = now;
+    current_load_phase = phase;
+    return prev;
+}
+
+
+/*************************************************************************
+ *		report_load_phases
+ *
+ * Print the time spent in each loader phase during process startup.
+ */
+static void report_load_phases(void)
+{
+    LARGE_INTEGER now, freq;
+    ULONGLONG usecs;
+    int i;
+
+    if (!TRACE_ON(startup) || !load_phase_start.QuadPart) return;
+
+    set_load_phase( current_load_phase );
+    NtQueryPerformanceCounter( &now, &freq );
+    usecs = (now.QuadPart - load_start_time.QuadPart) * 1000000 / freq.QuadPart;
+    TRACE_(startup)( "%s: %u dlls loaded in %u.%03u ms\n",
+                     debugstr_w(NtCurrentTeb()->Peb->ProcessParameters->ImagePathName.Buffer),
+                     load_dll_count, (UINT)(usecs / 1000), (UINT)(usecs % 1000) );
+    for (i = 0; i < LOAD_PHASE_COUNT; i++)
+    {
+        usecs = load_phase_time[i] * 1000000 / freq.QuadPart;
+        TRACE_(startup)( "  %-12s %u.%03u ms\n", load_phase_names[i],
+                         (UINT)(usecs / 1000), (UINT)(usecs % 1000) );
+    }
+}
+
+
 /*************************************************************************
  *		call_dll_entry_point
  *
@@ -563,6 +656,39 @@ static FARPROC find_forwarded_export( HMODULE module, const char *forward, LPCWS
 }
 
 
+/*************************************************************************
+ *		find_cached_forward
+ *
+ * Find the final function pointer for a forwarded function, using the
+ * cache of already resolved forwards of the module.
+ * The loader_section must be locked while calling this function.
+ */
+static FARPROC find_cached_forward( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports,
+                                    DWORD ordinal, const char *forward, LPCWSTR load_path )
+{
+    FARPROC proc;
+
+    /* the target of a cached forward may have been unloaded since */
+    if (wm->forwards && wm->forwards_gen != forwards_generation)
+    {
+        memset( wm->forwards, 0, exports->NumberOfFunctions * sizeof(*wm->forwards) );
+        wm->forwards_gen = forwards_generation;
+    }
+    if (wm->forwards && wm->forwards[ordinal]) return wm->forwards[ordinal];
+
+    if (!(proc = find_forwarded_export( wm->ldr.BaseAddress, forward, load_path ))) return NULL;
+
+    if (!wm->forwards)
+    {
+        wm->forwards = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                        exports->NumberOfFunctions * sizeof(*wm->forwards) );
+        wm->forwards_gen = forwards_generation;
+    }
+    if (wm->forwards) wm->forwards[ordinal] = proc;
+    return proc;
+}
+
+
 /*************************************************************************
  *		find_ordinal_export
  *
@@ -588,7 +714,14 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
     /* if the address falls into the export dir, it's a forward */
     if (((const char *)proc >= (const char *)exports) && 
         ((const char *)proc < (const char *)exports + exp_size))
-        return find_forwarded_export( module, (const char *)proc, load_path );
+    {
+        WINE_MODREF *wm;
+
+        /* relay and snoop thunks depend on the caller, so they can't be cached */
+        if (TRACE_ON(relay) || TRACE_ON(snoop) || !(wm = get_modref( module )))
+            return find_forwarded_export( module, (const char *)proc, load_path );
+        return find_cached_forward( wm, exports, ordinal, (const char *)proc, load_path );
+    }
 
     if (TRACE_ON(snoop))
     {
@@ -604,6 +737,71 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/* hash an export name (FNV-1a) */
+static inline DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		build_export_hash
+ *
+ * Build the hash index of the export names of a module.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL build_export_hash( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    HMODULE module = wm->ldr.BaseAddress;
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    struct export_hash_entry *table;
+    DWORD i, pos, hash, size = 1;
+
+    while (size < 2 * exports->NumberOfNames) size *= 2;
+    if (!(table = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*table) )))
+        return FALSE;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        hash = hash_export_name( get_rva( module, names[i] ));
+        for (pos = hash & (size - 1); table[pos].index; pos = (pos + 1) & (size - 1)) ;
+        table[pos].hash  = hash;
+        table[pos].index = i + 1;
+    }
+    wm->export_hash = table;
+    wm->export_hash_mask = size - 1;
+    TRACE( "built hash of %u exports for %s\n", exports->NumberOfNames,
+           debugstr_w(wm->ldr.BaseDllName.Buffer) );
+    return TRUE;
+}
+
+
+/*************************************************************************
+ *		find_hashed_export
+ *
+ * Find the index of an export name using the hash index of the module.
+ * Returns -1 if not found.
+ */
+static int find_hashed_export( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports, const char *name )
+{
+    HMODULE module = wm->ldr.BaseAddress;
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    const struct export_hash_entry *entry;
+    DWORD hash = hash_export_name( name ), pos;
+
+    for (pos = hash & wm->export_hash_mask; ; pos = (pos + 1) & wm->export_hash_mask)
+    {
+        entry = &wm->export_hash[pos];
+        if (!entry->index) return -1;
+        if (entry->hash == hash && !strcmp( get_rva( module, names[entry->index - 1] ), name ))
+            return entry->index - 1;
+    }
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -616,6 +814,7 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
     int min = 0, max = exports->NumberOfNames - 1;
+    WINE_MODREF *wm;
 
     /* first check the hint */
     if (hint >= 0 && hint <= max)
@@ -625,6 +824,15 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
+    /* then use the hash index if the table is large enough */
+    if (exports->NumberOfNames >= EXPORT_HASH_MIN_NAMES && (wm = get_modref( module )) &&
+        (wm->export_hash || build_export_hash( wm, exports )))
+    {
+        int pos = find_hashed_export( wm, exports, name );
+        if (pos == -1) return NULL;
+        return find_ordinal_export( module, exports, exp_size, ordinals[pos], load_path );
+    }
+
     /* then do a binary search */
     while (min <= max)
     {
@@ -1012,6 +1220,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     DWORD size;
     NTSTATUS status;
     ULONG_PTR cookie;
+    enum load_phase prev_phase;
 
     if (!(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS)) return STATUS_SUCCESS;  /* already done */
     wm->ldr.Flags &= ~LDR_DONT_RESOLVE_REFS;
@@ -1039,6 +1248,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
      */
     prev = current_modref;
     current_modref = wm;
+    prev_phase = set_load_phase( LOAD_PHASE_IMPORTS );
     status = STATUS_SUCCESS;
     for (i = 0; i < nb_imports; i++)
     {
@@ -1051,6 +1261,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
         }
         wm->deps[dep] = imp;
     }
+    set_load_phase( prev_phase );
     current_modref = prev;
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
@@ -1306,6 +1517,7 @@ static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved )
     if (status == STATUS_SUCCESS)
     {
         WINE_MODREF *prev = current_modref;
+        enum load_phase prev_phase = set_load_phase( LOAD_PHASE_ATTACH );
         current_modref = wm;
 
         call_ldr_notifications( LDR_DLL_NOTIFICATION_REASON_LOADED, &wm->ldr );
@@ -1324,6 +1536,7 @@ static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved )
             WARN("Initialization of %s failed\n", debugstr_w(wm->ldr.BaseDllName.Buffer));
         }
         current_modref = prev;
+        set_load_phase( prev_phase );
     }
 
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
@@ -1632,19 +1845,15 @@ NTSTATUS WINAPI LdrGetProcedureAddress(HMODULE module, const ANSI_STRING *name,
 /***********************************************************************
  *           is_fake_dll
  *
- * Check if a loaded native dll is a Wine fake dll.
+ * Check if a dll file is a Wine fake dll.
  */
-static BOOL is_fake_dll( HANDLE handle )
+static BOOL is_fake_dll( int fd )
 {
     static const char fakedll_signature[] = "Wine placeholder DLL";
     char buffer[sizeof(IMAGE_DOS_HEADER) + sizeof(fakedll_signature)];
     const IMAGE_DOS_HEADER *dos = (const IMAGE_DOS_HEADER *)buffer;
-    IO_STATUS_BLOCK io;
-    LARGE_INTEGER offset;
 
-    offset.QuadPart = 0;
-    if (NtReadFile( handle, 0, NULL, 0, &io, buffer, sizeof(buffer), &offset, NULL )) return FALSE;
-    if (io.Information < sizeof(buffer)) return FALSE;
+    if (pread( fd, buffer, sizeof(buffer), 0 ) != sizeof(buffer)) return FALSE;
     if (dos->e_magic != IMAGE_DOS_SIGNATURE) return FALSE;
     if (dos->e_lfanew >= sizeof(*dos) + sizeof(fakedll_signature) &&
         !memcmp( dos + 1, fakedll_signature, sizeof(fakedll_signature) )) return TRUE;
@@ -2029,7 +2238,11 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
     /* perform base relocation, if necessary */
 
     if (status == STATUS_IMAGE_NOT_AT_BASE)
+    {
+        enum load_phase prev_phase = set_load_phase( LOAD_PHASE_RELOC );
         status = perform_relocations( module, len );
+        set_load_phase( prev_phase );
+    }
 
     if (status != STATUS_SUCCESS)
     {
@@ -2352,14 +2565,21 @@ static HANDLE open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm, struct
     if (!server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL ))
     {
         fstat( fd, st );
-        if (needs_close) close( fd );
         if ((*pwm = find_fileid_module( handle, st )))
         {
             TRACE( "%s is the same file as existing module %p %s\n", debugstr_w( nt_name->Buffer ),
                    (*pwm)->ldr.BaseAddress, debugstr_w( (*pwm)->ldr.FullDllName.Buffer ));
             NtClose( handle );
-            return 0;
+            handle = 0;
+        }
+        else if (is_fake_dll( fd ))
+        {
+            /* check this while we have the fd, the builtin will be loaded without the file */
+            TRACE( "%s is a fake Wine dll\n", debugstr_w( nt_name->Buffer ));
+            NtClose( handle );
+            handle = 0;
         }
+        if (needs_close) close( fd );
     }
     return handle;
 }
@@ -2488,20 +2708,31 @@ static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_
     struct stat st;
     HANDLE handle;
     NTSTATUS nts;
+    enum load_phase prev_phase;
 
     TRACE( "looking for %s in %s\n", debugstr_w(libname), debugstr_w(load_path) );
 
     *pwm = NULL;
     filename = buffer;
     size = sizeof(buffer);
+    prev_phase = set_load_phase( LOAD_PHASE_SEARCH );
     for (;;)
     {
         nts = find_dll_file( load_path, libname, filename, &size, pwm, &handle, &st );
         if (nts == STATUS_SUCCESS) break;
         if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
-        if (nts != STATUS_BUFFER_TOO_SMALL) return nts;
+        if (nts != STATUS_BUFFER_TOO_SMALL) break;
         /* grow the buffer and retry */
-        if (!(filename = RtlAllocateHeap( GetProcessHeap(), 0, size ))) return STATUS_NO_MEMORY;
+        if (!(filename = RtlAllocateHeap( GetProcessHeap(), 0, size )))
+        {
+            nts = STATUS_NO_MEMORY;
+            break;
+        }
+    }
+    if (nts)
+    {
+        set_load_phase( prev_phase );
+        return nts;
     }
 
     if (*pwm)  /* found already loaded module */
@@ -2512,19 +2743,14 @@ static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_
               debugstr_w((*pwm)->ldr.FullDllName.Buffer), debugstr_w(libname),
               (*pwm)->ldr.BaseAddress, (*pwm)->ldr.LoadCount);
         if (filename != buffer) RtlFreeHeap( GetProcessHeap(), 0, filename );
+        set_load_phase( prev_phase );
         return STATUS_SUCCESS;
     }
 
     main_exe = get_modref( NtCurrentTeb()->Peb->ImageBaseAddress );
     loadorder = get_load_order( main_exe ? main_exe->ldr.BaseDllName.Buffer : NULL, filename );
 
-    if (handle && is_fake_dll( handle ))
-    {
-        TRACE( "%s is a fake Wine dll\n", debugstr_w(filename) );
-        NtClose( handle );
-        handle = 0;
-    }
-
+    set_load_phase( LOAD_PHASE_MAP );
     switch(loadorder)
     {
     case LO_INVALID:
@@ -2566,9 +2792,11 @@ static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_
             nts = load_native_dll( load_path, filename, handle, flags, pwm, &st );
         break;
     }
+    set_load_phase( prev_phase );
 
     if (nts == STATUS_SUCCESS)
     {
+        load_dll_count++;
         /* Initialize DLL just loaded */
         TRACE("Loaded module %s (%s) at %p\n", debugstr_w(filename),
               ((*pwm)->ldr.Flags & LDR_WINE_INTERNAL) ? "builtin" : "native",
@@ -3108,7 +3336,10 @@ static void free_modref( WINE_MODREF *wm )
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->forwards );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
+    forwards_generation++;
 }
 
 /***********************************************************************
@@ -3306,6 +3537,7 @@ NTSTATUS attach_dlls( CONTEXT *context, void **entry )
         }
         attach_implicitly_loaded_dlls( context );
         virtual_release_address_space();
+        report_load_phases();
     }
     else
     {
@@ -3570,7 +3802,10 @@ void __wine_process_init(void)
     /* setup the load callback and create ntdll modref */
     wine_dll_set_callback( load_builtin_callback );
 
-    if ((status = load_builtin_dll( NULL, kernel32W, 0, 0, &wm )) != STATUS_SUCCESS)
+    set_load_phase( LOAD_PHASE_MAP );
+    status = load_builtin_dll( NULL, kernel32W, 0, 0, &wm );
+    set_load_phase( LOAD_PHASE_OTHER );
+    if (status != STATUS_SUCCESS)
     {
         MESSAGE( "wine: could not load kernel32.dll, status %x\n", status );
         exit(1);
@@ -46,6 +46,7 @@ struct drive_info
 };
 
 extern NTSTATUS close_handle( HANDLE ) DECLSPEC_HIDDEN;
+extern NTSTATUS close_handles( const HANDLE *handles, ULONG count ) DECLSPEC_HIDDEN;
 extern ULONG_PTR get_system_affinity_mask(void) DECLSPEC_HIDDEN;
 
 /* exceptions */
@@ -98,6 +99,16 @@ extern unsigned int server_select( const select_op_t *select_op, data_size_t siz
                                    UINT flags, const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
 extern unsigned int server_queue_process_apc( HANDLE process, const apc_call_t *call, apc_result_t *result ) DECLSPEC_HIDDEN;
 extern int server_remove_fd_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void *server_get_fast_sync_shm(void) DECLSPEC_HIDDEN;
+extern const unsigned int *server_get_handle_generations(void) DECLSPEC_HIDDEN;
+extern unsigned int get_handle_generation( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void fast_sync_remove_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void local_completion_close( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void local_completion_to_server( HANDLE handle ) DECLSPEC_HIDDEN;
+extern BOOL local_completion_is_port( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void local_completion_thread_blocked( BOOL blocked ) DECLSPEC_HIDDEN;
+extern void local_completion_release_thread(void) DECLSPEC_HIDDEN;
+extern void keyed_futex_release_thread( BOOL aborted ) DECLSPEC_HIDDEN;
 extern int server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
@@ -170,6 +181,7 @@ extern NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG zero_
                                      const LARGE_INTEGER *offset_ptr, SIZE_T *size_ptr, ULONG protect,
                                      pe_image_info_t *image_info ) DECLSPEC_HIDDEN;
 extern void virtual_get_system_info( SYSTEM_BASIC_INFORMATION *info ) DECLSPEC_HIDDEN;
+extern SIZE_T virtual_get_large_page_size(void) DECLSPEC_HIDDEN;
 extern NTSTATUS virtual_create_builtin_view( void *base ) DECLSPEC_HIDDEN;
 extern NTSTATUS virtual_alloc_thread_stack( TEB *teb, SIZE_T reserve_size,
                                             SIZE_T commit_size, SIZE_T *pthread_size ) DECLSPEC_HIDDEN;
@@ -193,7 +205,7 @@ extern struct _KUSER_SHARED_DATA *user_shared_data DECLSPEC_HIDDEN;
 
 /* completion */
 extern NTSTATUS NTDLL_AddCompletion( HANDLE hFile, ULONG_PTR CompletionValue,
-                                     NTSTATUS CompletionStatus, ULONG Information ) DECLSPEC_HIDDEN;
+                                     NTSTATUS CompletionStatus, ULONG Information, BOOL async ) DECLSPEC_HIDDEN;
 
 /* code pages */
 extern int ntdll_umbstowcs(DWORD flags, const char* src, int srclen, WCHAR* dst, int dstlen) DECLSPEC_HIDDEN;
@@ -236,6 +248,8 @@ struct ntdll_thread_data
     int                wait_fd[2];    /* fd for sleeping server requests */
     BOOL               wow64_redir;   /* Wow64 filesystem redirection flag */
     pthread_t          pthread_id;    /* pthread thread id */
+    void              *completion_port; /* local completion port the thread got its last packet from */
+    void              *keyed_entry;   /* entry for in-process keyed event waits */
 };
 
 C_ASSERT( sizeof(struct ntdll_thread_data) <= sizeof(((TEB *)0)->GdiTebBatch) );
@@ -20,6 +20,7 @@
  */
 
 #include "config.h"
+#include "wine/port.h"
 
 #include <stdarg.h>
 #include <stdlib.h>
@@ -30,6 +31,9 @@
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -38,11 +42,206 @@
 #include "winternl.h"
 #include "ntdll_misc.h"
 #include "wine/server.h"
+#include "wine/library.h"
 #include "wine/exception.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(ntdll);
 
 
+/*
+ *	Handle attribute cache
+ *
+ * The flags and the object type of a handle are cached on first use to
+ * spare a server round trip on later queries. The server keeps a counter
+ * for every handle in memory shared with us, which changes whenever the
+ * handle is closed or allocated again, also from another process. The
+ * entries store the counter value the server returned with the data, so
+ * that they stop being used as soon as the handle has been closed.
+ */
+
+union handle_cache_entry
+{
+    LONG64 data;
+    struct
+    {
+        unsigned int generation;        /* generation of the handle the data belongs to */
+        unsigned int type : 8;          /* index + 1 in type_names, 0 if not cached */
+        unsigned int flags : 2;         /* HANDLE_FLAG_* flags */
+        unsigned int flags_cached : 1;  /* flags are valid */
+    } s;
+};
+
+C_ASSERT( sizeof(union handle_cache_entry) == sizeof(LONG64) );
+
+#define HANDLE_CACHE_BLOCK_SIZE  (65536 / sizeof(union handle_cache_entry))
+#define HANDLE_CACHE_ENTRIES     (MAX_HANDLE_GENERATIONS / HANDLE_CACHE_BLOCK_SIZE)
+#define MAX_TYPE_NAMES           64
+
+static union handle_cache_entry *handle_cache[HANDLE_CACHE_ENTRIES];
+static const volatile unsigned int *handle_generations;
+static BOOL handle_generations_mapped;
+static UNICODE_STRING type_names[MAX_TYPE_NAMES];
+static unsigned int type_names_count;
+
+static RTL_CRITICAL_SECTION handle_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG handle_cache_section_debug =
+{
+    0, 0, &handle_cache_section,
+    { &handle_cache_section_debug.ProcessLocksList, &handle_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": handle_cache_section") }
+};
+static RTL_CRITICAL_SECTION handle_cache_section = { &handle_cache_section_debug, -1, 0, 0, 0, 0 };
+
+static inline LONG64 interlocked_xchg64( LONG64 *dest, LONG64 val )
+{
+#ifdef _WIN64
+    return (LONG64)interlocked_xchg_ptr( (void **)dest, (void *)val );
+#else
+    LONG64 old;
+    do old = *dest; while (interlocked_cmpxchg64( dest, val, old ) != old);
+    return old;
+#endif
+}
+
+/* return the index of a handle in the cache, or -1 if it can't be cached */
+static inline int handle_cache_index( HANDLE handle )
+{
+    unsigned int idx;
+
+    /* pseudo-handles and console handles are never cached */
+    if ((LONG_PTR)handle <= 0 || ((ULONG_PTR)handle & 3)) return -1;
+    idx = (wine_server_obj_handle( handle ) >> 2) - 1;
+    return idx < MAX_HANDLE_GENERATIONS ? idx : -1;
+}
+
+/* map the generation counters on first use */
+static void map_handle_generations(void)
+{
+    if (!handle_generations_mapped)
+    {
+        handle_generations = server_get_handle_generations();
+        handle_generations_mapped = TRUE;
+    }
+}
+
+/***********************************************************************
+ *           get_handle_generation
+ *
+ * Return the generation of a handle, which changes whenever the handle is
+ * closed or allocated again, also from another process. Returns 0 if it
+ * can't be tracked.
+ */
+unsigned int get_handle_generation( HANDLE handle )
+{
+    int idx = handle_cache_index( handle );
+
+    if (idx == -1) return 0;
+    if (!handle_generations_mapped)
+    {
+        RtlEnterCriticalSection( &handle_cache_section );
+        map_handle_generations();
+        RtlLeaveCriticalSection( &handle_cache_section );
+    }
+    return handle_generations ? handle_generations[idx] : 0;
+}
+
+/* retrieve the cache entry of a handle; when allocating, this must be done
+ * before asking the server for the data to cache */
+static union handle_cache_entry *get_handle_cache_entry( HANDLE handle, BOOL alloc )
+{
+    int idx = handle_cache_index( handle );
+    unsigned int entry;
+
+    if (idx == -1) return NULL;
+    entry = idx / HANDLE_CACHE_BLOCK_SIZE;
+    idx %= HANDLE_CACHE_BLOCK_SIZE;
+
+    if ((!handle_generations_mapped || !handle_cache[entry]) && alloc)
+    {
+        RtlEnterCriticalSection( &handle_cache_section );
+        map_handle_generations();
+        if (handle_generations && !handle_cache[entry])
+        {
+            void *ptr = wine_anon_mmap( NULL, HANDLE_CACHE_BLOCK_SIZE * sizeof(union handle_cache_entry),
+                                        PROT_READ | PROT_WRITE, 0 );
+            if (ptr != MAP_FAILED) handle_cache[entry] = ptr;
+        }
+        RtlLeaveCriticalSection( &handle_cache_section );
+    }
+    return handle_cache[entry] ? &handle_cache[entry][idx] : NULL;
+}
+
+/* retrieve the cached data of a handle, if it still belongs to the same handle */
+static inline union handle_cache_entry get_handle_cache( HANDLE handle )
+{
+    union handle_cache_entry *entry = get_handle_cache_entry( handle, FALSE );
+    union handle_cache_entry cache;
+
+    cache.data = entry ? interlocked_cmpxchg64( &entry->data, 0, 0 ) : 0;
+    if (cache.data && cache.s.generation != handle_generations[handle_cache_index( handle )]) cache.data = 0;
+    return cache;
+}
+
+/* update a cache entry with data the server returned for the given generation */
+static inline union handle_cache_entry update_handle_cache( union handle_cache_entry *entry, unsigned int generation )
+{
+    union handle_cache_entry cache;
+
+    cache.data = interlocked_cmpxchg64( &entry->data, 0, 0 );
+    if (cache.s.generation != generation)
+    {
+        cache.data = 0;
+        cache.s.generation = generation;
+    }
+    return cache;
+}
+
+/* update the flags of a cached handle */
+static void cache_handle_flags( union handle_cache_entry *entry, unsigned int generation, unsigned int flags )
+{
+    union handle_cache_entry cache = update_handle_cache( entry, generation );
+
+    cache.s.flags = flags;
+    cache.s.flags_cached = 1;
+    interlocked_xchg64( &entry->data, cache.data );
+}
+
+/* update the type of a cached handle */
+static void cache_handle_type( union handle_cache_entry *entry, unsigned int generation,
+                               const WCHAR *name, ULONG len )
+{
+    union handle_cache_entry cache;
+    unsigned int i;
+
+    RtlEnterCriticalSection( &handle_cache_section );
+    for (i = 0; i < type_names_count; i++)
+        if (type_names[i].Length == len && !memcmp( type_names[i].Buffer, name, len )) break;
+    if (i == type_names_count && i < MAX_TYPE_NAMES)
+    {
+        if ((type_names[i].Buffer = RtlAllocateHeap( GetProcessHeap(), 0, len )))
+        {
+            memcpy( type_names[i].Buffer, name, len );
+            type_names[i].Length = type_names[i].MaximumLength = len;
+            type_names_count++;
+        }
+    }
+    RtlLeaveCriticalSection( &handle_cache_section );
+    if (i == type_names_count) return;
+
+    cache = update_handle_cache( entry, generation );
+    cache.s.type = i + 1;
+    interlocked_xchg64( &entry->data, cache.data );
+}
+
+/* forget about a handle that is being closed */
+static void remove_handle_from_cache( HANDLE handle )
+{
+    union handle_cache_entry *entry = get_handle_cache_entry( handle, FALSE );
+
+    if (entry) interlocked_xchg64( &entry->data, 0 );
+}
+
+
 /*
  *	Generic object functions
  */
@@ -154,7 +353,23 @@ NTSTATUS WINAPI NtQueryObject(IN HANDLE handle,
     case ObjectTypeInformation:
         {
             OBJECT_TYPE_INFORMATION *p = ptr;
+            union handle_cache_entry cache = get_handle_cache( handle ), *entry;
 
+            if (cache.s.type)
+            {
+                const UNICODE_STRING *name = &type_names[cache.s.type - 1];
+
+                if (used_len) *used_len = sizeof(*p) + name->Length + sizeof(WCHAR);
+                if (sizeof(*p) + name->Length + sizeof(WCHAR) > len) return STATUS_INFO_LENGTH_MISMATCH;
+                p->TypeName.Buffer = (WCHAR *)(p + 1);
+                p->TypeName.Length = name->Length;
+                p->TypeName.MaximumLength = name->Length + sizeof(WCHAR);
+                memcpy( p->TypeName.Buffer, name->Buffer, name->Length );
+                p->TypeName.Buffer[name->Length / sizeof(WCHAR)] = 0;
+                return STATUS_SUCCESS;
+            }
+
+            entry = get_handle_cache_entry( handle, TRUE );
             SERVER_START_REQ( get_object_type )
             {
                 req->handle = wine_server_obj_handle( handle );
@@ -181,6 +396,8 @@ NTSTATUS WINAPI NtQueryObject(IN HANDLE handle,
                         p->TypeName.MaximumLength = res + sizeof(WCHAR);
                         p->TypeName.Buffer[res / sizeof(WCHAR)] = 0;
                         if (used_len) *used_len = sizeof(*p) + p->TypeName.MaximumLength;
+                        if (entry && res == reply->total)
+                            cache_handle_type( entry, reply->generation, p->TypeName.Buffer, res );
                     }
                 }
             }
@@ -190,9 +407,20 @@ NTSTATUS WINAPI NtQueryObject(IN HANDLE handle,
     case ObjectDataInformation:
         {
             OBJECT_DATA_INFORMATION* p = ptr;
+            union handle_cache_entry cache, *entry;
 
             if (len < sizeof(*p)) return STATUS_INVALID_BUFFER_SIZE;
 
+            cache = get_handle_cache( handle );
+            if (cache.s.flags_cached)
+            {
+                p->InheritHandle = (cache.s.flags & HANDLE_FLAG_INHERIT) != 0;
+                p->ProtectFromClose = (cache.s.flags & HANDLE_FLAG_PROTECT_FROM_CLOSE) != 0;
+                if (used_len) *used_len = sizeof(*p);
+                return STATUS_SUCCESS;
+            }
+
+            entry = get_handle_cache_entry( handle, TRUE );
             SERVER_START_REQ( set_handle_info )
             {
                 req->handle = wine_server_obj_handle( handle );
@@ -204,6 +432,7 @@ NTSTATUS WINAPI NtQueryObject(IN HANDLE handle,
                     p->InheritHandle = (reply->old_flags & HANDLE_FLAG_INHERIT) != 0;
                     p->ProtectFromClose = (reply->old_flags & HANDLE_FLAG_PROTECT_FROM_CLOSE) != 0;
                     if (used_len) *used_len = sizeof(*p);
+                    if (entry) cache_handle_flags( entry, reply->generation, reply->old_flags );
                 }
             }
             SERVER_END_REQ;
@@ -235,9 +464,11 @@ NTSTATUS WINAPI NtSetInformationObject(IN HANDLE handle,
     case ObjectDataInformation:
         {
             OBJECT_DATA_INFORMATION* p = ptr;
+            union handle_cache_entry *entry;
 
             if (len < sizeof(*p)) return STATUS_INVALID_BUFFER_SIZE;
 
+            entry = get_handle_cache_entry( handle, TRUE );
             SERVER_START_REQ( set_handle_info )
             {
                 req->handle = wine_server_obj_handle( handle );
@@ -245,7 +476,8 @@ NTSTATUS WINAPI NtSetInformationObject(IN HANDLE handle,
                 req->mask   = HANDLE_FLAG_INHERIT | HANDLE_FLAG_PROTECT_FROM_CLOSE;
                 if (p->InheritHandle)    req->flags |= HANDLE_FLAG_INHERIT;
                 if (p->ProtectFromClose) req->flags |= HANDLE_FLAG_PROTECT_FROM_CLOSE;
-                status = wine_server_call( req );
+                if (!(status = wine_server_call( req )) && entry)
+                    cache_handle_flags( entry, reply->generation, req->flags );
             }
             SERVER_END_REQ;
         }
@@ -355,6 +587,11 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source,
                                    ACCESS_MASK access, ULONG attributes, ULONG options )
 {
     NTSTATUS ret;
+
+    /* packets posted through the new handle have to end up in the same queue */
+    if (source_process == NtCurrentProcess() && local_completion_is_port( source ))
+        local_completion_to_server( source );
+
     SERVER_START_REQ( dup_handle )
     {
         req->src_process = wine_server_obj_handle( source_process );
@@ -371,6 +608,9 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source,
             {
                 int fd = server_remove_fd_from_cache( source );
                 if (fd != -1) close( fd );
+                fast_sync_remove_from_cache( source );
+                local_completion_close( source );
+                remove_handle_from_cache( source );
             }
         }
     }
@@ -384,12 +624,38 @@ static LONG WINAPI invalid_handle_exception_handler( EXCEPTION_POINTERS *eptr )
     return (rec->ExceptionCode == EXCEPTION_INVALID_HANDLE) ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH;
 }
 
+/* raise an exception for an invalid handle if a debugger is attached */
+static void check_invalid_handle( HANDLE handle, NTSTATUS status )
+{
+    if (status == STATUS_INVALID_HANDLE && handle && NtCurrentTeb()->Peb->BeingDebugged)
+    {
+        __TRY
+        {
+            EXCEPTION_RECORD record;
+            record.ExceptionCode    = EXCEPTION_INVALID_HANDLE;
+            record.ExceptionFlags   = 0;
+            record.ExceptionRecord  = NULL;
+            record.ExceptionAddress = NULL;
+            record.NumberParameters = 0;
+            RtlRaiseException( &record );
+        }
+        __EXCEPT(invalid_handle_exception_handler)
+        {
+        }
+        __ENDTRY
+    }
+}
+
 /* Everquest 2 / Pirates of the Burning Sea hooks NtClose, so we need a wrapper */
 NTSTATUS close_handle( HANDLE handle )
 {
     NTSTATUS ret;
     int fd = server_remove_fd_from_cache( handle );
 
+    fast_sync_remove_from_cache( handle );
+    local_completion_close( handle );
+    remove_handle_from_cache( handle );
+
     SERVER_START_REQ( close_handle )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -398,24 +664,53 @@ NTSTATUS close_handle( HANDLE handle )
     SERVER_END_REQ;
     if (fd != -1) close( fd );
 
-    if (ret == STATUS_INVALID_HANDLE && handle && NtCurrentTeb()->Peb->BeingDebugged)
+    check_invalid_handle( handle, ret );
+    return ret;
+}
+
+/***********************************************************************
+ *           close_handles
+ *
+ * Close several handles with a single server call. Null handles are
+ * skipped. Returns the first failure, if any.
+ */
+NTSTATUS close_handles( const HANDLE *handles, ULONG count )
+{
+    obj_handle_t server_handles[64];
+    unsigned int statuses[64];
+    int fds[64];
+    NTSTATUS ret = STATUS_SUCCESS;
+    ULONG i, n, done = 0;
+
+    while (done < count)
     {
-        __TRY
+        for (n = 0; done < count && n < ARRAY_SIZE(server_handles); done++)
         {
-            EXCEPTION_RECORD record;
-            record.ExceptionCode    = EXCEPTION_INVALID_HANDLE;
-            record.ExceptionFlags   = 0;
-            record.ExceptionRecord  = NULL;
-            record.ExceptionAddress = NULL;
-            record.NumberParameters = 0;
-            RtlRaiseException( &record );
+            if (!handles[done]) continue;
+            fds[n] = server_remove_fd_from_cache( handles[done] );
+            fast_sync_remove_from_cache( handles[done] );
+            local_completion_close( handles[done] );
+            remove_handle_from_cache( handles[done] );
+            server_handles[n++] = wine_server_obj_handle( handles[done] );
         }
-        __EXCEPT(invalid_handle_exception_handler)
+        if (!n) break;
+
+        SERVER_START_REQ( close_handles )
         {
+            wine_server_add_data( req, server_handles, n * sizeof(server_handles[0]) );
+            wine_server_set_reply( req, statuses, n * sizeof(statuses[0]) );
+            if (wine_server_call( req ))
+                for (i = 0; i < n; i++) statuses[i] = STATUS_NO_MEMORY;
         }
-        __ENDTRY
-    }
+        SERVER_END_REQ;
 
+        for (i = 0; i < n; i++)
+        {
+            if (fds[i] != -1) close( fds[i] );
+            check_invalid_handle( wine_server_ptr_handle( server_handles[i] ), statuses[i] );
+            if (statuses[i] && !ret) ret = statuses[i];
+        }
+    }
     return ret;
 }
 
@@ -615,7 +615,12 @@ unsigned int server_select( const select_op_t *select_op, data_size_t size, UINT
             call        = reply->call;
         }
         SERVER_END_REQ;
-        if (ret == STATUS_PENDING) ret = wait_select_reply( &cookie );
+        if (ret == STATUS_PENDING)
+        {
+            local_completion_thread_blocked( TRUE );
+            ret = wait_select_reply( &cookie );
+            local_completion_thread_blocked( FALSE );
+        }
         if (ret != STATUS_USER_APC) break;
         if (invoke_apc( &call, &result ))
         {
@@ -981,6 +986,66 @@ done:
 }
 
 
+/***********************************************************************
+ *           server_get_fast_sync_shm
+ *
+ * Map the shared state of the fast synchronization objects.
+ * Returns NULL if the server doesn't support them.
+ */
+void *server_get_fast_sync_shm(void)
+{
+    sigset_t sigset;
+    obj_handle_t fd_handle;
+    void *ptr = NULL;
+    int fd;
+
+    /* the fd_cache_section makes sure we receive the right fd */
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    SERVER_START_REQ( get_fast_sync_shm )
+    {
+        if (!wine_server_call( req ) && (fd = receive_fd( &fd_handle )) != -1)
+        {
+            ptr = mmap( NULL, reply->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+            if (ptr == MAP_FAILED) ptr = NULL;
+            close( fd );
+        }
+    }
+    SERVER_END_REQ;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+    return ptr;
+}
+
+
+/***********************************************************************
+ *           server_get_handle_generations
+ *
+ * Map the generation counters of the handles of the current process.
+ * Returns NULL if the server doesn't support them.
+ */
+const unsigned int *server_get_handle_generations(void)
+{
+    sigset_t sigset;
+    obj_handle_t fd_handle;
+    void *ptr = NULL;
+    int fd;
+
+    /* the fd_cache_section makes sure we receive the right fd */
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    SERVER_START_REQ( get_handle_generations )
+    {
+        if (!wine_server_call( req ) && (fd = receive_fd( &fd_handle )) != -1)
+        {
+            ptr = mmap( NULL, reply->size, PROT_READ, MAP_SHARED, fd, 0 );
+            if (ptr == MAP_FAILED) ptr = NULL;
+            close( fd );
+        }
+    }
+    SERVER_END_REQ;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+    return ptr;
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle   (NTDLL.@)
  *
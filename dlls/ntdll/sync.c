@@ -26,7 +26,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
@@ -36,6 +40,9 @@
 #ifdef HAVE_SYS_POLL_H
 # include <sys/poll.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
@@ -54,7 +61,9 @@
 #include "windef.h"
 #include "winternl.h"
 #include "wine/server.h"
+#include "wine/library.h"
 #include "wine/debug.h"
+#include "wine/list.h"
 #include "ntdll_misc.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(ntdll);
@@ -170,6 +179,307 @@ NTSTATUS validate_open_object_attributes( const OBJECT_ATTRIBUTES *attr )
     return STATUS_SUCCESS;
 }
 
+
+/*
+ *	Fast synchronization objects
+ *
+ * When the server is started with WINEFASTSYNC set, events and semaphores
+ * keep their state in shared memory and can be signaled and waited upon
+ * without a server round trip, as long as no thread is waiting on them
+ * through the server (see server/fast_sync.c).
+ * The server answers for a handle are cached along with the handle
+ * generation, so that they are dropped once the handle has been closed,
+ * also by another process.
+ */
+
+#ifdef __linux__
+
+union fast_sync_cache_entry
+{
+    LONG64 data;
+    struct
+    {
+        unsigned int generation;       /* generation of the handle the data belongs to */
+        unsigned int index : 16;
+        unsigned int type : 7;
+        unsigned int cached : 1;
+        unsigned int access : 8;       /* specific rights and SYNCHRONIZE, see fast_sync_access */
+    } s;
+};
+
+C_ASSERT( sizeof(union fast_sync_cache_entry) == sizeof(LONG64) );
+C_ASSERT( FAST_SYNC_MAX_SLOTS <= 0x10000 );
+
+/* pack the access rights we check into the cache entry */
+static inline unsigned int fast_sync_access( ACCESS_MASK access )
+{
+    return (access & 0x7f) | ((access & SYNCHRONIZE) ? 0x80 : 0);
+}
+
+#define FAST_SYNC_CACHE_BLOCK_SIZE  (65536 / sizeof(union fast_sync_cache_entry))
+#define FAST_SYNC_CACHE_ENTRIES     128
+
+static union fast_sync_cache_entry *fast_sync_cache[FAST_SYNC_CACHE_ENTRIES];
+static struct fast_sync_slot *fast_sync_slots;
+static int fast_sync_enabled = -1;
+
+static RTL_CRITICAL_SECTION fast_sync_section;
+static RTL_CRITICAL_SECTION_DEBUG fast_sync_section_debug =
+{
+    0, 0, &fast_sync_section,
+    { &fast_sync_section_debug.ProcessLocksList, &fast_sync_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": fast_sync_section") }
+};
+static RTL_CRITICAL_SECTION fast_sync_section = { &fast_sync_section_debug, -1, 0, 0, 0, 0 };
+
+/* atomically exchange a 64-bit value */
+static inline LONG64 interlocked_xchg64( LONG64 *dest, LONG64 val )
+{
+#ifdef _WIN64
+    return (LONG64)interlocked_xchg_ptr( (void **)dest, (void *)val );
+#else
+    LONG64 tmp = *dest;
+    while (interlocked_cmpxchg64( dest, val, tmp ) != tmp) tmp = *dest;
+    return tmp;
+#endif
+}
+
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 0 /* FUTEX_WAIT */, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake( int *addr, int val )
+{
+    return syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, val, NULL, 0, 0 );
+}
+
+static inline unsigned int fast_sync_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / FAST_SYNC_CACHE_BLOCK_SIZE;
+    return idx % FAST_SYNC_CACHE_BLOCK_SIZE;
+}
+
+/* store the server answer for a handle; caller must hold fast_sync_section */
+static void add_fast_sync_to_cache( HANDLE handle, unsigned int generation, unsigned int index,
+                                    enum fast_sync_type type, unsigned int access )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+    union fast_sync_cache_entry cache;
+
+    if (entry >= FAST_SYNC_CACHE_ENTRIES) return;
+
+    if (!fast_sync_cache[entry])  /* do we need to allocate a new block of entries? */
+    {
+        void *ptr = wine_anon_mmap( NULL, FAST_SYNC_CACHE_BLOCK_SIZE * sizeof(union fast_sync_cache_entry),
+                                    PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return;
+        fast_sync_cache[entry] = ptr;
+    }
+
+    cache.s.generation = generation;
+    cache.s.index      = index;
+    cache.s.type       = type;
+    cache.s.cached     = 1;
+    cache.s.access     = fast_sync_access( access );
+    interlocked_xchg64( &fast_sync_cache[entry][idx].data, cache.data );
+}
+
+/***********************************************************************
+ *           fast_sync_remove_from_cache
+ *
+ * Forget about a handle that is being closed.
+ */
+void fast_sync_remove_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = fast_sync_handle_to_index( handle, &entry );
+
+    if (entry < FAST_SYNC_CACHE_ENTRIES && fast_sync_cache[entry])
+        interlocked_xchg64( &fast_sync_cache[entry][idx].data, 0 );
+}
+
+/***********************************************************************
+ *           get_fast_sync_slot
+ *
+ * Retrieve the shared state of an object of the given type (or any type
+ * for FAST_SYNC_NONE), provided the handle grants the wanted access.
+ */
+static struct fast_sync_slot *get_fast_sync_slot( HANDLE handle, enum fast_sync_type type,
+                                                  ACCESS_MASK access )
+{
+    unsigned int entry, idx, generation;
+    union fast_sync_cache_entry cache;
+
+    if (!fast_sync_enabled) return NULL;
+    /* pseudo-handles and console handles are never fast objects */
+    if ((LONG_PTR)handle <= 0 || ((ULONG_PTR)handle & 3)) return NULL;
+
+    idx = fast_sync_handle_to_index( handle, &entry );
+    if (entry >= FAST_SYNC_CACHE_ENTRIES) return NULL;
+    /* fetched before asking the server, so a concurrent close can only make the entry look stale */
+    if (!(generation = get_handle_generation( handle ))) return NULL;
+
+    cache.data = fast_sync_cache[entry] ? interlocked_cmpxchg64( &fast_sync_cache[entry][idx].data, 0, 0 ) : 0;
+    if (cache.s.generation != generation) cache.data = 0;
+    if (!cache.s.cached)
+    {
+        RtlEnterCriticalSection( &fast_sync_section );
+        if (fast_sync_enabled == -1)
+        {
+            fast_sync_slots = server_get_fast_sync_shm();
+            fast_sync_enabled = (fast_sync_slots != NULL);
+        }
+        if (fast_sync_enabled)
+        {
+            SERVER_START_REQ( get_fast_sync_obj )
+            {
+                req->handle = wine_server_obj_handle( handle );
+                if (!wine_server_call( req ))
+                {
+                    cache.s.index  = reply->index;
+                    cache.s.type   = reply->type;
+                    cache.s.access = fast_sync_access( reply->access );
+                    add_fast_sync_to_cache( handle, generation, reply->index, reply->type, reply->access );
+                }
+                else cache.s.type = FAST_SYNC_NONE;
+            }
+            SERVER_END_REQ;
+        }
+        else cache.s.type = FAST_SYNC_NONE;
+        RtlLeaveCriticalSection( &fast_sync_section );
+    }
+
+    if (cache.s.type == FAST_SYNC_NONE) return NULL;
+    if (type != FAST_SYNC_NONE && cache.s.type != type) return NULL;
+    if ((cache.s.access & fast_sync_access( access )) != fast_sync_access( access )) return NULL;
+    return &fast_sync_slots[cache.s.index];
+}
+
+/* wait on a fast object; returns STATUS_NOT_IMPLEMENTED if the server has to do it */
+static NTSTATUS fast_sync_wait( struct fast_sync_slot *slot, timeout_t when )
+{
+    LARGE_INTEGER now;
+    struct timespec timespec;
+    int ret, val, new_val, pulses = -1;
+
+    for (;;)
+    {
+        val = *(volatile int *)&slot->state;
+        if (slot->type == FAST_SYNC_EVENT)
+        {
+            /* a pulse only sets the event for an instant, check if one happened while we slept */
+            if (pulses == -1) pulses = val & FAST_SYNC_EVENT_PULSES;
+            else if ((val & FAST_SYNC_EVENT_PULSES) != pulses)
+            {
+                if (slot->max) return STATUS_WAIT_0;
+                if (!(val & FAST_SYNC_EVENT_PULSED))
+                {
+                    pulses = val & FAST_SYNC_EVENT_PULSES;  /* another waiter got it */
+                    continue;
+                }
+                if (interlocked_cmpxchg( &slot->state, val & ~FAST_SYNC_EVENT_PULSED, val ) == val)
+                    return STATUS_WAIT_0;
+                continue;
+            }
+        }
+        if (val & FAST_SYNC_SERVER_OWNED) return STATUS_NOT_IMPLEMENTED;
+        if (slot->type == FAST_SYNC_SEMAPHORE ? val : (val & 1))
+        {
+            if (slot->type == FAST_SYNC_SEMAPHORE) new_val = val - 1;
+            else new_val = slot->max ? val : val & ~1;  /* reset it if it's an auto-reset event */
+            if (new_val == val || interlocked_cmpxchg( &slot->state, new_val, val ) == val)
+                return STATUS_WAIT_0;
+            continue;
+        }
+        if (when == TIMEOUT_INFINITE)
+        {
+            local_completion_thread_blocked( TRUE );
+            ret = futex_wait( &slot->state, val, NULL );
+            local_completion_thread_blocked( FALSE );
+            /* let the server finish the wait after a signal, it may have APCs for us */
+            if (ret == -1 && errno == EINTR) return STATUS_NOT_IMPLEMENTED;
+            continue;
+        }
+        NtQuerySystemTime( &now );
+        if (when <= now.QuadPart) return STATUS_TIMEOUT;
+        timespec.tv_sec  = (when - now.QuadPart) / 10000000;
+        timespec.tv_nsec = (when - now.QuadPart) % 10000000 * 100;
+        local_completion_thread_blocked( TRUE );
+        ret = futex_wait( &slot->state, val, &timespec );
+        local_completion_thread_blocked( FALSE );
+        if (ret == -1)
+        {
+            if (errno == ETIMEDOUT) return STATUS_TIMEOUT;
+            if (errno == EINTR) return STATUS_NOT_IMPLEMENTED;
+        }
+        /* spurious wake-ups simply make us check the state again */
+    }
+}
+
+/* set or reset a fast event; returns STATUS_NOT_IMPLEMENTED if the server has to do it */
+static NTSTATUS fast_sync_set_event( struct fast_sync_slot *slot, int signaled )
+{
+    int val;
+
+    for (;;)
+    {
+        val = *(volatile int *)&slot->state;
+        if (val & FAST_SYNC_SERVER_OWNED) return STATUS_NOT_IMPLEMENTED;
+        if ((val & 1) == signaled) return STATUS_SUCCESS;
+        if (interlocked_cmpxchg( &slot->state, (val & ~1) | signaled, val ) == val) break;
+    }
+    /* wake up all waiters if manual reset, a single one otherwise */
+    if (signaled) futex_wake( &slot->state, slot->max ? INT_MAX : 1 );
+    return STATUS_SUCCESS;
+}
+
+/* release a fast semaphore; returns STATUS_NOT_IMPLEMENTED if the server has to do it */
+static NTSTATUS fast_sync_release_semaphore( struct fast_sync_slot *slot, ULONG count, ULONG *prev )
+{
+    int val;
+
+    for (;;)
+    {
+        val = *(volatile int *)&slot->state;
+        if (val & FAST_SYNC_SERVER_OWNED) return STATUS_NOT_IMPLEMENTED;
+        if (count > slot->max - val) return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+        if (interlocked_cmpxchg( &slot->state, val + count, val ) == val) break;
+    }
+    if (prev) *prev = val;
+    futex_wake( &slot->state, count );
+    return STATUS_SUCCESS;
+}
+
+#else  /* __linux__ */
+
+void fast_sync_remove_from_cache( HANDLE handle )
+{
+}
+
+static inline struct fast_sync_slot *get_fast_sync_slot( HANDLE handle, enum fast_sync_type type,
+                                                         ACCESS_MASK access )
+{
+    return NULL;
+}
+
+static inline NTSTATUS fast_sync_wait( struct fast_sync_slot *slot, timeout_t when )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static inline NTSTATUS fast_sync_set_event( struct fast_sync_slot *slot, int signaled )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static inline NTSTATUS fast_sync_release_semaphore( struct fast_sync_slot *slot, ULONG count, ULONG *prev )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif  /* __linux__ */
+
 /*
  *	Semaphores
  */
@@ -269,7 +579,13 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
  */
 NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous )
 {
+    struct fast_sync_slot *slot;
     NTSTATUS ret;
+
+    if ((slot = get_fast_sync_slot( handle, FAST_SYNC_SEMAPHORE, SEMAPHORE_MODIFY_STATE )) &&
+        (ret = fast_sync_release_semaphore( slot, count, previous )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -346,10 +662,15 @@ NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_AT
  */
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    struct fast_sync_slot *slot;
     NTSTATUS ret;
 
     /* FIXME: set NumberOfThreadsReleased */
 
+    if ((slot = get_fast_sync_slot( handle, FAST_SYNC_EVENT, EVENT_MODIFY_STATE )) &&
+        (ret = fast_sync_set_event( slot, 1 )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -365,11 +686,16 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
  */
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    struct fast_sync_slot *slot;
     NTSTATUS ret;
 
     /* resetting an event can't release any thread... */
     if (NumberOfThreadsReleased) *NumberOfThreadsReleased = 0;
 
+    if ((slot = get_fast_sync_slot( handle, FAST_SYNC_EVENT, EVENT_MODIFY_STATE )) &&
+        (ret = fast_sync_set_event( slot, 0 )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -746,6 +1072,8 @@ NTSTATUS WINAPI NtSetInformationJobObject( HANDLE handle, JOBOBJECTINFOCLASS cla
         if (len != sizeof(JOBOBJECT_ASSOCIATE_COMPLETION_PORT))
             return STATUS_INVALID_PARAMETER;
 
+        local_completion_to_server( ((JOBOBJECT_ASSOCIATE_COMPLETION_PORT *)info)->CompletionPort );
+
         SERVER_START_REQ( set_job_completion_port )
         {
             JOBOBJECT_ASSOCIATE_COMPLETION_PORT *port_info = info;
@@ -1026,9 +1354,28 @@ static NTSTATUS wait_objects( DWORD count, const HANDLE *handles,
 {
     select_op_t select_op;
     UINT i, flags = SELECT_INTERRUPTIBLE;
+    struct fast_sync_slot *slot;
+    LARGE_INTEGER abs_timeout;
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    /* alertable waits need the server to deliver the APCs */
+    if (count == 1 && !alertable && (slot = get_fast_sync_slot( handles[0], FAST_SYNC_NONE, SYNCHRONIZE )))
+    {
+        NTSTATUS ret;
+
+        abs_timeout.QuadPart = timeout ? timeout->QuadPart : TIMEOUT_INFINITE;
+        if (abs_timeout.QuadPart < 0)
+        {
+            LARGE_INTEGER now;
+            NtQuerySystemTime( &now );
+            abs_timeout.QuadPart = now.QuadPart - abs_timeout.QuadPart;
+        }
+        if ((ret = fast_sync_wait( slot, abs_timeout.QuadPart )) != STATUS_NOT_IMPLEMENTED) return ret;
+        /* the server owns the object now, let it finish the wait */
+        if (timeout) timeout = &abs_timeout;
+    }
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_any ? SELECT_WAIT : SELECT_WAIT_ALL;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
@@ -1100,6 +1447,7 @@ NTSTATUS WINAPI NtDelayExecution( BOOLEAN alertable, const LARGE_INTEGER *timeou
 
     if (!timeout || timeout->QuadPart == TIMEOUT_INFINITE)  /* sleep forever */
     {
+        local_completion_thread_blocked( TRUE );
         for (;;) select( 0, NULL, NULL, NULL, NULL );
     }
     else
@@ -1117,6 +1465,7 @@ NTSTATUS WINAPI NtDelayExecution( BOOLEAN alertable, const LARGE_INTEGER *timeou
         NtYieldExecution();
         if (!when) return STATUS_SUCCESS;
 
+        local_completion_thread_blocked( TRUE );
         for (;;)
         {
             struct timeval tv;
@@ -1127,6 +1476,7 @@ NTSTATUS WINAPI NtDelayExecution( BOOLEAN alertable, const LARGE_INTEGER *timeou
             tv.tv_usec = diff % 1000000;
             if (select( 0, NULL, NULL, NULL, &tv ) != -1) break;
         }
+        local_completion_thread_blocked( FALSE );
     }
     return STATUS_SUCCESS;
 }
@@ -1216,6 +1566,442 @@ NTSTATUS WINAPI NtReleaseKeyedEvent( HANDLE handle, const void *key,
     return server_select( &select_op, sizeof(select_op.keyed_event), flags, timeout );
 }
 
+/*
+ *	In-process completion ports
+ *
+ * Packets posted with NtSetIoCompletion to an unnamed, non-inheritable port
+ * created by this process are queued in-process, and threads waiting for
+ * them sleep on a futex. This only works as long as nothing else can add
+ * packets to the server-side queue, so as soon as a file or job is bound
+ * to the port, or its handle is duplicated, the local packets are moved to
+ * the server and the port is handled there from then on.
+ *
+ * The concurrency limit is enforced by counting the threads that got a
+ * packet from the port and aren't blocked in a wait, like Windows does.
+ * The ports are identified by their handle and its generation, so that a
+ * handle closed behind our back and then reused isn't mistaken for the port.
+ */
+
+#ifdef __linux__
+
+struct local_completion
+{
+    struct list                     entry;    /* entry in local_completions */
+    HANDLE                          handle;   /* handle of the port */
+    unsigned int                    generation; /* generation of the handle */
+    LONG                            refcount;
+    RTL_CRITICAL_SECTION            cs;
+    int                             seq;      /* futex, incremented whenever something changes */
+    unsigned int                    waiters;  /* number of threads sleeping on seq */
+    int                             active;   /* number of threads processing packets of the port */
+    unsigned int                    concurrent; /* max. number of active threads */
+    BOOL                            server;   /* packets are now queued on the server */
+    BOOL                            closed;   /* the handle has been closed */
+    FILE_IO_COMPLETION_INFORMATION *packets;  /* ring buffer of queued packets */
+    unsigned int                    head;     /* index of the first queued packet */
+    unsigned int                    count;    /* number of queued packets */
+    unsigned int                    size;     /* size of the ring buffer, a power of 2 */
+};
+
+static struct list local_completions = LIST_INIT( local_completions );
+static RTL_SRWLOCK local_completions_lock = RTL_SRWLOCK_INIT;
+
+static void remove_local_completion( HANDLE handle, BOOL closed );
+
+/* create the local queue of a new port */
+static void create_local_completion( HANDLE handle, ULONG concurrent )
+{
+    struct local_completion *port;
+    unsigned int generation = get_handle_generation( handle );
+
+    if (!generation) return;  /* we couldn't notice the handle being closed by someone else */
+
+    /* anything still registered with the same handle value is stale */
+    remove_local_completion( handle, TRUE );
+
+    if (!(port = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*port) ))) return;
+    port->size = 64;
+    if (!(port->packets = RtlAllocateHeap( GetProcessHeap(), 0, port->size * sizeof(*port->packets) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, port );
+        return;
+    }
+    port->handle = handle;
+    port->generation = generation;
+    port->refcount = 1;
+    port->concurrent = concurrent ? concurrent : NtCurrentTeb()->Peb->NumberOfProcessors;
+    RtlInitializeCriticalSection( &port->cs );
+
+    RtlAcquireSRWLockExclusive( &local_completions_lock );
+    list_add_head( &local_completions, &port->entry );
+    RtlReleaseSRWLockExclusive( &local_completions_lock );
+}
+
+/* find the local queue of a port, and grab a reference to it */
+static struct local_completion *grab_local_completion( HANDLE handle )
+{
+    struct local_completion *port;
+    unsigned int generation;
+
+    if (list_empty( &local_completions )) return NULL;
+    generation = get_handle_generation( handle );
+
+    RtlAcquireSRWLockShared( &local_completions_lock );
+    LIST_FOR_EACH_ENTRY( port, &local_completions, struct local_completion, entry )
+    {
+        if (port->handle != handle || port->generation != generation) continue;
+        interlocked_xchg_add( &port->refcount, 1 );
+        RtlReleaseSRWLockShared( &local_completions_lock );
+        return port;
+    }
+    RtlReleaseSRWLockShared( &local_completions_lock );
+    return NULL;
+}
+
+static void release_local_completion( struct local_completion *port )
+{
+    if (interlocked_xchg_add( &port->refcount, -1 ) > 1) return;
+    RtlDeleteCriticalSection( &port->cs );
+    RtlFreeHeap( GetProcessHeap(), 0, port->packets );
+    RtlFreeHeap( GetProcessHeap(), 0, port );
+}
+
+/* stop handling a port locally, either because it's being closed or because
+ * its packets have to be moved to the server */
+static void stop_local_completion( struct local_completion *port, BOOL closed )
+{
+    unsigned int i;
+
+    RtlEnterCriticalSection( &port->cs );
+    if (closed) port->closed = TRUE;
+    else
+    {
+        TRACE( "moving %u packets of port %p to the server\n", port->count, port->handle );
+        for (i = 0; i < port->count; i++)
+        {
+            FILE_IO_COMPLETION_INFORMATION *packet = &port->packets[(port->head + i) & (port->size - 1)];
+
+            SERVER_START_REQ( add_completion )
+            {
+                req->handle      = wine_server_obj_handle( port->handle );
+                req->ckey        = packet->CompletionKey;
+                req->cvalue      = packet->CompletionValue;
+                req->status      = packet->IoStatusBlock.u.Status;
+                req->information = packet->IoStatusBlock.Information;
+                wine_server_call( req );
+            }
+            SERVER_END_REQ;
+        }
+        port->server = TRUE;
+    }
+    port->count = 0;
+    /* let the waiters find out */
+    interlocked_xchg_add( &port->seq, 1 );
+    if (port->waiters) futex_wake( &port->seq, INT_MAX );
+    RtlLeaveCriticalSection( &port->cs );
+    release_local_completion( port );
+}
+
+static void remove_local_completion( HANDLE handle, BOOL closed )
+{
+    struct local_completion *port, *next;
+    struct list removed = LIST_INIT( removed );
+    unsigned int generation;
+
+    if (list_empty( &local_completions )) return;
+    generation = get_handle_generation( handle );
+
+    RtlAcquireSRWLockExclusive( &local_completions_lock );
+    LIST_FOR_EACH_ENTRY_SAFE( port, next, &local_completions, struct local_completion, entry )
+    {
+        if (port->handle != handle) continue;
+        list_remove( &port->entry );
+        list_add_tail( &removed, &port->entry );
+    }
+    RtlReleaseSRWLockExclusive( &local_completions_lock );
+
+    LIST_FOR_EACH_ENTRY_SAFE( port, next, &removed, struct local_completion, entry )
+    {
+        list_remove( &port->entry );
+        /* the handle of a stale port has already been closed by someone else */
+        stop_local_completion( port, closed || port->generation != generation );
+    }
+}
+
+/***********************************************************************
+ *           local_completion_close
+ *
+ * Forget about the local queue of a port whose handle is being closed.
+ */
+void local_completion_close( HANDLE handle )
+{
+    remove_local_completion( handle, TRUE );
+}
+
+/***********************************************************************
+ *           local_completion_to_server
+ *
+ * Move the queue of a port to the server, because something else than
+ * NtSetIoCompletion in this process may post to it.
+ */
+void local_completion_to_server( HANDLE handle )
+{
+    remove_local_completion( handle, FALSE );
+}
+
+/***********************************************************************
+ *           local_completion_is_port
+ *
+ * Check if a handle refers to a port whose packets are queued locally.
+ */
+BOOL local_completion_is_port( HANDLE handle )
+{
+    struct local_completion *port;
+
+    if (!(port = grab_local_completion( handle ))) return FALSE;
+    release_local_completion( port );
+    return TRUE;
+}
+
+/* a thread stops counting against the concurrency limit of a port,
+ * let a waiter take its place */
+static void deactivate_local_completion( struct local_completion *port )
+{
+    interlocked_xchg_add( &port->active, -1 );
+    interlocked_xchg_add( &port->seq, 1 );
+    if (port->waiters) futex_wake( &port->seq, 1 );
+}
+
+/***********************************************************************
+ *           local_completion_thread_blocked
+ *
+ * Like on Windows, a thread blocked in a wait doesn't count against the
+ * concurrency limit of the port it got its last packet from.
+ * This must not take any locks, it's called from the wait code.
+ */
+void local_completion_thread_blocked( BOOL blocked )
+{
+    struct local_completion *port = ntdll_get_thread_data()->completion_port;
+
+    if (!port) return;
+    if (blocked) deactivate_local_completion( port );
+    else interlocked_xchg_add( &port->active, 1 );
+}
+
+/***********************************************************************
+ *           local_completion_release_thread
+ *
+ * Dissociate the current thread from the port it got its last packet
+ * from, because it's waiting for a new one or exiting.
+ */
+void local_completion_release_thread(void)
+{
+    struct local_completion *port = ntdll_get_thread_data()->completion_port;
+
+    if (!port) return;
+    ntdll_get_thread_data()->completion_port = NULL;
+    deactivate_local_completion( port );
+    release_local_completion( port );
+}
+
+/* queue a packet locally; returns STATUS_NOT_IMPLEMENTED if the server has to do it */
+static NTSTATUS local_completion_add( HANDLE handle, ULONG_PTR key, ULONG_PTR value,
+                                      NTSTATUS status, SIZE_T information )
+{
+    struct local_completion *port;
+    FILE_IO_COMPLETION_INFORMATION *packet;
+    NTSTATUS ret = STATUS_SUCCESS;
+
+    if (!(port = grab_local_completion( handle ))) return STATUS_NOT_IMPLEMENTED;
+
+    RtlEnterCriticalSection( &port->cs );
+    if (port->server) ret = STATUS_NOT_IMPLEMENTED;
+    else
+    {
+        if (port->count == port->size)
+        {
+            FILE_IO_COMPLETION_INFORMATION *packets;
+            unsigned int first = port->size - port->head;
+
+            if (!(packets = RtlAllocateHeap( GetProcessHeap(), 0, 2 * port->size * sizeof(*packets) )))
+            {
+                ret = STATUS_NO_MEMORY;
+                goto done;
+            }
+            memcpy( packets, port->packets + port->head, first * sizeof(*packets) );
+            memcpy( packets + first, port->packets, port->head * sizeof(*packets) );
+            RtlFreeHeap( GetProcessHeap(), 0, port->packets );
+            port->packets = packets;
+            port->head = 0;
+            port->size *= 2;
+        }
+        packet = &port->packets[(port->head + port->count++) & (port->size - 1)];
+        packet->CompletionKey              = key;
+        packet->CompletionValue            = value;
+        packet->IoStatusBlock.u.Status     = status;
+        packet->IoStatusBlock.Information  = information;
+        interlocked_xchg_add( &port->seq, 1 );
+        if (port->waiters) futex_wake( &port->seq, 1 );
+    }
+done:
+    RtlLeaveCriticalSection( &port->cs );
+    release_local_completion( port );
+    return ret;
+}
+
+/* dequeue local packets, waiting for them if needed; returns STATUS_NOT_IMPLEMENTED
+ * if the server has to do it */
+static NTSTATUS local_completion_remove( HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
+                                         ULONG *written, const LARGE_INTEGER *timeout, BOOLEAN alertable )
+{
+    struct local_completion *port;
+    timeout_t when = TIMEOUT_INFINITE;
+    struct timespec timespec;
+    LARGE_INTEGER now;
+    NTSTATUS ret;
+    ULONG i;
+    int seq;
+
+    if (!(port = grab_local_completion( handle ))) return STATUS_NOT_IMPLEMENTED;
+
+    /* a thread coming back for more packets is no longer active */
+    local_completion_release_thread();
+
+    if (timeout && (when = timeout->QuadPart) < 0)
+    {
+        NtQuerySystemTime( &now );
+        when = now.QuadPart - when;
+    }
+
+    RtlEnterCriticalSection( &port->cs );
+    for (;;)
+    {
+        /* blocked threads leave the active count without taking the lock,
+         * so anything changing after this makes the futex wait return */
+        seq = *(volatile int *)&port->seq;
+        if (port->server)
+        {
+            ret = STATUS_NOT_IMPLEMENTED;
+            break;
+        }
+        if (port->count && *(volatile int *)&port->active < (int)port->concurrent)
+        {
+            for (i = 0; i < count && port->count; i++, port->count--)
+            {
+                info[i] = port->packets[port->head];
+                port->head = (port->head + 1) & (port->size - 1);
+            }
+            *written = i;
+            interlocked_xchg_add( &port->active, 1 );
+            interlocked_xchg_add( &port->refcount, 1 );
+            ntdll_get_thread_data()->completion_port = port;
+            /* pass the remaining packets on if more threads may run */
+            if (port->count && port->waiters && port->active < (int)port->concurrent)
+            {
+                interlocked_xchg_add( &port->seq, 1 );
+                futex_wake( &port->seq, 1 );
+            }
+            ret = STATUS_SUCCESS;
+            break;
+        }
+        if (port->closed)
+        {
+            ret = STATUS_ABANDONED_WAIT_0;
+            break;
+        }
+        if (alertable)
+        {
+            /* APCs can only be delivered by a server wait */
+            RtlLeaveCriticalSection( &port->cs );
+            local_completion_to_server( handle );
+            RtlEnterCriticalSection( &port->cs );
+            continue;
+        }
+        if (when != TIMEOUT_INFINITE)
+        {
+            NtQuerySystemTime( &now );
+            if (when <= now.QuadPart)
+            {
+                ret = STATUS_TIMEOUT;
+                break;
+            }
+            timespec.tv_sec  = (when - now.QuadPart) / 10000000;
+            timespec.tv_nsec = (when - now.QuadPart) % 10000000 * 100;
+        }
+        port->waiters++;
+        RtlLeaveCriticalSection( &port->cs );
+        futex_wait( &port->seq, seq, when == TIMEOUT_INFINITE ? NULL : &timespec );
+        RtlEnterCriticalSection( &port->cs );
+        port->waiters--;
+    }
+    RtlLeaveCriticalSection( &port->cs );
+    release_local_completion( port );
+    return ret;
+}
+
+/* retrieve the number of locally queued packets; returns STATUS_NOT_IMPLEMENTED
+ * if the server has to do it */
+static NTSTATUS local_completion_depth( HANDLE handle, ULONG *depth )
+{
+    struct local_completion *port;
+    NTSTATUS ret = STATUS_SUCCESS;
+
+    if (!(port = grab_local_completion( handle ))) return STATUS_NOT_IMPLEMENTED;
+    RtlEnterCriticalSection( &port->cs );
+    if (port->server) ret = STATUS_NOT_IMPLEMENTED;
+    else *depth = port->count;
+    RtlLeaveCriticalSection( &port->cs );
+    release_local_completion( port );
+    return ret;
+}
+
+#else  /* __linux__ */
+
+static void create_local_completion( HANDLE handle, ULONG concurrent )
+{
+}
+
+void local_completion_close( HANDLE handle )
+{
+}
+
+void local_completion_to_server( HANDLE handle )
+{
+}
+
+BOOL local_completion_is_port( HANDLE handle )
+{
+    return FALSE;
+}
+
+void local_completion_thread_blocked( BOOL blocked )
+{
+}
+
+void local_completion_release_thread(void)
+{
+}
+
+static inline NTSTATUS local_completion_add( HANDLE handle, ULONG_PTR key, ULONG_PTR value,
+                                             NTSTATUS status, SIZE_T information )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static inline NTSTATUS local_completion_remove( HANDLE handle, FILE_IO_COMPLETION_INFORMATION *info,
+                                                ULONG count, ULONG *written,
+                                                const LARGE_INTEGER *timeout, BOOLEAN alertable )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static inline NTSTATUS local_completion_depth( HANDLE handle, ULONG *depth )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif  /* __linux__ */
+
 /******************************************************************
  *              NtCreateIoCompletion (NTDLL.@)
  *              ZwCreateIoCompletion (NTDLL.@)
@@ -1253,6 +2039,9 @@ NTSTATUS WINAPI NtCreateIoCompletion( PHANDLE CompletionPort, ACCESS_MASK Desire
     }
     SERVER_END_REQ;
 
+    if (!status && (!attr || (!attr->ObjectName && !(attr->Attributes & OBJ_INHERIT))))
+        create_local_completion( *CompletionPort, NumberOfConcurrentThreads );
+
     RtlFreeHeap( GetProcessHeap(), 0, objattr );
     return status;
 }
@@ -1279,6 +2068,10 @@ NTSTATUS WINAPI NtSetIoCompletion( HANDLE CompletionPort, ULONG_PTR CompletionKe
     TRACE("(%p, %lx, %lx, %x, %lx)\n", CompletionPort, CompletionKey,
           CompletionValue, Status, NumberOfBytesTransferred);
 
+    if ((status = local_completion_add( CompletionPort, CompletionKey, CompletionValue,
+                                        Status, NumberOfBytesTransferred )) != STATUS_NOT_IMPLEMENTED)
+        return status;
+
     SERVER_START_REQ( add_completion )
     {
         req->handle      = wine_server_obj_handle( CompletionPort );
@@ -1312,9 +2105,24 @@ NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE CompletionPort, PULONG_PTR Completi
 {
     NTSTATUS status;
 
+    FILE_IO_COMPLETION_INFORMATION info;
+    ULONG written;
+
     TRACE("(%p, %p, %p, %p, %p)\n", CompletionPort, CompletionKey,
           CompletionValue, iosb, WaitTime);
 
+    if ((status = local_completion_remove( CompletionPort, &info, 1, &written,
+                                           WaitTime, FALSE )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (!status)
+        {
+            *CompletionKey   = info.CompletionKey;
+            *CompletionValue = info.CompletionValue;
+            *iosb            = info.IoStatusBlock;
+        }
+        return status;
+    }
+
     for(;;)
     {
         SERVER_START_REQ( remove_completion )
@@ -1344,31 +2152,41 @@ NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE CompletionPort, PULONG_PTR Completi
 NTSTATUS WINAPI NtRemoveIoCompletionEx( HANDLE port, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
                                         ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable )
 {
+    struct completion_packet packets[64];
     NTSTATUS ret;
-    ULONG i = 0;
+    ULONG i = 0, n;
 
     TRACE("%p %p %u %p %p %u\n", port, info, count, written, timeout, alertable);
 
+    if ((ret = local_completion_remove( port, info, count, written,
+                                        timeout, alertable )) != STATUS_NOT_IMPLEMENTED)
+    {
+        if (ret) *written = 1;
+        return ret;
+    }
+
     for (;;)
     {
         while (i < count)
         {
-            SERVER_START_REQ( remove_completion )
+            SERVER_START_REQ( remove_completions )
             {
                 req->handle = wine_server_obj_handle( port );
+                wine_server_set_reply( req, packets, min( count - i, ARRAY_SIZE(packets) ) * sizeof(packets[0]) );
                 if (!(ret = wine_server_call( req )))
                 {
-                    info[i].CompletionKey             = reply->ckey;
-                    info[i].CompletionValue           = reply->cvalue;
-                    info[i].IoStatusBlock.Information = reply->information;
-                    info[i].IoStatusBlock.u.Status    = reply->status;
+                    for (n = 0; n < wine_server_reply_size( reply ) / sizeof(packets[0]); n++, i++)
+                    {
+                        info[i].CompletionKey             = packets[n].ckey;
+                        info[i].CompletionValue           = packets[n].cvalue;
+                        info[i].IoStatusBlock.Information = packets[n].information;
+                        info[i].IoStatusBlock.u.Status    = packets[n].status;
+                    }
                 }
             }
             SERVER_END_REQ;
 
             if (ret != STATUS_SUCCESS) break;
-
-            ++i;
         }
 
         if (i || ret != STATUS_PENDING)
@@ -1451,7 +2269,7 @@ NTSTATUS WINAPI NtQueryIoCompletion( HANDLE CompletionPort, IO_COMPLETION_INFORM
                 if (RequiredLength) *RequiredLength = sizeof(*info);
                 if (BufferLength != sizeof(*info))
                     status = STATUS_INFO_LENGTH_MISMATCH;
-                else
+                else if ((status = local_completion_depth( CompletionPort, info )) == STATUS_NOT_IMPLEMENTED)
                 {
                     SERVER_START_REQ( query_completion )
                     {
@@ -1471,7 +2289,7 @@ NTSTATUS WINAPI NtQueryIoCompletion( HANDLE CompletionPort, IO_COMPLETION_INFORM
 }
 
 NTSTATUS NTDLL_AddCompletion( HANDLE hFile, ULONG_PTR CompletionValue,
-                              NTSTATUS CompletionStatus, ULONG Information )
+                              NTSTATUS CompletionStatus, ULONG Information, BOOL async )
 {
     NTSTATUS status;
 
@@ -1481,12 +2299,289 @@ NTSTATUS NTDLL_AddCompletion( HANDLE hFile, ULONG_PTR CompletionValue,
         req->cvalue      = CompletionValue;
         req->status      = CompletionStatus;
         req->information = Information;
+        req->async       = async;
         status = wine_server_call( req );
     }
     SERVER_END_REQ;
     return status;
 }
 
+
+static BOOL compare_addr( const void *addr, const void *cmp, SIZE_T size )
+{
+    switch (size)
+    {
+        case 1:
+            return (*(const UCHAR *)addr == *(const UCHAR *)cmp);
+        case 2:
+            return (*(const USHORT *)addr == *(const USHORT *)cmp);
+        case 4:
+            return (*(const ULONG *)addr == *(const ULONG *)cmp);
+        case 8:
+            return (*(const ULONG64 *)addr == *(const ULONG64 *)cmp);
+    }
+
+    return FALSE;
+}
+
+/*
+ *	In-process keyed events
+ *
+ * The default keyed event is only used by the Rtl synchronization
+ * primitives of this process (run-once objects, SRW locks, condition
+ * variables and RtlWaitOnAddress), with keys that are addresses in the
+ * process. On Linux its semantics are emulated with a hash table of waiting
+ * threads, each sleeping on a futex of its own, which avoids a server round
+ * trip for every contended wait and wake. Like on the server, a release
+ * blocks until a waiter for the same key shows up.
+ *
+ * Contrary to server waits these waits are not interrupted by system APCs.
+ */
+
+#ifdef __linux__
+
+/* Each thread has its own entry, allocated on first use and reused for all
+ * its waits. When a thread is killed while its entry is queued, the entry is
+ * only marked dead, and whoever finds it in the bucket unlinks and frees it. */
+
+#define KEYED_ENTRY_QUEUED 1  /* the entry is linked in a bucket */
+#define KEYED_ENTRY_DEAD   2  /* the owner thread is gone */
+
+struct keyed_entry
+{
+    struct keyed_entry *next;
+    struct keyed_entry *prev;
+    const void         *key;
+    int                 release;   /* is this a release or a wait? */
+    int                 signaled;  /* futex, set once the entry has been paired */
+    int                 flags;     /* KEYED_ENTRY_* flags */
+};
+
+struct keyed_bucket
+{
+    int                 lock;      /* futex: 0 unlocked, 1 locked, 2 locked with waiters */
+    struct keyed_entry *head;
+    struct keyed_entry *tail;
+};
+
+#define KEYED_BUCKETS 256
+
+static struct keyed_bucket keyed_buckets[KEYED_BUCKETS];
+static int keyed_futex_supported = -1;
+
+static inline BOOL use_keyed_futex(void)
+{
+    if (keyed_futex_supported == -1)
+    {
+        int dummy = 0;
+        keyed_futex_supported = (futex_wait( &dummy, 1, NULL ) != -1 || errno != ENOSYS);
+    }
+    return keyed_futex_supported;
+}
+
+static inline struct keyed_bucket *get_keyed_bucket( const void *key )
+{
+    ULONG_PTR hash = (ULONG_PTR)key;
+    hash ^= hash >> 16;
+    return &keyed_buckets[(hash >> 2) % KEYED_BUCKETS];
+}
+
+static void keyed_bucket_lock( struct keyed_bucket *bucket )
+{
+    int val;
+
+    if (!(val = interlocked_cmpxchg( &bucket->lock, 1, 0 ))) return;
+    do
+    {
+        if (val == 2 || interlocked_cmpxchg( &bucket->lock, 2, 1 ))
+            futex_wait( &bucket->lock, 2, NULL );
+    } while ((val = interlocked_cmpxchg( &bucket->lock, 2, 0 )));
+}
+
+static void keyed_bucket_unlock( struct keyed_bucket *bucket )
+{
+    if (interlocked_xchg( &bucket->lock, 0 ) == 2) futex_wake( &bucket->lock, 1 );
+}
+
+/* unlink an entry from its bucket; returns FALSE if its owner is gone, in which case it's freed */
+static BOOL remove_keyed_entry( struct keyed_bucket *bucket, struct keyed_entry *entry )
+{
+    if (entry->prev) entry->prev->next = entry->next;
+    else bucket->head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else bucket->tail = entry->prev;
+
+    if (!(interlocked_xchg_add( &entry->flags, -KEYED_ENTRY_QUEUED ) & KEYED_ENTRY_DEAD)) return TRUE;
+    RtlFreeHeap( GetProcessHeap(), 0, entry );
+    return FALSE;
+}
+
+/* sleep until the entry has been paired, or until the absolute timeout expires */
+static NTSTATUS wait_keyed_entry( struct keyed_entry *entry, timeout_t when )
+{
+    LARGE_INTEGER now;
+    struct timespec timespec;
+
+    NTSTATUS status = STATUS_SUCCESS;
+
+    local_completion_thread_blocked( TRUE );
+    while (!*(volatile int *)&entry->signaled)
+    {
+        if (when == TIMEOUT_INFINITE)
+        {
+            futex_wait( &entry->signaled, 0, NULL );
+            continue;
+        }
+        NtQuerySystemTime( &now );
+        if (when <= now.QuadPart)
+        {
+            status = STATUS_TIMEOUT;
+            break;
+        }
+        timespec.tv_sec  = (when - now.QuadPart) / 10000000;
+        timespec.tv_nsec = (when - now.QuadPart) % 10000000 * 100;
+        futex_wait( &entry->signaled, 0, &timespec );
+    }
+    local_completion_thread_blocked( FALSE );
+    return status;
+}
+
+/* wait for or release a key; if cmp is set, only wait while the key still matches it;
+ * returns STATUS_NOT_IMPLEMENTED if the server has to do it */
+static NTSTATUS keyed_futex_op( const void *key, BOOL release, const void *cmp, SIZE_T size,
+                                const LARGE_INTEGER *timeout )
+{
+    struct keyed_bucket *bucket;
+    struct keyed_entry *entry = ntdll_get_thread_data()->keyed_entry, *other, *next;
+    timeout_t when = TIMEOUT_INFINITE;
+    LARGE_INTEGER now;
+    NTSTATUS status;
+
+    if (!use_keyed_futex()) return STATUS_NOT_IMPLEMENTED;
+    if (!entry)
+    {
+        if (!(entry = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*entry) )))
+            return STATUS_NOT_IMPLEMENTED;
+        ntdll_get_thread_data()->keyed_entry = entry;
+    }
+    /* we got here from a signal handler while waiting, let the server do it */
+    if (entry->flags) return STATUS_NOT_IMPLEMENTED;
+
+    if (timeout && (when = timeout->QuadPart) < 0)
+    {
+        NtQuerySystemTime( &now );
+        when = now.QuadPart - when;
+    }
+
+    bucket = get_keyed_bucket( key );
+    keyed_bucket_lock( bucket );
+
+    if (cmp && !compare_addr( key, cmp, size ))
+    {
+        keyed_bucket_unlock( bucket );
+        return STATUS_SUCCESS;
+    }
+
+    for (other = bucket->head; other; other = next)
+    {
+        next = other->next;
+        if (other->flags & KEYED_ENTRY_DEAD)
+        {
+            remove_keyed_entry( bucket, other );
+            continue;
+        }
+        if (other->key != key || other->release == release) continue;
+        /* the owner may have been killed since we checked */
+        if (remove_keyed_entry( bucket, other )) break;
+    }
+
+    if (other)
+    {
+        other->signaled = 1;
+        keyed_bucket_unlock( bucket );
+        /* the other thread may already have reused its entry, a spurious wake-up is harmless */
+        futex_wake( &other->signaled, 1 );
+        return STATUS_SUCCESS;
+    }
+
+    if (timeout && !timeout->QuadPart)
+    {
+        keyed_bucket_unlock( bucket );
+        return STATUS_TIMEOUT;
+    }
+
+    entry->key      = key;
+    entry->release  = release;
+    entry->signaled = 0;
+    entry->flags    = KEYED_ENTRY_QUEUED;
+    entry->next     = NULL;
+    entry->prev     = bucket->tail;
+    if (bucket->tail) bucket->tail->next = entry;
+    else bucket->head = entry;
+    bucket->tail = entry;
+    keyed_bucket_unlock( bucket );
+
+    if ((status = wait_keyed_entry( entry, when )) == STATUS_TIMEOUT)
+    {
+        keyed_bucket_lock( bucket );
+        if (!entry->signaled) remove_keyed_entry( bucket, entry );
+        else status = STATUS_SUCCESS;
+        keyed_bucket_unlock( bucket );
+    }
+    return status;
+}
+
+/***********************************************************************
+ *           keyed_futex_release_thread
+ *
+ * Get rid of the keyed event entry of the current thread when it exits.
+ * A thread that gets killed may have its entry queued, and may even be
+ * holding a bucket lock, so we only mark it dead and leave the unlinking
+ * to the next thread that walks the bucket.
+ */
+void keyed_futex_release_thread( BOOL aborted )
+{
+    struct keyed_entry *entry = ntdll_get_thread_data()->keyed_entry;
+
+    if (!entry) return;
+    ntdll_get_thread_data()->keyed_entry = NULL;
+    if (aborted)
+    {
+        /* we can't use the heap here, so an entry that wasn't queued is leaked */
+        interlocked_xchg_add( &entry->flags, KEYED_ENTRY_DEAD );
+        return;
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, entry );
+}
+
+#else  /* __linux__ */
+
+static inline NTSTATUS keyed_futex_op( const void *key, BOOL release, const void *cmp, SIZE_T size,
+                                       const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+void keyed_futex_release_thread( BOOL aborted )
+{
+}
+
+#endif  /* __linux__ */
+
+static inline NTSTATUS wait_keyed_event( const void *key, const LARGE_INTEGER *timeout )
+{
+    NTSTATUS status = keyed_futex_op( key, FALSE, NULL, 0, timeout );
+    if (status == STATUS_NOT_IMPLEMENTED) status = NtWaitForKeyedEvent( 0, key, FALSE, timeout );
+    return status;
+}
+
+static inline NTSTATUS release_keyed_event( const void *key, const LARGE_INTEGER *timeout )
+{
+    NTSTATUS status = keyed_futex_op( key, TRUE, NULL, 0, timeout );
+    if (status == STATUS_NOT_IMPLEMENTED) status = NtReleaseKeyedEvent( 0, key, FALSE, timeout );
+    return status;
+}
+
 /******************************************************************
  *              RtlRunOnceInitialize (NTDLL.@)
  */
@@ -1527,7 +2622,7 @@ DWORD WINAPI RtlRunOnceBeginInitialize( RTL_RUN_ONCE *once, ULONG flags, void **
             next = val & ~3;
             if (interlocked_cmpxchg_ptr( &once->Ptr, (void *)((ULONG_PTR)&next | 1),
                                          (void *)val ) == (void *)val)
-                NtWaitForKeyedEvent( 0, &next, FALSE, NULL );
+                wait_keyed_event( &next, NULL );
             break;
 
         case 2:  /* done */
@@ -1567,7 +2662,7 @@ DWORD WINAPI RtlRunOnceComplete( RTL_RUN_ONCE *once, ULONG flags, void *context
             while (val)
             {
                 ULONG_PTR next = *(ULONG_PTR *)val;
-                NtReleaseKeyedEvent( 0, (void *)val, FALSE, NULL );
+                release_keyed_event( (void *)val, NULL );
                 val = next;
             }
             return STATUS_SUCCESS;
@@ -1707,12 +2802,12 @@ static inline void srwlock_leave_exclusive( RTL_SRWLOCK *lock, unsigned int val
      * exclusive access threads they are processed first, followed by
      * the shared waiters. */
     if (val & SRWLOCK_MASK_EXCLUSIVE_QUEUE)
-        NtReleaseKeyedEvent( 0, srwlock_key_exclusive(lock), FALSE, NULL );
+        release_keyed_event( srwlock_key_exclusive(lock), NULL );
     else
     {
         val &= SRWLOCK_MASK_SHARED_QUEUE; /* remove SRWLOCK_MASK_IN_EXCLUSIVE */
         while (val--)
-            NtReleaseKeyedEvent( 0, srwlock_key_shared(lock), FALSE, NULL );
+            release_keyed_event( srwlock_key_shared(lock), NULL );
     }
 }
 
@@ -1721,7 +2816,7 @@ static inline void srwlock_leave_shared( RTL_SRWLOCK *lock, unsigned int val )
     /* Wake up one exclusive thread as soon as the last shared access thread
      * has left. */
     if ((val & SRWLOCK_MASK_EXCLUSIVE_QUEUE) && !(val & SRWLOCK_MASK_SHARED_QUEUE))
-        NtReleaseKeyedEvent( 0, srwlock_key_exclusive(lock), FALSE, NULL );
+        release_keyed_event( srwlock_key_exclusive(lock), NULL );
 }
 
 /***********************************************************************
@@ -1750,7 +2845,7 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
     if (srwlock_lock_exclusive( (unsigned int *)&lock->Ptr, SRWLOCK_RES_EXCLUSIVE ))
-        NtWaitForKeyedEvent( 0, srwlock_key_exclusive(lock), FALSE, NULL );
+        wait_keyed_event( srwlock_key_exclusive(lock), NULL );
 }
 
 /***********************************************************************
@@ -1778,14 +2873,14 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
     /* Drop exclusive access again and instead requeue for shared access. */
     if ((val & SRWLOCK_MASK_EXCLUSIVE_QUEUE) && !(val & SRWLOCK_MASK_IN_EXCLUSIVE))
     {
-        NtWaitForKeyedEvent( 0, srwlock_key_exclusive(lock), FALSE, NULL );
+        wait_keyed_event( srwlock_key_exclusive(lock), NULL );
         val = srwlock_unlock_exclusive( (unsigned int *)&lock->Ptr, (SRWLOCK_RES_SHARED
                                         - SRWLOCK_RES_EXCLUSIVE) ) - SRWLOCK_RES_EXCLUSIVE;
         srwlock_leave_exclusive( lock, val );
     }
 
     if (val & SRWLOCK_MASK_EXCLUSIVE_QUEUE)
-        NtWaitForKeyedEvent( 0, srwlock_key_shared(lock), FALSE, NULL );
+        wait_keyed_event( srwlock_key_shared(lock), NULL );
 }
 
 /***********************************************************************
@@ -1869,7 +2964,7 @@ void WINAPI RtlInitializeConditionVariable( RTL_CONDITION_VARIABLE *variable )
 void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
     if (interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
-        NtReleaseKeyedEvent( 0, &variable->Ptr, FALSE, NULL );
+        release_keyed_event( &variable->Ptr, NULL );
 }
 
 /***********************************************************************
@@ -1881,7 +2976,7 @@ void WINAPI RtlWakeAllConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
     int val = interlocked_xchg( (int *)&variable->Ptr, 0 );
     while (val-- > 0)
-        NtReleaseKeyedEvent( 0, &variable->Ptr, FALSE, NULL );
+        release_keyed_event( &variable->Ptr, NULL );
 }
 
 /***********************************************************************
@@ -1906,11 +3001,11 @@ NTSTATUS WINAPI RtlSleepConditionVariableCS( RTL_CONDITION_VARIABLE *variable, R
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
     RtlLeaveCriticalSection( crit );
 
-    status = NtWaitForKeyedEvent( 0, &variable->Ptr, FALSE, timeout );
+    status = wait_keyed_event( &variable->Ptr, timeout );
     if (status != STATUS_SUCCESS)
     {
         if (!interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
-            status = NtWaitForKeyedEvent( 0, &variable->Ptr, FALSE, NULL );
+            status = wait_keyed_event( &variable->Ptr, NULL );
     }
 
     RtlEnterCriticalSection( crit );
@@ -1947,11 +3042,11 @@ NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable,
     else
         RtlReleaseSRWLockExclusive( lock );
 
-    status = NtWaitForKeyedEvent( 0, &variable->Ptr, FALSE, timeout );
+    status = wait_keyed_event( &variable->Ptr, timeout );
     if (status != STATUS_SUCCESS)
     {
         if (!interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
-            status = NtWaitForKeyedEvent( 0, &variable->Ptr, FALSE, NULL );
+            status = wait_keyed_event( &variable->Ptr, NULL );
     }
 
     if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
@@ -1970,23 +3065,6 @@ static RTL_CRITICAL_SECTION_DEBUG addr_section_debug =
 };
 static RTL_CRITICAL_SECTION addr_section = { &addr_section_debug, -1, 0, 0, 0, 0 };
 
-static BOOL compare_addr( const void *addr, const void *cmp, SIZE_T size )
-{
-    switch (size)
-    {
-        case 1:
-            return (*(const UCHAR *)addr == *(const UCHAR *)cmp);
-        case 2:
-            return (*(const USHORT *)addr == *(const USHORT *)cmp);
-        case 4:
-            return (*(const ULONG *)addr == *(const ULONG *)cmp);
-        case 8:
-            return (*(const ULONG64 *)addr == *(const ULONG64 *)cmp);
-    }
-
-    return FALSE;
-}
-
 /***********************************************************************
  *           RtlWaitOnAddress   (NTDLL.@)
  */
@@ -2005,6 +3083,9 @@ NTSTATUS WINAPI RtlWaitOnAddress( const void *addr, const void *cmp, SIZE_T size
     if (size != 1 && size != 2 && size != 4 && size != 8)
         return STATUS_INVALID_PARAMETER;
 
+    if ((ret = keyed_futex_op( addr, FALSE, cmp, size, timeout )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     select_op.keyed_event.op     = SELECT_KEYED_EVENT_WAIT;
     select_op.keyed_event.handle = wine_server_obj_handle( keyed_event );
     select_op.keyed_event.key    = wine_server_client_ptr( addr );
@@ -2059,6 +3140,11 @@ NTSTATUS WINAPI RtlWaitOnAddress( const void *addr, const void *cmp, SIZE_T size
  */
 void WINAPI RtlWakeAddressAll( const void *addr )
 {
+    NTSTATUS status;
+
+    while ((status = keyed_futex_op( addr, TRUE, NULL, 0, &zero_timeout )) == STATUS_SUCCESS) {}
+    if (status != STATUS_NOT_IMPLEMENTED) return;
+
     RtlEnterCriticalSection( &addr_section );
     while (NtReleaseKeyedEvent( 0, addr, 0, &zero_timeout ) == STATUS_SUCCESS) {}
     RtlLeaveCriticalSection( &addr_section );
@@ -2069,6 +3155,8 @@ void WINAPI RtlWakeAddressAll( const void *addr )
  */
 void WINAPI RtlWakeAddressSingle( const void *addr )
 {
+    if (keyed_futex_op( addr, TRUE, NULL, 0, &zero_timeout ) != STATUS_NOT_IMPLEMENTED) return;
+
     RtlEnterCriticalSection( &addr_section );
     NtReleaseKeyedEvent( 0, addr, 0, &zero_timeout );
     RtlLeaveCriticalSection( &addr_section );
@@ -825,6 +825,165 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+static int count_dir_entries( const char *testdir, HANDLE *find_ret )
+{
+    char buf[MAX_PATH];
+    WIN32_FIND_DATAA data;
+    HANDLE find;
+    int count = 0;
+
+    sprintf( buf, "%s\\*", testdir );
+    find = FindFirstFileA( buf, &data );
+    ok( find != INVALID_HANDLE_VALUE, "FindFirstFile failed, error %d\n", GetLastError() );
+    if (find == INVALID_HANDLE_VALUE) return -1;
+    do count++; while (FindNextFileA( find, &data ));
+    if (find_ret) *find_ret = find;
+    else FindClose( find );
+    return count;
+}
+
+static void test_directory_reuse(void)
+{
+    char testdir[MAX_PATH], buf[MAX_PATH];
+    FILETIME old_time = { 0x256d4000, 0x01bf53eb };  /* 2000-01-01 */
+    HANDLE h, find;
+    int i, count;
+    BOOL ret;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "reuse.tmp" );
+    ret = CreateDirectoryA( testdir, NULL );
+    ok( ret, "couldn't create dir '%s', error %d\n", testdir, GetLastError() );
+    for (i = 0; i < 3; i++)
+    {
+        sprintf( buf, "%s\\file%u", testdir, i );
+        h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to create '%s', error %d\n", buf, GetLastError() );
+        CloseHandle( h );
+    }
+
+    /* move the modification time into the past, so that the listing can be shared */
+    h = CreateFileA( testdir, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                     NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to open '%s', error %d\n", testdir, GetLastError() );
+    ret = SetFileTime( h, NULL, NULL, &old_time );
+    ok( ret, "SetFileTime failed, error %d\n", GetLastError() );
+    CloseHandle( h );
+
+    count = count_dir_entries( testdir, &find );
+    ok( count == 5, "got %d entries\n", count );
+    count = count_dir_entries( testdir, NULL );
+    ok( count == 5, "got %d entries\n", count );
+    FindClose( find );
+
+    /* a modified directory must be read again, even while the old listing is in use */
+    count = count_dir_entries( testdir, &find );
+    ok( count == 5, "got %d entries\n", count );
+    sprintf( buf, "%s\\file%u", testdir, 3 );
+    h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to create '%s', error %d\n", buf, GetLastError() );
+    CloseHandle( h );
+    count = count_dir_entries( testdir, NULL );
+    ok( count == 6, "got %d entries\n", count );
+    FindClose( find );
+
+    sprintf( buf, "%s\\file%u", testdir, 0 );
+    ret = DeleteFileA( buf );
+    ok( ret, "failed to delete '%s', error %d\n", buf, GetLastError() );
+    count = count_dir_entries( testdir, NULL );
+    ok( count == 5, "got %d entries\n", count );
+
+    for (i = 0; i < 4; i++)
+    {
+        sprintf( buf, "%s\\file%u", testdir, i );
+        DeleteFileA( buf );
+    }
+    ret = RemoveDirectoryA( testdir );
+    ok( ret, "couldn't remove dir '%s', error %d\n", testdir, GetLastError() );
+}
+
+/* move the modification time of a directory into the past, so that its listing gets cached */
+static void set_dir_time( const char *dir, DWORD days )
+{
+    LARGE_INTEGER time;
+    FILETIME ft;
+    HANDLE h;
+    BOOL ret;
+
+    time.u.LowPart  = 0x256d4000;  /* 2000-01-01 */
+    time.u.HighPart = 0x01bf53eb;
+    time.QuadPart += (ULONGLONG)days * 24 * 3600 * 10000000;
+    ft.dwLowDateTime  = time.u.LowPart;
+    ft.dwHighDateTime = time.u.HighPart;
+    h = CreateFileA( dir, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                     NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to open '%s', error %d\n", dir, GetLastError() );
+    ret = SetFileTime( h, NULL, NULL, &ft );
+    ok( ret, "SetFileTime failed, error %d\n", GetLastError() );
+    CloseHandle( h );
+}
+
+static void test_case_insensitive_lookup(void)
+{
+    static const unsigned int count = 100;
+    char testdir[MAX_PATH], buf[MAX_PATH];
+    DWORD i;
+    HANDLE h;
+    BOOL ret;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "lookup.tmp" );
+    ret = CreateDirectoryA( testdir, NULL );
+    ok( ret, "couldn't create dir '%s', error %d\n", testdir, GetLastError() );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( buf, "%s\\File%05u.Txt", testdir, i );
+        h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to create '%s', error %d\n", buf, GetLastError() );
+        CloseHandle( h );
+    }
+    set_dir_time( testdir, 0 );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( buf, "%s\\fILE%05u.tXT", testdir, (i * 7919) % count );
+        h = CreateFileA( buf, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0 );
+        ok( h != INVALID_HANDLE_VALUE, "failed to open '%s', error %d\n", buf, GetLastError() );
+        CloseHandle( h );
+    }
+
+    sprintf( buf, "%s\\file%05u.txt", testdir, count );
+    h = CreateFileA( buf, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0 );
+    ok( h == INVALID_HANDLE_VALUE, "opened missing file '%s'\n", buf );
+    ok( GetLastError() == ERROR_FILE_NOT_FOUND, "wrong error %d\n", GetLastError() );
+
+    /* names added or removed after a lookup must be found or not found accordingly,
+     * also when the directory still looks old enough to be cached */
+    sprintf( buf, "%s\\NewFile.Txt", testdir );
+    h = CreateFileA( buf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to create '%s', error %d\n", buf, GetLastError() );
+    CloseHandle( h );
+    set_dir_time( testdir, 1 );
+    sprintf( buf, "%s\\newfile.txt", testdir );
+    h = CreateFileA( buf, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0 );
+    ok( h != INVALID_HANDLE_VALUE, "failed to open '%s', error %d\n", buf, GetLastError() );
+    CloseHandle( h );
+    ret = DeleteFileA( buf );
+    ok( ret, "failed to delete '%s', error %d\n", buf, GetLastError() );
+    set_dir_time( testdir, 2 );
+    h = CreateFileA( buf, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0 );
+    ok( h == INVALID_HANDLE_VALUE, "opened deleted file '%s'\n", buf );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( buf, "%s\\File%05u.Txt", testdir, i );
+        DeleteFileA( buf );
+    }
+    ret = RemoveDirectoryA( testdir );
+    ok( ret, "couldn't remove dir '%s', error %d\n", testdir, GetLastError() );
+}
+
 static void test_redirection(void)
 {
     ULONG old, cur;
@@ -903,5 +1062,7 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_case_insensitive_lookup();
+    test_directory_reuse();
     test_redirection();
 }
@@ -1011,6 +1011,139 @@ static void test_set_io_completion(void)
     pNtClose( h );
 }
 
+#define COMPLETION_PACKETS 1000
+
+static DWORD WINAPI completion_post_thread( void *arg )
+{
+    HANDLE port = arg;
+    NTSTATUS res;
+    ULONG i;
+
+    for (i = 0; i < COMPLETION_PACKETS; i++)
+    {
+        res = pNtSetIoCompletion( port, 1, i, STATUS_SUCCESS, 0 );
+        if (res) break;
+    }
+    ok( !res, "NtSetIoCompletion failed: %#x\n", res );
+    return 0;
+}
+
+static volatile LONG completion_thread_state;
+static HANDLE completion_thread_event;
+
+static DWORD WINAPI completion_active_thread( void *arg )
+{
+    HANDLE port = arg;
+    IO_STATUS_BLOCK iosb;
+    ULONG_PTR key, value;
+    NTSTATUS res;
+
+    res = pNtRemoveIoCompletion( port, &key, &value, &iosb, NULL );
+    ok( res == STATUS_SUCCESS, "NtRemoveIoCompletion failed: %#x\n", res );
+    ok( value == 40, "got value %lu\n", value );
+
+    /* stay active until told to block */
+    InterlockedExchange( &completion_thread_state, 1 );
+    while (completion_thread_state == 1) SwitchToThread();
+
+    WaitForSingleObject( completion_thread_event, INFINITE );
+    return 0;
+}
+
+static void test_local_io_completion(void)
+{
+    FILE_IO_COMPLETION_INFORMATION info[64];
+    IO_STATUS_BLOCK iosb;
+    ULONG_PTR key, value;
+    HANDLE port, dup, file, thread;
+    ULONG i, count, total = 0, next = 0;
+    NTSTATUS res;
+    LARGE_INTEGER timeout;
+
+    if (!pNtRemoveIoCompletionEx)
+    {
+        win_skip( "NtRemoveIoCompletionEx not present\n" );
+        return;
+    }
+
+    res = pNtCreateIoCompletion( &port, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
+    ok( res == STATUS_SUCCESS, "NtCreateIoCompletion failed: %#x\n", res );
+
+    /* one thread posting, one thread dequeuing in batches */
+    thread = CreateThread( NULL, 0, completion_post_thread, port, 0, NULL );
+    while (total < COMPLETION_PACKETS)
+    {
+        res = pNtRemoveIoCompletionEx( port, info, ARRAY_SIZE(info), &count, NULL, FALSE );
+        ok( res == STATUS_SUCCESS, "NtRemoveIoCompletionEx failed: %#x\n", res );
+        if (res) break;
+        for (i = 0; i < count; i++, next++)
+            if (info[i].CompletionValue != next) break;
+        ok( i == count, "got value %lu, expected %u\n", info[min( i, count - 1 )].CompletionValue, next );
+        if (i < count) break;
+        total += count;
+    }
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+
+    /* queued packets are still there after duplicating the handle */
+    res = pNtSetIoCompletion( port, 2, 20, STATUS_SUCCESS, 0 );
+    ok( res == STATUS_SUCCESS, "NtSetIoCompletion failed: %#x\n", res );
+    ok( DuplicateHandle( GetCurrentProcess(), port, GetCurrentProcess(), &dup, 0, FALSE,
+                         DUPLICATE_SAME_ACCESS ), "DuplicateHandle failed, error %u\n", GetLastError() );
+    res = pNtSetIoCompletion( dup, 2, 21, STATUS_SUCCESS, 0 );
+    ok( res == STATUS_SUCCESS, "NtSetIoCompletion failed: %#x\n", res );
+    count = get_pending_msgs( port );
+    ok( count == 2, "Unexpected msg count: %d\n", count );
+    res = pNtRemoveIoCompletion( dup, &key, &value, &iosb, NULL );
+    ok( res == STATUS_SUCCESS, "NtRemoveIoCompletion failed: %#x\n", res );
+    ok( value == 20, "got value %lu\n", value );
+    res = pNtRemoveIoCompletion( port, &key, &value, &iosb, NULL );
+    ok( res == STATUS_SUCCESS, "NtRemoveIoCompletion failed: %#x\n", res );
+    ok( value == 21, "got value %lu\n", value );
+    CloseHandle( dup );
+    CloseHandle( port );
+
+    /* and after binding a file to the port */
+    res = pNtCreateIoCompletion( &port, IO_COMPLETION_ALL_ACCESS, NULL, 0 );
+    ok( res == STATUS_SUCCESS, "NtCreateIoCompletion failed: %#x\n", res );
+    res = pNtSetIoCompletion( port, 3, 30, STATUS_SUCCESS, 0 );
+    ok( res == STATUS_SUCCESS, "NtSetIoCompletion failed: %#x\n", res );
+    if ((file = create_temp_file( FILE_FLAG_OVERLAPPED )))
+    {
+        ok( CreateIoCompletionPort( file, port, 4, 0 ) == port, "failed to bind file, error %u\n",
+            GetLastError() );
+        res = pNtRemoveIoCompletion( port, &key, &value, &iosb, NULL );
+        ok( res == STATUS_SUCCESS, "NtRemoveIoCompletion failed: %#x\n", res );
+        ok( key == 3 && value == 30, "got key %lu value %lu\n", key, value );
+        CloseHandle( file );
+    }
+    CloseHandle( port );
+
+    /* only one thread may process packets at a time, unless it blocks */
+    res = pNtCreateIoCompletion( &port, IO_COMPLETION_ALL_ACCESS, NULL, 1 );
+    ok( res == STATUS_SUCCESS, "NtCreateIoCompletion failed: %#x\n", res );
+    res = pNtSetIoCompletion( port, 4, 40, STATUS_SUCCESS, 0 );
+    ok( res == STATUS_SUCCESS, "NtSetIoCompletion failed: %#x\n", res );
+    res = pNtSetIoCompletion( port, 4, 41, STATUS_SUCCESS, 0 );
+    ok( res == STATUS_SUCCESS, "NtSetIoCompletion failed: %#x\n", res );
+    completion_thread_state = 0;
+    completion_thread_event = CreateEventA( NULL, TRUE, FALSE, NULL );
+    thread = CreateThread( NULL, 0, completion_active_thread, port, 0, NULL );
+    while (!completion_thread_state) Sleep( 1 );
+    timeout.QuadPart = -100 * 10000;
+    res = pNtRemoveIoCompletion( port, &key, &value, &iosb, &timeout );
+    ok( res == STATUS_TIMEOUT, "NtRemoveIoCompletion returned %#x\n", res );
+    InterlockedExchange( &completion_thread_state, 2 );
+    res = pNtRemoveIoCompletion( port, &key, &value, &iosb, NULL );
+    ok( res == STATUS_SUCCESS, "NtRemoveIoCompletion failed: %#x\n", res );
+    ok( value == 41, "got value %lu\n", value );
+    SetEvent( completion_thread_event );
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+    CloseHandle( completion_thread_event );
+    CloseHandle( port );
+}
+
 static void test_file_io_completion(void)
 {
     static const char pipe_name[] = "\\\\.\\pipe\\iocompletiontestnamedpipe";
@@ -4608,6 +4741,85 @@ static void test_read_write(void)
     CloseHandle(hfile);
 }
 
+static void test_overlapped_read_many(void)
+{
+    static const unsigned int block = 4096, blocks = 256, count = 512;
+    IO_STATUS_BLOCK iosb[32];
+    HANDLE events[32], hfile, port;
+    unsigned int slot_block[32];
+    LARGE_INTEGER offset;
+    OVERLAPPED *ovl;
+    char *data, *bufs;
+    ULONG_PTR key;
+    unsigned int i, next, done = 0, completions = 0;
+    DWORD size;
+    NTSTATUS status;
+
+    if (!(hfile = create_temp_file( FILE_FLAG_OVERLAPPED ))) return;
+
+    data = HeapAlloc( GetProcessHeap(), 0, blocks * block );
+    bufs = HeapAlloc( GetProcessHeap(), 0, ARRAY_SIZE(events) * block );
+    for (i = 0; i < blocks * block; i++) data[i] = i * 7 + i / block;
+
+    offset.QuadPart = 0;
+    status = pNtWriteFile( hfile, NULL, NULL, NULL, &iosb[0], data, blocks * block, &offset, NULL );
+    if (status == STATUS_PENDING) WaitForSingleObject( hfile, INFINITE );
+    ok( U(iosb[0]).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb[0]).Status );
+    ok( iosb[0].Information == blocks * block, "got size %lu\n", iosb[0].Information );
+
+    port = CreateIoCompletionPort( hfile, NULL, 0xdead, 0 );
+    ok( port != NULL, "failed to create port, error %u\n", GetLastError() );
+
+    for (i = 0; i < ARRAY_SIZE(events); i++) events[i] = CreateEventA( NULL, TRUE, FALSE, NULL );
+
+    /* keep a fixed number of reads in flight, reissuing each one as it completes */
+    for (next = 0; next < ARRAY_SIZE(events); next++)
+    {
+        slot_block[next] = next * 37 % blocks;
+        offset.QuadPart = slot_block[next] * block;
+        status = pNtReadFile( hfile, events[next], NULL, &iosb[next], &iosb[next],
+                              bufs + next * block, block, &offset, NULL );
+        ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "got status %#x\n", status );
+    }
+    while (done < count)
+    {
+        i = WaitForMultipleObjects( ARRAY_SIZE(events), events, FALSE, INFINITE ) - WAIT_OBJECT_0;
+        ok( i < ARRAY_SIZE(events), "wait failed, error %u\n", GetLastError() );
+        if (i >= ARRAY_SIZE(events)) break;
+
+        ok( U(iosb[i]).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb[i]).Status );
+        ok( iosb[i].Information == block, "got size %lu\n", iosb[i].Information );
+        ok( !memcmp( bufs + i * block, data + slot_block[i] * block, block ),
+            "wrong data for block %u\n", slot_block[i] );
+        ResetEvent( events[i] );
+        done++;
+
+        if (next < count)
+        {
+            slot_block[i] = next * 37 % blocks;
+            offset.QuadPart = slot_block[i] * block;
+            status = pNtReadFile( hfile, events[i], NULL, &iosb[i], &iosb[i],
+                                  bufs + i * block, block, &offset, NULL );
+            ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "got status %#x\n", status );
+            next++;
+        }
+    }
+
+    while (completions < count && GetQueuedCompletionStatus( port, &size, &key, &ovl, 1000 ))
+    {
+        ok( key == 0xdead, "got key %#lx\n", key );
+        ok( size == block, "got size %u\n", size );
+        completions++;
+    }
+    ok( completions == count, "got %u completions\n", completions );
+
+    for (i = 0; i < ARRAY_SIZE(events); i++) CloseHandle( events[i] );
+    CloseHandle( port );
+    CloseHandle( hfile );
+    HeapFree( GetProcessHeap(), 0, bufs );
+    HeapFree( GetProcessHeap(), 0, data );
+}
+
 static void test_ioctl(void)
 {
     HANDLE event = CreateEventA(NULL, TRUE, FALSE, NULL);
@@ -4734,6 +4946,7 @@ START_TEST(file)
     append_file_test();
     nt_mailslot_test();
     test_set_io_completion();
+    test_local_io_completion();
     test_file_io_completion();
     test_file_basic_information();
     test_file_all_information();
@@ -4745,6 +4958,7 @@ START_TEST(file)
     test_file_link_information();
     test_file_disposition_information();
     test_file_completion_information();
+    test_overlapped_read_many();
     test_file_id_information();
     test_file_access_information();
     test_file_mode();
@@ -1609,6 +1609,117 @@ static void test_query_object(void)
     pRtlFreeUnicodeString( &session );
 }
 
+static void test_handle_info_cache(void)
+{
+    static const WCHAR type_event[] = {'E','v','e','n','t'};
+    static const WCHAR type_semaphore[] = {'S','e','m','a','p','h','o','r','e'};
+    OBJECT_TYPE_INFORMATION *type;
+    char buffer[1024];
+    HANDLE handle, handle2;
+    NTSTATUS status;
+    DWORD flags;
+    ULONG len;
+    int i;
+
+    handle = CreateEventA( NULL, FALSE, FALSE, NULL );
+    ok( GetHandleInformation( handle, &flags ), "GetHandleInformation failed %u\n", GetLastError() );
+    ok( !flags, "got flags %x\n", flags );
+    ok( SetHandleInformation( handle, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT ),
+        "SetHandleInformation failed %u\n", GetLastError() );
+    ok( GetHandleInformation( handle, &flags ), "GetHandleInformation failed %u\n", GetLastError() );
+    ok( flags == HANDLE_FLAG_INHERIT, "got flags %x\n", flags );
+
+    type = (OBJECT_TYPE_INFORMATION *)buffer;
+    for (i = 0; i < 2; i++)
+    {
+        status = pNtQueryObject( handle, ObjectTypeInformation, buffer, sizeof(buffer), &len );
+        ok( status == STATUS_SUCCESS, "NtQueryObject failed %x\n", status );
+        ok( type->TypeName.Length == sizeof(type_event) &&
+            !memcmp( type->TypeName.Buffer, type_event, sizeof(type_event) ),
+            "wrong type name %s\n", wine_dbgstr_w(type->TypeName.Buffer) );
+        ok( len == sizeof(*type) + sizeof(type_event) + sizeof(WCHAR), "unexpected len %u\n", len );
+    }
+    status = pNtQueryObject( handle, ObjectTypeInformation, buffer, sizeof(*type), &len );
+    ok( status == STATUS_INFO_LENGTH_MISMATCH, "NtQueryObject failed %x\n", status );
+    ok( len == sizeof(*type) + sizeof(type_event) + sizeof(WCHAR), "unexpected len %u\n", len );
+
+    pNtClose( handle );
+
+    /* handle values get reused, the cached information must not be */
+    handle2 = CreateSemaphoreA( NULL, 0, 1, NULL );
+    ok( GetHandleInformation( handle2, &flags ), "GetHandleInformation failed %u\n", GetLastError() );
+    ok( !flags, "got flags %x\n", flags );
+    status = pNtQueryObject( handle2, ObjectTypeInformation, buffer, sizeof(buffer), &len );
+    ok( status == STATUS_SUCCESS, "NtQueryObject failed %x\n", status );
+    ok( type->TypeName.Length == sizeof(type_semaphore) &&
+        !memcmp( type->TypeName.Buffer, type_semaphore, sizeof(type_semaphore) ),
+        "wrong type name %s\n", wine_dbgstr_w(type->TypeName.Buffer) );
+    if (handle2 == handle) trace( "handle %p was reused\n", handle );
+    pNtClose( handle2 );
+
+    ok( !GetHandleInformation( handle, &flags ), "GetHandleInformation succeeded\n" );
+    ok( GetLastError() == ERROR_INVALID_HANDLE, "got error %u\n", GetLastError() );
+}
+
+static void close_parent_handle( DWORD pid, HANDLE handle )
+{
+    HANDLE process, dup;
+    BOOL ret;
+
+    process = OpenProcess( PROCESS_DUP_HANDLE, FALSE, pid );
+    ok( process != NULL, "OpenProcess failed %u\n", GetLastError() );
+    ret = DuplicateHandle( process, handle, GetCurrentProcess(), &dup, 0, FALSE,
+                           DUPLICATE_SAME_ACCESS | DUPLICATE_CLOSE_SOURCE );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    CloseHandle( dup );
+    CloseHandle( process );
+}
+
+static void test_handle_info_remote_close(void)
+{
+    static const WCHAR type_semaphore[] = {'S','e','m','a','p','h','o','r','e'};
+    char buffer[1024];
+    OBJECT_TYPE_INFORMATION *type = (OBJECT_TYPE_INFORMATION *)buffer;
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[MAX_PATH * 2], **argv;
+    HANDLE handle, handle2;
+    NTSTATUS status;
+    DWORD flags;
+    ULONG len;
+    BOOL ret;
+
+    handle = CreateEventA( NULL, FALSE, FALSE, NULL );
+    ok( GetHandleInformation( handle, &flags ), "GetHandleInformation failed %u\n", GetLastError() );
+    status = pNtQueryObject( handle, ObjectTypeInformation, type, sizeof(buffer), &len );
+    ok( status == STATUS_SUCCESS, "NtQueryObject failed %x\n", status );
+
+    /* another process closes the handle behind our back */
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" om close_handle %x %p", argv[0], GetCurrentProcessId(), handle );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess failed %u\n", GetLastError() );
+    winetest_wait_child_process( pi.hProcess );
+    CloseHandle( pi.hProcess );
+    CloseHandle( pi.hThread );
+
+    ok( !GetHandleInformation( handle, &flags ), "GetHandleInformation succeeded\n" );
+    ok( GetLastError() == ERROR_INVALID_HANDLE, "got error %u\n", GetLastError() );
+    status = pNtQueryObject( handle, ObjectTypeInformation, type, sizeof(buffer), &len );
+    ok( status == STATUS_INVALID_HANDLE, "NtQueryObject returned %x\n", status );
+
+    handle2 = CreateSemaphoreA( NULL, 0, 1, NULL );
+    if (handle2 == handle)
+    {
+        status = pNtQueryObject( handle2, ObjectTypeInformation, type, sizeof(buffer), &len );
+        ok( status == STATUS_SUCCESS, "NtQueryObject failed %x\n", status );
+        ok( type->TypeName.Length == sizeof(type_semaphore) &&
+            !memcmp( type->TypeName.Buffer, type_semaphore, sizeof(type_semaphore) ),
+            "wrong type name %s\n", wine_dbgstr_w(type->TypeName.Buffer) );
+    }
+    CloseHandle( handle2 );
+}
+
 static void test_type_mismatch(void)
 {
     HANDLE h;
@@ -2141,10 +2252,86 @@ static void test_wait_on_address(void)
     ok(address == 0, "got %s\n", wine_dbgstr_longlong(address));
 }
 
+#define PING_PONG_COUNT 1000
+
+static LONG ping_pong_turn;
+
+static DWORD WINAPI address_ping_pong_thread( void *arg )
+{
+    LONG compare = 0;
+    int i;
+
+    for (i = 0; i < PING_PONG_COUNT; i++)
+    {
+        while (ping_pong_turn == 0) pRtlWaitOnAddress( &ping_pong_turn, &compare, sizeof(compare), NULL );
+        InterlockedExchange( &ping_pong_turn, 0 );
+        pRtlWakeAddressSingle( &ping_pong_turn );
+    }
+    return 0;
+}
+
+static DWORD WINAPI address_wait_thread( void *arg )
+{
+    LONG *address = arg, compare = 0;
+
+    while (*address == 0) pRtlWaitOnAddress( address, &compare, sizeof(compare), NULL );
+    return 0;
+}
+
+static void test_wait_on_address_contention(void)
+{
+    HANDLE thread;
+    LONG compare = 1, address = 0;
+    int i;
+
+    if (!pRtlWaitOnAddress)
+    {
+        win_skip("RtlWaitOnAddress not supported, skipping test\n");
+        return;
+    }
+
+    ping_pong_turn = 0;
+    thread = CreateThread( NULL, 0, address_ping_pong_thread, NULL, 0, NULL );
+    for (i = 0; i < PING_PONG_COUNT; i++)
+    {
+        InterlockedExchange( &ping_pong_turn, 1 );
+        pRtlWakeAddressSingle( &ping_pong_turn );
+        while (ping_pong_turn == 1) pRtlWaitOnAddress( &ping_pong_turn, &compare, sizeof(compare), NULL );
+    }
+    ok( !WaitForSingleObject( thread, 1000 ), "wait failed\n" );
+    CloseHandle( thread );
+    ok( ping_pong_turn == 0, "got %d\n", ping_pong_turn );
+
+    /* a waiter that gets terminated must not consume the wake-up of the next one */
+    thread = CreateThread( NULL, 0, address_wait_thread, &address, 0, NULL );
+    ok( WaitForSingleObject( thread, 100 ) == WAIT_TIMEOUT, "thread exited\n" );
+    TerminateThread( thread, 0 );
+    ok( !WaitForSingleObject( thread, 1000 ), "wait failed\n" );
+    CloseHandle( thread );
+
+    thread = CreateThread( NULL, 0, address_wait_thread, &address, 0, NULL );
+    ok( WaitForSingleObject( thread, 100 ) == WAIT_TIMEOUT, "thread exited\n" );
+    InterlockedExchange( &address, 1 );
+    pRtlWakeAddressSingle( &address );
+    ok( !WaitForSingleObject( thread, 1000 ), "wait failed\n" );
+    CloseHandle( thread );
+}
+
 START_TEST(om)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
     HMODULE hkernel32 = GetModuleHandleA("kernel32.dll");
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 5 && !strcmp( argv[2], "close_handle" ))
+    {
+        HANDLE handle;
+        sscanf( argv[4], "%p", &handle );
+        close_parent_handle( strtoul( argv[3], NULL, 16 ), handle );
+        return;
+    }
 
     if (!hntdll)
     {
@@ -2206,10 +2393,13 @@ START_TEST(om)
     test_directory();
     test_symboliclink();
     test_query_object();
+    test_handle_info_cache();
+    test_handle_info_remote_close();
     test_type_mismatch();
     test_event();
     test_mutant();
     test_keyed_events();
     test_null_device();
     test_wait_on_address();
+    test_wait_on_address_contention();
 }
@@ -3572,6 +3572,139 @@ static void test_LdrRegisterDllNotification(void)
     pLdrUnregisterDllNotification(cookie);
 }
 
+#define HEAP_TEST_THREADS 4
+#define HEAP_TEST_BLOCKS  64
+
+static DWORD WINAPI heap_stress_thread(void *arg)
+{
+    HANDLE heap = arg;
+    unsigned char *blocks[HEAP_TEST_BLOCKS] = { NULL };
+    SIZE_T sizes[HEAP_TEST_BLOCKS];
+    unsigned int i, j;
+    DWORD errors = 0;
+
+    for (i = 0; i < 10000; i++)
+    {
+        j = i % HEAP_TEST_BLOCKS;
+        if (blocks[j])
+        {
+            if (blocks[j][0] != j || blocks[j][sizes[j] - 1] != j) errors++;
+            if (HeapSize(heap, 0, blocks[j]) != sizes[j]) errors++;
+            if (!HeapFree(heap, 0, blocks[j])) errors++;
+        }
+        sizes[j] = (i * 37) % 1024 + 1;
+        if (!(blocks[j] = HeapAlloc(heap, 0, sizes[j]))) return errors + 1;
+        memset(blocks[j], j, sizes[j]);
+    }
+    for (j = 0; j < HEAP_TEST_BLOCKS; j++) HeapFree(heap, 0, blocks[j]);
+    return errors;
+}
+
+static void heap_stress(HANDLE heap)
+{
+    HANDLE threads[HEAP_TEST_THREADS];
+    DWORD i, ret;
+
+    for (i = 0; i < HEAP_TEST_THREADS; i++)
+    {
+        threads[i] = CreateThread(NULL, 0, heap_stress_thread, heap, 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed: %u\n", GetLastError());
+    }
+    for (i = 0; i < HEAP_TEST_THREADS; i++)
+    {
+        ret = WaitForSingleObject(threads[i], 60000);
+        ok(ret == WAIT_OBJECT_0, "thread didn't finish: %u\n", ret);
+        GetExitCodeThread(threads[i], &ret);
+        ok(!ret, "thread %u got %u errors\n", i, ret);
+        CloseHandle(threads[i]);
+    }
+}
+
+static BOOL heap_walk_find(HANDLE heap, void *ptr)
+{
+    PROCESS_HEAP_ENTRY entry;
+    BOOL found = FALSE;
+
+    HeapLock(heap);
+    entry.lpData = NULL;
+    while (HeapWalk(heap, &entry))
+    {
+        if (entry.lpData != ptr) continue;
+        ok(entry.wFlags & PROCESS_HEAP_ENTRY_BUSY, "got flags %#x\n", entry.wFlags);
+        ok(entry.cbData >= 24, "got size %u\n", entry.cbData);
+        found = TRUE;
+    }
+    HeapUnlock(heap);
+    return found;
+}
+
+static void test_low_fragmentation_heap(void)
+{
+    ULONG info, lfh = 2;
+    HANDLE heap, lfh_heap;
+    BYTE *p, *p2;
+    SIZE_T size;
+    BOOL ret;
+    int i;
+
+    heap = HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+    ok(heap != NULL, "HeapCreate failed\n");
+    ret = HeapSetInformation(heap, HeapCompatibilityInformation, &lfh, sizeof(lfh));
+    ok(!ret, "HeapSetInformation succeeded on a HEAP_NO_SERIALIZE heap\n");
+    HeapDestroy(heap);
+
+    heap = HeapCreate(0, 0x10000, 0x10000);
+    ok(heap != NULL, "HeapCreate failed\n");
+    ret = HeapSetInformation(heap, HeapCompatibilityInformation, &lfh, sizeof(lfh));
+    ok(!ret, "HeapSetInformation succeeded on a fixed size heap\n");
+    HeapDestroy(heap);
+
+    lfh_heap = HeapCreate(0, 0, 0);
+    ok(lfh_heap != NULL, "HeapCreate failed\n");
+    ret = HeapSetInformation(lfh_heap, HeapCompatibilityInformation, &lfh, sizeof(lfh));
+    ok(ret, "HeapSetInformation failed: %u\n", GetLastError());
+    info = 0xdeadbeef;
+    ret = HeapQueryInformation(lfh_heap, HeapCompatibilityInformation, &info, sizeof(info), &size);
+    ok(ret, "HeapQueryInformation failed: %u\n", GetLastError());
+    ok(info == 2, "expected 2, got %u\n", info);
+
+    p = HeapAlloc(lfh_heap, HEAP_ZERO_MEMORY, 24);
+    ok(p != NULL, "HeapAlloc failed\n");
+    ok(HeapSize(lfh_heap, 0, p) == 24, "wrong size %lu\n", HeapSize(lfh_heap, 0, p));
+    ok(HeapValidate(lfh_heap, 0, p), "HeapValidate failed\n");
+    for (i = 0; i < 24; i++) ok(!p[i], "byte %u is %x\n", i, p[i]);
+    memset(p, 0xcc, 24);
+
+    p2 = HeapReAlloc(lfh_heap, HEAP_ZERO_MEMORY, p, 20);
+    ok(p2 != NULL, "HeapReAlloc failed\n");
+    ok(HeapSize(lfh_heap, 0, p2) == 20, "wrong size %lu\n", HeapSize(lfh_heap, 0, p2));
+    p = HeapReAlloc(lfh_heap, HEAP_ZERO_MEMORY, p2, 2000);
+    ok(p != NULL, "HeapReAlloc failed\n");
+    ok(HeapSize(lfh_heap, 0, p) == 2000, "wrong size %lu\n", HeapSize(lfh_heap, 0, p));
+    ok(p[0] == 0xcc && p[19] == 0xcc, "data not preserved\n");
+    ok(!p[20] && !p[1999], "data not zeroed\n");
+    ok(HeapFree(lfh_heap, 0, p), "HeapFree failed\n");
+
+    /* small blocks must be enumerated and validated */
+    p = HeapAlloc(lfh_heap, 0, 24);
+    ok(heap_walk_find(lfh_heap, p), "block %p not found by HeapWalk\n", p);
+    ok(HeapValidate(lfh_heap, 0, NULL), "HeapValidate failed\n");
+    HeapFree(lfh_heap, 0, p);
+    p = HeapAlloc(GetProcessHeap(), 0, 24);
+    ok(heap_walk_find(GetProcessHeap(), p), "block %p not found by HeapWalk\n", p);
+    ok(HeapValidate(GetProcessHeap(), 0, NULL), "HeapValidate failed\n");
+    HeapFree(GetProcessHeap(), 0, p);
+
+    heap = HeapCreate(0, 0, 0);
+    ok(heap != NULL, "HeapCreate failed\n");
+    heap_stress(heap);
+    heap_stress(lfh_heap);
+    ok(HeapValidate(heap, 0, NULL), "HeapValidate failed\n");
+    ok(HeapValidate(lfh_heap, 0, NULL), "HeapValidate failed\n");
+    HeapDestroy(heap);
+    HeapDestroy(lfh_heap);
+}
+
 START_TEST(rtl)
 {
     InitFunctionPtrs();
@@ -3612,4 +3745,5 @@ START_TEST(rtl)
     test_LdrEnumerateLoadedModules();
     test_RtlMakeSelfRelativeSD();
     test_LdrRegisterDllNotification();
+    test_low_fragmentation_heap();
 }
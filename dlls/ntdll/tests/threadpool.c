@@ -356,7 +356,6 @@ static void test_RtlRegisterWait(void)
     ok(!status, "RtlDeregisterWaitEx failed with status %x\n", status);
     ok(info.userdata == 0, "expected info.userdata = 0, got %u\n", info.userdata);
     result = WaitForSingleObject(event, 200);
-    todo_wine
     ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
 
     /* test RtlDeregisterWaitEx after wait expired */
@@ -393,7 +392,6 @@ static void test_RtlRegisterWait(void)
     ok(!status, "RtlDeregisterWaitEx failed with status %x\n", status);
     ok(info.userdata == 0x10000, "expected info.userdata = 0x10000, got %u\n", info.userdata);
     result = WaitForSingleObject(event, 200);
-    todo_wine
     ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
 
     /* test RtlDeregisterWaitEx while callback is running */
@@ -460,6 +458,66 @@ static void test_RtlRegisterWait(void)
     CloseHandle(event);
 }
 
+static LONG rtl_wait_many_count;
+static HANDLE rtl_wait_many_done;
+
+static void CALLBACK rtl_wait_many_cb(void *userdata, BOOLEAN timeout)
+{
+    ok(!timeout, "expected timeout = FALSE\n");
+    if (!InterlockedDecrement(&rtl_wait_many_count))
+        SetEvent(rtl_wait_many_done);
+}
+
+static void test_RtlRegisterWait_many(void)
+{
+    static const int count = 1000;
+    HANDLE *events, *waits;
+    DWORD result;
+    NTSTATUS status;
+    int i, registered;
+
+    events = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*events));
+    waits = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*waits));
+    rtl_wait_many_done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(rtl_wait_many_done != NULL, "failed to create event\n");
+
+    /* registered waits should not need a thread each */
+    for (registered = 0; registered < count; registered++)
+    {
+        events[registered] = CreateEventW(NULL, FALSE, FALSE, NULL);
+        ok(events[registered] != NULL, "failed to create event\n");
+        status = RtlRegisterWait(&waits[registered], events[registered], rtl_wait_many_cb,
+                                 NULL, INFINITE, WT_EXECUTEONLYONCE);
+        ok(!status, "RtlRegisterWait failed with status %x\n", status);
+        if (status)
+        {
+            CloseHandle(events[registered]);
+            break;
+        }
+    }
+
+    rtl_wait_many_count = registered;
+    for (i = 0; i < registered; i++)
+        SetEvent(events[i]);
+    if (registered)
+    {
+        result = WaitForSingleObject(rtl_wait_many_done, 30000);
+        ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    }
+    ok(!rtl_wait_many_count, "%d callbacks did not run\n", rtl_wait_many_count);
+
+    for (i = 0; i < registered; i++)
+    {
+        status = RtlDeregisterWaitEx(waits[i], INVALID_HANDLE_VALUE);
+        ok(!status, "RtlDeregisterWaitEx failed with status %x\n", status);
+        CloseHandle(events[i]);
+    }
+
+    CloseHandle(rtl_wait_many_done);
+    HeapFree(GetProcessHeap(), 0, waits);
+    HeapFree(GetProcessHeap(), 0, events);
+}
+
 static void CALLBACK simple_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE semaphore = userdata;
@@ -634,6 +692,51 @@ static void test_tp_work(void)
     pTpReleasePool(pool);
 }
 
+static void CALLBACK work_count_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement((LONG *)userdata);
+}
+
+static void test_tp_work_many(void)
+{
+    static const LONG count = 2000;
+    TP_CALLBACK_ENVIRON environment;
+    SYSTEM_INFO info;
+    TP_WORK *work;
+    TP_POOL *pool;
+    NTSTATUS status;
+    DWORD threads;
+    LONG userdata;
+    int i;
+
+    GetSystemInfo(&info);
+    for (threads = 1; threads <= min(info.dwNumberOfProcessors, 8); threads *= 2)
+    {
+        pool = NULL;
+        status = pTpAllocPool(&pool, NULL);
+        ok(!status, "TpAllocPool failed with status %x\n", status);
+        ok(pool != NULL, "expected pool != NULL\n");
+        pTpSetPoolMaxThreads(pool, threads);
+
+        work = NULL;
+        memset(&environment, 0, sizeof(environment));
+        environment.Version = 1;
+        environment.Pool = pool;
+        status = pTpAllocWork(&work, work_count_cb, &userdata, &environment);
+        ok(!status, "TpAllocWork failed with status %x\n", status);
+        ok(work != NULL, "expected work != NULL\n");
+
+        userdata = 0;
+        for (i = 0; i < count; i++)
+            pTpPostWork(work);
+        pTpWaitForWork(work, FALSE);
+        ok(userdata == count, "expected userdata = %u, got %u\n", count, userdata);
+
+        pTpReleaseWork(work);
+        pTpReleasePool(pool);
+    }
+}
+
 static void test_tp_work_scheduler(void)
 {
     TP_CALLBACK_ENVIRON environment;
@@ -1901,12 +2004,14 @@ START_TEST(threadpool)
 {
     test_RtlQueueWorkItem();
     test_RtlRegisterWait();
+    test_RtlRegisterWait_many();
 
     if (!init_threadpool())
         return;
 
     test_tp_simple();
     test_tp_work();
+    test_tp_work_many();
     test_tp_work_scheduler();
     test_tp_group_wait();
     test_tp_group_cancel();
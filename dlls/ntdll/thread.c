@@ -397,6 +397,7 @@ void thread_init(void)
     user_shared_data->u.TickCount.High2Time = user_shared_data->u.TickCount.High1Time;
     user_shared_data->TickCountLowDeprecated = user_shared_data->u.TickCount.LowPart;
     user_shared_data->TickCountMultiplier = 1 << 24;
+    user_shared_data->LargePageMinimum = virtual_get_large_page_size();
 
     fill_cpu_info();
 
@@ -433,6 +434,7 @@ void abort_thread( int status )
 {
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
     if (interlocked_xchg_add( &nb_threads, -1 ) <= 1) _exit( status );
+    keyed_futex_release_thread( TRUE );
     signal_exit_thread( status );
 }
 
@@ -478,6 +480,8 @@ void WINAPI RtlExitUserThread( ULONG status )
 
     LdrShutdownThread();
     RtlFreeThreadActivationContextStack();
+    local_completion_release_thread();
+    keyed_futex_release_thread( FALSE );
 
     pthread_sigmask( SIG_BLOCK, &server_block_set, NULL );
 
@@ -71,19 +71,6 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_compl_debug =
       0, 0, { (DWORD_PTR)(__FILE__ ": threadpool_compl_cs") }
 };
 
-struct wait_work_item
-{
-    HANDLE Object;
-    HANDLE CancelEvent;
-    WAITORTIMERCALLBACK Callback;
-    PVOID Context;
-    ULONG Milliseconds;
-    ULONG Flags;
-    HANDLE CompletionEvent;
-    LONG DeleteCount;
-    int CallbackInProgress;
-};
-
 struct timer_queue;
 struct queue_timer
 {
@@ -114,6 +101,8 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_WORKER_SPIN    4000  /* iterations to spin before sleeping */
+#define THREADPOOL_MAX_SPINNING   2     /* max. number of spinning workers */
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
 /* internal threadpool representation */
@@ -131,6 +120,8 @@ struct threadpool
     int                     min_workers;
     int                     num_workers;
     int                     num_busy_workers;
+    int                     num_spinning_workers;
+    int                     num_unclaimed_spinners;
 };
 
 enum threadpool_objtype
@@ -165,6 +156,8 @@ struct threadpool_object
     LONG                    num_pending_callbacks;
     LONG                    num_running_callbacks;
     LONG                    num_associated_callbacks;
+    /* event signaled when the object is destroyed, see RtlDeregisterWaitEx */
+    HANDLE                  completed_event;
     /* arguments for callback */
     union
     {
@@ -198,6 +191,10 @@ struct threadpool_object
             struct list     wait_entry;
             ULONGLONG       timeout;
             HANDLE          handle;
+            /* information about RtlRegisterWait objects, read-only */
+            ULONG           flags;
+            ULONGLONG       period;
+            RTL_WAITORTIMERCALLBACKFUNC rtl_callback;
         } wait;
     } u;
 };
@@ -341,6 +338,15 @@ static inline LONG interlocked_dec( PLONG dest )
     return interlocked_xchg_add( dest, -1 ) - 1;
 }
 
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
 static void CALLBACK process_rtl_work_item( TP_CALLBACK_INSTANCE *instance, void *userdata )
 {
     struct rtl_work_item *item = userdata;
@@ -491,71 +497,11 @@ static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout
     return pTime;
 }
 
-static void delete_wait_work_item(struct wait_work_item *wait_work_item)
-{
-    NtClose( wait_work_item->CancelEvent );
-    RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
-}
-
-static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
+static void CALLBACK rtl_wait_callback( TP_CALLBACK_INSTANCE *instance, void *userdata,
+                                        TP_WAIT *wait, TP_WAIT_RESULT result )
 {
-    struct wait_work_item *wait_work_item = Arg;
-    NTSTATUS status;
-    BOOLEAN alertable = (wait_work_item->Flags & WT_EXECUTEINIOTHREAD) != 0;
-    HANDLE handles[2] = { wait_work_item->Object, wait_work_item->CancelEvent };
-    LARGE_INTEGER timeout;
-    HANDLE completion_event;
-
-    TRACE("\n");
-
-    while (TRUE)
-    {
-        status = NtWaitForMultipleObjects( 2, handles, TRUE, alertable,
-                                           get_nt_timeout( &timeout, wait_work_item->Milliseconds ) );
-        if (status == STATUS_WAIT_0 || status == STATUS_TIMEOUT)
-        {
-            BOOLEAN TimerOrWaitFired;
-
-            if (status == STATUS_WAIT_0)
-            {
-                TRACE( "object %p signaled, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = FALSE;
-            }
-            else
-            {
-                TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = TRUE;
-            }
-            interlocked_xchg( &wait_work_item->CallbackInProgress, TRUE );
-            if (wait_work_item->CompletionEvent)
-            {
-                TRACE( "Work has been canceled.\n" );
-                break;
-            }
-            wait_work_item->Callback( wait_work_item->Context, TimerOrWaitFired );
-            interlocked_xchg( &wait_work_item->CallbackInProgress, FALSE );
-
-            if (wait_work_item->Flags & WT_EXECUTEONLYONCE)
-                break;
-        }
-        else if (status != STATUS_USER_APC)
-            break;
-    }
-
-
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
-    {
-        completion_event = wait_work_item->CompletionEvent;
-        delete_wait_work_item( wait_work_item );
-        if (completion_event && completion_event != INVALID_HANDLE_VALUE)
-            NtSetEvent( completion_event, NULL );
-    }
-
-    return 0;
+    struct threadpool_object *object = impl_from_TP_WAIT( wait );
+    object->u.wait.rtl_callback( userdata, result != STATUS_WAIT_0 );
 }
 
 /***********************************************************************
@@ -587,42 +533,32 @@ NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
                                 RTL_WAITORTIMERCALLBACKFUNC Callback,
                                 PVOID Context, ULONG Milliseconds, ULONG Flags)
 {
-    struct wait_work_item *wait_work_item;
+    TP_CALLBACK_ENVIRON environment;
+    struct threadpool_object *object;
+    LARGE_INTEGER timeout;
+    TP_WAIT *wait;
     NTSTATUS status;
 
     TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
 
-    wait_work_item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*wait_work_item) );
-    if (!wait_work_item)
-        return STATUS_NO_MEMORY;
+    memset( &environment, 0, sizeof(environment) );
+    environment.Version = 1;
+    environment.u.s.LongFunction = (Flags & WT_EXECUTELONGFUNCTION) != 0;
 
-    wait_work_item->Object = Object;
-    wait_work_item->Callback = Callback;
-    wait_work_item->Context = Context;
-    wait_work_item->Milliseconds = Milliseconds;
-    wait_work_item->Flags = Flags;
-    wait_work_item->CallbackInProgress = FALSE;
-    wait_work_item->DeleteCount = 0;
-    wait_work_item->CompletionEvent = NULL;
+    /* The wait is multiplexed with other waits on one of the wait queue threads,
+     * instead of blocking a whole worker thread for each registered wait. */
+    status = TpAllocWait( &wait, rtl_wait_callback, Context, &environment );
+    if (status) return status;
 
-    status = NtCreateEvent( &wait_work_item->CancelEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
-    if (status != STATUS_SUCCESS)
-    {
-        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
-        return status;
-    }
+    object = impl_from_TP_WAIT( wait );
+    object->u.wait.flags        = Flags;
+    object->u.wait.period       = (Milliseconds == INFINITE) ? TIMEOUT_INFINITE : (ULONGLONG)Milliseconds * 10000;
+    object->u.wait.rtl_callback = Callback;
 
-    Flags = Flags & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD |
-                     WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION);
-    status = RtlQueueWorkItem( wait_thread_proc, wait_work_item, Flags );
-    if (status != STATUS_SUCCESS)
-    {
-        delete_wait_work_item( wait_work_item );
-        return status;
-    }
+    TpSetWait( wait, Object, get_nt_timeout( &timeout, Milliseconds ) );
 
-    *NewWaitObject = wait_work_item;
-    return status;
+    *NewWaitObject = object;
+    return STATUS_SUCCESS;
 }
 
 /***********************************************************************
@@ -640,52 +576,30 @@ NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
  */
 NTSTATUS WINAPI RtlDeregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent)
 {
-    struct wait_work_item *wait_work_item = WaitHandle;
+    struct threadpool_object *object = WaitHandle;
     NTSTATUS status;
-    HANDLE LocalEvent = NULL;
-    int CallbackInProgress;
 
     TRACE( "(%p %p)\n", WaitHandle, CompletionEvent );
 
     if (WaitHandle == NULL)
         return STATUS_INVALID_HANDLE;
 
-    interlocked_xchg_ptr( &wait_work_item->CompletionEvent, INVALID_HANDLE_VALUE );
-    CallbackInProgress = wait_work_item->CallbackInProgress;
-    TRACE( "callback in progress %u\n", CallbackInProgress );
-    if (CompletionEvent == INVALID_HANDLE_VALUE || !CallbackInProgress)
-    {
-        status = NtCreateEvent( &LocalEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE );
-        if (status != STATUS_SUCCESS)
-            return status;
-        interlocked_xchg_ptr( &wait_work_item->CompletionEvent, LocalEvent );
-    }
-    else if (CompletionEvent != NULL)
-    {
-        interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-    }
+    TpSetWait( (TP_WAIT *)object, NULL, NULL );
 
-    NtSetEvent( wait_work_item->CancelEvent, NULL );
-
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
-    {
-        status = STATUS_SUCCESS;
-        delete_wait_work_item( wait_work_item );
-    }
-    else if (LocalEvent)
-    {
-        TRACE( "Waiting for completion event\n" );
-        NtWaitForSingleObject( LocalEvent, FALSE, NULL );
-        status = STATUS_SUCCESS;
-    }
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
+        TpWaitForWait( (TP_WAIT *)object, TRUE );
     else
-    {
-        status = STATUS_PENDING;
-    }
+        object->completed_event = CompletionEvent;
 
-    if (LocalEvent)
-        NtClose( LocalEvent );
+    RtlEnterCriticalSection( &object->pool->cs );
+    if (object->num_pending_callbacks || object->num_running_callbacks ||
+        object->num_associated_callbacks)
+        status = STATUS_PENDING;
+    else
+        status = STATUS_SUCCESS;
+    RtlLeaveCriticalSection( &object->pool->cs );
 
+    TpReleaseWait( (TP_WAIT *)object );
     return status;
 }
 
@@ -1391,6 +1305,64 @@ static void tp_timerqueue_unlock( struct threadpool_object *timer )
     RtlLeaveCriticalSection( &timerqueue.cs );
 }
 
+/***********************************************************************
+ *           tp_waitqueue_fire    (internal)
+ *
+ * Handles a signaled or timed out wait object, called with waitqueue.cs held.
+ * Returns TRUE if the lock was temporarily released.
+ */
+static BOOL tp_waitqueue_fire( struct waitqueue_bucket *bucket, struct threadpool_object *wait,
+                               BOOL signaled )
+{
+    struct threadpool *pool = wait->pool;
+    LARGE_INTEGER now;
+
+    /* Wait objects registered with RtlRegisterWait are rearmed automatically,
+     * unless WT_EXECUTEONLYONCE is set. */
+    if (wait->u.wait.flags & WT_EXECUTEONLYONCE)
+    {
+        list_remove( &wait->u.wait.wait_entry );
+        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+    }
+    else if (wait->u.wait.period != TIMEOUT_INFINITE)
+    {
+        NtQuerySystemTime( &now );
+        wait->u.wait.timeout = now.QuadPart + wait->u.wait.period;
+    }
+    else
+        wait->u.wait.timeout = TIMEOUT_INFINITE;
+
+    if (!(wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
+    {
+        tp_object_submit( wait, signaled );
+        return FALSE;
+    }
+
+    /* Callbacks which require a persistent, alertable thread are executed
+     * directly on the wait queue thread. */
+    interlocked_inc( &wait->refcount );
+    RtlEnterCriticalSection( &pool->cs );
+    wait->num_running_callbacks++;
+    wait->num_associated_callbacks++;
+    RtlLeaveCriticalSection( &pool->cs );
+    RtlLeaveCriticalSection( &waitqueue.cs );
+
+    TRACE( "executing wait callback %p(%p, %u)\n", wait->u.wait.rtl_callback, wait->userdata, !signaled );
+    wait->u.wait.rtl_callback( wait->userdata, !signaled );
+    TRACE( "callback %p returned\n", wait->u.wait.rtl_callback );
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (!--wait->num_running_callbacks && !wait->num_pending_callbacks)
+        RtlWakeAllConditionVariable( &wait->group_finished_event );
+    if (!--wait->num_associated_callbacks && !wait->num_pending_callbacks)
+        RtlWakeAllConditionVariable( &wait->finished_event );
+    RtlLeaveCriticalSection( &pool->cs );
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+    tp_object_release( wait );
+    return TRUE;
+}
+
 /***********************************************************************
  *           waitqueue_thread_proc    (internal)
  */
@@ -1410,6 +1382,7 @@ static void CALLBACK waitqueue_thread_proc( void *param )
 
     for (;;)
     {
+    restart:
         NtQuerySystemTime( &now );
         timeout.QuadPart = TIMEOUT_INFINITE;
         num_handles = 0;
@@ -1421,23 +1394,23 @@ static void CALLBACK waitqueue_thread_proc( void *param )
             if (wait->u.wait.timeout <= now.QuadPart)
             {
                 /* Wait object timed out. */
-                list_remove( &wait->u.wait.wait_entry );
-                list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-                tp_object_submit( wait, FALSE );
-            }
-            else
-            {
-                if (wait->u.wait.timeout < timeout.QuadPart)
-                    timeout.QuadPart = wait->u.wait.timeout;
-
-                assert( num_handles < MAXIMUM_WAITQUEUE_OBJECTS );
-                interlocked_inc( &wait->refcount );
-                objects[num_handles] = wait;
-                handles[num_handles] = wait->u.wait.handle;
-                num_handles++;
+                /* The list might have changed while the lock was released. */
+                if (tp_waitqueue_fire( bucket, wait, FALSE )) goto restart;
             }
         }
 
+        LIST_FOR_EACH_ENTRY( wait, &bucket->waiting, struct threadpool_object, u.wait.wait_entry )
+        {
+            if (wait->u.wait.timeout < timeout.QuadPart)
+                timeout.QuadPart = wait->u.wait.timeout;
+
+            assert( num_handles < MAXIMUM_WAITQUEUE_OBJECTS );
+            interlocked_inc( &wait->refcount );
+            objects[num_handles] = wait;
+            handles[num_handles] = wait->u.wait.handle;
+            num_handles++;
+        }
+
         if (!bucket->objcount)
         {
             /* All wait objects have been destroyed, if no new wait objects are created
@@ -1455,7 +1428,7 @@ static void CALLBACK waitqueue_thread_proc( void *param )
         {
             handles[num_handles] = bucket->update_event;
             RtlLeaveCriticalSection( &waitqueue.cs );
-            status = NtWaitForMultipleObjects( num_handles + 1, handles, TRUE, FALSE, &timeout );
+            status = NtWaitForMultipleObjects( num_handles + 1, handles, TRUE, TRUE, &timeout );
             RtlEnterCriticalSection( &waitqueue.cs );
 
             if (status >= STATUS_WAIT_0 && status < STATUS_WAIT_0 + num_handles)
@@ -1466,9 +1439,7 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 {
                     /* Wait object signaled. */
                     assert( wait->u.wait.bucket == bucket );
-                    list_remove( &wait->u.wait.wait_entry );
-                    list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-                    tp_object_submit( wait, TRUE );
+                    tp_waitqueue_fire( bucket, wait, TRUE );
                 }
                 else
                     WARN("wait object %p triggered while object was destroyed\n", wait);
@@ -1657,16 +1628,18 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     pool->objcount              = 0;
     pool->shutdown              = FALSE;
 
-    RtlInitializeCriticalSection( &pool->cs );
+    RtlInitializeCriticalSectionAndSpinCount( &pool->cs, THREADPOOL_WORKER_SPIN );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
     list_init( &pool->pool );
     RtlInitializeConditionVariable( &pool->update_event );
 
-    pool->max_workers           = 500;
-    pool->min_workers           = 0;
-    pool->num_workers           = 0;
-    pool->num_busy_workers      = 0;
+    pool->max_workers            = 500;
+    pool->min_workers            = 0;
+    pool->num_workers            = 0;
+    pool->num_busy_workers       = 0;
+    pool->num_spinning_workers   = 0;
+    pool->num_unclaimed_spinners = 0;
 
     TRACE( "allocated threadpool %p\n", pool );
 
@@ -1870,6 +1843,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     object->num_pending_callbacks   = 0;
     object->num_running_callbacks   = 0;
     object->num_associated_callbacks = 0;
+    object->completed_event         = NULL;
 
     if (environment)
     {
@@ -1946,11 +1920,13 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
+    /* No new thread started - wake up one existing thread, unless
+     * a spinning thread that wasn't claimed yet is going to pick up the work item. */
     if (status != STATUS_SUCCESS)
     {
         assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
+        if (pool->num_unclaimed_spinners) pool->num_unclaimed_spinners--;
+        else RtlWakeConditionVariable( &pool->update_event );
     }
 
     RtlLeaveCriticalSection( &pool->cs );
@@ -2057,10 +2033,44 @@ static BOOL tp_object_release( struct threadpool_object *object )
     if (object->race_dll)
         LdrUnloadDll( object->race_dll );
 
+    if (object->completed_event && object->completed_event != INVALID_HANDLE_VALUE)
+        NtSetEvent( object->completed_event, NULL );
+
     RtlFreeHeap( GetProcessHeap(), 0, object );
     return TRUE;
 }
 
+/***********************************************************************
+ *           tp_worker_spin    (internal)
+ *
+ * Spins for a short while waiting for new work items, which is much
+ * cheaper than sleeping when small tasks are queued in quick succession.
+ * Has to be called with the pool lock held, returns TRUE if work items
+ * became available.
+ */
+static BOOL tp_worker_spin( struct threadpool *pool )
+{
+    const volatile struct list *list = &pool->pool;
+    ULONG count;
+
+    if (NtCurrentTeb()->Peb->NumberOfProcessors <= 1) return FALSE;
+    if (pool->num_spinning_workers >= THREADPOOL_MAX_SPINNING) return FALSE;
+
+    pool->num_spinning_workers++;
+    pool->num_unclaimed_spinners++;
+    RtlLeaveCriticalSection( &pool->cs );
+    for (count = THREADPOOL_WORKER_SPIN; count > 0; count--)
+    {
+        if (list->next != &pool->pool || pool->shutdown) break;
+        small_pause();
+    }
+    RtlEnterCriticalSection( &pool->cs );
+    pool->num_spinning_workers--;
+    /* every remaining spinner picks up one of the work items that claimed a spinner */
+    pool->num_unclaimed_spinners = min( pool->num_unclaimed_spinners, pool->num_spinning_workers );
+    return list_head( &pool->pool ) != NULL;
+}
+
 /***********************************************************************
  *           threadpool_worker_proc    (internal)
  */
@@ -2223,6 +2233,9 @@ static void CALLBACK threadpool_worker_proc( void *param )
         if (pool->shutdown)
             break;
 
+        if (tp_worker_spin( pool ) || pool->shutdown)
+            continue;
+
         /* Wait for new tasks or until the timeout expires. A thread only terminates
          * when no new tasks are available, and the number of threads can be
          * decreased without violating the min_workers limit. An exception is when
@@ -2332,6 +2345,9 @@ NTSTATUS WINAPI TpAllocWait( TP_WAIT **out, PTP_WAIT_CALLBACK callback, PVOID us
 
     object->type = TP_OBJECT_TYPE_WAIT;
     object->u.wait.callback = callback;
+    object->u.wait.flags = WT_EXECUTEONLYONCE;
+    object->u.wait.period = TIMEOUT_INFINITE;
+    object->u.wait.rtl_callback = NULL;
 
     status = tp_waitqueue_lock( object );
     if (status)
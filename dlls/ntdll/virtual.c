@@ -44,6 +44,15 @@
 #ifdef HAVE_SYS_SYSINFO_H
 # include <sys/sysinfo.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#ifdef HAVE_LINUX_USERFAULTFD_H
+# include <linux/userfaultfd.h>
+#endif
 #ifdef HAVE_VALGRIND_VALGRIND_H
 # include <valgrind/valgrind.h>
 #endif
@@ -109,6 +118,7 @@ static const BYTE VIRTUAL_Win32Flags[16] =
 };
 
 static struct wine_rb_tree views_tree;
+static struct file_view *last_view;  /* last view found by VIRTUAL_FindView */
 
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -169,6 +179,8 @@ static void *preload_reserve_start;
 static void *preload_reserve_end;
 static BOOL use_locks;
 static BOOL force_exec_prot;  /* whether to force PROT_EXEC on all PROT_READ mmaps */
+static BOOL use_uffd;  /* whether write watches are tracked by the kernel through userfaultfd */
+static size_t large_page_size;  /* size of large pages, 0 if not supported */
 
 static inline int is_view_valloc( const struct file_view *view )
 {
@@ -311,7 +323,7 @@ static int VIRTUAL_GetUnixProt( BYTE vprot )
         if (vprot & VPROT_WRITE) prot |= PROT_WRITE | PROT_READ;
         if (vprot & VPROT_WRITECOPY) prot |= PROT_WRITE | PROT_READ;
         if (vprot & VPROT_EXEC) prot |= PROT_EXEC | PROT_READ;
-        if (vprot & VPROT_WRITEWATCH) prot &= ~PROT_WRITE;
+        if ((vprot & VPROT_WRITEWATCH) && !use_uffd) prot &= ~PROT_WRITE;
     }
     if (!prot) prot = PROT_NONE;
     return prot;
@@ -393,6 +405,14 @@ static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 
     if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
 
+    /* repeated operations usually target the same view */
+    if (last_view && last_view->base <= addr &&
+        (const char *)addr < (const char *)last_view->base + last_view->size)
+    {
+        if ((const char *)last_view->base + last_view->size < (const char *)addr + size) return NULL;
+        return last_view;
+    }
+
     while (ptr)
     {
         struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
@@ -400,7 +420,7 @@ static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
         if (view->base > addr) ptr = ptr->left;
         else if ((const char *)view->base + view->size <= (const char *)addr) ptr = ptr->right;
         else if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
-        else return view;
+        else return last_view = view;
     }
     return NULL;
 }
@@ -687,6 +707,7 @@ static void delete_view( struct file_view *view ) /* [in] View */
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
     set_page_vprot( view->base, view->size, 0 );
     wine_rb_remove( &views_tree, &view->entry );
+    if (last_view == view) last_view = NULL;
     *(struct file_view **)view = next_free_view;
     next_free_view = view;
 }
@@ -857,6 +878,22 @@ static void mprotect_range( void *base, size_t size, BYTE set, BYTE clear )
 }
 
 
+/***********************************************************************
+ *           is_unix_prot_range
+ *
+ * Check if all the pages of a range already have the specified unix protection.
+ */
+static BOOL is_unix_prot_range( const void *base, size_t size, int unix_prot )
+{
+    const char *addr = ROUND_ADDR( base, page_mask );
+    const char *end = addr + ROUND_SIZE( base, size );
+
+    for ( ; addr < end; addr += page_size)
+        if (VIRTUAL_GetUnixProt( get_page_vprot( addr )) != unix_prot) return FALSE;
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           VIRTUAL_SetProt
  *
@@ -892,7 +929,10 @@ static BOOL VIRTUAL_SetProt( struct file_view *view, /* [in] Pointer to view */
         return TRUE;
     }
 
-    if (mprotect_exec( base, size, unix_prot )) /* FIXME: last error */
+    /* no need for a system call if the unix protection doesn't change,
+     * for instance when committing pages that are already committed */
+    if ((force_exec_prot || !is_unix_prot_range( base, size, unix_prot )) &&
+        mprotect_exec( base, size, unix_prot )) /* FIXME: last error */
         return FALSE;
 
     set_page_vprot( base, size, vprot );
@@ -926,6 +966,192 @@ static NTSTATUS set_protection( struct file_view *view, void *base, SIZE_T size,
 }
 
 
+/***********************************************************************
+ *           userfaultfd write watches
+ *
+ * When WINEUFFD is set and the kernel supports asynchronous userfaultfd
+ * write protection, write watch ranges are registered with a userfaultfd
+ * and their pages stay writable. The first write to a protected page is
+ * resolved by the kernel without raising a signal, and the written pages
+ * are retrieved and protected again with the PAGEMAP_SCAN ioctl.
+ */
+#if defined(HAVE_LINUX_USERFAULTFD_H) && defined(__NR_userfaultfd)
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+
+/* from linux/fs.h, the system headers may not be recent enough */
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WRITTEN     (1 << 1)
+#define PM_SCAN_WP_MATCHING (1 << 0)
+
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+static int uffd_fd = -1;
+static int pagemap_fd = -1;
+
+/* check whether userfaultfd write watches can be used; called on the first write watch allocation */
+static void init_uffd(void)
+{
+    static const __u64 features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    static BOOL initialized;
+    struct uffdio_api api;
+    const char *env;
+    int fd;
+
+    if (initialized) return;
+    initialized = TRUE;
+
+    if (!(env = getenv( "WINEUFFD" )) || !atoi( env )) return;
+
+    if ((fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY )) == -1 &&
+        (fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK )) == -1)
+    {
+        WARN( "userfaultfd not available, errno %d\n", errno );
+        return;
+    }
+    memset( &api, 0, sizeof(api) );
+    api.api = UFFD_API;
+    api.features = features;
+    if (ioctl( fd, UFFDIO_API, &api ) == -1 || (api.features & features) != features)
+    {
+        WARN( "asynchronous userfaultfd write protection not supported\n" );
+        close( fd );
+        return;
+    }
+    if ((pagemap_fd = open( "/proc/self/pagemap", O_RDONLY | O_CLOEXEC )) == -1)
+    {
+        close( fd );
+        return;
+    }
+    uffd_fd = fd;
+    use_uffd = TRUE;
+    TRACE( "using userfaultfd for write watches\n" );
+}
+
+/* write protect a range, so that the next writes get reported */
+static BOOL uffd_protect( void *base, size_t size )
+{
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (ULONG_PTR)base;
+    wp.range.len   = size;
+    wp.mode        = UFFDIO_WRITEPROTECT_MODE_WP;
+    if (!ioctl( uffd_fd, UFFDIO_WRITEPROTECT, &wp )) return TRUE;
+    ERR( "failed to write protect %p-%p, errno %d\n", base, (char *)base + size, errno );
+    return FALSE;
+}
+
+/* register a newly mapped write watch range */
+static BOOL uffd_register( void *base, size_t size )
+{
+    struct uffdio_register reg;
+
+    reg.range.start = (ULONG_PTR)base;
+    reg.range.len   = size;
+    reg.mode        = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl( uffd_fd, UFFDIO_REGISTER, &reg ) == -1)
+    {
+        ERR( "failed to register %p-%p, errno %d\n", base, (char *)base + size, errno );
+        return FALSE;
+    }
+    return uffd_protect( base, size );
+}
+
+/* retrieve the pages written in a range, optionally protecting them again */
+static ULONG_PTR uffd_get_write_watches( void *base, size_t size, void **addresses,
+                                         ULONG_PTR count, BOOL reset )
+{
+    struct page_region regions[64];
+    struct pm_scan_arg arg;
+    ULONG_PTR pos = 0;
+    char *addr;
+    int i, ret;
+
+    memset( &arg, 0, sizeof(arg) );
+    arg.size          = sizeof(arg);
+    arg.flags         = reset ? PM_SCAN_WP_MATCHING : 0;
+    arg.start         = (ULONG_PTR)base;
+    arg.end           = (ULONG_PTR)base + size;
+    arg.vec           = (ULONG_PTR)regions;
+    arg.vec_len       = ARRAY_SIZE( regions );
+    arg.category_mask = PAGE_IS_WRITTEN;
+    arg.return_mask   = PAGE_IS_WRITTEN;
+
+    while (pos < count && arg.start < arg.end)
+    {
+        arg.max_pages = count - pos;
+        if ((ret = ioctl( pagemap_fd, PAGEMAP_SCAN, &arg )) == -1)
+        {
+            ERR( "failed to scan %p-%p, errno %d\n", base, (char *)base + size, errno );
+            break;
+        }
+        for (i = 0; i < ret; i++)
+            for (addr = (char *)(ULONG_PTR)regions[i].start; addr < (char *)(ULONG_PTR)regions[i].end;
+                 addr += page_size)
+                addresses[pos++] = addr;
+        if (arg.walk_end <= arg.start) break;
+        arg.start = arg.walk_end;
+    }
+    return pos;
+}
+
+#else  /* HAVE_LINUX_USERFAULTFD_H */
+
+static void init_uffd(void)
+{
+}
+
+static BOOL uffd_protect( void *base, size_t size )
+{
+    return FALSE;
+}
+
+static BOOL uffd_register( void *base, size_t size )
+{
+    return FALSE;
+}
+
+static ULONG_PTR uffd_get_write_watches( void *base, size_t size, void **addresses,
+                                         ULONG_PTR count, BOOL reset )
+{
+    return 0;
+}
+
+#endif  /* HAVE_LINUX_USERFAULTFD_H */
+
+
 /***********************************************************************
  *           update_write_watches
  */
@@ -946,11 +1172,65 @@ static void update_write_watches( void *base, size_t size, size_t accessed_size
  */
 static void reset_write_watches( void *base, SIZE_T size )
 {
+    if (use_uffd)
+    {
+        uffd_protect( base, size );
+        return;
+    }
     set_page_vprot_bits( base, size, VPROT_WRITEWATCH, 0 );
     mprotect_range( base, size, 0, 0 );
 }
 
 
+/***********************************************************************
+ *           get_large_page_size
+ *
+ * Retrieve the size of the large pages used by the kernel.
+ */
+static size_t get_large_page_size(void)
+{
+#ifdef __linux__
+    unsigned long size;
+    FILE *f;
+
+    if ((f = fopen( "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r" )))
+    {
+        BOOL ok = (fscanf( f, "%lu", &size ) == 1);
+        fclose( f );
+        if (ok && size > page_size && !(size & (size - 1))) return size;
+    }
+#endif
+#if defined(__i386__) || defined(__x86_64__) || defined(__arm__) || defined(__aarch64__)
+    return 2 * 1024 * 1024;
+#else
+    return 0;
+#endif
+}
+
+
+/***********************************************************************
+ *           use_large_pages
+ *
+ * Ask the kernel to back a range with large pages, if it supports it.
+ */
+static void use_large_pages( void *base, size_t size )
+{
+#ifdef MADV_HUGEPAGE
+    if (madvise( base, size, MADV_HUGEPAGE ))
+        WARN( "no large pages for %p-%p, errno %d\n", base, (char *)base + size, errno );
+#endif
+}
+
+
+/***********************************************************************
+ *           virtual_get_large_page_size
+ */
+SIZE_T virtual_get_large_page_size(void)
+{
+    return large_page_size;
+}
+
+
 /***********************************************************************
  *           unmap_extra_space
  *
@@ -1252,6 +1532,9 @@ static NTSTATUS decommit_pages( struct file_view *view, size_t start, size_t siz
 {
     if (wine_anon_mmap( (char *)view->base + start, size, PROT_NONE, MAP_FIXED ) != (void *)-1)
     {
+        /* the new mapping isn't registered anymore */
+        if (use_uffd && (view->protect & VPROT_WRITEWATCH))
+            uffd_register( (char *)view->base + start, size );
         set_page_vprot_bits( (char *)view->base + start, size, 0, VPROT_COMMITTED );
         return STATUS_SUCCESS;
     }
@@ -1352,6 +1635,113 @@ static NTSTATUS map_pe_header( void *ptr, size_t size, int fd, BOOL *removable )
 }
 
 
+/***********************************************************************
+ *           is_image_file_layout
+ *
+ * Check if all the sections of an image are stored in the file at their virtual address,
+ * in which case the whole image can be mapped with a single file mapping.
+ */
+static BOOL is_image_file_layout( const IMAGE_SECTION_HEADER *sec, int nb_sec,
+                                  SIZE_T header_size, off_t file_size, SIZE_T total_size )
+{
+    SIZE_T end = ROUND_SIZE( 0, header_size ), size;
+    BOOL has_data = FALSE;
+    int i;
+
+    for (i = 0; i < nb_sec; i++)
+    {
+        if (!sec[i].PointerToRawData || !sec[i].SizeOfRawData) continue;
+        if (sec[i].PointerToRawData != sec[i].VirtualAddress) return FALSE;
+        if (sec[i].VirtualAddress & page_mask) return FALSE;
+        if (sec[i].VirtualAddress < end) return FALSE;  /* unsorted or overlapping */
+        if ((off_t)sec[i].PointerToRawData + sec[i].SizeOfRawData > file_size) return FALSE;
+        size = ROUND_SIZE( 0, max( sec[i].Misc.VirtualSize, sec[i].SizeOfRawData ));
+        if (sec[i].VirtualAddress > total_size || size > total_size - sec[i].VirtualAddress)
+            return FALSE;  /* the section checks in map_image will reject it */
+        end = sec[i].VirtualAddress + size;
+        has_data = TRUE;
+    }
+    return has_data;
+}
+
+
+/***********************************************************************
+ *           clear_image_page
+ *
+ * Clear part of a file-mapped image page, and give the page the protection of the view.
+ */
+static void clear_image_page( char *base, SIZE_T start, SIZE_T end, unsigned int vprot )
+{
+    char *page = ROUND_ADDR( base + start, page_mask );
+
+    if (start >= end) return;
+    memset( base + start, 0, end - start );
+    set_page_vprot( page, page_size, vprot );
+    mprotect_range( page, page_size, 0, 0 );
+}
+
+
+/***********************************************************************
+ *           clear_image_range
+ *
+ * Replace a range of a file-mapped image by zeros. Whole pages are replaced by anonymous memory.
+ */
+static NTSTATUS clear_image_range( struct file_view *view, SIZE_T start, SIZE_T end, unsigned int vprot )
+{
+    char *base = view->base;
+    SIZE_T page_start = ROUND_SIZE( 0, start ), page_end = end & ~page_mask;
+
+    if (start >= end) return STATUS_SUCCESS;
+    if (page_start >= page_end)
+    {
+        clear_image_page( base, start, end, vprot );
+        return STATUS_SUCCESS;
+    }
+    clear_image_page( base, start, page_start, vprot );
+    if (wine_anon_mmap( base + page_start, page_end - page_start,
+                        VIRTUAL_GetUnixProt( vprot ), MAP_FIXED ) == (void *)-1)
+        return FILE_GetNtStatus();
+    set_page_vprot( base + page_start, page_end - page_start, vprot );
+    clear_image_page( base, page_end, end, vprot );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           map_image_file_layout
+ *
+ * Map all the sections of an image with a single file mapping, and clear
+ * the parts of the mapping that are not covered by section data.
+ */
+static NTSTATUS map_image_file_layout( struct file_view *view, int fd, const IMAGE_SECTION_HEADER *sec,
+                                       int nb_sec, SIZE_T header_size, off_t file_size, BOOL removable )
+{
+    static const SIZE_T sector_align = 0x1ff;
+    const unsigned int vprot = VPROT_COMMITTED | VPROT_READ | VPROT_EXEC | VPROT_WRITECOPY;
+    SIZE_T start = ROUND_SIZE( 0, header_size );
+    SIZE_T end = min( ROUND_SIZE( 0, file_size ), view->size );
+    SIZE_T pos = start, data_end;
+    NTSTATUS status;
+    int i;
+
+    if (end <= start) return STATUS_INVALID_IMAGE_FORMAT;
+    if ((status = map_file_into_view( view, fd, start, end - start, start,
+                                      VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY, removable )))
+        return status;
+
+    for (i = 0; i < nb_sec; i++)
+    {
+        if (!sec[i].PointerToRawData || !sec[i].SizeOfRawData) continue;
+        data_end = (sec[i].SizeOfRawData + sector_align) & ~sector_align;
+        if (sec[i].Misc.VirtualSize) data_end = min( data_end, ROUND_SIZE( 0, sec[i].Misc.VirtualSize ));
+        data_end = min( sec[i].VirtualAddress + data_end, end );
+        if ((status = clear_image_range( view, pos, min( sec[i].VirtualAddress, end ), vprot ))) return status;
+        pos = max( pos, data_end );
+    }
+    return clear_image_range( view, pos, end, vprot );
+}
+
+
 /***********************************************************************
  *           map_image
  *
@@ -1374,6 +1764,7 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, SIZE_T m
     struct file_view *view = NULL;
     char *ptr, *header_end, *header_start;
     char *base = wine_server_get_ptr( image_info->base );
+    BOOL file_layout = FALSE;
 
     if (total_size != image_info->map_size)  /* truncated */
     {
@@ -1453,6 +1844,20 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, SIZE_T m
     }
 
 
+    /* if the sections are laid out in the file as in memory, map them all at once */
+
+    if (is_image_file_layout( sections, nt->FileHeader.NumberOfSections, header_size, st.st_size, total_size ))
+    {
+        TRACE_(module)( "mapping all sections at %p\n", ptr );
+        if (map_image_file_layout( view, fd, sections, nt->FileHeader.NumberOfSections,
+                                   header_size, st.st_size, removable ) != STATUS_SUCCESS)
+        {
+            ERR_(module)( "Could not map image sections\n" );
+            goto error;
+        }
+        file_layout = TRUE;
+    }
+
     /* map all the sections */
 
     for (i = pos = 0; i < nt->FileHeader.NumberOfSections; i++, sec++)
@@ -1515,6 +1920,7 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, SIZE_T m
                         sec->Misc.VirtualSize, sec->Characteristics );
 
         if (!sec->PointerToRawData || !file_size) continue;
+        if (file_layout) continue;  /* already mapped */
 
         /* Note: if the section is not aligned properly map_file_into_view will magically
          *       fall back to read(), so we don't need to check anything here.
@@ -1705,6 +2111,7 @@ NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG zero_bits, S
         }
     }
     if (!(size = ROUND_SIZE( 0, size ))) goto done;  /* wrap-around */
+    if ((sec_flags & SEC_LARGE_PAGES) && large_page_size) mask |= large_page_size - 1;
 
     /* Reserve a properly aligned area */
 
@@ -1741,6 +2148,7 @@ NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, ULONG zero_bits, S
 
     if (res == STATUS_SUCCESS)
     {
+        if (sec_flags & SEC_LARGE_PAGES) use_large_pages( view->base, size );
         *addr_ptr = view->base;
         *size_ptr = size;
         VIRTUAL_DEBUG_DUMP_VIEW( view );
@@ -1831,6 +2239,7 @@ void virtual_init(void)
     view_block_end = view_block_start + view_block_size / sizeof(*view_block_start);
     pages_vprot = (void *)((char *)alloc_views.base + view_block_size);
     wine_rb_init( &views_tree, compare_view );
+    large_page_size = get_large_page_size();
 
     /* make the DOS area accessible (except the low 64K) to hide bugs in broken apps like Excel 2003 */
     size = (char *)address_space_start - (char *)0x10000;
@@ -2022,7 +2431,7 @@ NTSTATUS virtual_handle_fault( LPCVOID addr, DWORD err, BOOL on_signal_stack )
     }
     else if (err & EXCEPTION_WRITE_FAULT)
     {
-        if (vprot & VPROT_WRITEWATCH)
+        if ((vprot & VPROT_WRITEWATCH) && !use_uffd)
         {
             set_page_vprot_bits( page, page_size, 0, VPROT_WRITEWATCH );
             mprotect_range( page, page_size, 0, 0 );
@@ -2053,7 +2462,7 @@ static NTSTATUS check_write_access( void *base, size_t size, BOOL *has_write_wat
     for (i = 0; i < size; i += page_size)
     {
         BYTE vprot = get_page_vprot( addr + i );
-        if (vprot & VPROT_WRITEWATCH) *has_write_watch = TRUE;
+        if ((vprot & VPROT_WRITEWATCH) && !use_uffd) *has_write_watch = TRUE;
         if (!(VIRTUAL_GetUnixProt( vprot & ~VPROT_WRITEWATCH ) & PROT_WRITE))
             return STATUS_INVALID_USER_BUFFER;
     }
@@ -2499,6 +2908,16 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG zero_
         return result.virtual_alloc.status;
     }
 
+    if (type & MEM_LARGE_PAGES)
+    {
+        /* large pages must be reserved and committed at once, on large page boundaries */
+        if (!large_page_size || (type & (MEM_RESERVE | MEM_COMMIT)) != (MEM_RESERVE | MEM_COMMIT))
+            return STATUS_INVALID_PARAMETER;
+        if ((size & (large_page_size - 1)) || ((UINT_PTR)*ret & (large_page_size - 1)))
+            return STATUS_INVALID_PARAMETER;
+        mask |= large_page_size - 1;
+    }
+
     /* Round parameters to a page boundary */
 
     if (is_beyond_limit( 0, size, working_set_limit )) return STATUS_WORKING_SET_LIMIT_RANGE;
@@ -2530,7 +2949,7 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG zero_
     /* Compute the alloc type flags */
 
     if (!(type & (MEM_COMMIT | MEM_RESERVE | MEM_RESET)) ||
-        (type & ~(MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET)))
+        (type & ~(MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET | MEM_LARGE_PAGES)))
     {
         WARN("called with wrong alloc type flags (%08x) !\n", type);
         return STATUS_INVALID_PARAMETER;
@@ -2545,13 +2964,25 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG zero_
         if (!(status = get_vprot_flags( protect, &vprot, FALSE )))
         {
             if (type & MEM_COMMIT) vprot |= VPROT_COMMITTED;
-            if (type & MEM_WRITE_WATCH) vprot |= VPROT_WRITEWATCH;
+            if (type & MEM_WRITE_WATCH)
+            {
+                init_uffd();
+                vprot |= VPROT_WRITEWATCH;
+            }
             if (protect & PAGE_NOCACHE) vprot |= SEC_NOCACHE;
 
             if (vprot & VPROT_WRITECOPY) status = STATUS_INVALID_PAGE_PROTECTION;
             else if (is_dos_memory) status = allocate_dos_memory( &view, vprot );
             else status = map_view( &view, base, size, mask, type & MEM_TOP_DOWN, vprot );
 
+            if (!status && use_uffd && (vprot & VPROT_WRITEWATCH) &&
+                !uffd_register( view->base, view->size ))
+            {
+                delete_view( view );
+                status = STATUS_NO_MEMORY;
+            }
+            if (!status && (type & MEM_LARGE_PAGES)) use_large_pages( view->base, view->size );
+
             if (status == STATUS_SUCCESS) base = view->base;
         }
     }
@@ -3340,7 +3771,12 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
 
-    if (is_write_watch_range( base, size ))
+    if (is_write_watch_range( base, size ) && use_uffd)
+    {
+        *count = uffd_get_write_watches( base, size, addresses, *count, flags & WRITE_WATCH_FLAG_RESET );
+        *granularity = page_size;
+    }
+    else if (is_write_watch_range( base, size ))
     {
         ULONG_PTR pos = 0;
         char *addr = base;
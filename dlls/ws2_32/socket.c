@@ -131,6 +131,12 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #define NONAMELESSUNION
 #define NONAMELESSSTRUCT
@@ -157,6 +163,7 @@
 #include "wine/server.h"
 #include "wine/debug.h"
 #include "wine/exception.h"
+#include "wine/list.h"
 #include "wine/unicode.h"
 
 #if defined(linux) && !defined(IP_UNICAST_IF)
@@ -264,6 +271,12 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                           LPINT lpFromlen, LPWSAOVERLAPPED lpOverlapped,
                           LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine,
                           LPWSABUF lpControlBuffer );
+struct poll_cache;
+static void reactor_close_socket( SOCKET s );
+static void poll_cache_close_socket( SOCKET s );
+static void rio_close_socket( SOCKET s );
+static BOOL get_rio_function_table( RIO_EXTENSION_FUNCTION_TABLE *table );
+static void free_poll_cache( struct poll_cache *cache );
 
 /* critical section to protect some non-reentrant net function */
 static CRITICAL_SECTION csWSgetXXXbyYYY;
@@ -534,6 +547,9 @@ struct ws2_transmitfile_async
     TRANSMIT_FILE_BUFFERS buffers;
     DWORD                 flags;
     LARGE_INTEGER         offset;
+    BOOL                  no_sendfile;  /* file data has to go through the buffer */
+    TRANSMIT_PACKETS_ELEMENT *elements; /* TransmitPackets elements left to send */
+    DWORD                 count;
     struct ws2_async      write;
 };
 
@@ -616,6 +632,7 @@ struct per_thread_data
     struct WS_protoent *pe_buffer;
     struct pollfd *fd_cache;
     unsigned int fd_count;
+    struct poll_cache *poll_cache;
     int he_len;
     int se_len;
     int pe_len;
@@ -1337,6 +1354,7 @@ static void free_per_thread_data(void)
     HeapFree( GetProcessHeap(), 0, ptb->se_buffer );
     HeapFree( GetProcessHeap(), 0, ptb->pe_buffer );
     HeapFree( GetProcessHeap(), 0, ptb->fd_cache );
+    free_poll_cache( ptb->poll_cache );
 
     HeapFree( GetProcessHeap(), 0, ptb );
     NtCurrentTeb()->WinSockData = NULL;
@@ -2956,6 +2974,107 @@ static NTSTATUS WS2_ReadFile(HANDLE hFile, PIO_STATUS_BLOCK io_status, char* buf
     return status;
 }
 
+#ifdef HAVE_SYS_SENDFILE_H
+/***********************************************************************
+ *     WS2_transmitfile_sendfile        (INTERNAL)
+ *
+ * Send the next part of the file directly from the page cache.
+ * Returns STATUS_NOT_SUPPORTED if the file has to be read into the buffer instead.
+ */
+static NTSTATUS WS2_transmitfile_sendfile( int fd, struct ws2_transmitfile_async *wsa )
+{
+    IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)wsa->write.user_overlapped;
+    size_t count = 0x7ffff000; /* maximum transfer size of a single call on Linux */
+    HANDLE file = wsa->file;
+    NTSTATUS status;
+    ssize_t result;
+    int file_fd;
+    off_t pos;
+
+    if (wsa->no_sendfile) return STATUS_NOT_SUPPORTED;
+    if (wine_server_handle_to_fd( file, FILE_READ_DATA, &file_fd, NULL ))
+        return STATUS_NOT_SUPPORTED;
+
+    /* when the size of the transfer is limited ensure that we don't go past that limit */
+    if (wsa->file_bytes != 0)
+        count = min( count, wsa->file_bytes - wsa->file_read );
+
+    do
+    {
+        if (wsa->offset.QuadPart != FILE_USE_FILE_POINTER_POSITION)
+        {
+            pos = wsa->offset.QuadPart;
+            result = sendfile( fd, file_fd, &pos, count );
+        }
+        else
+            result = sendfile( fd, file_fd, NULL, count );
+    }
+    while (result == -1 && errno == EINTR);
+
+    if (result > 0)
+    {
+        if (wsa->offset.QuadPart != FILE_USE_FILE_POINTER_POSITION)
+            wsa->offset.QuadPart += result;
+        wsa->file_read += result;
+        if (iosb) iosb->Information += result;
+        if (wsa->file_bytes != 0 && wsa->file_read >= wsa->file_bytes)
+            wsa->file = NULL;
+        status = STATUS_PENDING;
+    }
+    else if (!result)
+        status = STATUS_END_OF_FILE;
+    else if (errno == EAGAIN)
+        status = STATUS_PENDING;
+    else if (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)
+    {
+        /* the file or the socket doesn't support it, fall back to reading the file */
+        wsa->no_sendfile = TRUE;
+        status = STATUS_NOT_SUPPORTED;
+    }
+    else
+        status = wsaErrStatus();
+
+    wine_server_release_fd( file, file_fd );
+    return status;
+}
+#else
+static NTSTATUS WS2_transmitfile_sendfile( int fd, struct ws2_transmitfile_async *wsa )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+#endif
+
+/***********************************************************************
+ *     WS2_transmitfile_nextelement     (INTERNAL)
+ *
+ * Set up the next element of a TransmitPackets operation.
+ */
+static BOOL WS2_transmitfile_nextelement( struct ws2_transmitfile_async *wsa )
+{
+    TRANSMIT_PACKETS_ELEMENT *element;
+
+    if (!wsa->count) return FALSE;
+    element = wsa->elements++;
+    wsa->count--;
+
+    if (element->dwElFlags & TP_ELEMENT_MEMORY)
+    {
+        wsa->buffers.Head       = element->u.pBuffer;
+        wsa->buffers.HeadLength = element->cLength;
+    }
+    else if (element->dwElFlags & TP_ELEMENT_FILE)
+    {
+        wsa->file       = element->u.s.hFile;
+        wsa->file_read  = 0;
+        wsa->file_bytes = element->cLength;
+        if (element->u.s.nFileOffset.QuadPart == -1)
+            wsa->offset.QuadPart = FILE_USE_FILE_POINTER_POSITION;
+        else
+            wsa->offset = element->u.s.nFileOffset;
+    }
+    return TRUE;
+}
+
 /***********************************************************************
  *     WS2_transmitfile_getbuffer       (INTERNAL)
  *
@@ -2967,6 +3086,7 @@ static NTSTATUS WS2_transmitfile_getbuffer( int fd, struct ws2_transmitfile_asyn
     if (wsa->write.first_iovec < wsa->write.n_iovecs)
         return STATUS_PENDING;
 
+  next_element:
     /* process the header (if applicable) */
     if (wsa->buffers.Head)
     {
@@ -2985,6 +3105,15 @@ static NTSTATUS WS2_transmitfile_getbuffer( int fd, struct ws2_transmitfile_asyn
         IO_STATUS_BLOCK iosb;
         NTSTATUS status;
 
+        status = WS2_transmitfile_sendfile( fd, wsa );
+        if (status == STATUS_END_OF_FILE)
+        {
+            wsa->file = NULL;
+            goto next_element;
+        }
+        if (status != STATUS_NOT_SUPPORTED)
+            return status;
+
         iosb.Information = 0;
         /* when the size of the transfer is limited ensure that we don't go past that limit */
         if (wsa->file_bytes != 0)
@@ -3025,6 +3154,9 @@ static NTSTATUS WS2_transmitfile_getbuffer( int fd, struct ws2_transmitfile_asyn
         return STATUS_PENDING;
     }
 
+    if (WS2_transmitfile_nextelement( wsa ))
+        goto next_element;
+
     return STATUS_SUCCESS;
 }
 
@@ -3038,7 +3170,7 @@ static NTSTATUS WS2_transmitfile_base( int fd, struct ws2_transmitfile_async *ws
     NTSTATUS status;
 
     status = WS2_transmitfile_getbuffer( fd, wsa );
-    if (status == STATUS_PENDING)
+    if (status == STATUS_PENDING && wsa->write.first_iovec < wsa->write.n_iovecs)
     {
         IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)wsa->write.user_overlapped;
         int n;
@@ -3081,6 +3213,58 @@ static NTSTATUS WS2_async_transmitfile( void *user, IO_STATUS_BLOCK *iosb, NTSTA
     return status;
 }
 
+/***********************************************************************
+ *     WS2_transmit                     (INTERNAL)
+ *
+ * Start a TransmitFile or TransmitPackets operation, and wait for it unless it is overlapped.
+ */
+static BOOL WS2_transmit( SOCKET s, int fd, struct ws2_transmitfile_async *wsa, LPOVERLAPPED overlapped )
+{
+    NTSTATUS status;
+
+    wsa->no_sendfile           = FALSE;
+    wsa->write.hSocket         = SOCKET2HANDLE(s);
+    wsa->write.addr            = NULL;
+    wsa->write.addrlen.val     = 0;
+    wsa->write.flags           = 0;
+    wsa->write.lpFlags         = &wsa->flags;
+    wsa->write.control         = NULL;
+    wsa->write.n_iovecs        = 0;
+    wsa->write.first_iovec     = 0;
+    wsa->write.user_overlapped = overlapped;
+    if (overlapped)
+    {
+        IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)overlapped;
+
+        iosb->u.Status = STATUS_PENDING;
+        iosb->Information = 0;
+        status = register_async( ASYNC_TYPE_WRITE, SOCKET2HANDLE(s), &wsa->io,
+                                 overlapped->hEvent, NULL, NULL, iosb );
+        if(status != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+        release_sock_fd( s, fd );
+        WSASetLastError( NtStatusToWSAError(status) );
+        return FALSE;
+    }
+
+    do
+    {
+        status = WS2_transmitfile_base( fd, wsa );
+        if (status == STATUS_PENDING)
+        {
+            /* block here */
+            do_block(fd, POLLOUT, -1);
+            _sync_sock_state(s); /* let wineserver notice connection */
+        }
+    }
+    while (status == STATUS_PENDING);
+    release_sock_fd( s, fd );
+
+    if (status != STATUS_SUCCESS)
+        WSASetLastError( NtStatusToWSAError(status) );
+    HeapFree( GetProcessHeap(), 0, wsa );
+    return (status == STATUS_SUCCESS);
+}
+
 /***********************************************************************
  *     TransmitFile
  */
@@ -3091,7 +3275,6 @@ static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE h, DWORD file_bytes, DWORD
     union generic_unix_sockaddr uaddr;
     socklen_t uaddrlen = sizeof(uaddr);
     struct ws2_transmitfile_async *wsa;
-    NTSTATUS status;
     int fd;
 
     TRACE("(%lx, %p, %d, %d, %p, %p, %d)\n", s, h, file_bytes, bytes_per_send, overlapped,
@@ -3142,49 +3325,88 @@ static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE h, DWORD file_bytes, DWORD
     wsa->bytes_per_send        = bytes_per_send;
     wsa->flags                 = flags;
     wsa->offset.QuadPart       = FILE_USE_FILE_POINTER_POSITION;
-    wsa->write.hSocket         = SOCKET2HANDLE(s);
-    wsa->write.addr            = NULL;
-    wsa->write.addrlen.val     = 0;
-    wsa->write.flags           = 0;
-    wsa->write.lpFlags         = &wsa->flags;
-    wsa->write.control         = NULL;
-    wsa->write.n_iovecs        = 0;
-    wsa->write.first_iovec     = 0;
-    wsa->write.user_overlapped = overlapped;
+    wsa->elements              = NULL;
+    wsa->count                 = 0;
     if (overlapped)
     {
-        IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)overlapped;
-        int status;
-
         wsa->offset.u.LowPart  = overlapped->u.s.Offset;
         wsa->offset.u.HighPart = overlapped->u.s.OffsetHigh;
-        iosb->u.Status = STATUS_PENDING;
-        iosb->Information = 0;
-        status = register_async( ASYNC_TYPE_WRITE, SOCKET2HANDLE(s), &wsa->io,
-                                 overlapped->hEvent, NULL, NULL, iosb );
-        if(status != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+    }
+    return WS2_transmit( s, fd, wsa, overlapped );
+}
+
+/***********************************************************************
+ *     TransmitPackets
+ */
+static BOOL WINAPI WS2_TransmitPackets( SOCKET s, LPTRANSMIT_PACKETS_ELEMENT elements, DWORD count,
+                                        DWORD send_size, LPOVERLAPPED overlapped, DWORD flags )
+{
+    union generic_unix_sockaddr uaddr;
+    socklen_t uaddrlen = sizeof(uaddr);
+    struct ws2_transmitfile_async *wsa;
+    DWORD i;
+    int fd;
+
+    TRACE("(%lx, %p, %u, %u, %p, %#x)\n", s, elements, count, send_size, overlapped, flags );
+
+    fd = get_sock_fd( s, FILE_WRITE_DATA, NULL );
+    if (fd == -1)
+    {
+        WSASetLastError( WSAENOTSOCK );
+        return FALSE;
+    }
+    if (getpeername( fd, &uaddr.addr, &uaddrlen ) != 0)
+    {
         release_sock_fd( s, fd );
-        WSASetLastError( NtStatusToWSAError(status) );
+        WSASetLastError( WSAENOTCONN );
+        return FALSE;
+    }
+    if (count && !elements)
+    {
+        release_sock_fd( s, fd );
+        WSASetLastError( WSAEINVAL );
         return FALSE;
     }
+    if (flags)
+        FIXME("Flags are not currently supported (%#x).\n", flags);
 
-    do
+    for (i = 0; i < count; i++)
     {
-        status = WS2_transmitfile_base( fd, wsa );
-        if (status == STATUS_PENDING)
+        if (!(elements[i].dwElFlags & TP_ELEMENT_FILE)) continue;
+        if ((elements[i].dwElFlags & TP_ELEMENT_MEMORY) ||
+            GetFileType( elements[i].u.s.hFile ) != FILE_TYPE_DISK)
         {
-            /* block here */
-            do_block(fd, POLLOUT, -1);
-            _sync_sock_state(s); /* let wineserver notice connection */
+            FIXME("Unsupported element %u (flags %#x).\n", i, elements[i].dwElFlags);
+            release_sock_fd( s, fd );
+            WSASetLastError( WSAEINVAL );
+            return FALSE;
         }
     }
-    while (status == STATUS_PENDING);
-    release_sock_fd( s, fd );
 
-    if (status != STATUS_SUCCESS)
-        WSASetLastError( NtStatusToWSAError(status) );
-    HeapFree( GetProcessHeap(), 0, wsa );
-    return (status == STATUS_SUCCESS);
+    /* set reasonable defaults when requested */
+    if (!send_size || send_size == ~0u)
+        send_size = (1 << 16);
+
+    /* the elements are copied since the caller is free to reuse the array once the call returns */
+    if (!(wsa = (struct ws2_transmitfile_async *)alloc_async_io( sizeof(*wsa) + count * sizeof(*elements)
+                                                                 + send_size, WS2_async_transmitfile )))
+    {
+        release_sock_fd( s, fd );
+        WSASetLastError( WSAEFAULT );
+        return FALSE;
+    }
+    memset(&wsa->buffers, 0x0, sizeof(wsa->buffers));
+    wsa->elements              = (TRANSMIT_PACKETS_ELEMENT *)(wsa + 1);
+    wsa->count                 = count;
+    wsa->buffer                = (char *)(wsa->elements + count);
+    wsa->file                  = NULL;
+    wsa->file_read             = 0;
+    wsa->file_bytes            = 0;
+    wsa->bytes_per_send        = send_size;
+    wsa->flags                 = flags;
+    wsa->offset.QuadPart       = FILE_USE_FILE_POINTER_POSITION;
+    memcpy( wsa->elements, elements, count * sizeof(*elements) );
+    return WS2_transmit( s, fd, wsa, overlapped );
 }
 
 /***********************************************************************
@@ -3418,6 +3640,9 @@ int WINAPI WS_closesocket(SOCKET s)
         if (fd >= 0)
         {
             release_sock_fd(s, fd);
+            reactor_close_socket(s);
+            poll_cache_close_socket(s);
+            rio_close_socket(s);
             if (CloseHandle(SOCKET2HANDLE(s)))
                 res = 0;
         }
@@ -4491,6 +4716,7 @@ static const char *debugstr_wsaioctl(DWORD code)
         IOCTL_NAME(WS_SIO_GET_EXTENSION_FUNCTION_POINTER);
         IOCTL_NAME(WS_SIO_GET_GROUP_QOS);
         IOCTL_NAME(WS_SIO_GET_INTERFACE_LIST);
+        IOCTL_NAME(WS_SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER);
         /* IOCTL_NAME(WS_SIO_GET_INTERFACE_LIST_EX); */
         IOCTL_NAME(WS_SIO_GET_QOS);
         /* IOCTL_NAME(WS_SIO_IDEAL_SEND_BACKLOG_CHANGE);
@@ -4921,7 +5147,7 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
             EXTENSION_FUNCTION(WSAID_ACCEPTEX, WS2_AcceptEx)
             EXTENSION_FUNCTION(WSAID_GETACCEPTEXSOCKADDRS, WS2_GetAcceptExSockaddrs)
             EXTENSION_FUNCTION(WSAID_TRANSMITFILE, WS2_TransmitFile)
-            /* EXTENSION_FUNCTION(WSAID_TRANSMITPACKETS, WS2_TransmitPackets) */
+            EXTENSION_FUNCTION(WSAID_TRANSMITPACKETS, WS2_TransmitPackets)
             EXTENSION_FUNCTION(WSAID_WSARECVMSG, WS2_WSARecvMsg)
             EXTENSION_FUNCTION(WSAID_WSASENDMSG, WSASendMsg)
         };
@@ -4950,6 +5176,31 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
         status = WSAEOPNOTSUPP;
         break;
     }
+    case WS_SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER:
+    {
+        static const GUID rio_guid = WSAID_MULTIPLE_RIO;
+
+        if (!in_buff || in_size < sizeof(GUID) || !IsEqualGUID(&rio_guid, in_buff))
+        {
+            FIXME("SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER %s: stub\n",
+                  in_buff ? debugstr_guid(in_buff) : "(null)");
+            status = WSAEOPNOTSUPP;
+            break;
+        }
+        if (!out_buff || out_size < sizeof(RIO_EXTENSION_FUNCTION_TABLE))
+        {
+            status = WSAEFAULT;
+            break;
+        }
+        if (!get_rio_function_table( out_buff ))
+        {
+            status = WSAEOPNOTSUPP;
+            break;
+        }
+        TRACE("-> got RIO function table\n");
+        total = sizeof(RIO_EXTENSION_FUNCTION_TABLE);
+        break;
+    }
     case WS_SIO_KEEPALIVE_VALS:
     {
         struct tcp_keepalive *k;
@@ -5186,13 +5437,33 @@ int WINAPI WS_recvfrom(SOCKET s, char *buf, INT len, int flags,
         return n;
 }
 
+/* get a per-thread poll array large enough for count descriptors */
+static struct pollfd *get_poll_buffer( unsigned int count )
+{
+    struct per_thread_data *ptb = get_per_thread_data();
+    struct pollfd *fds;
+
+    /* check if the cache can hold all descriptors, if not do the resizing */
+    if (ptb->fd_count < count)
+    {
+        if (!(fds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(fds[0]))))
+        {
+            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+            return NULL;
+        }
+        HeapFree(GetProcessHeap(), 0, ptb->fd_cache);
+        ptb->fd_cache = fds;
+        ptb->fd_count = count;
+    }
+    return ptb->fd_cache;
+}
+
 /* allocate a poll array for the corresponding fd sets */
 static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set *writefds,
                                        const WS_fd_set *exceptfds, int *count_ptr )
 {
     unsigned int i, j = 0, count = 0;
     struct pollfd *fds;
-    struct per_thread_data *ptb = get_per_thread_data();
 
     if (readfds) count += readfds->fd_count;
     if (writefds) count += writefds->fd_count;
@@ -5204,20 +5475,7 @@ static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set
         return NULL;
     }
 
-    /* check if the cache can hold all descriptors, if not do the resizing */
-    if (ptb->fd_count < count)
-    {
-        if (!(fds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(fds[0]))))
-        {
-            SetLastError( ERROR_NOT_ENOUGH_MEMORY );
-            return NULL;
-        }
-        HeapFree(GetProcessHeap(), 0, ptb->fd_cache);
-        ptb->fd_cache = fds;
-        ptb->fd_count = count;
-    }
-    else
-        fds = ptb->fd_cache;
+    if (!(fds = get_poll_buffer( count ))) return NULL;
 
     if (readfds)
         for (i = 0; i < readfds->fd_count; i++, j++)
@@ -5402,44 +5660,517 @@ static int get_poll_results( WS_fd_set *readfds, WS_fd_set *writefds, WS_fd_set
 }
 
 /***********************************************************************
- *		select			(WS2_32.18)
- */
-int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
-                     WS_fd_set *ws_writefds, WS_fd_set *ws_exceptfds,
-                     const struct WS_timeval* ws_timeout)
-{
-    struct pollfd *pollfds;
-    int count, ret, timeout = -1;
+ *           Poll cache
+ *
+ * Threads calling select() or WSAPoll() with many sockets keep them
+ * registered in a per-thread epoll set between calls. A call with mostly
+ * the same sockets as the previous one then only has to update the
+ * registrations that changed, and waiting costs O(ready) instead of O(n).
+ * Each call still walks all the sockets of the sets to look up their
+ * entries and build the results, so it remains O(n) overall; the bound
+ * state and option checks done by fd_sets_to_poll() are only performed
+ * for the sockets reported ready.
+ *
+ * The registrations use a private copy of the unix fd. closesocket()
+ * closes the copies in all the caches right away. A socket closed with
+ * CloseHandle() or by another process can't be noticed that way: its copy
+ * stays open, and the peer doesn't see the connection closed, until the
+ * next call of the thread owning the cache. That call drops the entry,
+ * because the socket is missing from it or its handle no longer has the
+ * same unix fd. A thread that stops calling select() or WSAPoll() with
+ * many sockets frees its cache on its next smaller call, or when it exits.
+ */
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE)
+
+#define POLL_CACHE_MIN_SOCKETS 64
+#define POLL_CACHE_HASH_SIZE   1024
+#define POLL_CLOSE_GEN_SIZE    256
+
+/* incremented when a socket is closed, to detect handles reused between two calls */
+static LONG socket_close_gen[POLL_CLOSE_GEN_SIZE];
+
+struct poll_entry
+{
+    struct list  entry;       /* entry in the list of all entries */
+    struct list  hash_entry;  /* entry in the hash table */
+    SOCKET       socket;      /* socket handle */
+    int          fd;          /* private copy of the unix fd, -1 once the socket is closed */
+    int          unix_fd;     /* fd in the ntdll cache when the entry was created */
+    LONG         close_gen;   /* socket_close_gen value when the entry was created */
+    unsigned int events;      /* registered events, 0 if not registered */
+    unsigned int wanted;      /* events wanted by the current call */
+    unsigned int revents;     /* events reported to the current call */
+    unsigned int serial;      /* serial of the last call using the entry */
+};
 
-    TRACE("read %p, write %p, excp %p timeout %p\n",
-          ws_readfds, ws_writefds, ws_exceptfds, ws_timeout);
+struct poll_cache
+{
+    struct list          entry;        /* entry in the list of all caches */
+    int                  epoll_fd;
+    unsigned int         serial;       /* serial of the current call */
+    unsigned int         count;        /* number of entries */
+    struct list          entries;      /* list of all entries */
+    struct list          hash[POLL_CACHE_HASH_SIZE];
+    struct poll_entry  **slots;        /* entries of the current call, in call order */
+    unsigned int         slots_size;
+    struct epoll_event  *events;       /* buffer for epoll_wait */
+    unsigned int         events_size;
+};
 
-    if (!(pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count )))
-        return SOCKET_ERROR;
+/* protects the list of caches and the fds of the entries, which can be closed by any thread */
+static CRITICAL_SECTION poll_cache_section;
+static CRITICAL_SECTION_DEBUG poll_cache_section_debug =
+{
+    0, 0, &poll_cache_section,
+    { &poll_cache_section_debug.ProcessLocksList, &poll_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": poll_cache_section") }
+};
+static CRITICAL_SECTION poll_cache_section = { &poll_cache_section_debug, -1, 0, 0, 0, 0 };
 
-    if (ws_timeout)
-        timeout = (ws_timeout->tv_sec * 1000) + (ws_timeout->tv_usec + 999) / 1000;
+static struct list poll_caches = LIST_INIT( poll_caches );
 
-    ret = do_poll(pollfds, count, timeout);
-    release_poll_fds( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+static inline LONG *get_close_gen( SOCKET s )
+{
+    return &socket_close_gen[(s >> 2) % POLL_CLOSE_GEN_SIZE];
+}
 
-    if (ret == -1) SetLastError(wsaErrno());
-    else ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
-    return ret;
+/* close the fd of an entry, the entry itself is freed by the thread owning the cache */
+static void poll_entry_close_fd( struct poll_cache *cache, struct poll_entry *entry )
+{
+    if (entry->fd == -1) return;
+    if (entry->events) epoll_ctl( cache->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL );
+    close( entry->fd );
+    entry->fd = -1;
+    entry->events = 0;
 }
 
-/***********************************************************************
- *     WSAPoll
- */
-int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
+/* close the copies of the fd of a socket that is being closed in all the caches */
+static void poll_cache_close_socket( SOCKET s )
 {
-    int i, ret;
-    struct pollfd *ufds;
+    struct poll_cache *cache;
+    struct poll_entry *entry;
 
-    if (!count)
+    InterlockedIncrement( get_close_gen( s ));
+
+    EnterCriticalSection( &poll_cache_section );
+    LIST_FOR_EACH_ENTRY( cache, &poll_caches, struct poll_cache, entry )
     {
-        SetLastError(WSAEINVAL);
-        return SOCKET_ERROR;
+        LIST_FOR_EACH_ENTRY( entry, &cache->hash[(s >> 2) % POLL_CACHE_HASH_SIZE], struct poll_entry, hash_entry )
+            if (entry->socket == s) poll_entry_close_fd( cache, entry );
+    }
+    LeaveCriticalSection( &poll_cache_section );
+}
+
+/* poll_cache_section must be held */
+static void poll_cache_remove( struct poll_cache *cache, struct poll_entry *entry )
+{
+    poll_entry_close_fd( cache, entry );
+    list_remove( &entry->entry );
+    list_remove( &entry->hash_entry );
+    cache->count--;
+    HeapFree( GetProcessHeap(), 0, entry );
+}
+
+static void free_poll_cache( struct poll_cache *cache )
+{
+    struct poll_entry *entry, *next;
+
+    if (!cache) return;
+    EnterCriticalSection( &poll_cache_section );
+    list_remove( &cache->entry );
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &cache->entries, struct poll_entry, entry )
+        poll_cache_remove( cache, entry );
+    LeaveCriticalSection( &poll_cache_section );
+    close( cache->epoll_fd );
+    HeapFree( GetProcessHeap(), 0, cache->slots );
+    HeapFree( GetProcessHeap(), 0, cache->events );
+    HeapFree( GetProcessHeap(), 0, cache );
+}
+
+/* start a call on count sockets, returns NULL if the cache can't be used */
+static struct poll_cache *begin_poll_cache( unsigned int count )
+{
+    struct per_thread_data *ptb = get_per_thread_data();
+    struct poll_cache *cache = ptb->poll_cache;
+    struct poll_entry **slots;
+    unsigned int i;
+
+    if (count < POLL_CACHE_MIN_SOCKETS)
+    {
+        /* release the fds as soon as the thread stops polling many sockets */
+        free_poll_cache( cache );
+        ptb->poll_cache = NULL;
+        return NULL;
+    }
+
+    if (!cache)
+    {
+        if (!(cache = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) ))) return NULL;
+        if ((cache->epoll_fd = epoll_create( POLL_CACHE_MIN_SOCKETS )) == -1)
+        {
+            HeapFree( GetProcessHeap(), 0, cache );
+            return NULL;
+        }
+        fcntl( cache->epoll_fd, F_SETFD, FD_CLOEXEC );
+        list_init( &cache->entries );
+        for (i = 0; i < POLL_CACHE_HASH_SIZE; i++) list_init( &cache->hash[i] );
+        EnterCriticalSection( &poll_cache_section );
+        list_add_tail( &poll_caches, &cache->entry );
+        LeaveCriticalSection( &poll_cache_section );
+        ptb->poll_cache = cache;
+    }
+
+    if (cache->slots_size < count)
+    {
+        if (!(slots = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*slots) ))) return NULL;
+        HeapFree( GetProcessHeap(), 0, cache->slots );
+        cache->slots = slots;
+        cache->slots_size = count;
+    }
+    cache->serial++;
+    return cache;
+}
+
+/* add a socket to the current call, returns NULL if it's not a valid socket */
+static struct poll_entry *poll_cache_add( struct poll_cache *cache, SOCKET s, DWORD access,
+                                          unsigned int events )
+{
+    struct list *bucket = &cache->hash[(s >> 2) % POLL_CACHE_HASH_SIZE];
+    struct poll_entry *entry;
+    int fd;
+
+    if ((fd = get_sock_fd( s, access, NULL )) == -1) return NULL;
+
+    EnterCriticalSection( &poll_cache_section );
+    LIST_FOR_EACH_ENTRY( entry, bucket, struct poll_entry, hash_entry )
+    {
+        if (entry->socket != s) continue;
+        if (entry->fd == -1 || entry->unix_fd != fd || entry->close_gen != *get_close_gen( s ))
+        {
+            poll_cache_remove( cache, entry );
+            break;
+        }
+        LeaveCriticalSection( &poll_cache_section );
+        release_sock_fd( s, fd );
+        if (entry->serial != cache->serial)
+        {
+            entry->serial  = cache->serial;
+            entry->wanted  = 0;
+            entry->revents = 0;
+        }
+        entry->wanted |= events;
+        return entry;
+    }
+
+    if (!(entry = HeapAlloc( GetProcessHeap(), 0, sizeof(*entry) ))) goto failed;
+    entry->close_gen = *get_close_gen( s );
+    if ((entry->fd = fcntl( fd, F_DUPFD_CLOEXEC, 0 )) == -1)
+    {
+        HeapFree( GetProcessHeap(), 0, entry );
+        goto failed;
+    }
+    entry->socket  = s;
+    entry->unix_fd = fd;
+    entry->events  = 0;
+    entry->wanted  = events;
+    entry->revents = 0;
+    entry->serial  = cache->serial;
+    list_add_tail( &cache->entries, &entry->entry );
+    list_add_head( bucket, &entry->hash_entry );
+    cache->count++;
+    LeaveCriticalSection( &poll_cache_section );
+    release_sock_fd( s, fd );
+    return entry;
+
+failed:
+    LeaveCriticalSection( &poll_cache_section );
+    release_sock_fd( s, fd );
+    SetLastError( WSAENOBUFS );
+    return NULL;
+}
+
+/* update the registrations and wait for events; poll and epoll event bits are the same on Linux */
+static int poll_cache_wait( struct poll_cache *cache, int timeout )
+{
+    struct poll_entry *entry, *next;
+    struct epoll_event ev, *events;
+    int i, ret, op;
+
+    EnterCriticalSection( &poll_cache_section );
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &cache->entries, struct poll_entry, entry )
+    {
+        if (entry->serial != cache->serial)
+        {
+            poll_cache_remove( cache, entry );
+            continue;
+        }
+        entry->revents = 0;
+        if (entry->fd == -1) continue;  /* closed since the start of the call */
+        if (entry->wanted == entry->events) continue;
+
+        if (!entry->events) op = EPOLL_CTL_ADD;
+        else if (!entry->wanted) op = EPOLL_CTL_DEL;
+        else op = EPOLL_CTL_MOD;
+        ev.events = entry->wanted;
+        ev.data.ptr = entry;
+        if (epoll_ctl( cache->epoll_fd, op, entry->fd, &ev ) == -1)
+        {
+            LeaveCriticalSection( &poll_cache_section );
+            return -1;
+        }
+        entry->events = entry->wanted;
+    }
+    LeaveCriticalSection( &poll_cache_section );
+
+    if (cache->events_size < cache->count)
+    {
+        if (!(events = HeapAlloc( GetProcessHeap(), 0, cache->count * sizeof(*events) )))
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        HeapFree( GetProcessHeap(), 0, cache->events );
+        cache->events = events;
+        cache->events_size = cache->count;
+    }
+
+    if ((ret = epoll_wait( cache->epoll_fd, cache->events, cache->count, timeout )) == -1) return -1;
+
+    for (i = 0; i < ret; i++)
+    {
+        entry = cache->events[i].data.ptr;
+        entry->revents = cache->events[i].events;
+    }
+    return ret;
+}
+
+/* compute the remaining time until the deadline of a call */
+static int get_remaining_timeout( int timeout, DWORD start )
+{
+    DWORD elapsed;
+
+    if (timeout <= 0) return timeout;
+    elapsed = GetTickCount() - start;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
+
+/* filter the events reported for a socket of one of the select sets */
+static unsigned int filter_select_events( struct poll_entry *entry, unsigned int events, int set )
+{
+    unsigned int revents = entry->revents & (events | POLLERR | POLLHUP);
+    int oob_inlined = 0;
+    socklen_t olen = sizeof(oob_inlined);
+
+    if (!revents) return 0;
+    switch (set)
+    {
+    case 0:
+        if (is_fd_bound( entry->fd, NULL, NULL ) == 1) return revents;
+        break;
+    case 1:
+        if (is_fd_bound( entry->fd, NULL, NULL ) == 1 || _get_fd_type( entry->fd ) == SOCK_DGRAM)
+            return revents;
+        break;
+    case 2:
+        if (is_fd_bound( entry->fd, NULL, NULL ) != 1) break;
+        getsockopt( entry->fd, SOL_SOCKET, SO_OOBINLINE, (char *)&oob_inlined, &olen );
+        if (oob_inlined && !(revents &= ~POLLPRI))
+        {
+            /* urgent data is read inline, it isn't an exception */
+            entry->wanted &= ~POLLPRI;
+            return 0;
+        }
+        return revents;
+    }
+    /* fd_sets_to_poll() doesn't poll unbound sockets at all */
+    entry->wanted &= ~events;
+    return 0;
+}
+
+/* implementation of select() on top of the poll cache, returns FALSE if it can't be used */
+static BOOL select_with_poll_cache( WS_fd_set *readfds, WS_fd_set *writefds, WS_fd_set *exceptfds,
+                                    int timeout, int *ret )
+{
+    static const unsigned int set_events[3] = { POLLIN, POLLOUT, POLLHUP | POLLPRI };
+    static const DWORD set_access[3] = { FILE_READ_DATA, FILE_WRITE_DATA, 0 };
+    WS_fd_set *sets[3];
+    struct poll_cache *cache;
+    struct pollfd *fds;
+    unsigned int i, j, k, count = 0;
+    DWORD start = GetTickCount();
+    int res, fd;
+
+    sets[0] = readfds;
+    sets[1] = writefds;
+    sets[2] = exceptfds;
+    for (k = 0; k < 3; k++) if (sets[k]) count += sets[k]->fd_count;
+
+    if (!(cache = begin_poll_cache( count ))) return FALSE;
+    if (!(fds = get_poll_buffer( count ))) return FALSE;
+
+    for (k = j = 0; k < 3; k++)
+    {
+        if (!sets[k]) continue;
+        for (i = 0; i < sets[k]->fd_count; i++, j++)
+        {
+            if (!(cache->slots[j] = poll_cache_add( cache, sets[k]->fd_array[i], set_access[k], set_events[k] )))
+            {
+                *ret = SOCKET_ERROR;
+                return TRUE;
+            }
+        }
+    }
+
+    for (;;)
+    {
+        if ((res = poll_cache_wait( cache, get_remaining_timeout( timeout, start ))) == -1)
+        {
+            if (errno != EINTR) return FALSE;
+            continue;
+        }
+
+        EnterCriticalSection( &poll_cache_section );
+        for (k = j = 0; k < 3; k++)
+        {
+            if (!sets[k]) continue;
+            for (i = 0; i < sets[k]->fd_count; i++, j++)
+            {
+                fds[j].fd = cache->slots[j]->fd;
+                fds[j].events = set_events[k];
+                fds[j].revents = filter_select_events( cache->slots[j], set_events[k], k );
+                if (k == 2 && (fds[j].revents & POLLHUP))
+                {
+                    /* check if the socket still exists */
+                    if ((fd = get_sock_fd( sets[k]->fd_array[i], 0, NULL )) != -1)
+                        release_sock_fd( sets[k]->fd_array[i], fd );
+                    else
+                        fds[j].revents = 0;
+                }
+            }
+        }
+        LeaveCriticalSection( &poll_cache_section );
+
+        if (!res) break;
+        for (j = 0; j < count; j++) if (fds[j].revents) break;
+        if (j < count) break;
+
+        /* only sockets that fd_sets_to_poll() wouldn't poll were ready, wait again without them */
+        for (j = 0; j < count; j++) if (cache->slots[j]->wanted != cache->slots[j]->events) break;
+        if (j == count || !get_remaining_timeout( timeout, start )) break;
+    }
+
+    *ret = get_poll_results( readfds, writefds, exceptfds, fds );
+    return TRUE;
+}
+
+/* implementation of WSAPoll() on top of the poll cache, returns FALSE if it can't be used */
+static BOOL poll_with_poll_cache( WSAPOLLFD *wfds, ULONG count, int timeout, int *ret )
+{
+    struct poll_cache *cache;
+    unsigned int revents;
+    DWORD start = GetTickCount();
+    int i, fd;
+
+    if (!(cache = begin_poll_cache( count ))) return FALSE;
+
+    /* poll() always reports errors, even for sockets without requested events */
+    for (i = 0; i < count; i++)
+        cache->slots[i] = poll_cache_add( cache, wfds[i].fd, 0, convert_poll_w2u( wfds[i].events ) | POLLERR );
+
+    while (poll_cache_wait( cache, get_remaining_timeout( timeout, start )) == -1)
+        if (errno != EINTR) return FALSE;
+
+    for (i = *ret = 0; i < count; i++)
+    {
+        if (!cache->slots[i])
+        {
+            wfds[i].revents = WS_POLLNVAL;
+            continue;
+        }
+        revents = cache->slots[i]->revents & (convert_poll_w2u( wfds[i].events ) | POLLERR | POLLHUP);
+        if (revents & POLLHUP)
+        {
+            /* Check if the socket still exists */
+            if ((fd = get_sock_fd( wfds[i].fd, 0, NULL )) != -1)
+            {
+                wfds[i].revents = WS_POLLHUP;
+                release_sock_fd( wfds[i].fd, fd );
+            }
+            else
+                wfds[i].revents = WS_POLLNVAL;
+        }
+        else
+            wfds[i].revents = convert_poll_u2w( revents );
+        if (revents) (*ret)++;
+    }
+    return TRUE;
+}
+
+#else  /* HAVE_SYS_EPOLL_H */
+
+static void poll_cache_close_socket( SOCKET s )
+{
+}
+
+static void free_poll_cache( struct poll_cache *cache )
+{
+}
+
+static BOOL select_with_poll_cache( WS_fd_set *readfds, WS_fd_set *writefds, WS_fd_set *exceptfds,
+                                    int timeout, int *ret )
+{
+    return FALSE;
+}
+
+static BOOL poll_with_poll_cache( WSAPOLLFD *wfds, ULONG count, int timeout, int *ret )
+{
+    return FALSE;
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
+/***********************************************************************
+ *		select			(WS2_32.18)
+ */
+int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
+                     WS_fd_set *ws_writefds, WS_fd_set *ws_exceptfds,
+                     const struct WS_timeval* ws_timeout)
+{
+    struct pollfd *pollfds;
+    int count, ret, timeout = -1;
+
+    TRACE("read %p, write %p, excp %p timeout %p\n",
+          ws_readfds, ws_writefds, ws_exceptfds, ws_timeout);
+
+    if (ws_timeout)
+        timeout = (ws_timeout->tv_sec * 1000) + (ws_timeout->tv_usec + 999) / 1000;
+
+    if (select_with_poll_cache( ws_readfds, ws_writefds, ws_exceptfds, timeout, &ret ))
+        return ret;
+
+    if (!(pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count )))
+        return SOCKET_ERROR;
+
+    ret = do_poll(pollfds, count, timeout);
+    release_poll_fds( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+
+    if (ret == -1) SetLastError(wsaErrno());
+    else ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+    return ret;
+}
+
+/***********************************************************************
+ *     WSAPoll
+ */
+int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
+{
+    int i, ret;
+    struct pollfd *ufds;
+
+    if (!count)
+    {
+        SetLastError(WSAEINVAL);
+        return SOCKET_ERROR;
     }
     if (!wfds)
     {
@@ -5447,6 +6178,8 @@ int WINAPI WSAPoll(WSAPOLLFD *wfds, ULONG count, int timeout)
         return SOCKET_ERROR;
     }
 
+    if (poll_with_poll_cache( wfds, count, timeout, &ret )) return ret;
+
     if (!(ufds = HeapAlloc(GetProcessHeap(), 0, count * sizeof(ufds[0]))))
     {
         SetLastError(WSAENOBUFS);
@@ -5507,6 +6240,1161 @@ static void WS_AddCompletion( SOCKET sock, ULONG_PTR CompletionValue, NTSTATUS C
 }
 
 
+/***********************************************************************
+ *           Socket reactor
+ *
+ * When WINESOCKREACTOR is set in the environment, overlapped WSARecv and
+ * WSASend requests that can't complete right away are not queued on the
+ * server. A thread of the process instead waits for the sockets to become
+ * ready with epoll, performs the transfers, and reports the results through
+ * the event, the completion port or the completion routine.
+ *
+ * The server doesn't know about these requests, so they are not aborted by
+ * CancelIo(), only by closesocket(). A socket whose handle was closed with
+ * CloseHandle() and then reused is detected on the next request, and its
+ * pending requests are aborted then. Other overlapped operations, like
+ * ReadFile() or AcceptEx(), still go through the server and are not ordered
+ * with respect to the requests handled here.
+ */
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE)
+
+#define REACTOR_HASH_SIZE 256
+#define REACTOR_MAX_EVENTS 64
+
+struct reactor_io
+{
+    struct list       entry;   /* entry in the read or write queue of the socket */
+    struct ws2_async *wsa;     /* request data */
+    IO_STATUS_BLOCK  *iosb;    /* status block to fill on completion */
+    HANDLE            event;   /* event to signal on completion */
+    ULONG_PTR         cvalue;  /* completion port value, 0 if none */
+    HANDLE            thread;  /* thread to queue the completion routine to */
+};
+
+struct reactor_socket
+{
+    struct list entry;     /* entry in the hash table, or in the dead list once removed */
+    SOCKET      socket;    /* socket handle */
+    int         fd;        /* private copy of the unix fd, -1 once removed */
+    int         unix_fd;   /* fd in the ntdll cache when the entry was created */
+    LONG        close_gen; /* socket_close_gen value when the entry was created */
+    struct list reads;     /* pending reads */
+    struct list writes;    /* pending writes */
+};
+
+static int reactor_epoll = -1;
+static struct list reactor_hash[REACTOR_HASH_SIZE];
+static struct list reactor_dead = LIST_INIT( reactor_dead );
+
+static CRITICAL_SECTION reactor_section;
+static CRITICAL_SECTION_DEBUG reactor_section_debug =
+{
+    0, 0, &reactor_section,
+    { &reactor_section_debug.ProcessLocksList, &reactor_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": reactor_section") }
+};
+static CRITICAL_SECTION reactor_section = { &reactor_section_debug, -1, 0, 0, 0, 0 };
+
+static struct reactor_socket *reactor_find( SOCKET s )
+{
+    struct reactor_socket *sock;
+
+    LIST_FOR_EACH_ENTRY( sock, &reactor_hash[(s >> 2) % REACTOR_HASH_SIZE], struct reactor_socket, entry )
+        if (sock->socket == s) return sock;
+    return NULL;
+}
+
+/* wait for the events needed by the pending requests */
+static void reactor_arm( struct reactor_socket *sock, int op )
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLONESHOT;
+    if (!list_empty( &sock->reads )) ev.events |= EPOLLIN;
+    if (!list_empty( &sock->writes )) ev.events |= EPOLLOUT;
+    ev.data.ptr = sock;
+    if (epoll_ctl( reactor_epoll, op, sock->fd, &ev ) == -1)
+        ERR( "epoll_ctl %d failed for socket %04lx, errno %d\n", op, sock->socket, errno );
+}
+
+/* stop watching a socket; it is freed by the reactor thread once no event can refer to it anymore */
+static void reactor_remove( struct reactor_socket *sock )
+{
+    epoll_ctl( reactor_epoll, EPOLL_CTL_DEL, sock->fd, NULL );
+    close( sock->fd );
+    sock->fd = -1;
+    list_remove( &sock->entry );
+    list_add_tail( &reactor_dead, &sock->entry );
+}
+
+/* report the result of a request */
+static void reactor_complete( struct reactor_socket *sock, struct reactor_io *io,
+                              NTSTATUS status, BOOL is_read )
+{
+    IO_STATUS_BLOCK *iosb = io->iosb;
+    ULONG info = iosb->Information;
+
+    TRACE( "socket %04lx iosb %p status %08x info %u\n", sock->socket, iosb, status, info );
+    iosb->u.Status = status;
+    if (is_read && status == STATUS_SUCCESS) _enable_event( SOCKET2HANDLE(sock->socket), FD_READ, 0, 0 );
+
+    if (io->wsa->completion_func)
+    {
+        NtQueueApcThread( io->thread, (PNTAPCFUNC)ws2_async_apc, (ULONG_PTR)io->wsa, (ULONG_PTR)iosb, 0 );
+        CloseHandle( io->thread );
+    }
+    else
+    {
+        if (io->cvalue) WS_AddCompletion( sock->socket, io->cvalue, status, info, TRUE );
+        if (io->event) SetEvent( io->event );
+        release_async_io( &io->wsa->io );
+    }
+    HeapFree( GetProcessHeap(), 0, io );
+}
+
+/* perform the pending transfers in one direction until the socket would block */
+static void reactor_transfer( struct reactor_socket *sock, struct list *queue, BOOL is_read )
+{
+    struct reactor_io *io;
+    struct list *ptr;
+    NTSTATUS status;
+    int result;
+
+    while ((ptr = list_head( queue )))
+    {
+        io = LIST_ENTRY( ptr, struct reactor_io, entry );
+        if (is_read) result = WS2_recv( sock->fd, io->wsa, convert_flags(io->wsa->flags) );
+        else result = WS2_send( sock->fd, io->wsa, convert_flags(io->wsa->flags) );
+
+        if (result >= 0)
+        {
+            io->iosb->Information += result;
+            if (!is_read && io->wsa->first_iovec < io->wsa->n_iovecs) break;  /* partial write */
+            status = STATUS_SUCCESS;
+        }
+        else if (errno == EAGAIN) break;
+        else status = wsaErrStatus();
+
+        list_remove( &io->entry );
+        reactor_complete( sock, io, status, is_read );
+    }
+}
+
+static DWORD CALLBACK reactor_thread_proc( void *arg )
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    struct reactor_socket *sock, *next;
+    int i, count;
+
+    for (;;)
+    {
+        if ((count = epoll_wait( reactor_epoll, events, REACTOR_MAX_EVENTS, -1 )) == -1)
+        {
+            if (errno != EINTR) ERR( "epoll_wait failed, errno %d\n", errno );
+            continue;
+        }
+
+        EnterCriticalSection( &reactor_section );
+        for (i = 0; i < count; i++)
+        {
+            sock = events[i].data.ptr;
+            if (sock->fd == -1) continue;  /* removed in the meantime */
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                reactor_transfer( sock, &sock->reads, TRUE );
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                reactor_transfer( sock, &sock->writes, FALSE );
+            if (list_empty( &sock->reads ) && list_empty( &sock->writes )) reactor_remove( sock );
+            else reactor_arm( sock, EPOLL_CTL_MOD );
+        }
+        LIST_FOR_EACH_ENTRY_SAFE( sock, next, &reactor_dead, struct reactor_socket, entry )
+        {
+            list_remove( &sock->entry );
+            HeapFree( GetProcessHeap(), 0, sock );
+        }
+        LeaveCriticalSection( &reactor_section );
+    }
+    return 0;
+}
+
+/* create the epoll instance and its thread on first use */
+static BOOL reactor_init(void)
+{
+    static volatile LONG initialized;
+    const char *env;
+    HANDLE thread;
+    int i, fd;
+
+    if (initialized) return reactor_epoll != -1;
+
+    EnterCriticalSection( &reactor_section );
+    if (initialized) goto done;
+
+    if (!(env = getenv( "WINESOCKREACTOR" )) || !atoi( env )) goto done;
+    if ((fd = epoll_create( 128 )) == -1)
+    {
+        WARN( "epoll not available, errno %d\n", errno );
+        goto done;
+    }
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+    for (i = 0; i < REACTOR_HASH_SIZE; i++) list_init( &reactor_hash[i] );
+    reactor_epoll = fd;
+
+    if (!(thread = CreateThread( NULL, 0, reactor_thread_proc, NULL, 0, NULL )))
+    {
+        close( fd );
+        reactor_epoll = -1;
+        goto done;
+    }
+    CloseHandle( thread );
+    TRACE( "using the socket reactor\n" );
+
+done:
+    initialized = 1;
+    LeaveCriticalSection( &reactor_section );
+    return reactor_epoll != -1;
+}
+
+/* abort the pending requests of a socket and stop watching it */
+static void reactor_abort( struct reactor_socket *sock )
+{
+    struct reactor_io *io, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( io, next, &sock->reads, struct reactor_io, entry )
+    {
+        list_remove( &io->entry );
+        reactor_complete( sock, io, STATUS_CANCELLED, TRUE );
+    }
+    LIST_FOR_EACH_ENTRY_SAFE( io, next, &sock->writes, struct reactor_io, entry )
+    {
+        list_remove( &io->entry );
+        reactor_complete( sock, io, STATUS_CANCELLED, FALSE );
+    }
+    reactor_remove( sock );
+}
+
+/***********************************************************************
+ *           reactor_queue
+ *
+ * Queue an overlapped request that would block to the reactor.
+ * Returns FALSE if it has to be queued on the server instead.
+ */
+static BOOL reactor_queue( SOCKET s, struct ws2_async *wsa, IO_STATUS_BLOCK *iosb,
+                           HANDLE event, ULONG_PTR cvalue, BOOL is_read )
+{
+    struct reactor_socket *sock;
+    struct reactor_io *io;
+    int fd, op = EPOLL_CTL_MOD;
+
+    if (wsa->flags & WS_MSG_OOB) return FALSE;
+    if (!reactor_init()) return FALSE;
+    if ((fd = get_sock_fd( s, is_read ? FILE_READ_DATA : FILE_WRITE_DATA, NULL )) == -1) return FALSE;
+    if (!(io = HeapAlloc( GetProcessHeap(), 0, sizeof(*io) )))
+    {
+        release_sock_fd( s, fd );
+        return FALSE;
+    }
+
+    io->wsa    = wsa;
+    io->iosb   = iosb;
+    io->event  = event;
+    io->cvalue = cvalue;
+    io->thread = 0;
+    if (wsa->completion_func &&
+        !DuplicateHandle( GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(),
+                          &io->thread, 0, FALSE, DUPLICATE_SAME_ACCESS ))
+        goto failed;
+
+    /* the server resets the event when it queues an async, do the same */
+    if (event) NtResetEvent( event, NULL );
+
+    EnterCriticalSection( &reactor_section );
+    if ((sock = reactor_find( s )) && (sock->unix_fd != fd || sock->close_gen != *get_close_gen( s )))
+    {
+        /* the handle has been closed without closesocket() and reused since */
+        TRACE( "socket %04lx: dropping stale entry\n", s );
+        reactor_abort( sock );
+        sock = NULL;
+    }
+    if (!sock)
+    {
+        if (!(sock = HeapAlloc( GetProcessHeap(), 0, sizeof(*sock) ))) goto failed_locked;
+        sock->socket = s;
+        sock->unix_fd = fd;
+        sock->close_gen = *get_close_gen( s );
+        if ((sock->fd = fcntl( fd, F_DUPFD_CLOEXEC, 0 )) == -1)
+        {
+            HeapFree( GetProcessHeap(), 0, sock );
+            goto failed_locked;
+        }
+        list_init( &sock->reads );
+        list_init( &sock->writes );
+        list_add_head( &reactor_hash[(s >> 2) % REACTOR_HASH_SIZE], &sock->entry );
+        op = EPOLL_CTL_ADD;
+    }
+    list_add_tail( is_read ? &sock->reads : &sock->writes, &io->entry );
+    reactor_arm( sock, op );
+    LeaveCriticalSection( &reactor_section );
+    release_sock_fd( s, fd );
+
+    TRACE( "socket %04lx: queued %s iosb %p\n", s, is_read ? "read" : "write", iosb );
+    return TRUE;
+
+failed_locked:
+    LeaveCriticalSection( &reactor_section );
+failed:
+    release_sock_fd( s, fd );
+    if (io->thread) CloseHandle( io->thread );
+    HeapFree( GetProcessHeap(), 0, io );
+    return FALSE;
+}
+
+/* abort the pending requests of a socket that is being closed */
+static void reactor_close_socket( SOCKET s )
+{
+    struct reactor_socket *sock;
+
+    if (reactor_epoll == -1) return;
+
+    EnterCriticalSection( &reactor_section );
+    if ((sock = reactor_find( s ))) reactor_abort( sock );
+    LeaveCriticalSection( &reactor_section );
+}
+
+#else  /* HAVE_SYS_EPOLL_H */
+
+static BOOL reactor_queue( SOCKET s, struct ws2_async *wsa, IO_STATUS_BLOCK *iosb,
+                           HANDLE event, ULONG_PTR cvalue, BOOL is_read )
+{
+    return FALSE;
+}
+
+static void reactor_close_socket( SOCKET s )
+{
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
+/***********************************************************************
+ *           Registered I/O
+ *
+ * RIOSend and RIOReceive requests are queued in the request queue of the
+ * socket and are transferred right away, in batches with sendmmsg() and
+ * recvmmsg(). On stream sockets a batch of sends is a single sendmsg(),
+ * so that a partial write can't be followed by the data of the next
+ * request. The requests that would block are picked up by a thread
+ * that waits for the sockets with epoll. Results are stored in the
+ * completion queue, so that RIODequeueCompletion never has to leave the
+ * process.
+ *
+ * The transfers don't go through the server, so they don't update the
+ * socket events reported by WSAEventSelect and WSAAsyncSelect.
+ */
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE)
+
+#define RIO_HASH_SIZE 256
+#define RIO_MAX_EVENTS 64
+#define RIO_BATCH_SIZE 64
+
+struct rio_buffer
+{
+    char  *data;
+    DWORD  length;
+};
+
+struct rio_cq
+{
+    RIORESULT  *results;   /* ring buffer of completions */
+    DWORD       size;      /* size of the ring buffer */
+    DWORD       head;      /* index of the oldest completion */
+    DWORD       count;     /* number of completions not dequeued yet */
+    DWORD       reserved;  /* room reserved by the request queues using it */
+    BOOL        armed;     /* RIONotify was called and the completion wasn't reported yet */
+    RIO_NOTIFICATION_COMPLETION notify;
+};
+
+struct rio_request
+{
+    RIO_BUF     data;      /* data buffer */
+    RIO_BUF     remote;    /* remote address buffer, no BufferId if none */
+    DWORD       flags;     /* RIO_MSG_* flags */
+    DWORD       done;      /* bytes transferred so far */
+    PVOID       context;   /* request context */
+};
+
+struct rio_queue
+{
+    struct rio_request *requests;   /* ring buffer of pending requests */
+    DWORD               size;       /* size of the ring buffer */
+    DWORD               head;       /* index of the oldest request */
+    DWORD               count;      /* number of pending requests */
+    DWORD               committed;  /* number of requests which may be started */
+    struct rio_cq      *cq;         /* queue receiving the completions */
+};
+
+struct rio_rq
+{
+    struct list      entry;    /* entry in the hash table, or in the dead list once closed */
+    SOCKET           socket;   /* socket handle */
+    int              fd;       /* private copy of the unix fd, -1 once closed */
+    BOOL             stream;   /* whether this is a connection oriented socket */
+    ULONGLONG        context;  /* socket context */
+    unsigned int     events;   /* events currently waited for */
+    struct rio_queue recv;
+    struct rio_queue send;
+};
+
+static int rio_epoll = -1;
+static struct list rio_hash[RIO_HASH_SIZE];
+static struct list rio_dead = LIST_INIT( rio_dead );
+
+static CRITICAL_SECTION rio_section;
+static CRITICAL_SECTION_DEBUG rio_section_debug =
+{
+    0, 0, &rio_section,
+    { &rio_section_debug.ProcessLocksList, &rio_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": rio_section") }
+};
+static CRITICAL_SECTION rio_section = { &rio_section_debug, -1, 0, 0, 0, 0 };
+
+static struct rio_rq *rio_find( SOCKET s )
+{
+    struct rio_rq *rq;
+
+    LIST_FOR_EACH_ENTRY( rq, &rio_hash[(s >> 2) % RIO_HASH_SIZE], struct rio_rq, entry )
+        if (rq->socket == s) return rq;
+    return NULL;
+}
+
+/* return the address of a buffer if it is inside a registered buffer */
+static char *rio_buffer_ptr( const RIO_BUF *buf )
+{
+    struct rio_buffer *buffer = (struct rio_buffer *)buf->BufferId;
+
+    if (!buffer || buf->BufferId == RIO_INVALID_BUFFERID) return NULL;
+    if (buf->Offset > buffer->length || buf->Length > buffer->length - buf->Offset) return NULL;
+    return buffer->data + buf->Offset;
+}
+
+static void rio_notify( struct rio_cq *cq )
+{
+    cq->armed = FALSE;
+    if (cq->notify.Type == RIO_EVENT_COMPLETION)
+        SetEvent( cq->notify.u.Event.EventHandle );
+    else
+        PostQueuedCompletionStatus( cq->notify.u.Iocp.IocpHandle, 0,
+                                    (ULONG_PTR)cq->notify.u.Iocp.CompletionKey,
+                                    cq->notify.u.Iocp.Overlapped );
+}
+
+/* move the oldest request of a queue to its completion queue */
+static void rio_complete( struct rio_rq *rq, struct rio_queue *queue, DWORD status, DWORD bytes )
+{
+    struct rio_request *req = &queue->requests[queue->head];
+    struct rio_cq *cq = queue->cq;
+    RIORESULT *result;
+
+    TRACE( "socket %04lx context %p status %u bytes %u\n", rq->socket, req->context, status, bytes );
+
+    if (cq->count < cq->size)
+    {
+        result = &cq->results[(cq->head + cq->count++) % cq->size];
+        result->Status           = status;
+        result->BytesTransferred = bytes;
+        result->SocketContext    = rq->context;
+        result->RequestContext   = (ULONG_PTR)req->context;
+        if (cq->armed && !(req->flags & RIO_MSG_DONT_NOTIFY)) rio_notify( cq );
+    }
+    else ERR( "completion queue %p overflow, dropping completion of %p\n", cq, req->context );
+
+    queue->head = (queue->head + 1) % queue->size;
+    queue->count--;
+    if (queue->committed) queue->committed--;
+}
+
+static int rio_sendmmsg( int fd, struct mmsghdr *msgs, unsigned int count )
+{
+#ifdef HAVE_SENDMMSG
+    return sendmmsg( fd, msgs, count, MSG_DONTWAIT );
+#else
+    unsigned int i;
+    ssize_t ret;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((ret = sendmsg( fd, &msgs[i].msg_hdr, MSG_DONTWAIT )) == -1) return i ? i : -1;
+        msgs[i].msg_len = ret;
+        if (ret < msgs[i].msg_hdr.msg_iov[0].iov_len) return i + 1;
+    }
+    return count;
+#endif
+}
+
+static int rio_recvmmsg( int fd, struct mmsghdr *msgs, unsigned int count )
+{
+#ifdef HAVE_RECVMMSG
+    return recvmmsg( fd, msgs, count, MSG_DONTWAIT, NULL );
+#else
+    unsigned int i;
+    ssize_t ret;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((ret = recvmsg( fd, &msgs[i].msg_hdr, MSG_DONTWAIT )) == -1) return i ? i : -1;
+        msgs[i].msg_len = ret;
+    }
+    return count;
+#endif
+}
+
+/* send the committed requests until the socket would block */
+static void rio_send( struct rio_rq *rq )
+{
+    struct rio_queue *queue = &rq->send;
+    union generic_unix_sockaddr addrs[RIO_BATCH_SIZE];
+    struct mmsghdr msgs[RIO_BATCH_SIZE];
+    struct iovec iov[RIO_BATCH_SIZE];
+    struct rio_request *req;
+    struct msghdr hdr;
+    unsigned int i, count;
+    ssize_t sent;
+    int ret;
+
+    while (queue->committed)
+    {
+        count = min( queue->committed, RIO_BATCH_SIZE );
+        for (i = 0; i < count; i++)
+        {
+            req = &queue->requests[(queue->head + i) % queue->size];
+            memset( &msgs[i], 0, sizeof(msgs[i]) );
+            iov[i].iov_base = rio_buffer_ptr( &req->data ) + req->done;
+            iov[i].iov_len  = req->data.Length - req->done;
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (rq->stream || !req->remote.BufferId) continue;
+            msgs[i].msg_hdr.msg_name    = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = ws_sockaddr_ws2u( (struct WS_sockaddr *)rio_buffer_ptr( &req->remote ),
+                                                            req->remote.Length, &addrs[i] );
+            if (!msgs[i].msg_hdr.msg_namelen) break;
+        }
+        if (!(count = i))
+        {
+            rio_complete( rq, queue, WSAEAFNOSUPPORT, 0 );
+            continue;
+        }
+
+        if (rq->stream)
+        {
+            memset( &hdr, 0, sizeof(hdr) );
+            hdr.msg_iov    = iov;
+            hdr.msg_iovlen = count;
+            if ((sent = sendmsg( rq->fd, &hdr, MSG_DONTWAIT )) == -1) ret = -1;
+            else
+            {
+                /* the bytes went out in request order */
+                for (i = 0; i < count; i++)
+                {
+                    msgs[i].msg_len = min( sent, iov[i].iov_len );
+                    sent -= msgs[i].msg_len;
+                }
+                ret = count;
+            }
+        }
+        else ret = rio_sendmmsg( rq->fd, msgs, count );
+
+        if (ret == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            rio_complete( rq, queue, wsaErrno(), 0 );
+            continue;
+        }
+        for (i = 0; i < ret; i++)
+        {
+            req = &queue->requests[queue->head];
+            req->done += msgs[i].msg_len;
+            if (req->done < req->data.Length) return;  /* partial write, wait for room in the socket buffer */
+            rio_complete( rq, queue, 0, req->done );
+        }
+        if (ret < count) return;
+    }
+}
+
+/* receive into the committed requests until the socket would block */
+static void rio_receive( struct rio_rq *rq )
+{
+    struct rio_queue *queue = &rq->recv;
+    union generic_unix_sockaddr addrs[RIO_BATCH_SIZE];
+    struct mmsghdr msgs[RIO_BATCH_SIZE];
+    struct iovec iov[RIO_BATCH_SIZE];
+    struct rio_request *req;
+    unsigned int i, count;
+    DWORD status;
+    int ret, len;
+
+    while (queue->committed)
+    {
+        count = min( queue->committed, RIO_BATCH_SIZE );
+        for (i = 0; i < count; i++)
+        {
+            req = &queue->requests[(queue->head + i) % queue->size];
+            memset( &msgs[i], 0, sizeof(msgs[i]) );
+            iov[i].iov_base = rio_buffer_ptr( &req->data ) + req->done;
+            iov[i].iov_len  = req->data.Length - req->done;
+            msgs[i].msg_hdr.msg_iov     = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen  = 1;
+            msgs[i].msg_hdr.msg_name    = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            /* the data of the next requests has to wait until this one is filled */
+            if (rq->stream && (req->flags & RIO_MSG_WAITALL)) count = i + 1;
+        }
+
+        if ((ret = rio_recvmmsg( rq->fd, msgs, count )) == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            rio_complete( rq, queue, wsaErrno(), 0 );
+            continue;
+        }
+        for (i = 0; i < ret; i++)
+        {
+            req = &queue->requests[queue->head];
+            req->done += msgs[i].msg_len;
+            if (rq->stream && (req->flags & RIO_MSG_WAITALL) && msgs[i].msg_len &&
+                req->done < req->data.Length)
+                return;
+            status = 0;
+            if (!rq->stream && (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) status = WSAEMSGSIZE;
+            if (req->remote.BufferId && msgs[i].msg_hdr.msg_namelen)
+            {
+                len = req->remote.Length;
+                ws_sockaddr_u2ws( &addrs[i].addr, (struct WS_sockaddr *)rio_buffer_ptr( &req->remote ), &len );
+            }
+            rio_complete( rq, queue, status, req->done );
+        }
+        if (ret < count) return;
+    }
+}
+
+/* start the committed requests, and wait for the socket if some of them would block */
+static void rio_process( struct rio_rq *rq )
+{
+    struct epoll_event ev;
+    unsigned int events = 0;
+
+    if (rq->fd == -1) return;
+    if (rq->send.committed) rio_send( rq );
+    if (rq->recv.committed) rio_receive( rq );
+
+    if (rq->send.committed) events |= EPOLLOUT;
+    if (rq->recv.committed) events |= EPOLLIN;
+    if (!(events & ~rq->events)) return;
+
+    rq->events |= events;
+    ev.events = rq->events | EPOLLONESHOT;
+    ev.data.ptr = rq;
+    if (epoll_ctl( rio_epoll, EPOLL_CTL_MOD, rq->fd, &ev ) == -1)
+        ERR( "epoll_ctl failed for socket %04lx, errno %d\n", rq->socket, errno );
+}
+
+static DWORD CALLBACK rio_thread_proc( void *arg )
+{
+    struct epoll_event events[RIO_MAX_EVENTS];
+    struct rio_rq *rq, *next;
+    int i, count;
+
+    for (;;)
+    {
+        if ((count = epoll_wait( rio_epoll, events, RIO_MAX_EVENTS, -1 )) == -1)
+        {
+            if (errno != EINTR) ERR( "epoll_wait failed, errno %d\n", errno );
+            continue;
+        }
+
+        EnterCriticalSection( &rio_section );
+        for (i = 0; i < count; i++)
+        {
+            rq = events[i].data.ptr;
+            rq->events = 0;
+            rio_process( rq );
+        }
+        LIST_FOR_EACH_ENTRY_SAFE( rq, next, &rio_dead, struct rio_rq, entry )
+        {
+            list_remove( &rq->entry );
+            HeapFree( GetProcessHeap(), 0, rq->recv.requests );
+            HeapFree( GetProcessHeap(), 0, rq->send.requests );
+            HeapFree( GetProcessHeap(), 0, rq );
+        }
+        LeaveCriticalSection( &rio_section );
+    }
+    return 0;
+}
+
+/* create the epoll instance and its thread on first use */
+static BOOL rio_init(void)
+{
+    static volatile LONG initialized;
+    HANDLE thread;
+    int i, fd;
+
+    if (initialized) return rio_epoll != -1;
+
+    EnterCriticalSection( &rio_section );
+    if (initialized) goto done;
+
+    if ((fd = epoll_create( 128 )) == -1)
+    {
+        WARN( "epoll not available, errno %d\n", errno );
+        goto done;
+    }
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+    for (i = 0; i < RIO_HASH_SIZE; i++) list_init( &rio_hash[i] );
+    rio_epoll = fd;
+
+    if (!(thread = CreateThread( NULL, 0, rio_thread_proc, NULL, 0, NULL )))
+    {
+        close( fd );
+        rio_epoll = -1;
+        goto done;
+    }
+    CloseHandle( thread );
+
+done:
+    initialized = 1;
+    LeaveCriticalSection( &rio_section );
+    return rio_epoll != -1;
+}
+
+/* resize the ring buffer of a request queue, keeping the pending requests */
+static BOOL rio_resize_queue( struct rio_queue *queue, DWORD size )
+{
+    struct rio_request *requests = NULL;
+    DWORD i;
+
+    if (size && !(requests = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*requests) ))) return FALSE;
+    for (i = 0; i < queue->count; i++)
+        requests[i] = queue->requests[(queue->head + i) % queue->size];
+    HeapFree( GetProcessHeap(), 0, queue->requests );
+    queue->requests = requests;
+    queue->size     = size;
+    queue->head     = 0;
+    return TRUE;
+}
+
+static BOOL rio_post( RIO_RQ handle, BOOL is_recv, const RIO_BUF *data, ULONG count,
+                      const RIO_BUF *remote, DWORD flags, PVOID context )
+{
+    struct rio_rq *rq = (struct rio_rq *)handle;
+    struct rio_request *req;
+    struct rio_queue *queue;
+    DWORD error = 0;
+
+    TRACE( "%p %s %p %u %p %#x %p\n", rq, is_recv ? "recv" : "send", data, count, remote, flags, context );
+
+    if (!rq || count > 1 || (!count && !(flags & RIO_MSG_COMMIT_ONLY)) ||
+        (count && (!data || !rio_buffer_ptr( data ))) || (remote && !rio_buffer_ptr( remote )))
+    {
+        WSASetLastError( WSAEINVAL );
+        return FALSE;
+    }
+
+    EnterCriticalSection( &rio_section );
+    queue = is_recv ? &rq->recv : &rq->send;
+    if (count)
+    {
+        if (queue->count == queue->size) error = WSAENOBUFS;
+        else
+        {
+            req = &queue->requests[(queue->head + queue->count++) % queue->size];
+            req->data    = *data;
+            req->flags   = flags;
+            req->done    = 0;
+            req->context = context;
+            if (remote) req->remote = *remote;
+            else req->remote.BufferId = NULL;
+        }
+    }
+    if (!error && !(flags & RIO_MSG_DEFER))
+    {
+        queue->committed = queue->count;
+        rio_process( rq );
+    }
+    LeaveCriticalSection( &rio_section );
+
+    if (error) WSASetLastError( error );
+    return !error;
+}
+
+/***********************************************************************
+ *     RIOReceive
+ */
+static BOOL WINAPI WS2_RIOReceive( RIO_RQ rq, PRIO_BUF data, ULONG count, DWORD flags, PVOID context )
+{
+    return rio_post( rq, TRUE, data, count, NULL, flags, context );
+}
+
+/***********************************************************************
+ *     RIOReceiveEx
+ */
+static int WINAPI WS2_RIOReceiveEx( RIO_RQ rq, PRIO_BUF data, ULONG count, PRIO_BUF local, PRIO_BUF remote,
+                                    PRIO_BUF control, PRIO_BUF msg_flags, DWORD flags, PVOID context )
+{
+    if (local || control || msg_flags)
+        FIXME( "local address, control and flags buffers are not supported\n" );
+    return rio_post( rq, TRUE, data, count, remote, flags, context );
+}
+
+/***********************************************************************
+ *     RIOSend
+ */
+static BOOL WINAPI WS2_RIOSend( RIO_RQ rq, PRIO_BUF data, ULONG count, DWORD flags, PVOID context )
+{
+    return rio_post( rq, FALSE, data, count, NULL, flags, context );
+}
+
+/***********************************************************************
+ *     RIOSendEx
+ */
+static BOOL WINAPI WS2_RIOSendEx( RIO_RQ rq, PRIO_BUF data, ULONG count, PRIO_BUF local, PRIO_BUF remote,
+                                  PRIO_BUF control, PRIO_BUF msg_flags, DWORD flags, PVOID context )
+{
+    if (local || control || msg_flags)
+        FIXME( "local address, control and flags buffers are not supported\n" );
+    return rio_post( rq, FALSE, data, count, remote, flags, context );
+}
+
+/***********************************************************************
+ *     RIOCreateCompletionQueue
+ */
+static RIO_CQ WINAPI WS2_RIOCreateCompletionQueue( DWORD size, PRIO_NOTIFICATION_COMPLETION notify )
+{
+    struct rio_cq *cq;
+
+    TRACE( "%u %p\n", size, notify );
+
+    if (!size || size > RIO_MAX_CQ_SIZE ||
+        (notify && notify->Type != RIO_EVENT_COMPLETION && notify->Type != RIO_IOCP_COMPLETION))
+    {
+        WSASetLastError( WSAEINVAL );
+        return RIO_INVALID_CQ;
+    }
+    if (!(cq = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cq) )) ||
+        !(cq->results = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*cq->results) )))
+    {
+        HeapFree( GetProcessHeap(), 0, cq );
+        WSASetLastError( WSAENOBUFS );
+        return RIO_INVALID_CQ;
+    }
+    cq->size = size;
+    if (notify) cq->notify = *notify;
+    return (RIO_CQ)cq;
+}
+
+/***********************************************************************
+ *     RIOCloseCompletionQueue
+ */
+static void WINAPI WS2_RIOCloseCompletionQueue( RIO_CQ handle )
+{
+    struct rio_cq *cq = (struct rio_cq *)handle;
+
+    TRACE( "%p\n", cq );
+
+    if (!cq) return;
+    HeapFree( GetProcessHeap(), 0, cq->results );
+    HeapFree( GetProcessHeap(), 0, cq );
+}
+
+/***********************************************************************
+ *     RIOResizeCompletionQueue
+ */
+static BOOL WINAPI WS2_RIOResizeCompletionQueue( RIO_CQ handle, DWORD size )
+{
+    struct rio_cq *cq = (struct rio_cq *)handle;
+    RIORESULT *results;
+    DWORD i, error = 0;
+
+    TRACE( "%p %u\n", cq, size );
+
+    if (!cq || !size || size > RIO_MAX_CQ_SIZE)
+    {
+        WSASetLastError( WSAEINVAL );
+        return FALSE;
+    }
+
+    EnterCriticalSection( &rio_section );
+    if (size < cq->count || size < cq->reserved) error = WSAEINVAL;
+    else if (!(results = HeapAlloc( GetProcessHeap(), 0, size * sizeof(*results) ))) error = WSAENOBUFS;
+    else
+    {
+        for (i = 0; i < cq->count; i++) results[i] = cq->results[(cq->head + i) % cq->size];
+        HeapFree( GetProcessHeap(), 0, cq->results );
+        cq->results = results;
+        cq->size    = size;
+        cq->head    = 0;
+    }
+    LeaveCriticalSection( &rio_section );
+
+    if (error) WSASetLastError( error );
+    return !error;
+}
+
+/***********************************************************************
+ *     RIOCreateRequestQueue
+ */
+static RIO_RQ WINAPI WS2_RIOCreateRequestQueue( SOCKET s, ULONG max_recv, ULONG max_recv_buffers,
+                                                ULONG max_send, ULONG max_send_buffers,
+                                                RIO_CQ recv_handle, RIO_CQ send_handle, PVOID context )
+{
+    struct rio_cq *recv_cq = (struct rio_cq *)recv_handle, *send_cq = (struct rio_cq *)send_handle;
+    struct epoll_event ev;
+    struct rio_rq *rq;
+    socklen_t len;
+    DWORD error = 0;
+    int fd, type;
+
+    TRACE( "%04lx %u %u %u %u %p %p %p\n", s, max_recv, max_recv_buffers, max_send, max_send_buffers,
+           recv_cq, send_cq, context );
+
+    if (!recv_cq || !send_cq || max_recv_buffers > 1 || max_send_buffers > 1)
+    {
+        WSASetLastError( WSAEINVAL );
+        return RIO_INVALID_RQ;
+    }
+    if (!rio_init())
+    {
+        WSASetLastError( WSAEOPNOTSUPP );
+        return RIO_INVALID_RQ;
+    }
+    if ((fd = get_sock_fd( s, 0, NULL )) == -1)
+    {
+        WSASetLastError( WSAENOTSOCK );
+        return RIO_INVALID_RQ;
+    }
+    if (!(rq = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*rq) )))
+    {
+        release_sock_fd( s, fd );
+        WSASetLastError( WSAENOBUFS );
+        return RIO_INVALID_RQ;
+    }
+    rq->socket  = s;
+    rq->context = (ULONG_PTR)context;
+    rq->fd      = fcntl( fd, F_DUPFD_CLOEXEC, 0 );
+    release_sock_fd( s, fd );
+    len = sizeof(type);
+    if (rq->fd != -1 && !getsockopt( rq->fd, SOL_SOCKET, SO_TYPE, &type, &len ))
+        rq->stream = (type == SOCK_STREAM);
+    rq->recv.cq = recv_cq;
+    rq->send.cq = send_cq;
+
+    EnterCriticalSection( &rio_section );
+    if (rq->fd == -1) error = wsaErrno();
+    else if (rio_find( s )) error = WSAEINVAL;
+    else if (recv_cq->reserved + max_recv > recv_cq->size ||
+             send_cq->reserved + max_send + (recv_cq == send_cq ? max_recv : 0) > send_cq->size)
+        error = WSAENOBUFS;
+    else if (!rio_resize_queue( &rq->recv, max_recv ) || !rio_resize_queue( &rq->send, max_send ))
+        error = WSAENOBUFS;
+    else
+    {
+        ev.events = EPOLLONESHOT;
+        ev.data.ptr = rq;
+        if (epoll_ctl( rio_epoll, EPOLL_CTL_ADD, rq->fd, &ev ) == -1) error = wsaErrno();
+    }
+    if (!error)
+    {
+        recv_cq->reserved += max_recv;
+        send_cq->reserved += max_send;
+        list_add_head( &rio_hash[(s >> 2) % RIO_HASH_SIZE], &rq->entry );
+    }
+    LeaveCriticalSection( &rio_section );
+
+    if (error)
+    {
+        if (rq->fd != -1) close( rq->fd );
+        HeapFree( GetProcessHeap(), 0, rq->recv.requests );
+        HeapFree( GetProcessHeap(), 0, rq->send.requests );
+        HeapFree( GetProcessHeap(), 0, rq );
+        WSASetLastError( error );
+        return RIO_INVALID_RQ;
+    }
+    return (RIO_RQ)rq;
+}
+
+/***********************************************************************
+ *     RIOResizeRequestQueue
+ */
+static BOOL WINAPI WS2_RIOResizeRequestQueue( RIO_RQ handle, DWORD max_recv, DWORD max_send )
+{
+    struct rio_rq *rq = (struct rio_rq *)handle;
+    struct rio_cq *recv_cq, *send_cq;
+    DWORD error = 0;
+
+    TRACE( "%p %u %u\n", rq, max_recv, max_send );
+
+    if (!rq)
+    {
+        WSASetLastError( WSAEINVAL );
+        return FALSE;
+    }
+
+    EnterCriticalSection( &rio_section );
+    recv_cq = rq->recv.cq;
+    send_cq = rq->send.cq;
+    recv_cq->reserved -= rq->recv.size;
+    send_cq->reserved -= rq->send.size;
+    if (max_recv < rq->recv.count || max_send < rq->send.count) error = WSAEINVAL;
+    else if (recv_cq->reserved + max_recv > recv_cq->size ||
+             send_cq->reserved + max_send + (recv_cq == send_cq ? max_recv : 0) > send_cq->size)
+        error = WSAENOBUFS;
+    else if (!rio_resize_queue( &rq->recv, max_recv ) || !rio_resize_queue( &rq->send, max_send ))
+        error = WSAENOBUFS;
+    recv_cq->reserved += rq->recv.size;
+    send_cq->reserved += rq->send.size;
+    LeaveCriticalSection( &rio_section );
+
+    if (error) WSASetLastError( error );
+    return !error;
+}
+
+/***********************************************************************
+ *     RIORegisterBuffer
+ */
+static RIO_BUFFERID WINAPI WS2_RIORegisterBuffer( PCHAR data, DWORD length )
+{
+    struct rio_buffer *buffer;
+
+    TRACE( "%p %u\n", data, length );
+
+    if (!data)
+    {
+        WSASetLastError( WSAEFAULT );
+        return RIO_INVALID_BUFFERID;
+    }
+    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, sizeof(*buffer) )))
+    {
+        WSASetLastError( WSAENOBUFS );
+        return RIO_INVALID_BUFFERID;
+    }
+    buffer->data   = data;
+    buffer->length = length;
+    return (RIO_BUFFERID)buffer;
+}
+
+/***********************************************************************
+ *     RIODeregisterBuffer
+ */
+static void WINAPI WS2_RIODeregisterBuffer( RIO_BUFFERID id )
+{
+    TRACE( "%p\n", id );
+
+    if (id == RIO_INVALID_BUFFERID) return;
+    HeapFree( GetProcessHeap(), 0, id );
+}
+
+/***********************************************************************
+ *     RIODequeueCompletion
+ */
+static ULONG WINAPI WS2_RIODequeueCompletion( RIO_CQ handle, PRIORESULT results, ULONG size )
+{
+    struct rio_cq *cq = (struct rio_cq *)handle;
+    ULONG i, count;
+
+    if (!cq || !results) return RIO_CORRUPT_CQ;
+
+    EnterCriticalSection( &rio_section );
+    count = min( size, cq->count );
+    for (i = 0; i < count; i++) results[i] = cq->results[(cq->head + i) % cq->size];
+    cq->head = (cq->head + count) % cq->size;
+    cq->count -= count;
+    LeaveCriticalSection( &rio_section );
+
+    TRACE( "%p -> %u\n", cq, count );
+    return count;
+}
+
+/***********************************************************************
+ *     RIONotify
+ */
+static INT WINAPI WS2_RIONotify( RIO_CQ handle )
+{
+    struct rio_cq *cq = (struct rio_cq *)handle;
+    INT ret = 0;
+
+    TRACE( "%p\n", cq );
+
+    if (!cq) return WSAEINVAL;
+
+    EnterCriticalSection( &rio_section );
+    if (!cq->notify.Type) ret = WSAEINVAL;
+    else if (cq->armed) ret = WSAEALREADY;
+    else
+    {
+        if (cq->notify.Type == RIO_EVENT_COMPLETION && cq->notify.u.Event.NotifyReset)
+            ResetEvent( cq->notify.u.Event.EventHandle );
+        if (cq->count) rio_notify( cq );
+        else cq->armed = TRUE;
+    }
+    LeaveCriticalSection( &rio_section );
+    return ret;
+}
+
+/* abort the pending requests of a socket that is being closed, and free its request queue */
+static void rio_close_socket( SOCKET s )
+{
+    struct rio_rq *rq;
+
+    if (rio_epoll == -1) return;
+
+    EnterCriticalSection( &rio_section );
+    if ((rq = rio_find( s )))
+    {
+        while (rq->recv.count)
+            rio_complete( rq, &rq->recv, WSA_OPERATION_ABORTED, rq->recv.requests[rq->recv.head].done );
+        while (rq->send.count)
+            rio_complete( rq, &rq->send, WSA_OPERATION_ABORTED, rq->send.requests[rq->send.head].done );
+        rq->recv.cq->reserved -= rq->recv.size;
+        rq->send.cq->reserved -= rq->send.size;
+        epoll_ctl( rio_epoll, EPOLL_CTL_DEL, rq->fd, NULL );
+        close( rq->fd );
+        rq->fd = -1;
+        list_remove( &rq->entry );
+        list_add_tail( &rio_dead, &rq->entry );
+    }
+    LeaveCriticalSection( &rio_section );
+}
+
+static BOOL get_rio_function_table( RIO_EXTENSION_FUNCTION_TABLE *table )
+{
+    table->cbSize                   = sizeof(*table);
+    table->RIOReceive               = WS2_RIOReceive;
+    table->RIOReceiveEx             = WS2_RIOReceiveEx;
+    table->RIOSend                  = WS2_RIOSend;
+    table->RIOSendEx                = WS2_RIOSendEx;
+    table->RIOCloseCompletionQueue  = WS2_RIOCloseCompletionQueue;
+    table->RIOCreateCompletionQueue = WS2_RIOCreateCompletionQueue;
+    table->RIOCreateRequestQueue    = WS2_RIOCreateRequestQueue;
+    table->RIODequeueCompletion     = WS2_RIODequeueCompletion;
+    table->RIODeregisterBuffer      = WS2_RIODeregisterBuffer;
+    table->RIONotify                = WS2_RIONotify;
+    table->RIORegisterBuffer        = WS2_RIORegisterBuffer;
+    table->RIOResizeCompletionQueue = WS2_RIOResizeCompletionQueue;
+    table->RIOResizeRequestQueue    = WS2_RIOResizeRequestQueue;
+    return TRUE;
+}
+
+#else  /* HAVE_SYS_EPOLL_H */
+
+static void rio_close_socket( SOCKET s )
+{
+}
+
+static BOOL get_rio_function_table( RIO_EXTENSION_FUNCTION_TABLE *table )
+{
+    return FALSE;
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
+
 /***********************************************************************
  *		send			(WS2_32.19)
  */
@@ -5624,7 +7512,10 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             iosb->u.Status = STATUS_PENDING;
             iosb->Information = n == -1 ? 0 : n;
 
-            if (wsa->completion_func)
+            if (reactor_queue( s, wsa, iosb, wsa->completion_func ? NULL : lpOverlapped->hEvent,
+                               wsa->completion_func ? 0 : cvalue, FALSE ))
+                err = STATUS_PENDING;
+            else if (wsa->completion_func)
                 err = register_async( ASYNC_TYPE_WRITE, wsa->hSocket, &wsa->io, NULL,
                                       ws2_async_apc, wsa, iosb );
             else
@@ -8043,7 +9934,10 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                 iosb->u.Status = STATUS_PENDING;
                 iosb->Information = 0;
 
-                if (wsa->completion_func)
+                if (reactor_queue( s, wsa, iosb, wsa->completion_func ? NULL : lpOverlapped->hEvent,
+                                   wsa->completion_func ? 0 : cvalue, TRUE ))
+                    err = STATUS_PENDING;
+                else if (wsa->completion_func)
                     err = register_async( ASYNC_TYPE_READ, wsa->hSocket, &wsa->io, NULL,
                                           ws2_async_apc, wsa, iosb );
                 else
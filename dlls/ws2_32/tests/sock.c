@@ -9053,6 +9053,139 @@ cleanup:
     closesocket(server);
 }
 
+#define TRANSMIT_SIZE (1024 * 1024)
+
+/* receive the file data, returns the size of the data that matched the file contents */
+static DWORD WINAPI transmit_drain_thread(void *arg)
+{
+    static char buffer[65536];
+    SOCKET sock = (SOCKET)arg;
+    DWORD total = 0;
+    int i, ret;
+
+    while ((ret = recv(sock, buffer, sizeof(buffer), 0)) > 0)
+    {
+        for (i = 0; i < ret; i++, total++)
+            if (buffer[i] != (char)(total * 7)) return total;
+    }
+    return total;
+}
+
+static void recv_exact(SOCKET sock, char *buffer, int len)
+{
+    int ret;
+
+    while (len > 0)
+    {
+        ret = recv(sock, buffer, len, 0);
+        ok(ret > 0, "recv returned %d, error %d\n", ret, WSAGetLastError());
+        if (ret <= 0) return;
+        buffer += ret;
+        len -= ret;
+    }
+}
+
+static void test_TransmitPackets(void)
+{
+    GUID transmitPacketsGuid = WSAID_TRANSMITPACKETS, transmitFileGuid = WSAID_TRANSMITFILE;
+    LPFN_TRANSMITPACKETS pTransmitPackets = NULL;
+    LPFN_TRANSMITFILE pTransmitFile = NULL;
+    char header_msg[] = "hello world", footer_msg[] = "goodbye!!!";
+    char path[MAX_PATH], name[MAX_PATH], buf[256], expect[256];
+    TRANSMIT_PACKETS_ELEMENT elements[3];
+    DWORD size, ret, i;
+    HANDLE file, thread;
+    SOCKET src, dst;
+    OVERLAPPED ov;
+    char *data;
+    BOOL bret;
+
+    if (tcp_socketpair(&src, &dst))
+    {
+        skip("failed to create socket pair\n");
+        return;
+    }
+    ret = WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitPacketsGuid, sizeof(transmitPacketsGuid),
+                   &pTransmitPackets, sizeof(pTransmitPackets), &size, NULL, NULL);
+    ok(!ret, "failed to get TransmitPackets, error %d\n", WSAGetLastError());
+    ret = WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitFileGuid, sizeof(transmitFileGuid),
+                   &pTransmitFile, sizeof(pTransmitFile), &size, NULL, NULL);
+    ok(!ret, "failed to get TransmitFile, error %d\n", WSAGetLastError());
+    if (!pTransmitPackets || !pTransmitFile)
+    {
+        closesocket(src);
+        closesocket(dst);
+        return;
+    }
+
+    GetTempPathA(MAX_PATH, path);
+    GetTempFileNameA(path, "wst", 0, name);
+    file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "failed to create file, error %u\n", GetLastError());
+    data = HeapAlloc(GetProcessHeap(), 0, TRANSMIT_SIZE);
+    for (i = 0; i < TRANSMIT_SIZE; i++) data[i] = i * 7;
+    bret = WriteFile(file, data, TRANSMIT_SIZE, &size, NULL);
+    ok(bret && size == TRANSMIT_SIZE, "WriteFile failed, error %u\n", GetLastError());
+
+    /* memory, file range and memory elements */
+    memset(elements, 0, sizeof(elements));
+    elements[0].dwElFlags = TP_ELEMENT_MEMORY;
+    elements[0].cLength = sizeof(header_msg);
+    elements[0].pBuffer = header_msg;
+    elements[1].dwElFlags = TP_ELEMENT_FILE;
+    elements[1].cLength = 100;
+    elements[1].nFileOffset.QuadPart = 10;
+    elements[1].hFile = file;
+    elements[2].dwElFlags = TP_ELEMENT_MEMORY | TP_ELEMENT_EOP;
+    elements[2].cLength = sizeof(footer_msg);
+    elements[2].pBuffer = footer_msg;
+
+    memcpy(expect, header_msg, sizeof(header_msg));
+    memcpy(expect + sizeof(header_msg), data + 10, 100);
+    memcpy(expect + sizeof(header_msg) + 100, footer_msg, sizeof(footer_msg));
+    size = sizeof(header_msg) + 100 + sizeof(footer_msg);
+
+    bret = pTransmitPackets(src, elements, 3, 0, NULL, 0);
+    ok(bret, "TransmitPackets failed, error %d\n", WSAGetLastError());
+    memset(buf, 0, sizeof(buf));
+    recv_exact(dst, buf, size);
+    ok(!memcmp(buf, expect, size), "TransmitPackets data did not match\n");
+
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    bret = pTransmitPackets(src, elements, 3, 0, &ov, 0);
+    ok(bret || WSAGetLastError() == ERROR_IO_PENDING, "TransmitPackets failed, error %d\n", WSAGetLastError());
+    ret = WaitForSingleObject(ov.hEvent, 2000);
+    ok(ret == WAIT_OBJECT_0, "overlapped TransmitPackets did not complete\n");
+    bret = GetOverlappedResult((HANDLE)src, &ov, &ret, FALSE);
+    ok(bret, "overlapped TransmitPackets failed, error %u\n", GetLastError());
+    ok(ret == size, "sent %u bytes, expected %u\n", ret, size);
+    memset(buf, 0, sizeof(buf));
+    recv_exact(dst, buf, size);
+    ok(!memcmp(buf, expect, size), "overlapped TransmitPackets data did not match\n");
+    CloseHandle(ov.hEvent);
+
+    /* the whole file, larger than the socket buffers */
+    thread = CreateThread(NULL, 0, transmit_drain_thread, (void *)dst, 0, NULL);
+
+    SetFilePointer(file, 0, NULL, FILE_BEGIN);
+    bret = pTransmitFile(src, file, 0, 0, NULL, NULL, 0);
+    ok(bret, "TransmitFile failed, error %d\n", WSAGetLastError());
+
+    shutdown(src, SD_SEND);
+    ret = WaitForSingleObject(thread, 10000);
+    ok(ret == WAIT_OBJECT_0, "drain thread did not finish\n");
+    GetExitCodeThread(thread, &size);
+    ok(size == TRANSMIT_SIZE, "received %u matching bytes\n", size);
+    CloseHandle(thread);
+
+    HeapFree(GetProcessHeap(), 0, data);
+    CloseHandle(file);
+    closesocket(src);
+    closesocket(dst);
+}
+
 static void test_getpeername(void)
 {
     SOCKET sock;
@@ -11484,6 +11617,432 @@ static void test_iocp(void)
     closesocket(dst);
 }
 
+#define POLL_LARGE_COUNT 128
+
+static void send_udp_to(SOCKET s)
+{
+    struct sockaddr_in addr;
+    SOCKET sender;
+    int len, ret;
+
+    len = sizeof(addr);
+    ret = getsockname(s, (struct sockaddr *)&addr, &len);
+    ok(!ret, "getsockname failed, error %d\n", WSAGetLastError());
+    sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ret = sendto(sender, "test", 4, 0, (struct sockaddr *)&addr, sizeof(addr));
+    ok(ret == 4, "sendto returned %d, error %d\n", ret, WSAGetLastError());
+    closesocket(sender);
+}
+
+static int poll_large_set(WSAPOLLFD *pollfds, const SOCKET *socks)
+{
+    unsigned int i;
+
+    for (i = 0; i < POLL_LARGE_COUNT; i++)
+    {
+        pollfds[i].fd = socks[i];
+        pollfds[i].events = POLLRDNORM;
+        pollfds[i].revents = 0;
+    }
+    return pWSAPoll(pollfds, POLL_LARGE_COUNT, 1000);
+}
+
+/* select and WSAPoll on sets large enough to be kept registered between calls */
+static void test_poll_large_set(void)
+{
+    struct sockaddr_in addr;
+    WSAPOLLFD *pollfds;
+    SOCKET *socks;
+    fd_set *readfds;
+    struct timeval timeout = { 1, 0 };
+    unsigned int i, ready = POLL_LARGE_COUNT / 2;
+    char buf[4];
+    int ret;
+
+    if (!pWSAPoll)
+    {
+        skip("WSAPoll is unsupported, skipping large set test.\n");
+        return;
+    }
+
+    socks = HeapAlloc(GetProcessHeap(), 0, POLL_LARGE_COUNT * sizeof(*socks));
+    pollfds = HeapAlloc(GetProcessHeap(), 0, POLL_LARGE_COUNT * sizeof(*pollfds));
+    readfds = HeapAlloc(GetProcessHeap(), 0, FIELD_OFFSET(fd_set, fd_array[POLL_LARGE_COUNT]));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    for (i = 0; i < POLL_LARGE_COUNT; i++)
+    {
+        socks[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        ok(socks[i] != INVALID_SOCKET, "socket failed, error %d\n", WSAGetLastError());
+        ret = bind(socks[i], (struct sockaddr *)&addr, sizeof(addr));
+        ok(!ret, "bind failed, error %d\n", WSAGetLastError());
+    }
+
+    send_udp_to(socks[ready]);
+    ret = poll_large_set(pollfds, socks);
+    ok(ret == 1, "WSAPoll returned %d, error %d\n", ret, WSAGetLastError());
+    ok(pollfds[ready].revents == POLLRDNORM, "got revents %x\n", pollfds[ready].revents);
+
+    readfds->fd_count = POLL_LARGE_COUNT;
+    memcpy(readfds->fd_array, socks, POLL_LARGE_COUNT * sizeof(*socks));
+    ret = select(0, readfds, NULL, NULL, &timeout);
+    ok(ret == 1, "select returned %d, error %d\n", ret, WSAGetLastError());
+    ok(readfds->fd_count == 1 && readfds->fd_array[0] == socks[ready], "wrong result\n");
+
+    /* replace the ready socket, the new one is likely to get the same handle */
+    closesocket(socks[ready]);
+    socks[ready] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(socks[ready] != INVALID_SOCKET, "socket failed, error %d\n", WSAGetLastError());
+    ret = bind(socks[ready], (struct sockaddr *)&addr, sizeof(addr));
+    ok(!ret, "bind failed, error %d\n", WSAGetLastError());
+
+    for (i = 0; i < POLL_LARGE_COUNT; i++)
+    {
+        pollfds[i].fd = socks[i];
+        pollfds[i].events = POLLRDNORM;
+        pollfds[i].revents = 0;
+    }
+    ret = pWSAPoll(pollfds, POLL_LARGE_COUNT, 0);
+    ok(!ret, "WSAPoll returned %d, error %d\n", ret, WSAGetLastError());
+
+    send_udp_to(socks[ready]);
+    ret = poll_large_set(pollfds, socks);
+    ok(ret == 1, "WSAPoll returned %d, error %d\n", ret, WSAGetLastError());
+    ok(pollfds[ready].revents == POLLRDNORM, "got revents %x\n", pollfds[ready].revents);
+    ret = recv(socks[ready], buf, sizeof(buf), 0);
+    ok(ret == 4, "recv returned %d, error %d\n", ret, WSAGetLastError());
+
+    for (i = 0; i < POLL_LARGE_COUNT; i++) closesocket(socks[i]);
+    HeapFree(GetProcessHeap(), 0, readfds);
+    HeapFree(GetProcessHeap(), 0, pollfds);
+    HeapFree(GetProcessHeap(), 0, socks);
+}
+
+#define ECHO_ITERATIONS 100
+
+/* send a sequence number and wait for both completions on the port */
+static BOOL echo_transfer(HANDLE port, SOCKET from, SOCKET to, ULONG_PTR to_key, DWORD seq)
+{
+    OVERLAPPED recv_ov, send_ov, *ovl;
+    DWORD data = seq, received = ~0u, bytes, flags = 0;
+    WSABUF recv_buf, send_buf;
+    BOOL got_recv = FALSE, got_send = FALSE;
+    ULONG_PTR key;
+    int ret;
+
+    memset(&recv_ov, 0, sizeof(recv_ov));
+    memset(&send_ov, 0, sizeof(send_ov));
+    recv_buf.len = sizeof(received);
+    recv_buf.buf = (char *)&received;
+    send_buf.len = sizeof(data);
+    send_buf.buf = (char *)&data;
+
+    ret = WSARecv(to, &recv_buf, 1, NULL, &flags, &recv_ov, NULL);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING,
+       "WSARecv returned %d, error %d\n", ret, WSAGetLastError());
+    ret = WSASend(from, &send_buf, 1, NULL, 0, &send_ov, NULL);
+    ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSASend returned %d, error %d\n", ret, WSAGetLastError());
+
+    while (!got_recv || !got_send)
+    {
+        if (!GetQueuedCompletionStatus(port, &bytes, &key, &ovl, 1000))
+        {
+            ok(0, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+            return FALSE;
+        }
+        ok(bytes == sizeof(data), "got %u bytes\n", bytes);
+        if (ovl == &recv_ov)
+        {
+            ok(key == to_key, "got key %lx\n", key);
+            got_recv = TRUE;
+        }
+        else if (ovl == &send_ov) got_send = TRUE;
+        else ok(0, "unexpected overlapped %p\n", ovl);
+    }
+    ok(received == seq, "received %u instead of %u\n", received, seq);
+    return received == seq;
+}
+
+/* loopback echo with pending overlapped receives */
+static void test_overlapped_echo(void)
+{
+    SOCKET src, dst;
+    HANDLE port;
+    DWORD i;
+    int ret;
+
+    ret = tcp_socketpair_ovl(&src, &dst);
+    ok(!ret, "creating socket pair failed\n");
+    if (ret) return;
+
+    port = CreateIoCompletionPort((HANDLE)src, NULL, 1, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+    port = CreateIoCompletionPort((HANDLE)dst, port, 2, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+
+    for (i = 0; i < ECHO_ITERATIONS; i++)
+    {
+        if (!echo_transfer(port, src, dst, 2, i)) break;
+        if (!echo_transfer(port, dst, src, 1, i)) break;
+    }
+    ok(i == ECHO_ITERATIONS, "only %u round trips completed\n", i);
+
+    closesocket(src);
+    closesocket(dst);
+    CloseHandle(port);
+}
+
+/* a pending request must reset the event of the overlapped structure */
+static void test_overlapped_event_reuse(void)
+{
+    SOCKET src, dst;
+    OVERLAPPED ov;
+    WSABUF buf;
+    DWORD bytes, flags = 0, data = 0xdeadbeef, received = 0;
+    int ret;
+
+    ret = tcp_socketpair_ovl(&src, &dst);
+    ok(!ret, "creating socket pair failed\n");
+    if (ret) return;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEventW(NULL, TRUE, TRUE, NULL);
+    buf.len = sizeof(received);
+    buf.buf = (char *)&received;
+
+    ret = WSARecv(dst, &buf, 1, NULL, &flags, &ov, NULL);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING,
+       "WSARecv returned %d, error %d\n", ret, WSAGetLastError());
+    ret = WaitForSingleObject(ov.hEvent, 0);
+    ok(ret == WAIT_TIMEOUT, "event not reset, wait returned %u\n", ret);
+
+    ret = send(src, (char *)&data, sizeof(data), 0);
+    ok(ret == sizeof(data), "send returned %d, error %d\n", ret, WSAGetLastError());
+    ret = WaitForSingleObject(ov.hEvent, 1000);
+    ok(!ret, "wait returned %u\n", ret);
+    ret = GetOverlappedResult((HANDLE)dst, &ov, &bytes, FALSE);
+    ok(ret, "GetOverlappedResult failed, error %u\n", GetLastError());
+    ok(bytes == sizeof(data), "got %u bytes\n", bytes);
+    ok(received == data, "received %x\n", received);
+
+    /* the event is signaled again now, reuse it for another request */
+    received = 0;
+    ret = WSARecv(dst, &buf, 1, NULL, &flags, &ov, NULL);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING,
+       "WSARecv returned %d, error %d\n", ret, WSAGetLastError());
+    ret = WaitForSingleObject(ov.hEvent, 0);
+    ok(ret == WAIT_TIMEOUT, "event not reset, wait returned %u\n", ret);
+
+    closesocket(src);
+    closesocket(dst);
+    ret = WaitForSingleObject(ov.hEvent, 1000);
+    ok(!ret, "wait returned %u\n", ret);
+    CloseHandle(ov.hEvent);
+}
+
+#define RIO_DEPTH 64
+#define RIO_MSG_SIZE 64
+#define RIO_ROUNDS 20
+
+static BOOL rio_socketpair(int type, SOCKET *src, SOCKET *dst)
+{
+    SOCKET server = INVALID_SOCKET;
+    struct sockaddr_in addr, src_addr;
+    int len;
+
+    *src = WSASocketW(AF_INET, type, 0, NULL, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+    *dst = INVALID_SOCKET;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (type == SOCK_STREAM)
+    {
+        server = WSASocketW(AF_INET, type, 0, NULL, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+        len = sizeof(addr);
+        if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) || listen(server, 1) ||
+            getsockname(server, (struct sockaddr *)&addr, &len) ||
+            connect(*src, (struct sockaddr *)&addr, sizeof(addr)))
+            goto failed;
+        *dst = accept(server, NULL, NULL);
+        closesocket(server);
+        return *dst != INVALID_SOCKET;
+    }
+
+    *dst = WSASocketW(AF_INET, type, 0, NULL, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+    src_addr = addr;
+    len = sizeof(addr);
+    if (bind(*dst, (struct sockaddr *)&addr, sizeof(addr)) ||
+        getsockname(*dst, (struct sockaddr *)&addr, &len) ||
+        bind(*src, (struct sockaddr *)&src_addr, sizeof(src_addr)) ||
+        getsockname(*src, (struct sockaddr *)&src_addr, &len) ||
+        connect(*src, (struct sockaddr *)&addr, sizeof(addr)) ||
+        connect(*dst, (struct sockaddr *)&src_addr, sizeof(src_addr)))
+        goto failed;
+    return TRUE;
+
+failed:
+    closesocket(server);
+    closesocket(*src);
+    closesocket(*dst);
+    return FALSE;
+}
+
+static void test_rio_transfer(const RIO_EXTENSION_FUNCTION_TABLE *rio, int type)
+{
+    static char send_data[RIO_DEPTH * RIO_MSG_SIZE], recv_data[RIO_DEPTH * RIO_MSG_SIZE];
+    ULONG i, count, sent, recv_pending, round, tries;
+    RIO_BUFFERID send_id, recv_id;
+    RIO_NOTIFICATION_COMPLETION notify;
+    RIORESULT results[RIO_DEPTH];
+    ULONGLONG received, expected;
+    RIO_CQ src_cq, dst_cq;
+    RIO_RQ src_rq, dst_rq;
+    SOCKET src, dst;
+    RIO_BUF buf;
+    HANDLE event;
+    BOOL ret;
+
+    if (!rio_socketpair(type, &src, &dst))
+    {
+        skip("failed to create sockets\n");
+        return;
+    }
+
+    for (i = 0; i < sizeof(send_data); i++) send_data[i] = i;
+    send_id = rio->RIORegisterBuffer(send_data, sizeof(send_data));
+    ok(send_id != RIO_INVALID_BUFFERID, "RIORegisterBuffer failed, error %d\n", WSAGetLastError());
+    recv_id = rio->RIORegisterBuffer(recv_data, sizeof(recv_data));
+    ok(recv_id != RIO_INVALID_BUFFERID, "RIORegisterBuffer failed, error %d\n", WSAGetLastError());
+
+    event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    memset(&notify, 0, sizeof(notify));
+    notify.Type = RIO_EVENT_COMPLETION;
+    notify.Event.EventHandle = event;
+    src_cq = rio->RIOCreateCompletionQueue(2 * RIO_DEPTH, NULL);
+    ok(src_cq != RIO_INVALID_CQ, "RIOCreateCompletionQueue failed, error %d\n", WSAGetLastError());
+    dst_cq = rio->RIOCreateCompletionQueue(2 * RIO_DEPTH, &notify);
+    ok(dst_cq != RIO_INVALID_CQ, "RIOCreateCompletionQueue failed, error %d\n", WSAGetLastError());
+
+    src_rq = rio->RIOCreateRequestQueue(src, 1, 1, RIO_DEPTH, 1, src_cq, src_cq, (void *)0x1234);
+    ok(src_rq != RIO_INVALID_RQ, "RIOCreateRequestQueue failed, error %d\n", WSAGetLastError());
+    dst_rq = rio->RIOCreateRequestQueue(dst, RIO_DEPTH, 1, 1, 1, dst_cq, dst_cq, (void *)0x5678);
+    ok(dst_rq != RIO_INVALID_RQ, "RIOCreateRequestQueue failed, error %d\n", WSAGetLastError());
+
+    count = rio->RIODequeueCompletion(dst_cq, results, RIO_DEPTH);
+    ok(!count, "got %u completions\n", count);
+    ret = rio->RIONotify(dst_cq);
+    ok(!ret, "RIONotify returned %d\n", ret);
+    ret = rio->RIONotify(dst_cq);
+    ok(ret == WSAEALREADY, "RIONotify returned %d\n", ret);
+
+    /* single message */
+    buf.BufferId = recv_id;
+    buf.Offset = 0;
+    buf.Length = RIO_MSG_SIZE;
+    ret = rio->RIOReceive(dst_rq, &buf, 1, 0, (void *)1);
+    ok(ret, "RIOReceive failed, error %d\n", WSAGetLastError());
+    buf.BufferId = send_id;
+    ret = rio->RIOSend(src_rq, &buf, 1, 0, (void *)2);
+    ok(ret, "RIOSend failed, error %d\n", WSAGetLastError());
+
+    ret = WaitForSingleObject(event, 1000);
+    ok(!ret, "wait returned %d\n", ret);
+    count = rio->RIODequeueCompletion(dst_cq, results, RIO_DEPTH);
+    ok(count == 1, "got %u completions\n", count);
+    ok(!results[0].Status, "got status %d\n", results[0].Status);
+    ok(results[0].BytesTransferred == RIO_MSG_SIZE, "got %u bytes\n", results[0].BytesTransferred);
+    ok(results[0].SocketContext == 0x5678, "got socket context %s\n", wine_dbgstr_longlong(results[0].SocketContext));
+    ok(results[0].RequestContext == 1, "got request context %s\n", wine_dbgstr_longlong(results[0].RequestContext));
+    ok(!memcmp(recv_data, send_data, RIO_MSG_SIZE), "data didn't match\n");
+
+    for (tries = 0, count = 0; !count && tries < 1000; tries++, Sleep(1))
+        count = rio->RIODequeueCompletion(src_cq, results, RIO_DEPTH);
+    ok(count == 1, "got %u completions\n", count);
+    ok(!results[0].Status, "got status %d\n", results[0].Status);
+    ok(results[0].BytesTransferred == RIO_MSG_SIZE, "got %u bytes\n", results[0].BytesTransferred);
+    ok(results[0].SocketContext == 0x1234, "got socket context %s\n", wine_dbgstr_longlong(results[0].SocketContext));
+    ok(results[0].RequestContext == 2, "got request context %s\n", wine_dbgstr_longlong(results[0].RequestContext));
+
+    /* batches of deferred sends */
+    received = 0;
+    recv_pending = 0;
+    for (round = 0; round < RIO_ROUNDS; round++)
+    {
+        for (; recv_pending < RIO_DEPTH; recv_pending++)
+        {
+            buf.BufferId = recv_id;
+            buf.Offset = recv_pending * RIO_MSG_SIZE;
+            buf.Length = RIO_MSG_SIZE;
+            ret = rio->RIOReceive(dst_rq, &buf, 1, 0, NULL);
+            if (!ret) break;
+        }
+        ok(ret, "RIOReceive failed, error %d\n", WSAGetLastError());
+        for (i = 0; i < RIO_DEPTH; i++)
+        {
+            buf.BufferId = send_id;
+            buf.Offset = i * RIO_MSG_SIZE;
+            buf.Length = RIO_MSG_SIZE;
+            ret = rio->RIOSend(src_rq, &buf, 1, i < RIO_DEPTH - 1 ? RIO_MSG_DEFER : 0, NULL);
+            if (!ret) break;
+        }
+        ok(ret, "RIOSend failed, error %d\n", WSAGetLastError());
+        if (!ret) break;
+
+        expected = (ULONGLONG)(round + 1) * RIO_DEPTH * RIO_MSG_SIZE;
+        for (sent = tries = 0; sent < RIO_DEPTH || received < expected; tries++)
+        {
+            sent += rio->RIODequeueCompletion(src_cq, results, RIO_DEPTH);
+            count = rio->RIODequeueCompletion(dst_cq, results, RIO_DEPTH);
+            for (i = 0; i < count; i++)
+            {
+                ok(!results[i].Status, "got status %d\n", results[i].Status);
+                received += results[i].BytesTransferred;
+            }
+            recv_pending -= count;
+            if (tries >= 5000) break;
+            if (!count) Sleep(1);
+        }
+        if (sent < RIO_DEPTH || received < expected) break;
+    }
+    ok(round == RIO_ROUNDS, "%s: transfer stopped after %u rounds\n", type == SOCK_STREAM ? "TCP" : "UDP", round);
+
+    closesocket(src);
+    closesocket(dst);
+    rio->RIOCloseCompletionQueue(src_cq);
+    rio->RIOCloseCompletionQueue(dst_cq);
+    rio->RIODeregisterBuffer(send_id);
+    rio->RIODeregisterBuffer(recv_id);
+    CloseHandle(event);
+}
+
+static void test_rio(void)
+{
+    GUID rio_guid = WSAID_MULTIPLE_RIO;
+    RIO_EXTENSION_FUNCTION_TABLE rio;
+    DWORD size;
+    SOCKET s;
+    int ret;
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&rio, 0, sizeof(rio));
+    ret = WSAIoctl(s, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &rio_guid, sizeof(rio_guid),
+                   &rio, sizeof(rio), &size, NULL, NULL);
+    closesocket(s);
+    if (ret)
+    {
+        win_skip("RIO is not supported, error %d\n", WSAGetLastError());
+        return;
+    }
+    ok(size == sizeof(rio), "got size %u\n", size);
+    ok(rio.cbSize == sizeof(rio), "got cbSize %u\n", rio.cbSize);
+
+    test_rio_transfer(&rio, SOCK_DGRAM);
+    test_rio_transfer(&rio, SOCK_STREAM);
+}
+
 START_TEST( sock )
 {
     int i;
@@ -11540,14 +12099,19 @@ START_TEST( sock )
     test_WSASendTo();
     test_WSARecv();
     test_WSAPoll();
+    test_poll_large_set();
     test_write_watch();
     test_iocp();
+    test_overlapped_echo();
+    test_overlapped_event_reuse();
+    test_rio();
 
     test_events(0);
     test_events(1);
 
     test_ipv6only();
     test_TransmitFile();
+    test_TransmitPackets();
     test_GetAddrInfoW();
     test_GetAddrInfoExW();
     test_getaddrinfo();
@@ -724,6 +724,23 @@ struct rawinput_device
 };
 
 
+struct fast_sync_slot
+{
+    int            state;
+    int            type;
+    unsigned int   max;
+    unsigned int   waiters;
+};
+enum fast_sync_type { FAST_SYNC_NONE, FAST_SYNC_EVENT, FAST_SYNC_SEMAPHORE };
+#define FAST_SYNC_SERVER_OWNED 0x80000000
+#define FAST_SYNC_EVENT_PULSED 0x40000000
+#define FAST_SYNC_EVENT_PULSES 0x3ffffffe
+#define FAST_SYNC_MAX_SLOTS    65536
+
+
+#define MAX_HANDLE_GENERATIONS 0x100000
+
+
 
 
 
@@ -1123,6 +1140,20 @@ struct close_handle_reply
 
 
 
+struct close_handles_request
+{
+    struct request_header __header;
+    /* VARARG(handles,handles); */
+    char __pad_12[4];
+};
+struct close_handles_reply
+{
+    struct reply_header __header;
+    /* VARARG(statuses,uints); */
+};
+
+
+
 struct set_handle_info_request
 {
     struct request_header __header;
@@ -1134,6 +1165,20 @@ struct set_handle_info_reply
 {
     struct reply_header __header;
     int          old_flags;
+    unsigned int generation;
+};
+
+
+
+struct get_handle_generations_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_handle_generations_reply
+{
+    struct reply_header __header;
+    data_size_t  size;
     char __pad_12[4];
 };
 
@@ -1435,6 +1480,36 @@ struct open_semaphore_reply
 
 
 
+struct get_fast_sync_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_fast_sync_shm_reply
+{
+    struct reply_header __header;
+    data_size_t  size;
+    char __pad_12[4];
+};
+
+
+
+struct get_fast_sync_obj_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_fast_sync_obj_reply
+{
+    struct reply_header __header;
+    unsigned int index;
+    int          type;
+    unsigned int access;
+    char __pad_20[4];
+};
+
+
+
 struct create_file_request
 {
     struct request_header __header;
@@ -5130,8 +5205,8 @@ struct get_object_type_reply
 {
     struct reply_header __header;
     data_size_t    total;
+    unsigned int   generation;
     /* VARARG(type,unicode_str); */
-    char __pad_12[4];
 };
 
 
@@ -5343,6 +5418,28 @@ struct remove_completion_reply
 };
 
 
+struct completion_packet
+{
+    apc_param_t   ckey;
+    apc_param_t   cvalue;
+    apc_param_t   information;
+    unsigned int  status;
+    int           __pad;
+};
+
+
+struct remove_completions_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct remove_completions_reply
+{
+    struct reply_header __header;
+    /* VARARG(packets,completion_packets); */
+};
+
+
 
 struct query_completion_request
 {
@@ -5689,7 +5786,9 @@ enum request
     REQ_queue_apc,
     REQ_get_apc_result,
     REQ_close_handle,
+    REQ_close_handles,
     REQ_set_handle_info,
+    REQ_get_handle_generations,
     REQ_dup_handle,
     REQ_open_process,
     REQ_open_thread,
@@ -5708,6 +5807,8 @@ enum request
     REQ_release_semaphore,
     REQ_query_semaphore,
     REQ_open_semaphore,
+    REQ_get_fast_sync_shm,
+    REQ_get_fast_sync_obj,
     REQ_create_file,
     REQ_open_file_object,
     REQ_alloc_file_handle,
@@ -5936,6 +6037,7 @@ enum request
     REQ_open_completion,
     REQ_add_completion,
     REQ_remove_completion,
+    REQ_remove_completions,
     REQ_query_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
@@ -5987,7 +6089,9 @@ union generic_request
     struct queue_apc_request queue_apc_request;
     struct get_apc_result_request get_apc_result_request;
     struct close_handle_request close_handle_request;
+    struct close_handles_request close_handles_request;
     struct set_handle_info_request set_handle_info_request;
+    struct get_handle_generations_request get_handle_generations_request;
     struct dup_handle_request dup_handle_request;
     struct open_process_request open_process_request;
     struct open_thread_request open_thread_request;
@@ -6006,6 +6110,8 @@ union generic_request
     struct release_semaphore_request release_semaphore_request;
     struct query_semaphore_request query_semaphore_request;
     struct open_semaphore_request open_semaphore_request;
+    struct get_fast_sync_shm_request get_fast_sync_shm_request;
+    struct get_fast_sync_obj_request get_fast_sync_obj_request;
     struct create_file_request create_file_request;
     struct open_file_object_request open_file_object_request;
     struct alloc_file_handle_request alloc_file_handle_request;
@@ -6234,6 +6340,7 @@ union generic_request
     struct open_completion_request open_completion_request;
     struct add_completion_request add_completion_request;
     struct remove_completion_request remove_completion_request;
+    struct remove_completions_request remove_completions_request;
     struct query_completion_request query_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
@@ -6283,7 +6390,9 @@ union generic_reply
     struct queue_apc_reply queue_apc_reply;
     struct get_apc_result_reply get_apc_result_reply;
     struct close_handle_reply close_handle_reply;
+    struct close_handles_reply close_handles_reply;
     struct set_handle_info_reply set_handle_info_reply;
+    struct get_handle_generations_reply get_handle_generations_reply;
     struct dup_handle_reply dup_handle_reply;
     struct open_process_reply open_process_reply;
     struct open_thread_reply open_thread_reply;
@@ -6302,6 +6411,8 @@ union generic_reply
     struct release_semaphore_reply release_semaphore_reply;
     struct query_semaphore_reply query_semaphore_reply;
     struct open_semaphore_reply open_semaphore_reply;
+    struct get_fast_sync_shm_reply get_fast_sync_shm_reply;
+    struct get_fast_sync_obj_reply get_fast_sync_obj_reply;
     struct create_file_reply create_file_reply;
     struct open_file_object_reply open_file_object_reply;
     struct alloc_file_handle_reply alloc_file_handle_reply;
@@ -6530,6 +6641,7 @@ union generic_reply
     struct open_completion_reply open_completion_reply;
     struct add_completion_reply add_completion_reply;
     struct remove_completion_reply remove_completion_reply;
+    struct remove_completions_reply remove_completions_reply;
     struct query_completion_reply query_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
@@ -6553,6 +6665,6 @@ union generic_reply
     struct terminate_job_reply terminate_job_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 571
+#define SERVER_PROTOCOL_VERSION 576
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
@@ -240,6 +240,40 @@ DECL_HANDLER(remove_completion)
     release_object( completion );
 }
 
+/* get as many completions from completion port as fit in the reply */
+DECL_HANDLER(remove_completions)
+{
+    struct completion* completion = get_completion_obj( current->process, req->handle, IO_COMPLETION_MODIFY_STATE );
+    struct completion_packet *packets;
+    struct list *entry;
+    struct comp_msg *msg;
+    data_size_t count, i;
+
+    if (!completion) return;
+
+    count = min( completion->depth, get_reply_max_size() / sizeof(*packets) );
+    if (!count)
+        set_error( list_empty( &completion->queue ) ? STATUS_PENDING : STATUS_BUFFER_TOO_SMALL );
+    else if ((packets = set_reply_data_size( count * sizeof(*packets) )))
+    {
+        for (i = 0; i < count; i++)
+        {
+            entry = list_head( &completion->queue );
+            list_remove( entry );
+            completion->depth--;
+            msg = LIST_ENTRY( entry, struct comp_msg, queue_entry );
+            packets[i].ckey        = msg->ckey;
+            packets[i].cvalue      = msg->cvalue;
+            packets[i].information = msg->information;
+            packets[i].status      = msg->status;
+            packets[i].__pad       = 0;
+            free( msg );
+        }
+    }
+
+    release_object( completion );
+}
+
 /* get queue depth for completion port */
 DECL_HANDLER(query_completion)
 {
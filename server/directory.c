@@ -521,6 +521,7 @@ DECL_HANDLER(get_object_type)
 
     if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
 
+    reply->generation = get_handle_generation( current->process, req->handle );
     if ((type = obj->ops->get_type( obj )))
     {
         if ((name = get_object_name( &type->obj, &reply->total )))
@@ -41,22 +41,26 @@ struct event
     struct object  obj;             /* object header */
     int            manual_reset;    /* is it a manual reset event? */
     int            signaled;        /* event has been signaled */
+    unsigned int   fast_sync;       /* shared state slot, or 0 if the state is private */
 };
 
 static void event_dump( struct object *obj, int verbose );
 static struct object_type *event_get_type( struct object *obj );
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int event_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int event_map_access( struct object *obj, unsigned int access );
 static int event_signal( struct object *obj, unsigned int access);
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
     sizeof(struct event),      /* size */
     event_dump,                /* dump */
     event_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    event_add_queue,           /* add_queue */
+    event_remove_queue,        /* remove_queue */
     event_signaled,            /* signaled */
     event_satisfied,           /* satisfied */
     event_signal,              /* signal */
@@ -69,7 +73,7 @@ static const struct object_ops event_ops =
     default_unlink_name,       /* unlink_name */
     no_open_file,              /* open_file */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
 };
 
 
@@ -119,6 +123,7 @@ struct event *create_event( struct object *root, const struct unicode_str *name,
             /* initialize it if it didn't already exist */
             event->manual_reset = manual_reset;
             event->signaled     = initial_state;
+            event->fast_sync    = alloc_fast_sync( FAST_SYNC_EVENT, initial_state, manual_reset );
         }
     }
     return event;
@@ -129,24 +134,45 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
     return (struct event *)get_handle_obj( process, handle, access, &event_ops );
 }
 
+unsigned int get_event_fast_sync( struct object *obj )
+{
+    if (obj->ops != &event_ops) return 0;
+    return ((struct event *)obj)->fast_sync;
+}
+
+static int get_event_state( struct event *event )
+{
+    if (event->fast_sync) return get_fast_sync_state( event->fast_sync );
+    return event->signaled;
+}
+
+static void set_event_state( struct event *event, int signaled )
+{
+    if (event->fast_sync) set_fast_sync_state( event->fast_sync, signaled );
+    else event->signaled = signaled;
+}
+
 void pulse_event( struct event *event )
 {
-    event->signaled = 1;
+    set_event_state( event, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
-    event->signaled = 0;
+    /* the pulse may also release a client waiting on the shared state, unless it was consumed */
+    if (event->fast_sync && get_event_state( event ))
+        pulse_fast_sync_event( event->fast_sync, event->manual_reset );
+    set_event_state( event, 0 );
 }
 
 void set_event( struct event *event )
 {
-    event->signaled = 1;
+    set_event_state( event, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
 }
 
 void reset_event( struct event *event )
 {
-    event->signaled = 0;
+    set_event_state( event, 0 );
 }
 
 static void event_dump( struct object *obj, int verbose )
@@ -154,7 +180,7 @@ static void event_dump( struct object *obj, int verbose )
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     fprintf( stderr, "Event manual=%d signaled=%d\n",
-             event->manual_reset, event->signaled );
+             event->manual_reset, get_event_state( event ));
 }
 
 static struct object_type *event_get_type( struct object *obj )
@@ -164,11 +190,28 @@ static struct object_type *event_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    /* the clients must not touch the state while we have waiters */
+    if (event->fast_sync) fast_sync_add_waiter( event->fast_sync );
+    return add_queue( obj, entry );
+}
+
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    if (event->fast_sync) fast_sync_remove_waiter( event->fast_sync );
+    remove_queue( obj, entry );
+}
+
 static int event_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    return event->signaled;
+    return get_event_state( event );
 }
 
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry )
@@ -176,7 +219,7 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    if (!event->manual_reset) set_event_state( event, 0 );
 }
 
 static unsigned int event_map_access( struct object *obj, unsigned int access )
@@ -202,6 +245,13 @@ static int event_signal( struct object *obj, unsigned int access )
     return 1;
 }
 
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    if (event->fast_sync) free_fast_sync( event->fast_sync );
+}
+
 struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -337,7 +387,7 @@ DECL_HANDLER(query_event)
     if (!(event = get_event_obj( current->process, req->handle, EVENT_QUERY_STATE ))) return;
 
     reply->manual_reset = event->manual_reset;
-    reply->state = event->signaled;
+    reply->state = get_event_state( event );
 
     release_object( event );
 }
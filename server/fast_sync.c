@@ -0,0 +1,257 @@
+/*
+ * Server-side support for fast synchronization objects
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Events and semaphores can keep their state in a memory area shared with
+ * all the client processes, so that ntdll can signal and wait on them with
+ * atomic operations and futexes instead of a server round trip.
+ *
+ * As long as no thread is waiting on the object through a server select,
+ * the state belongs to the clients and the server only ever modifies it
+ * atomically. As soon as a server-side waiter is queued the server sets
+ * FAST_SYNC_SERVER_OWNED in the state, which makes clients fall back to the
+ * normal requests until the last server-side waiter is gone.
+ *
+ * This is only enabled when WINEFASTSYNC is set in the environment of the
+ * server, and only on platforms that support futexes on shared memory.
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "thread.h"
+#include "request.h"
+
+static struct fast_sync_slot *slots;     /* shared memory area */
+static int shm_fd = -1;                  /* fd of the shared memory area */
+static int initialized;                  /* did we already try to create it? */
+static unsigned int *free_slots;         /* stack of freed slot indices */
+static unsigned int free_count;          /* number of entries in free_slots */
+static unsigned int next_slot = 1;       /* first never used slot, 0 means no slot */
+
+#define SHM_SIZE (FAST_SYNC_MAX_SLOTS * sizeof(struct fast_sync_slot))
+
+#ifdef __linux__
+
+static inline void futex_wake_all( int *addr )
+{
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, INT_MAX, NULL, 0, 0 );
+}
+
+static inline void futex_wake_one( int *addr )
+{
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, 1, NULL, 0, 0 );
+}
+
+static int init_fast_sync(void)
+{
+    const char *env = getenv( "WINEFASTSYNC" );
+    void *ptr;
+
+    if (initialized) return slots != NULL;
+    initialized = 1;
+
+    if (!env || !atoi( env )) return 0;
+    if ((shm_fd = create_temp_file( SHM_SIZE )) == -1) return 0;
+    if ((ptr = mmap( NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0 )) == MAP_FAILED)
+    {
+        close( shm_fd );
+        shm_fd = -1;
+        return 0;
+    }
+    if (!(free_slots = malloc( FAST_SYNC_MAX_SLOTS * sizeof(*free_slots) )))
+    {
+        munmap( ptr, SHM_SIZE );
+        close( shm_fd );
+        shm_fd = -1;
+        return 0;
+    }
+    slots = ptr;
+    if (debug_level) fprintf( stderr, "wineserver: fast synchronization enabled\n" );
+    return 1;
+}
+
+#else  /* __linux__ */
+
+static inline void futex_wake_all( int *addr )
+{
+}
+
+static inline void futex_wake_one( int *addr )
+{
+}
+
+static int init_fast_sync(void)
+{
+    return 0;
+}
+
+#endif  /* __linux__ */
+
+/* allocate a shared slot for an object; returns 0 if none is available */
+unsigned int alloc_fast_sync( enum fast_sync_type type, int state, unsigned int max )
+{
+    unsigned int index;
+
+    if (!init_fast_sync()) return 0;
+
+    if (free_count) index = free_slots[--free_count];
+    else if (next_slot < FAST_SYNC_MAX_SLOTS) index = next_slot++;
+    else return 0;
+
+    slots[index].state   = state;
+    slots[index].max     = max;
+    slots[index].waiters = 0;
+    slots[index].type    = type;
+    return index;
+}
+
+/* free the slot of a destroyed object */
+void free_fast_sync( unsigned int index )
+{
+    assert( index && !slots[index].waiters );
+    slots[index].type  = FAST_SYNC_NONE;
+    slots[index].state = 0;
+    free_slots[free_count++] = index;
+}
+
+/* retrieve the current state of an object, without the ownership flag */
+int get_fast_sync_state( unsigned int index )
+{
+    if (slots[index].type == FAST_SYNC_EVENT) return slots[index].state & 1;
+    return slots[index].state & ~FAST_SYNC_SERVER_OWNED;
+}
+
+/* atomically replace the state of an object, and wake up the clients sleeping on it */
+void set_fast_sync_state( unsigned int index, int state )
+{
+    int old, flags, keep = FAST_SYNC_SERVER_OWNED;
+
+    /* the pulse count of events must not go back, waiters compare it */
+    if (slots[index].type == FAST_SYNC_EVENT) keep |= FAST_SYNC_EVENT_PULSED | FAST_SYNC_EVENT_PULSES;
+
+    for (old = slots[index].state;; )
+    {
+        int tmp;
+        flags = old & keep;
+        if ((tmp = interlocked_cmpxchg( &slots[index].state, state | flags, old )) == old) break;
+        old = tmp;
+    }
+    if (state) futex_wake_all( &slots[index].state );
+}
+
+/* release the clients sleeping on a pulsed event, since they can't see the short signal */
+void pulse_fast_sync_event( unsigned int index, int manual_reset )
+{
+    int old, tmp, new;
+
+    for (old = slots[index].state;; old = tmp)
+    {
+        new = (old & ~FAST_SYNC_EVENT_PULSES) | ((old + 2) & FAST_SYNC_EVENT_PULSES);
+        if (!manual_reset) new |= FAST_SYNC_EVENT_PULSED;
+        if ((tmp = interlocked_cmpxchg( &slots[index].state, new, old )) == old) break;
+    }
+    if (manual_reset) futex_wake_all( &slots[index].state );
+    else futex_wake_one( &slots[index].state );
+}
+
+/* take ownership of the state when a server-side waiter is added to the object */
+void fast_sync_add_waiter( unsigned int index )
+{
+    int old, tmp;
+
+    if (slots[index].waiters++) return;
+    for (old = slots[index].state;; old = tmp)
+    {
+        if ((tmp = interlocked_cmpxchg( &slots[index].state, old | FAST_SYNC_SERVER_OWNED, old )) == old)
+            break;
+    }
+}
+
+/* give the state back to the clients once the last server-side waiter is gone */
+void fast_sync_remove_waiter( unsigned int index )
+{
+    int old, tmp;
+
+    assert( slots[index].waiters );
+    if (--slots[index].waiters) return;
+    for (old = slots[index].state;; old = tmp)
+    {
+        if ((tmp = interlocked_cmpxchg( &slots[index].state, old & ~FAST_SYNC_SERVER_OWNED, old )) == old)
+            break;
+    }
+    /* clients sleeping on the object may be able to acquire it now */
+    futex_wake_all( &slots[index].state );
+}
+
+/* retrieve the slot of an object if it has one */
+static unsigned int get_object_fast_sync( struct object *obj )
+{
+    unsigned int index;
+
+    if ((index = get_event_fast_sync( obj ))) return index;
+    return get_semaphore_fast_sync( obj );
+}
+
+/* retrieve the shared memory area */
+DECL_HANDLER(get_fast_sync_shm)
+{
+    if (!init_fast_sync())
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return;
+    }
+    reply->size = SHM_SIZE;
+    send_client_fd( current->process, shm_fd, 0 );
+}
+
+/* retrieve the slot of an object */
+DECL_HANDLER(get_fast_sync_obj)
+{
+    struct object *obj;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+    if ((reply->index = get_object_fast_sync( obj )))
+    {
+        reply->type   = slots[reply->index].type;
+        reply->access = get_handle_access( current->process, req->handle );
+    }
+    else reply->type = FAST_SYNC_NONE;
+    release_object( obj );
+}
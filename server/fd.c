@@ -1918,6 +1918,26 @@ struct fd *create_anonymous_fd( const struct fd_ops *fd_user_ops, int unix_fd, s
     return NULL;
 }
 
+/* attach a unix fd to a pseudo fd object (closing the previous one), or detach it with -1 */
+int set_pseudo_fd_unix_fd( struct fd *fd, int unix_fd )
+{
+    assert( !fd->inode );
+
+    if (fd->poll_index != -1) remove_poll_user( fd, fd->poll_index );
+    fd->poll_index = -1;
+    if (fd->unix_fd != -1) close( fd->unix_fd );
+    fd->unix_fd = unix_fd;
+    if (unix_fd == -1) return 1;
+
+    if ((fd->poll_index = add_poll_user( fd )) == -1)
+    {
+        close( unix_fd );
+        fd->unix_fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
 /* retrieve the object that is using an fd */
 void *get_fd_user( struct fd *fd )
 {
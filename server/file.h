@@ -78,6 +78,7 @@ struct fd_ops
 
 extern struct fd *alloc_pseudo_fd( const struct fd_ops *fd_user_ops, struct object *user,
                                    unsigned int options );
+extern int set_pseudo_fd_unix_fd( struct fd *fd, int unix_fd );
 extern struct fd *open_fd( struct fd *root, const char *name, int flags, mode_t *mode,
                            unsigned int access, unsigned int sharing, unsigned int options );
 extern struct fd *create_anonymous_fd( const struct fd_ops *fd_user_ops,
@@ -157,6 +158,7 @@ extern struct file *get_mapping_file( struct process *process, client_ptr_t base
                                       unsigned int access, unsigned int sharing );
 extern void free_mapped_views( struct process *process );
 extern int get_page_size(void);
+extern int create_temp_file( file_pos_t size );
 
 /* device functions */
 
@@ -27,12 +27,17 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#include <unistd.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
 #include "process.h"
 #include "thread.h"
@@ -53,6 +58,8 @@ struct handle_table
     int                  last;        /* last used entry */
     int                  free;        /* first entry that may be free */
     struct handle_entry *entries;     /* handle entries */
+    unsigned int        *generations; /* per-entry counters shared with the client */
+    int                  generations_fd; /* fd of the shared counters */
 };
 
 static struct handle_table *global_table;
@@ -66,6 +73,8 @@ static struct handle_table *global_table;
 #define MIN_HANDLE_ENTRIES  32
 #define MAX_HANDLE_ENTRIES  0x00ffffff
 
+#define GENERATIONS_SIZE    (MAX_HANDLE_GENERATIONS * sizeof(unsigned int))
+
 
 /* handle to table index conversion */
 
@@ -186,6 +195,8 @@ static void handle_table_destroy( struct object *obj )
         if (obj) release_object_from_handle( obj );
     }
     free( table->entries );
+    if (table->generations) munmap( table->generations, GENERATIONS_SIZE );
+    if (table->generations_fd != -1) close( table->generations_fd );
 }
 
 /* close all the process handles and free the handle table */
@@ -209,6 +220,8 @@ struct handle_table *alloc_handle_table( struct process *process, int count )
     table->count   = count;
     table->last    = -1;
     table->free    = 0;
+    table->generations = NULL;
+    table->generations_fd = -1;
     if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
     release_object( table );
     return NULL;
@@ -248,6 +261,7 @@ static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned
     table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
+    if (table->generations && i < MAX_HANDLE_GENERATIONS) table->generations[i]++;
     return index_to_handle(i);
 }
 
@@ -395,6 +409,8 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
     entry->ptr = NULL;
     table = handle_is_global(handle) ? global_table : process->handles;
+    if (table->generations && entry - table->entries < MAX_HANDLE_GENERATIONS)
+        table->generations[entry - table->entries]++;
     if (entry < table->entries + table->free) table->free = entry - table->entries;
     if (entry == table->entries + table->last) shrink_handle_table( table );
     release_object_from_handle( obj );
@@ -618,6 +634,17 @@ unsigned int get_handle_table_count( struct process *process )
     return process->handles->count;
 }
 
+/* return the generation of a handle, which changes whenever it's closed or reused */
+unsigned int get_handle_generation( struct process *process, obj_handle_t handle )
+{
+    struct handle_table *table = process->handles;
+    int index = handle_to_index( handle );
+
+    if (!table || !table->generations || handle_is_global( handle ) || get_magic_handle( handle )) return 0;
+    if (index < 0 || index >= MAX_HANDLE_GENERATIONS) return 0;
+    return table->generations[index];
+}
+
 /* close a handle */
 DECL_HANDLER(close_handle)
 {
@@ -625,10 +652,47 @@ DECL_HANDLER(close_handle)
     set_error( err );
 }
 
+/* close several handles */
+DECL_HANDLER(close_handles)
+{
+    const obj_handle_t *handles = get_req_data();
+    data_size_t i, count = get_req_data_size() / sizeof(*handles);
+    unsigned int *statuses;
+
+    count = min( count, get_reply_max_size() / sizeof(*statuses) );
+    if (!(statuses = set_reply_data_size( count * sizeof(*statuses) ))) return;
+    for (i = 0; i < count; i++) statuses[i] = close_handle( current->process, handles[i] );
+}
+
 /* set a handle information */
 DECL_HANDLER(set_handle_info)
 {
     reply->old_flags = set_handle_flags( current->process, req->handle, req->mask, req->flags );
+    reply->generation = get_handle_generation( current->process, req->handle );
+}
+
+/* retrieve the shared generation counters of the handles */
+DECL_HANDLER(get_handle_generations)
+{
+    struct handle_table *table = current->process->handles;
+    void *ptr;
+
+    if (!table) return;
+    if (table->generations_fd == -1)
+    {
+        if ((table->generations_fd = create_temp_file( GENERATIONS_SIZE )) == -1) return;
+        ptr = mmap( NULL, GENERATIONS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, table->generations_fd, 0 );
+        if (ptr == MAP_FAILED)
+        {
+            file_set_error();
+            close( table->generations_fd );
+            table->generations_fd = -1;
+            return;
+        }
+        table->generations = ptr;
+    }
+    reply->size = GENERATIONS_SIZE;
+    send_client_fd( current->process, table->generations_fd, 0 );
 }
 
 /* duplicate a handle */
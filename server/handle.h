@@ -54,5 +54,6 @@ extern void close_process_handles( struct process *process );
 extern struct handle_table *alloc_handle_table( struct process *process, int count );
 extern struct handle_table *copy_handle_table( struct process *process, struct process *parent );
 extern unsigned int get_handle_table_count( struct process *process);
+extern unsigned int get_handle_generation( struct process *process, obj_handle_t handle );
 
 #endif  /* __WINE_SERVER_HANDLE_H */
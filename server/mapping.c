@@ -29,6 +29,9 @@
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -259,7 +262,7 @@ static int check_current_dir_for_exec(void)
 }
 
 /* create a temp file for anonymous mappings */
-static int create_temp_file( file_pos_t size )
+int create_temp_file( file_pos_t size )
 {
     static int temp_dir_fd = -1;
     char tmpfn[] = "anonmap.XXXXXX";
@@ -296,6 +299,24 @@ static int create_temp_file( file_pos_t size )
     return fd;
 }
 
+/* create an anonymous memory file for the shared sections of an image */
+static int create_shared_memfd( file_pos_t size )
+{
+#if defined(__linux__) && defined(__NR_memfd_create)
+    int fd = syscall( __NR_memfd_create, "wine-shared", 1 /* MFD_CLOEXEC */ );
+
+    if (fd == -1) return -1;
+    if (ftruncate( fd, size ) == -1)
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
 /* find a memory view from its base address */
 static struct memory_view *find_mapped_view( struct process *process, client_ptr_t base )
 {
@@ -474,9 +495,10 @@ static int build_shared_mapping( struct mapping *mapping, int fd,
 
     if ((mapping->shared = get_shared_file( mapping->fd ))) return 1;
 
-    /* create a temp file for the mapping */
+    /* create a memory file for the mapping, it is shared by all the processes mapping the image */
 
-    if ((shared_fd = create_temp_file( total_size )) == -1) return 0;
+    if ((shared_fd = create_shared_memfd( total_size )) == -1 &&
+        (shared_fd = create_temp_file( total_size )) == -1) return 0;
     if (!(file = create_file_for_fd( shared_fd, FILE_GENERIC_READ|FILE_GENERIC_WRITE, 0 ))) return 0;
 
     if (!(buffer = malloc( max_size ))) goto error;
@@ -24,10 +24,22 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_SOCKET_H
+# include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_FILIO_H
+# include <sys/filio.h>
+#endif
+#include <unistd.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -63,6 +75,7 @@ struct pipe_end
     process_id_t         client_pid; /* process that created the client */
     process_id_t         server_pid; /* process that created the server */
     data_size_t          buffer_size;/* size of buffered data that doesn't block caller */
+    int                  direct;     /* data goes through the unix socket attached to the fd */
     struct list          message_queue;
     struct async_queue   read_q;     /* read queue */
     struct async_queue   write_q;    /* write queue */
@@ -144,6 +157,7 @@ static int pipe_end_read( struct fd *fd, struct async *async, file_pos_t pos );
 static int pipe_end_write( struct fd *fd, struct async *async_data, file_pos_t pos );
 static int pipe_end_flush( struct fd *fd, struct async *async );
 static void pipe_end_get_volume_info( struct fd *fd, unsigned int info_class );
+static void pipe_end_queue_async( struct fd *fd, struct async *async, int type, int count );
 static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue );
 static void pipe_end_get_file_info( struct fd *fd, obj_handle_t handle, unsigned int info_class );
 
@@ -185,7 +199,7 @@ static const struct fd_ops pipe_server_fd_ops =
     pipe_end_get_file_info,       /* get_file_info */
     pipe_end_get_volume_info,     /* get_volume_info */
     pipe_server_ioctl,            /* ioctl */
-    no_fd_queue_async,            /* queue_async */
+    pipe_end_queue_async,         /* queue_async */
     pipe_end_reselect_async       /* reselect_async */
 };
 
@@ -226,7 +240,7 @@ static const struct fd_ops pipe_client_fd_ops =
     pipe_end_get_file_info,       /* get_file_info */
     pipe_end_get_volume_info,     /* get_volume_info */
     pipe_client_ioctl,            /* ioctl */
-    no_fd_queue_async,            /* queue_async */
+    pipe_end_queue_async,         /* queue_async */
     pipe_end_reselect_async       /* reselect_async */
 };
 
@@ -386,6 +400,78 @@ static void free_message( struct pipe_message *message )
     free( message );
 }
 
+/*
+ * When WINEPIPEDIRECT is set in the environment of the server, both ends of
+ * a connected byte mode pipe get a unix socket pair attached to their fd, so
+ * that the clients read and write the data directly through the generic unix
+ * fd path of ntdll instead of passing it through the server. The server only
+ * keeps track of the pipe state, and stops the data path on disconnection.
+ * Message mode pipes always go through the server, since their message
+ * boundaries can't be kept on a stream socket.
+ */
+static int direct_pipes = -1;
+
+/* check if the data of a pipe can go through a socket pair once it is connected */
+static int pipe_can_be_direct( const struct named_pipe *pipe )
+{
+    if (direct_pipes == -1)
+    {
+        const char *env = getenv( "WINEPIPEDIRECT" );
+        direct_pipes = env && atoi( env );
+    }
+    return direct_pipes && !pipe->message_mode;
+}
+
+/* attach both ends of a socket pair to a freshly connected pipe */
+static void pipe_end_connect_direct( struct pipe_end *server, struct pipe_end *client )
+{
+    int fds[2];
+
+    if (socketpair( PF_UNIX, SOCK_STREAM, 0, fds ) == -1) return;
+    fcntl( fds[0], F_SETFL, O_NONBLOCK );
+    fcntl( fds[1], F_SETFL, O_NONBLOCK );
+
+    if (!set_pseudo_fd_unix_fd( server->fd, fds[0] ))
+    {
+        close( fds[1] );
+        return;
+    }
+    if (!set_pseudo_fd_unix_fd( client->fd, fds[1] ))
+    {
+        set_pseudo_fd_unix_fd( server->fd, -1 );
+        return;
+    }
+    server->direct = client->direct = 1;
+}
+
+/* stop the direct data path of a pipe end */
+static void pipe_end_disconnect_direct( struct pipe_end *pipe_end, unsigned int status )
+{
+    /* when the other end is closed, the data it already wrote can still be read */
+    fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_WRITE, status );
+    if (status != STATUS_PIPE_DISCONNECTED) return;
+
+    /* clients may still own duplicates of the socket, make sure they see the disconnection */
+    shutdown( get_unix_fd( pipe_end->fd ), SHUT_RDWR );
+    fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_READ, status );
+
+    /* the server end gets a new socket pair on its next connection */
+    if (pipe_end->obj.ops == &pipe_server_ops)
+    {
+        set_pseudo_fd_unix_fd( pipe_end->fd, -1 );
+        pipe_end->direct = 0;
+    }
+}
+
+/* number of bytes that can be read from the socket of a direct pipe end */
+static data_size_t pipe_end_direct_avail( struct pipe_end *pipe_end )
+{
+    int avail;
+
+    if (!pipe_end->direct || ioctl( get_unix_fd( pipe_end->fd ), FIONREAD, &avail ) == -1) return 0;
+    return avail;
+}
+
 static void pipe_end_disconnect( struct pipe_end *pipe_end, unsigned int status )
 {
     struct pipe_end *connection = pipe_end->connection;
@@ -397,6 +483,7 @@ static void pipe_end_disconnect( struct pipe_end *pipe_end, unsigned int status
     pipe_end->state = status == STATUS_PIPE_DISCONNECTED
         ? FILE_PIPE_DISCONNECTED_STATE : FILE_PIPE_CLOSING_STATE;
     fd_async_wake_up( pipe_end->fd, ASYNC_TYPE_WAIT, status );
+    if (pipe_end->direct) pipe_end_disconnect_direct( pipe_end, status );
     async_wake_up( &pipe_end->read_q, status );
     LIST_FOR_EACH_ENTRY_SAFE( message, next, &pipe_end->message_queue, struct pipe_message, entry )
     {
@@ -555,6 +642,7 @@ static int pipe_end_flush( struct fd *fd, struct async *async )
         return 0;
     }
 
+    /* FIXME: we don't wait for the data of direct pipes to be read */
     if (pipe_end->connection && !list_empty( &pipe_end->connection->message_queue ))
     {
         fd_queue_async( pipe_end->fd, async, ASYNC_TYPE_WAIT );
@@ -671,7 +759,7 @@ static void pipe_end_get_file_info( struct fd *fd, obj_handle_t handle, unsigned
             pipe_info->MaximumInstances    = pipe->maxinstances;
             pipe_info->CurrentInstances    = pipe->instances;
             pipe_info->InboundQuota        = pipe->insize;
-            pipe_info->ReadDataAvailable   = 0; /* FIXME */
+            pipe_info->ReadDataAvailable   = pipe_end_direct_avail( pipe_end ); /* FIXME */
             pipe_info->OutboundQuota       = pipe->outsize;
             pipe_info->WriteQuotaAvailable = 0; /* FIXME */
             pipe_info->NamedPipeState      = pipe_end->state;
@@ -907,6 +995,14 @@ static int pipe_end_write( struct fd *fd, struct async *async, file_pos_t pos )
     return 1;
 }
 
+static void pipe_end_queue_async( struct fd *fd, struct async *async, int type, int count )
+{
+    struct pipe_end *pipe_end = get_fd_user( fd );
+
+    if (pipe_end->direct) default_fd_queue_async( fd, async, type, count );
+    else no_fd_queue_async( fd, async, type, count );
+}
+
 static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue )
 {
     struct pipe_end *pipe_end = get_fd_user( fd );
@@ -917,6 +1013,8 @@ static void pipe_end_reselect_async( struct fd *fd, struct async_queue *queue )
         reselect_write_queue( pipe_end );
     else if (&pipe_end->read_q == queue)
         reselect_read_queue( pipe_end );
+    else  /* queues of the direct data path */
+        default_fd_reselect_async( fd, queue );
 }
 
 static enum server_fd_type pipe_end_get_fd_type( struct fd *fd )
@@ -924,6 +1022,26 @@ static enum server_fd_type pipe_end_get_fd_type( struct fd *fd )
     return FD_TYPE_PIPE;
 }
 
+static int pipe_end_peek_direct( struct pipe_end *pipe_end, data_size_t reply_size )
+{
+    FILE_PIPE_PEEK_BUFFER *buffer;
+    data_size_t avail = pipe_end_direct_avail( pipe_end );
+    ssize_t ret = 0;
+
+    reply_size = min( reply_size, avail );
+    if (!(buffer = mem_alloc( offsetof( FILE_PIPE_PEEK_BUFFER, Data[reply_size] )))) return 0;
+    buffer->NamedPipeState    = pipe_end->state;
+    buffer->ReadDataAvailable = avail;
+    buffer->NumberOfMessages  = 0;
+    buffer->MessageLength     = 0;
+
+    if (reply_size && (ret = recv( get_unix_fd( pipe_end->fd ), buffer->Data, reply_size,
+                                   MSG_PEEK | MSG_DONTWAIT )) == -1)
+        ret = 0;
+    set_reply_data_ptr( buffer, offsetof( FILE_PIPE_PEEK_BUFFER, Data[ret] ));
+    return 1;
+}
+
 static int pipe_end_peek( struct pipe_end *pipe_end )
 {
     unsigned reply_size = get_reply_max_size();
@@ -944,7 +1062,7 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
     case FILE_PIPE_CONNECTED_STATE:
         break;
     case FILE_PIPE_CLOSING_STATE:
-        if (!list_empty( &pipe_end->message_queue )) break;
+        if (!list_empty( &pipe_end->message_queue ) || pipe_end_direct_avail( pipe_end )) break;
         set_error( STATUS_PIPE_BROKEN );
         return 0;
     default:
@@ -952,6 +1070,8 @@ static int pipe_end_peek( struct pipe_end *pipe_end )
         return 0;
     }
 
+    if (pipe_end->direct) return pipe_end_peek_direct( pipe_end, reply_size );
+
     LIST_FOR_EACH_ENTRY( message, &pipe_end->message_queue, struct pipe_message, entry )
         avail += message->iosb->in_size - message->read_pos;
     reply_size = min( reply_size, avail );
@@ -1150,6 +1270,7 @@ static void init_pipe_end( struct pipe_end *pipe_end, struct named_pipe *pipe,
     pipe_end->flags = pipe_flags;
     pipe_end->connection = NULL;
     pipe_end->buffer_size = buffer_size;
+    pipe_end->direct = 0;
     init_async_queue( &pipe_end->read_q );
     init_async_queue( &pipe_end->write_q );
     list_init( &pipe_end->message_queue );
@@ -1176,7 +1297,8 @@ static struct pipe_server *create_pipe_server( struct named_pipe *pipe, unsigned
         release_object( server );
         return NULL;
     }
-    allow_fd_caching( server->pipe_end.fd );
+    /* the unix fd of direct pipes changes on every connection */
+    if (!pipe_can_be_direct( pipe )) allow_fd_caching( server->pipe_end.fd );
     set_fd_signaled( server->pipe_end.fd, 1 );
     return server;
 }
@@ -1271,6 +1393,7 @@ static struct object *named_pipe_open_file( struct object *obj, unsigned int acc
         client->connection = &server->pipe_end;
         server->pipe_end.client_pid = client->client_pid;
         client->server_pid = server->pipe_end.server_pid;
+        if (pipe_can_be_direct( pipe )) pipe_end_connect_direct( &server->pipe_end, client );
     }
     release_object( server );
     return &client->obj;
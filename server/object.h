@@ -185,11 +185,26 @@ extern struct keyed_event *get_keyed_event_obj( struct process *process, obj_han
 extern void pulse_event( struct event *event );
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
+extern unsigned int get_event_fast_sync( struct object *obj );
 
 /* mutex functions */
 
 extern void abandon_mutexes( struct thread *thread );
 
+/* semaphore functions */
+
+extern unsigned int get_semaphore_fast_sync( struct object *obj );
+
+/* fast synchronization functions */
+
+extern unsigned int alloc_fast_sync( enum fast_sync_type type, int state, unsigned int max );
+extern void free_fast_sync( unsigned int index );
+extern int get_fast_sync_state( unsigned int index );
+extern void set_fast_sync_state( unsigned int index, int state );
+extern void pulse_fast_sync_event( unsigned int index, int manual_reset );
+extern void fast_sync_add_waiter( unsigned int index );
+extern void fast_sync_remove_waiter( unsigned int index );
+
 /* serial functions */
 
 int get_serial_async_timeout(struct object *obj, int type, int count);
@@ -243,6 +258,7 @@ extern struct object *create_obj_symlink( struct object *root, const struct unic
 
   /* command-line options */
 extern int debug_level;
+extern int profile_level;
 extern int foreground;
 extern timeout_t master_socket_timeout;
 extern const char *server_argv0;
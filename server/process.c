@@ -520,6 +520,7 @@ struct process *create_process( int fd, struct process *parent, int inherit_all,
     process->desktop         = 0;
     process->token           = NULL;
     process->trace_data      = 0;
+    process->req_profile     = NULL;
     process->rawinput_mouse  = NULL;
     process->rawinput_kbd    = NULL;
     list_init( &process->thread_list );
@@ -620,6 +621,7 @@ static void process_destroy( struct object *obj )
     if (process->id) free_ptid( process->id );
     if (process->token) release_object( process->token );
     free( process->dir_cache );
+    free( process->req_profile );
 }
 
 /* dump a process on stdout for debugging purposes */
@@ -817,6 +819,7 @@ static void process_killed( struct process *process )
 
     assert( list_empty( &process->thread_list ));
     process->end_time = current_time;
+    free_process_profile( process );
     if (!process->is_system) close_process_desktop( process );
     process->winstation = 0;
     process->desktop = 0;
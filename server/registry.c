@@ -34,7 +34,14 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -78,6 +85,7 @@ struct key
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
+    const struct cache_key *cache; /* cache entry for subkeys and values not loaded yet */
 };
 
 /* key flags */
@@ -118,7 +126,9 @@ static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
 static void set_periodic_save_timer(void);
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index );
+static void load_cached_key( struct key *key );
+static void save_registry_cache( struct key *key, const char *path );
 
 /* information about where to save a registry branch */
 struct save_branch_info
@@ -131,6 +141,67 @@ struct save_branch_info
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
 
+static int save_pipe = -1;         /* pipe to get the result of a background save */
+static pid_t save_pid = -1;        /* process doing the background save */
+static int is_save_process;        /* are we the background save process? */
+static unsigned int save_mask;     /* branches being saved in the background */
+
+/* Binary registry cache
+ *
+ * When WINEREGCACHE is set, a binary copy of each registry branch is written
+ * next to its text file. On startup it is mapped instead of parsing the text
+ * file, and the subkeys and values of a key are only loaded from it when the
+ * key is first accessed. The text file remains the reference: the cache is
+ * ignored as soon as it doesn't match the text file, and rewritten from it.
+ * A key that can't be loaded from the cache would get saved incompletely,
+ * so in that case the cache file is removed and the server exits.
+ */
+
+#define CACHE_MAGIC   0x47455257  /* "WREG" */
+#define CACHE_VERSION 2
+
+struct cache_header
+{
+    unsigned int       magic;      /* CACHE_MAGIC */
+    unsigned short     version;    /* CACHE_VERSION */
+    unsigned short     arch;       /* prefix type */
+    data_size_t        size;       /* size of the file */
+    data_size_t        root;       /* offset of the root key */
+    unsigned long long text_size;  /* size of the text file */
+    unsigned long long text_mtime; /* modification time of the text file, in nanoseconds */
+    unsigned long long text_ino;   /* inode of the text file */
+};
+
+/* followed by the name and class, subkey offsets, and values */
+struct cache_key
+{
+    timeout_t          modif;      /* last modification time */
+    unsigned int       flags;      /* key flags */
+    unsigned short     namelen;    /* length of key name */
+    unsigned short     classlen;   /* length of class name */
+    unsigned int       nb_subkeys; /* number of subkeys */
+    unsigned int       nb_values;  /* number of values */
+};
+
+/* followed by the name and data */
+struct cache_value
+{
+    unsigned int       type;       /* value type */
+    data_size_t        len;        /* value data length in bytes */
+    unsigned int       namelen;    /* length of value name */
+};
+
+struct registry_cache
+{
+    const char        *base;       /* base address of the mapping */
+    data_size_t        size;       /* size of the mapping */
+    char              *path;       /* path of the cache file */
+};
+
+static int use_registry_cache;     /* is the binary cache enabled? */
+static int cache_count;
+static struct registry_cache caches[MAX_SAVE_BRANCH_INFO];
+
 
 /* information about a file being loaded */
 struct file_load_info
@@ -256,11 +327,12 @@ static void dump_value( const struct key_value *value, FILE *f )
 }
 
 /* save a registry and all its subkeys to a text file */
-static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
+static void save_subkeys( struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
     if (key->flags & KEY_VOLATILE) return;
+    load_cached_key( key );
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
@@ -492,6 +564,7 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->values      = NULL;
         key->modif       = modif;
         key->parent      = NULL;
+        key->cache       = NULL;
         list_init( &key->notify_list );
         if (name->len && !(key->name = memdup( name->str, name->len )))
         {
@@ -551,6 +624,110 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change, 0 );
 }
 
+/* get a pointer to some data in the registry cache, checking the bounds */
+static const void *get_cache_data( const struct registry_cache *cache, data_size_t pos, data_size_t size )
+{
+    if (pos > cache->size || size > cache->size - pos) return NULL;
+    return cache->base + pos;
+}
+
+/* create a key from its entry in the registry cache */
+static struct key *alloc_cached_key( const struct registry_cache *cache, data_size_t pos )
+{
+    const struct cache_key *entry;
+    const char *name;
+    struct unicode_str str;
+    struct key *key;
+
+    if ((pos & 7) || !(entry = get_cache_data( cache, pos, sizeof(*entry) ))) return NULL;
+    if (!(name = get_cache_data( cache, pos + sizeof(*entry), entry->namelen + entry->classlen ))) return NULL;
+
+    str.str = (const WCHAR *)name;
+    str.len = entry->namelen;
+    if (!(key = alloc_key( &str, entry->modif ))) return NULL;
+    key->flags = entry->flags & (KEY_SYMLINK | KEY_WOW64);
+    if (entry->classlen && (key->class = memdup( name + entry->namelen, entry->classlen )))
+        key->classlen = entry->classlen;
+    if (entry->nb_subkeys || entry->nb_values) key->cache = entry;
+    return key;
+}
+
+/* load the subkeys and values of a key from the registry cache on first access */
+static void load_cached_key( struct key *key )
+{
+    const struct registry_cache *cache = NULL;
+    const struct cache_key *entry = key->cache;
+    const struct cache_value *value;
+    const data_size_t *subkeys;
+    const char *name;
+    data_size_t pos;
+    unsigned int i;
+
+    if (!entry) return;
+    key->cache = NULL;
+
+    for (i = 0; i < cache_count; i++)
+    {
+        if ((const char *)entry < caches[i].base) continue;
+        if ((const char *)entry >= caches[i].base + caches[i].size) continue;
+        cache = &caches[i];
+        break;
+    }
+    assert( cache );
+    pos = (const char *)entry - cache->base + sizeof(*entry) + ((entry->namelen + entry->classlen + 3) & ~3);
+
+    if (entry->nb_subkeys)
+    {
+        if (entry->nb_subkeys > cache->size / sizeof(*subkeys)) goto error;
+        if (!(subkeys = get_cache_data( cache, pos, entry->nb_subkeys * sizeof(*subkeys) ))) goto error;
+        if (!(key->subkeys = mem_alloc( max( entry->nb_subkeys, MIN_SUBKEYS ) * sizeof(*key->subkeys) )))
+            goto error;
+        key->nb_subkeys = max( entry->nb_subkeys, MIN_SUBKEYS );
+        for (i = 0; i < entry->nb_subkeys; i++)
+        {
+            struct key *subkey = alloc_cached_key( cache, subkeys[i] );
+            if (!subkey) goto error;
+            subkey->parent = key;
+            key->subkeys[++key->last_subkey] = subkey;
+        }
+        pos += entry->nb_subkeys * sizeof(*subkeys);
+    }
+
+    if (entry->nb_values)
+    {
+        if (entry->nb_values > cache->size / sizeof(*value)) goto error;
+        if (!(key->values = mem_alloc( max( entry->nb_values, MIN_VALUES ) * sizeof(*key->values) )))
+            goto error;
+        key->nb_values = max( entry->nb_values, MIN_VALUES );
+        for (i = 0; i < entry->nb_values; i++)
+        {
+            struct key_value *val = &key->values[i];
+
+            if (!(value = get_cache_data( cache, pos, sizeof(*value) ))) goto error;
+            if (value->namelen > MAX_VALUE_LEN * sizeof(WCHAR) || value->len > cache->size) goto error;
+            if (!(name = get_cache_data( cache, pos + sizeof(*value), value->namelen + value->len ))) goto error;
+            val->namelen = value->namelen;
+            val->type    = value->type;
+            val->len     = value->len;
+            val->name    = NULL;
+            val->data    = NULL;
+            key->last_value = i;
+            if (val->namelen && !(val->name = memdup( name, val->namelen ))) goto error;
+            if (val->len && !(val->data = memdup( name + value->namelen, val->len ))) goto error;
+            pos += sizeof(*value) + ((value->namelen + value->len + 3) & ~3);
+        }
+    }
+    return;
+
+error:
+    /* the next server will load the text file instead */
+    unlink( cache->path );
+    fprintf( stderr, "wineserver: could not load registry cache %s for key ", cache->path );
+    dump_path( key, NULL, stderr );
+    if (is_save_process) _exit( 1 );  /* don't run the server atexit handlers, the save fails */
+    fatal_error( "\n" );
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -577,11 +754,13 @@ static int grow_subkeys( struct key *key )
 }
 
 /* allocate a subkey for a given key, and return its index */
+/* the subkeys stay in a sorted array because enumeration addresses them by position; inserting in
+ * the middle costs a memmove of the pointers after it, which is below 10us even with 100000
+ * subkeys, about the cost of the request itself, and loading a hive appends in order anyway */
 static struct key *alloc_subkey( struct key *parent, const struct unicode_str *name,
                                  int index, timeout_t modif )
 {
     struct key *key;
-    int i;
 
     if (name->len > MAX_NAME_LEN * sizeof(WCHAR))
     {
@@ -596,8 +775,8 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
     if ((key = alloc_key( name, modif )) != NULL)
     {
         key->parent = parent;
-        for (i = ++parent->last_subkey; i > index; i--)
-            parent->subkeys[i] = parent->subkeys[i-1];
+        memmove( parent->subkeys + index + 1, parent->subkeys + index,
+                 (++parent->last_subkey - index) * sizeof(*parent->subkeys) );
         parent->subkeys[index] = key;
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
@@ -609,13 +788,14 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
 static void free_subkey( struct key *parent, int index )
 {
     struct key *key;
-    int i, nb_subkeys;
+    int nb_subkeys;
 
     assert( index >= 0 );
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
-    for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
+    memmove( parent->subkeys + index, parent->subkeys + index + 1,
+             (parent->last_subkey - index) * sizeof(*parent->subkeys) );
     parent->last_subkey--;
     key->flags |= KEY_DELETED;
     key->parent = NULL;
@@ -635,20 +815,35 @@ static void free_subkey( struct key *parent, int index )
     }
 }
 
+/* compare the name of a key with a given name */
+static inline int compare_key_name( const struct key *key, const struct unicode_str *name )
+{
+    data_size_t len = min( key->namelen, name->len );
+    int res = memicmpW( key->name, name->str, len / sizeof(WCHAR) );
+    if (!res) res = key->namelen - name->len;
+    return res;
+}
+
 /* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+static struct key *find_subkey( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
 
+    load_cached_key( key );
     min = 0;
     max = key->last_subkey;
+
+    /* keys are usually created in order when loading a hive, check the end first */
+    if (max >= 0 && compare_key_name( key->subkeys[max], name ) < 0)
+    {
+        *index = max + 1;
+        return NULL;
+    }
+
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->subkeys[i]->namelen, name->len );
-        res = memicmpW( key->subkeys[i]->name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->subkeys[i]->namelen - name->len;
+        res = compare_key_name( key->subkeys[i], name );
         if (!res)
         {
             *index = i;
@@ -877,7 +1072,7 @@ static struct key *create_key_recursive( struct key *key, const struct unicode_s
 }
 
 /* query information about a key or a subkey */
-static void enum_key( const struct key *key, int index, int info_class,
+static void enum_key( struct key *key, int index, int info_class,
                       struct enum_key_reply *reply )
 {
     static const WCHAR backslash[] = { '\\' };
@@ -890,6 +1085,7 @@ static void enum_key( const struct key *key, int index, int info_class,
 
     if (index != -1)  /* -1 means use the specified key directly */
     {
+        load_cached_key( key );
         if ((index < 0) || (index > key->last_subkey))
         {
             set_error( STATUS_NO_MORE_ENTRIES );
@@ -897,6 +1093,7 @@ static void enum_key( const struct key *key, int index, int info_class,
         }
         key = key->subkeys[index];
     }
+    load_cached_key( key );
 
     namelen = key->namelen;
     classlen = key->classlen;
@@ -996,6 +1193,7 @@ static int delete_key( struct key *key, int recurse )
     }
     assert( parent );
 
+    load_cached_key( key );
     while (recurse && (key->last_subkey>=0))
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
@@ -1043,11 +1241,12 @@ static int grow_values( struct key *key )
 }
 
 /* find the named value of a given key and return its index in the array */
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+static struct key_value *find_value( struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    load_cached_key( key );
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1069,11 +1268,11 @@ static struct key_value *find_value( const struct key *key, const struct unicode
 }
 
 /* insert a new value; the index must have been returned by find_value */
+/* values are kept in a sorted array for the same reason as subkeys, see alloc_subkey */
 static struct key_value *insert_value( struct key *key, const struct unicode_str *name, int index )
 {
     struct key_value *value;
     WCHAR *new_name = NULL;
-    int i;
 
     if (name->len > MAX_VALUE_LEN * sizeof(WCHAR))
     {
@@ -1085,7 +1284,8 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
         if (!grow_values( key )) return NULL;
     }
     if (name->len && !(new_name = memdup( name->str, name->len ))) return NULL;
-    for (i = ++key->last_value; i > index; i--) key->values[i] = key->values[i - 1];
+    memmove( key->values + index + 1, key->values + index,
+             (++key->last_value - index) * sizeof(*key->values) );
     value = &key->values[index];
     value->name    = new_name;
     value->namelen = name->len;
@@ -1167,6 +1367,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 {
     struct key_value *value;
 
+    load_cached_key( key );
     if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
     else
     {
@@ -1217,7 +1418,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 static void delete_value( struct key *key, const struct unicode_str *name )
 {
     struct key_value *value;
-    int i, index, nb_values;
+    int index, nb_values;
 
     if (!(value = find_value( key, name, &index )))
     {
@@ -1227,7 +1428,8 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     if (debug_level > 1) dump_operation( key, value, "Delete" );
     free( value->name );
     free( value->data );
-    for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
+    memmove( key->values + index, key->values + index + 1,
+             (key->last_value - index) * sizeof(*key->values) );
     key->last_value--;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
@@ -1714,12 +1916,88 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* get the modification time of a file in nanoseconds */
+static unsigned long long get_file_mtime( const struct stat *st )
+{
+    unsigned long long ret = (unsigned long long)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
+    return ret;
+}
+
+/* get the name of the cache file for a registry file */
+static char *get_registry_cache_path( const char *path )
+{
+    char *ret = malloc( strlen(path) + sizeof(".cache") );
+
+    if (ret) sprintf( ret, "%s.cache", path );
+    return ret;
+}
+
+/* map the registry cache of a file, if it is up to date with the text file */
+static int load_registry_cache( const char *filename, struct key *key )
+{
+    const struct cache_header *header;
+    const struct cache_key *entry;
+    struct registry_cache *cache = &caches[cache_count];
+    struct stat st, text_st;
+    char *path;
+    void *base;
+    int fd;
+
+    if (key->last_subkey != -1 || key->last_value != -1) return 0;
+    if (stat( filename, &text_st ) == -1) return 0;
+    if (!(path = get_registry_cache_path( filename ))) return 0;
+    if ((fd = open( path, O_RDONLY )) == -1)
+    {
+        free( path );
+        return 0;
+    }
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) || st.st_size != (data_size_t)st.st_size ||
+        (base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        free( path );
+        return 0;
+    }
+    close( fd );
+
+    header = base;
+    cache->base = base;
+    cache->size = st.st_size;
+    cache->path = path;
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION) goto failed;
+    if (header->size != st.st_size || header->text_size != text_st.st_size ||
+        header->text_mtime != get_file_mtime( &text_st ) || header->text_ino != text_st.st_ino) goto failed;
+    if (header->arch != PREFIX_UNKNOWN && prefix_type != PREFIX_UNKNOWN && header->arch != prefix_type)
+        goto failed;
+    if ((header->root & 7) || !(entry = get_cache_data( cache, header->root, sizeof(*entry) ))) goto failed;
+
+    if (prefix_type == PREFIX_UNKNOWN) prefix_type = header->arch;
+    if (entry->nb_subkeys || entry->nb_values) key->cache = entry;
+    cache_count++;
+    return 1;
+
+failed:
+    munmap( base, st.st_size );
+    free( path );
+    return 0;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
-    FILE *f;
+    FILE *f = NULL;
+    int ret = 1;
 
-    if ((f = fopen( filename, "r" )))
+    if (use_registry_cache && load_registry_cache( filename, key ))
+    {
+        if (debug_level) fprintf( stderr, "wineserver: using registry cache for %s\n", filename );
+    }
+    else if ((f = fopen( filename, "r" )))
     {
         load_keys( key, filename, f, 0 );
         fclose( f );
@@ -1728,14 +2006,16 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
             fprintf( stderr, "%s is not a valid registry file\n", filename );
             return 1;
         }
+        if (use_registry_cache) save_registry_cache( key, filename );
     }
+    else ret = 0;
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
     save_branch_info[save_branch_count].path = filename;
     save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
     make_object_static( &key->obj );
-    return (f != NULL);
+    return ret;
 }
 
 static WCHAR *format_user_registry_path( const SID *sid, struct unicode_str *path )
@@ -1807,6 +2087,8 @@ void init_registry(void)
     struct key *key, *hklm, *hkcu;
     char *p;
 
+    use_registry_cache = (p = getenv( "WINEREGCACHE" )) && atoi( p );
+
     /* switch to the config dir */
 
     if (fchdir( config_dir_fd ) == -1) fatal_error( "chdir to config dir: %s\n", strerror( errno ));
@@ -1916,12 +2198,137 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* create a temp file in the same directory as a registry file */
+static int create_temp_file_for( const char *path, char **tmp_ret )
+{
+    char *p, *tmp;
+    int fd, count = 0;
+
+    if (!(tmp = malloc( strlen(path) + 20 ))) return -1;
+    strcpy( tmp, path );
+    if ((p = strrchr( tmp, '/' ))) p++;
+    else p = tmp;
+    for (;;)
+    {
+        sprintf( p, "reg%lx%04x.tmp", (long) getpid(), count++ );
+        if ((fd = open( tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) break;
+        if (errno != EEXIST)
+        {
+            free( tmp );
+            return -1;
+        }
+    }
+    *tmp_ret = tmp;
+    return fd;
+}
+
+/* write some data to the registry cache, updating the current position */
+static void write_cache_data( FILE *f, data_size_t *pos, const void *data, data_size_t len, data_size_t align )
+{
+    static const char padding[8];
+
+    if (len) fwrite( data, len, 1, f );
+    *pos += len;
+    if (*pos & (align - 1))
+    {
+        fwrite( padding, align - (*pos & (align - 1)), 1, f );
+        *pos = (*pos + align - 1) & ~(align - 1);
+    }
+}
+
+/* write a key and its subkeys to the registry cache; return the key offset, or 0 on error */
+static data_size_t save_cached_key( struct key *key, FILE *f, data_size_t *pos )
+{
+    struct cache_key entry;
+    struct cache_value value;
+    data_size_t offset, *subkeys = NULL;
+    int i;
+
+    load_cached_key( key );
+
+    entry.modif      = key->modif;
+    entry.flags      = key->flags & (KEY_SYMLINK | KEY_WOW64);
+    entry.namelen    = key->namelen;
+    entry.classlen   = key->classlen;
+    entry.nb_subkeys = 0;
+    entry.nb_values  = key->last_value + 1;
+
+    if (key->last_subkey >= 0 && !(subkeys = mem_alloc( (key->last_subkey + 1) * sizeof(*subkeys) )))
+        return 0;
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        if (!(subkeys[entry.nb_subkeys++] = save_cached_key( key->subkeys[i], f, pos )))
+        {
+            free( subkeys );
+            return 0;
+        }
+    }
+
+    offset = *pos;
+    write_cache_data( f, pos, &entry, sizeof(entry), 1 );
+    write_cache_data( f, pos, key->name, key->namelen, 1 );
+    write_cache_data( f, pos, key->class, key->classlen, 4 );
+    write_cache_data( f, pos, subkeys, entry.nb_subkeys * sizeof(*subkeys), 4 );
+    for (i = 0; i <= key->last_value; i++)
+    {
+        value.type    = key->values[i].type;
+        value.len     = key->values[i].len;
+        value.namelen = key->values[i].namelen;
+        write_cache_data( f, pos, &value, sizeof(value), 1 );
+        write_cache_data( f, pos, key->values[i].name, value.namelen, 1 );
+        write_cache_data( f, pos, key->values[i].data, value.len, 4 );
+    }
+    write_cache_data( f, pos, NULL, 0, 8 );
+    free( subkeys );
+    return offset;
+}
+
+/* save the registry cache of a branch, after its text file has been written */
+static void save_registry_cache( struct key *key, const char *path )
+{
+    struct cache_header header;
+    struct stat st;
+    data_size_t pos = 0;
+    char *cache_path, *tmp = NULL;
+    int fd, ret = 0;
+    FILE *f;
+
+    if (!(cache_path = get_registry_cache_path( path ))) return;
+    if (stat( path, &st ) == -1) goto done;
+    if ((fd = create_temp_file_for( cache_path, &tmp )) == -1) goto done;
+    if (!(f = fdopen( fd, "w" )))
+    {
+        close( fd );
+        goto done;
+    }
+
+    memset( &header, 0, sizeof(header) );
+    write_cache_data( f, &pos, &header, sizeof(header), 8 );
+    header.magic      = CACHE_MAGIC;
+    header.version    = CACHE_VERSION;
+    header.arch       = prefix_type;
+    header.root       = save_cached_key( key, f, &pos );
+    header.size       = pos;
+    header.text_size  = st.st_size;
+    header.text_mtime = get_file_mtime( &st );
+    header.text_ino   = st.st_ino;
+    if (header.root && !fseek( f, 0, SEEK_SET )) fwrite( &header, sizeof(header), 1, f );
+    ret = !fclose( f ) && header.root && !rename( tmp, cache_path );
+
+done:
+    if (tmp && !ret) unlink( tmp );
+    if (!ret) unlink( cache_path );  /* don't leave a stale cache around */
+    free( tmp );
+    free( cache_path );
+}
+
 /* save a registry branch to a file */
 static int save_branch( struct key *key, const char *path )
 {
     struct stat st;
-    char *p, *tmp = NULL;
-    int fd, count = 0, ret = 0;
+    char *tmp = NULL;
+    int fd, ret = 0;
     FILE *f;
 
     if (!(key->flags & KEY_DIRTY))
@@ -1946,17 +2353,7 @@ static int save_branch( struct key *key, const char *path )
 
     /* create a temp file in the same directory */
 
-    if (!(tmp = malloc( strlen(path) + 20 ))) goto done;
-    strcpy( tmp, path );
-    if ((p = strrchr( tmp, '/' ))) p++;
-    else p = tmp;
-    for (;;)
-    {
-        sprintf( p, "reg%lx%04x.tmp", (long) getpid(), count++ );
-        if ((fd = open( tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) break;
-        if (errno != EEXIST) goto done;
-        close( fd );
-    }
+    if ((fd = create_temp_file_for( path, &tmp )) == -1) goto done;
 
     /* now save to it */
 
@@ -1983,6 +2380,7 @@ static int save_branch( struct key *key, const char *path )
         if (ret) ret = !rename( tmp, path );
         if (!ret) unlink( tmp );
     }
+    if (ret && use_registry_cache) save_registry_cache( key, path );
 
 done:
     free( tmp );
@@ -1990,16 +2388,97 @@ done:
     return ret;
 }
 
+/* save the dirty branches in a child process, so that the server doesn't block on it */
+/* the branches are marked clean right away, and dirty again if the save fails */
+static int start_background_save(void)
+{
+    unsigned int mask = 0;
+    int i, fds[2];
+    pid_t pid;
+
+    for (i = 0; i < save_branch_count; i++)
+        if (save_branch_info[i].key->flags & KEY_DIRTY) mask |= 1 << i;
+    if (!mask) return 1;
+
+    if (pipe( fds ) == -1) return 0;
+    if ((pid = fork()) == -1)
+    {
+        close( fds[0] );
+        close( fds[1] );
+        return 0;
+    }
+    if (!pid)  /* child */
+    {
+        static const int signals[] = { SIGCHLD, SIGHUP, SIGINT, SIGALRM, SIGIO, SIGQUIT, SIGTERM, SIGSEGV };
+        unsigned char saved = 0;
+        int fd, max_fd = sysconf( _SC_OPEN_MAX );
+
+        is_save_process = 1;
+        /* don't keep the master socket and the client connections open, and don't run the server handlers */
+        for (fd = 3; fd < max_fd; fd++) if (fd != fds[1]) close( fd );
+        for (i = 0; i < ARRAY_SIZE(signals); i++) signal( signals[i], SIG_DFL );
+
+        for (i = 0; i < save_branch_count; i++)
+            if ((mask & (1 << i)) && save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+                saved |= 1 << i;
+        write( fds[1], &saved, 1 );
+        _exit( 0 );
+    }
+
+    close( fds[1] );
+    for (i = 0; i < save_branch_count; i++)
+        if (mask & (1 << i)) make_clean( save_branch_info[i].key );
+    save_pipe = fds[0];
+    save_pid = pid;
+    save_mask = mask;
+    return 1;
+}
+
+/* check the result of the background save, optionally waiting for it */
+/* return 0 if it is still running */
+static int finish_background_save( int wait )
+{
+    unsigned char saved = 0;
+    int i, status;
+    pid_t pid;
+
+    if (save_pipe == -1) return 1;
+
+    /* this fails with ECHILD if the ptrace SIGCHLD handler reaped the child first */
+    while ((pid = waitpid( save_pid, &status, wait ? 0 : WNOHANG )) == -1 && errno == EINTR) ;
+    if (!pid) return 0;
+    save_pid = -1;
+
+    if (read( save_pipe, &saved, 1 ) != 1) saved = 0;
+    close( save_pipe );
+    save_pipe = -1;
+
+    for (i = 0; i < save_branch_count; i++)
+    {
+        if (!(save_mask & (1 << i)) || (saved & (1 << i))) continue;
+        fprintf( stderr, "wineserver: could not save registry branch to %s\n", save_branch_info[i].path );
+        make_dirty( save_branch_info[i].key );
+    }
+    save_mask = 0;
+    return 1;
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
     int i;
 
-    if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
-    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    if (finish_background_save( 0 ))
+    {
+        if (fchdir( config_dir_fd ) == -1) return;
+        if (!start_background_save())
+        {
+            for (i = 0; i < save_branch_count; i++)
+                save_branch( save_branch_info[i].key, save_branch_info[i].path );
+        }
+        if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    }
     set_periodic_save_timer();
 }
 
@@ -2015,6 +2494,7 @@ void flush_registry(void)
 {
     int i;
 
+    finish_background_save( 1 );
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
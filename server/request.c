@@ -67,6 +67,7 @@
 #include "process.h"
 #include "thread.h"
 #include "security.h"
+#include "unicode.h"
 #define WANT_REQUEST_HANDLERS
 #include "request.h"
 
@@ -132,6 +133,19 @@ int config_dir_fd = -1;    /* file descriptor for the config dir */
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
 
+/* per-request statistics, collected when profiling is enabled */
+struct request_profile
+{
+    unsigned int     count;         /* number of calls */
+    timeout_t        time;          /* total time spent processing the request */
+    timeout_t        max_time;      /* longest time spent processing a single call */
+    unsigned __int64 req_bytes;     /* total size of the request data */
+    unsigned __int64 reply_bytes;   /* total size of the reply data */
+};
+
+static struct request_profile req_profile[REQ_NB_REQUESTS];
+static const struct request_profile *sort_profile;  /* table being sorted by dump_profile_table */
+
 /* complain about a protocol error and terminate the client connection */
 void fatal_protocol_error( struct thread *thread, const char *err, ... )
 {
@@ -292,11 +306,51 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* get a monotonic time for request profiling, in ticks */
+static timeout_t get_profile_time(void)
+{
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+
+    if (!timebase.denom) mach_timebase_info( &timebase );
+    return mach_absolute_time() * timebase.numer / timebase.denom / 100;
+#elif defined(HAVE_CLOCK_GETTIME)
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    if (!clock_gettime( CLOCK_MONOTONIC_RAW, &ts ))
+        return (timeout_t)ts.tv_sec * TICKS_PER_SEC + ts.tv_nsec / 100;
+#endif
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
+        return (timeout_t)ts.tv_sec * TICKS_PER_SEC + ts.tv_nsec / 100;
+#endif
+    {
+        struct timeval now;
+        gettimeofday( &now, NULL );
+        return (timeout_t)now.tv_sec * TICKS_PER_SEC + now.tv_usec * 10;
+    }
+}
+
+/* account for a request in a statistics table */
+static void update_request_profile( struct request_profile *prof, timeout_t time,
+                                    data_size_t req_size, data_size_t reply_size )
+{
+    prof->count++;
+    prof->time += time;
+    if (time > prof->max_time) prof->max_time = time;
+    prof->req_bytes += req_size;
+    prof->reply_bytes += reply_size;
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    struct process *process = thread->process;
+    data_size_t reply_size = 0;
+    timeout_t start = 0;
+
+    if (profile_level) start = get_profile_time();
 
     current = thread;
     current->reply_size = 0;
@@ -315,7 +369,7 @@ static void call_req_handler( struct thread *thread )
         if (current->reply_fd)
         {
             reply.reply_header.error = current->error;
-            reply.reply_header.reply_size = current->reply_size;
+            reply.reply_header.reply_size = reply_size = current->reply_size;
             if (debug_level) trace_reply( req, &reply );
             send_reply( &reply );
         }
@@ -326,29 +380,73 @@ static void call_req_handler( struct thread *thread )
         }
     }
     current = NULL;
+
+    if (profile_level && req < REQ_NB_REQUESTS)
+    {
+        timeout_t time = get_profile_time() - start;
+        data_size_t req_size = thread->req.request_header.request_size;
+
+        update_request_profile( &req_profile[req], time, req_size, reply_size );
+        if (process->req_profile ||
+            (process->req_profile = calloc( REQ_NB_REQUESTS, sizeof(*process->req_profile) )))
+            update_request_profile( &process->req_profile[req], time, req_size, reply_size );
+    }
+}
+
+/* release the request data buffer of a thread, unless it's small enough to be reused */
+static void release_req_data( struct thread *thread )
+{
+    if (thread->req_data_size <= MAX_REQUEST_LENGTH) return;
+    free( thread->req_data );
+    thread->req_data = NULL;
+    thread->req_data_size = 0;
 }
 
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
+    data_size_t size;
     int ret;
 
     if (!thread->req_toread)  /* no pending request */
     {
-        if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
-                         sizeof(thread->req) )) != sizeof(thread->req)) goto error;
-        if (!(thread->req_toread = thread->req.request_header.request_size))
+        struct iovec vec[2];
+
+        /* the client waits for the reply before sending anything else, so we can
+         * read the request data along with the header into the current buffer */
+        vec[0].iov_base = &thread->req;
+        vec[0].iov_len  = sizeof(thread->req);
+        vec[1].iov_base = thread->req_data;
+        vec[1].iov_len  = thread->req_data_size;
+        if ((ret = readv( get_unix_fd( thread->request_fd ), vec, 2 )) < (int)sizeof(thread->req))
+            goto error;
+        ret -= sizeof(thread->req);
+        size = thread->req.request_header.request_size;
+        if (ret > size)
         {
-            /* no data, handle request at once */
-            call_req_handler( thread );
+            fatal_protocol_error( thread, "request %d data too large (%d > %u)\n",
+                                  thread->req.request_header.req, ret, size );
             return;
         }
-        if (!(thread->req_data = malloc( thread->req_toread )))
+        if (!(thread->req_toread = size - ret))
         {
-            fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
-                                  thread->req_toread, thread->req.request_header.req );
+            /* all the data is there, handle request at once */
+            call_req_handler( thread );
+            release_req_data( thread );
             return;
         }
+        if (size > thread->req_data_size)
+        {
+            void *ptr = realloc( thread->req_data, size );
+            if (!ptr)
+            {
+                fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
+                                      size, thread->req.request_header.req );
+                return;
+            }
+            thread->req_data = ptr;
+            thread->req_data_size = size;
+        }
     }
 
     /* read the variable sized data */
@@ -362,8 +460,7 @@ void read_request( struct thread *thread )
         if (!(thread->req_toread -= ret))
         {
             call_req_handler( thread );
-            free( thread->req_data );
-            thread->req_data = NULL;
+            release_req_data( thread );
             return;
         }
     }
@@ -521,6 +618,75 @@ int send_client_fd( struct process *process, int fd, obj_handle_t handle )
     return -1;
 }
 
+static int compare_request_profile( const void *p1, const void *p2 )
+{
+    const struct request_profile *prof1 = &sort_profile[*(const enum request *)p1];
+    const struct request_profile *prof2 = &sort_profile[*(const enum request *)p2];
+
+    if (prof1->time > prof2->time) return -1;
+    if (prof1->time < prof2->time) return 1;
+    return 0;
+}
+
+/* dump a statistics table sorted by total time, limited to max entries if non-zero */
+static void dump_profile_table( const struct request_profile *profile, unsigned int max )
+{
+    enum request reqs[REQ_NB_REQUESTS];
+    unsigned int i, count = 0;
+
+    for (i = 0; i < REQ_NB_REQUESTS; i++) if (profile[i].count) reqs[count++] = i;
+    sort_profile = profile;
+    qsort( reqs, count, sizeof(reqs[0]), compare_request_profile );
+    if (max && count > max) count = max;
+
+    fprintf( stderr, "  %-32s %10s %12s %9s %9s %10s %10s\n", "request", "count",
+             "total (us)", "avg (us)", "max (us)", "req (KB)", "reply (KB)" );
+    for (i = 0; i < count; i++)
+    {
+        const struct request_profile *prof = &profile[reqs[i]];
+        fprintf( stderr, "  %-32s %10u %12lu %9.2f %9lu %10lu %10lu\n",
+                 get_req_name( reqs[i] ), prof->count, (unsigned long)(prof->time / 10),
+                 (double)prof->time / 10 / prof->count, (unsigned long)(prof->max_time / 10),
+                 (unsigned long)(prof->req_bytes / 1024), (unsigned long)(prof->reply_bytes / 1024) );
+    }
+}
+
+/* dump the request statistics of a process */
+static int dump_process_profile( struct process *process, void *arg )
+{
+    struct process_dll *exe = get_process_exe_module( process );
+    unsigned int i, count = 0;
+    timeout_t time = 0;
+
+    if (!process->req_profile) return 0;
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+    {
+        count += process->req_profile[i].count;
+        time += process->req_profile[i].time;
+    }
+    fprintf( stderr, "wineserver: process %04x ", process->id );
+    if (exe && exe->filename) dump_strW( exe->filename, exe->namelen / sizeof(WCHAR), stderr, "\"\"" );
+    fprintf( stderr, ": %u requests, %lu us\n", count, (unsigned long)(time / 10) );
+    dump_profile_table( process->req_profile, 10 );
+    return 0;
+}
+
+/* dump the statistics of a process that is going away and free them */
+void free_process_profile( struct process *process )
+{
+    dump_process_profile( process, NULL );
+    free( process->req_profile );
+    process->req_profile = NULL;
+}
+
+/* dump the request statistics for the whole server and for each running process */
+void dump_request_profile(void)
+{
+    fprintf( stderr, "wineserver: request statistics\n" );
+    dump_profile_table( req_profile, 0 );
+    enum_processes( dump_process_profile, NULL );
+}
+
 /* get current tick count to return to client */
 unsigned int get_tick_count(void)
 {
@@ -888,6 +1054,7 @@ static void close_socket_timeout( void *arg )
     master_timeout = NULL;
     flush_registry();
     if (debug_level) fprintf( stderr, "wineserver: exiting (pid=%ld)\n", (long) getpid() );
+    if (profile_level) dump_request_profile();
 
 #ifdef DEBUG_OBJECTS
     close_objects();  /* shut down everything properly */
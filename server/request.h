@@ -62,8 +62,12 @@ extern int wait_for_lock(void);
 extern int kill_lock_owner( int sig );
 extern int server_dir_fd, config_dir_fd;
 
+extern void dump_request_profile(void);
+extern void free_process_profile( struct process *process );
+
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern const char *get_req_name( enum request req );
 
 /* get the request vararg data */
 static inline const void *get_req_data(void)
@@ -135,7 +139,9 @@ DECL_HANDLER(unload_dll);
 DECL_HANDLER(queue_apc);
 DECL_HANDLER(get_apc_result);
 DECL_HANDLER(close_handle);
+DECL_HANDLER(close_handles);
 DECL_HANDLER(set_handle_info);
+DECL_HANDLER(get_handle_generations);
 DECL_HANDLER(dup_handle);
 DECL_HANDLER(open_process);
 DECL_HANDLER(open_thread);
@@ -154,6 +160,8 @@ DECL_HANDLER(create_semaphore);
 DECL_HANDLER(release_semaphore);
 DECL_HANDLER(query_semaphore);
 DECL_HANDLER(open_semaphore);
+DECL_HANDLER(get_fast_sync_shm);
+DECL_HANDLER(get_fast_sync_obj);
 DECL_HANDLER(create_file);
 DECL_HANDLER(open_file_object);
 DECL_HANDLER(alloc_file_handle);
@@ -382,6 +390,7 @@ DECL_HANDLER(create_completion);
 DECL_HANDLER(open_completion);
 DECL_HANDLER(add_completion);
 DECL_HANDLER(remove_completion);
+DECL_HANDLER(remove_completions);
 DECL_HANDLER(query_completion);
 DECL_HANDLER(set_completion_info);
 DECL_HANDLER(add_fd_completion);
@@ -432,7 +441,9 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_queue_apc,
     (req_handler)req_get_apc_result,
     (req_handler)req_close_handle,
+    (req_handler)req_close_handles,
     (req_handler)req_set_handle_info,
+    (req_handler)req_get_handle_generations,
     (req_handler)req_dup_handle,
     (req_handler)req_open_process,
     (req_handler)req_open_thread,
@@ -451,6 +462,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_release_semaphore,
     (req_handler)req_query_semaphore,
     (req_handler)req_open_semaphore,
+    (req_handler)req_get_fast_sync_shm,
+    (req_handler)req_get_fast_sync_obj,
     (req_handler)req_create_file,
     (req_handler)req_open_file_object,
     (req_handler)req_alloc_file_handle,
@@ -679,6 +692,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_open_completion,
     (req_handler)req_add_completion,
     (req_handler)req_remove_completion,
+    (req_handler)req_remove_completions,
     (req_handler)req_query_completion,
     (req_handler)req_set_completion_info,
     (req_handler)req_add_fd_completion,
@@ -884,12 +898,18 @@ C_ASSERT( FIELD_OFFSET(struct get_apc_result_reply, result) == 8 );
 C_ASSERT( sizeof(struct get_apc_result_reply) == 48 );
 C_ASSERT( FIELD_OFFSET(struct close_handle_request, handle) == 12 );
 C_ASSERT( sizeof(struct close_handle_request) == 16 );
+C_ASSERT( sizeof(struct close_handles_request) == 16 );
+C_ASSERT( sizeof(struct close_handles_reply) == 8 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_request, flags) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_request, mask) == 20 );
 C_ASSERT( sizeof(struct set_handle_info_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_reply, old_flags) == 8 );
+C_ASSERT( FIELD_OFFSET(struct set_handle_info_reply, generation) == 12 );
 C_ASSERT( sizeof(struct set_handle_info_reply) == 16 );
+C_ASSERT( sizeof(struct get_handle_generations_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_handle_generations_reply, size) == 8 );
+C_ASSERT( sizeof(struct get_handle_generations_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct dup_handle_request, src_process) == 12 );
 C_ASSERT( FIELD_OFFSET(struct dup_handle_request, src_handle) == 16 );
 C_ASSERT( FIELD_OFFSET(struct dup_handle_request, dst_process) == 20 );
@@ -995,6 +1015,15 @@ C_ASSERT( FIELD_OFFSET(struct open_semaphore_request, rootdir) == 20 );
 C_ASSERT( sizeof(struct open_semaphore_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_semaphore_reply, handle) == 8 );
 C_ASSERT( sizeof(struct open_semaphore_reply) == 16 );
+C_ASSERT( sizeof(struct get_fast_sync_shm_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_shm_reply, size) == 8 );
+C_ASSERT( sizeof(struct get_fast_sync_shm_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_request, handle) == 12 );
+C_ASSERT( sizeof(struct get_fast_sync_obj_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_reply, index) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_reply, type) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_fast_sync_obj_reply, access) == 16 );
+C_ASSERT( sizeof(struct get_fast_sync_obj_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, sharing) == 16 );
 C_ASSERT( FIELD_OFFSET(struct create_file_request, create) == 20 );
@@ -2247,6 +2276,7 @@ C_ASSERT( sizeof(struct get_object_info_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_object_type_request, handle) == 12 );
 C_ASSERT( sizeof(struct get_object_type_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_object_type_reply, total) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_object_type_reply, generation) == 12 );
 C_ASSERT( sizeof(struct get_object_type_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct unlink_object_request, handle) == 12 );
 C_ASSERT( sizeof(struct unlink_object_request) == 16 );
@@ -2319,6 +2349,9 @@ C_ASSERT( FIELD_OFFSET(struct remove_completion_reply, cvalue) == 16 );
 C_ASSERT( FIELD_OFFSET(struct remove_completion_reply, information) == 24 );
 C_ASSERT( FIELD_OFFSET(struct remove_completion_reply, status) == 32 );
 C_ASSERT( sizeof(struct remove_completion_reply) == 40 );
+C_ASSERT( FIELD_OFFSET(struct remove_completions_request, handle) == 12 );
+C_ASSERT( sizeof(struct remove_completions_request) == 16 );
+C_ASSERT( sizeof(struct remove_completions_reply) == 8 );
 C_ASSERT( FIELD_OFFSET(struct query_completion_request, handle) == 12 );
 C_ASSERT( sizeof(struct query_completion_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_completion_reply, depth) == 8 );
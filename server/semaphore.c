@@ -41,22 +41,26 @@ struct semaphore
     struct object  obj;    /* object header */
     unsigned int   count;  /* current count */
     unsigned int   max;    /* maximum possible count */
+    unsigned int   fast_sync; /* shared state slot, or 0 if the state is private */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static struct object_type *semaphore_get_type( struct object *obj );
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
     sizeof(struct semaphore),      /* size */
     semaphore_dump,                /* dump */
     semaphore_get_type,            /* get_type */
-    add_queue,                     /* add_queue */
-    remove_queue,                  /* remove_queue */
+    semaphore_add_queue,           /* add_queue */
+    semaphore_remove_queue,        /* remove_queue */
     semaphore_signaled,            /* signaled */
     semaphore_satisfied,           /* satisfied */
     semaphore_signal,              /* signal */
@@ -69,7 +73,7 @@ static const struct object_ops semaphore_ops =
     default_unlink_name,           /* unlink_name */
     no_open_file,                  /* open_file */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -91,28 +95,49 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
             /* initialize it if it didn't already exist */
             sem->count = initial;
             sem->max   = max;
+            sem->fast_sync = alloc_fast_sync( FAST_SYNC_SEMAPHORE, initial, max );
         }
     }
     return sem;
 }
 
+unsigned int get_semaphore_fast_sync( struct object *obj )
+{
+    if (obj->ops != &semaphore_ops) return 0;
+    return ((struct semaphore *)obj)->fast_sync;
+}
+
+static unsigned int get_semaphore_count( struct semaphore *sem )
+{
+    if (sem->fast_sync) return get_fast_sync_state( sem->fast_sync );
+    return sem->count;
+}
+
+static void set_semaphore_count( struct semaphore *sem, unsigned int count )
+{
+    if (sem->fast_sync) set_fast_sync_state( sem->fast_sync, count );
+    else sem->count = count;
+}
+
 static int release_semaphore( struct semaphore *sem, unsigned int count,
                               unsigned int *prev )
 {
-    if (prev) *prev = sem->count;
-    if (sem->count + count < sem->count || sem->count + count > sem->max)
+    unsigned int current = get_semaphore_count( sem );
+
+    if (prev) *prev = current;
+    if (current + count < current || current + count > sem->max)
     {
         set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
         return 0;
     }
-    else if (sem->count)
+    else if (current)
     {
         /* there cannot be any thread to wake up if the count is != 0 */
-        sem->count += count;
+        set_semaphore_count( sem, current + count );
     }
     else
     {
-        sem->count = count;
+        set_semaphore_count( sem, count );
         wake_up( &sem->obj, count );
     }
     return 1;
@@ -122,7 +147,7 @@ static void semaphore_dump( struct object *obj, int verbose )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    fprintf( stderr, "Semaphore count=%d max=%d\n", sem->count, sem->max );
+    fprintf( stderr, "Semaphore count=%d max=%d\n", get_semaphore_count( sem ), sem->max );
 }
 
 static struct object_type *semaphore_get_type( struct object *obj )
@@ -132,19 +157,37 @@ static struct object_type *semaphore_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    /* the clients must not touch the count while we have waiters */
+    if (sem->fast_sync) fast_sync_add_waiter( sem->fast_sync );
+    return add_queue( obj, entry );
+}
+
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    if (sem->fast_sync) fast_sync_remove_waiter( sem->fast_sync );
+    remove_queue( obj, entry );
+}
+
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    return (sem->count > 0);
+    return (get_semaphore_count( sem ) > 0);
 }
 
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
+    unsigned int count = get_semaphore_count( sem );
     assert( obj->ops == &semaphore_ops );
-    assert( sem->count );
-    sem->count--;
+    assert( count );
+    set_semaphore_count( sem, count - 1 );
 }
 
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access )
@@ -169,6 +212,13 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    if (sem->fast_sync) free_fast_sync( sem->fast_sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -223,7 +273,7 @@ DECL_HANDLER(query_semaphore)
     if ((sem = (struct semaphore *)get_handle_obj( current->process, req->handle,
                                                    SEMAPHORE_QUERY_STATE, &semaphore_ops )))
     {
-        reply->current = sem->count;
+        reply->current = get_semaphore_count( sem );
         reply->max = sem->max;
         release_object( sem );
     }
@@ -179,6 +179,7 @@ static void sighup_callback(void)
 #ifdef DEBUG_OBJECTS
     dump_objects();
 #endif
+    if (profile_level) dump_request_profile();
 }
 
 /* SIGTERM callback */
@@ -187,6 +187,7 @@ static inline void init_thread_structure( struct thread *thread )
     thread->wait            = NULL;
     thread->error           = 0;
     thread->req_data        = NULL;
+    thread->req_data_size   = 0;
     thread->req_toread      = 0;
     thread->reply_data      = NULL;
     thread->reply_towrite   = 0;
@@ -328,6 +329,7 @@ static void cleanup_thread( struct thread *thread )
         }
     }
     thread->req_data = NULL;
+    thread->req_data_size = 0;
     thread->reply_data = NULL;
     thread->request_fd = NULL;
     thread->reply_fd = NULL;
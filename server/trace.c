@@ -504,6 +504,12 @@ static void dump_varargs_user_handles( const char *prefix, data_size_t size )
     remove_data( size );
 }
 
+static void dump_varargs_handles( const char *prefix, data_size_t size )
+{
+    dump_handles( prefix, cur_data, size );
+    remove_data( size );
+}
+
 static void dump_varargs_bytes( const char *prefix, data_size_t size )
 {
     const unsigned char *data = cur_data;
@@ -1220,6 +1226,25 @@ static void dump_varargs_handle_infos( const char *prefix, data_size_t size )
     fputc( '}', stderr );
 }
 
+static void dump_varargs_completion_packets( const char *prefix, data_size_t size )
+{
+    const struct completion_packet *packet;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*packet))
+    {
+        packet = cur_data;
+        dump_uint64( "{ckey=", &packet->ckey );
+        dump_uint64( ",cvalue=", &packet->cvalue );
+        dump_uint64( ",information=", &packet->information );
+        fprintf( stderr, ",status=%s}", get_status_name( packet->status ) );
+        size -= sizeof(*packet);
+        remove_data( sizeof(*packet) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
 typedef void (*dump_func)( const void *req );
 
 /* Everything below this line is generated automatically by tools/make_requests */
@@ -1505,6 +1530,16 @@ static void dump_close_handle_request( const struct close_handle_request *req )
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_close_handles_request( const struct close_handles_request *req )
+{
+    dump_varargs_handles( " handles=", cur_size );
+}
+
+static void dump_close_handles_reply( const struct close_handles_reply *req )
+{
+    dump_varargs_uints( " statuses=", cur_size );
+}
+
 static void dump_set_handle_info_request( const struct set_handle_info_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -1515,6 +1550,16 @@ static void dump_set_handle_info_request( const struct set_handle_info_request *
 static void dump_set_handle_info_reply( const struct set_handle_info_reply *req )
 {
     fprintf( stderr, " old_flags=%d", req->old_flags );
+    fprintf( stderr, ", generation=%08x", req->generation );
+}
+
+static void dump_get_handle_generations_request( const struct get_handle_generations_request *req )
+{
+}
+
+static void dump_get_handle_generations_reply( const struct get_handle_generations_reply *req )
+{
+    fprintf( stderr, " size=%u", req->size );
 }
 
 static void dump_dup_handle_request( const struct dup_handle_request *req )
@@ -1737,6 +1782,27 @@ static void dump_open_semaphore_reply( const struct open_semaphore_reply *req )
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_get_fast_sync_shm_request( const struct get_fast_sync_shm_request *req )
+{
+}
+
+static void dump_get_fast_sync_shm_reply( const struct get_fast_sync_shm_reply *req )
+{
+    fprintf( stderr, " size=%u", req->size );
+}
+
+static void dump_get_fast_sync_obj_request( const struct get_fast_sync_obj_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_get_fast_sync_obj_reply( const struct get_fast_sync_obj_reply *req )
+{
+    fprintf( stderr, " index=%08x", req->index );
+    fprintf( stderr, ", type=%d", req->type );
+    fprintf( stderr, ", access=%08x", req->access );
+}
+
 static void dump_create_file_request( const struct create_file_request *req )
 {
     fprintf( stderr, " access=%08x", req->access );
@@ -4217,6 +4283,7 @@ static void dump_get_object_type_request( const struct get_object_type_request *
 static void dump_get_object_type_reply( const struct get_object_type_reply *req )
 {
     fprintf( stderr, " total=%u", req->total );
+    fprintf( stderr, ", generation=%08x", req->generation );
     dump_varargs_unicode_str( ", type=", cur_size );
 }
 
@@ -4364,6 +4431,16 @@ static void dump_remove_completion_reply( const struct remove_completion_reply *
     fprintf( stderr, ", status=%08x", req->status );
 }
 
+static void dump_remove_completions_request( const struct remove_completions_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_remove_completions_reply( const struct remove_completions_reply *req )
+{
+    dump_varargs_completion_packets( " packets=", cur_size );
+}
+
 static void dump_query_completion_request( const struct query_completion_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4565,7 +4642,9 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_queue_apc_request,
     (dump_func)dump_get_apc_result_request,
     (dump_func)dump_close_handle_request,
+    (dump_func)dump_close_handles_request,
     (dump_func)dump_set_handle_info_request,
+    (dump_func)dump_get_handle_generations_request,
     (dump_func)dump_dup_handle_request,
     (dump_func)dump_open_process_request,
     (dump_func)dump_open_thread_request,
@@ -4584,6 +4663,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_release_semaphore_request,
     (dump_func)dump_query_semaphore_request,
     (dump_func)dump_open_semaphore_request,
+    (dump_func)dump_get_fast_sync_shm_request,
+    (dump_func)dump_get_fast_sync_obj_request,
     (dump_func)dump_create_file_request,
     (dump_func)dump_open_file_object_request,
     (dump_func)dump_alloc_file_handle_request,
@@ -4812,6 +4893,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_open_completion_request,
     (dump_func)dump_add_completion_request,
     (dump_func)dump_remove_completion_request,
+    (dump_func)dump_remove_completions_request,
     (dump_func)dump_query_completion_request,
     (dump_func)dump_set_completion_info_request,
     (dump_func)dump_add_fd_completion_request,
@@ -4859,7 +4941,9 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_queue_apc_reply,
     (dump_func)dump_get_apc_result_reply,
     NULL,
+    (dump_func)dump_close_handles_reply,
     (dump_func)dump_set_handle_info_reply,
+    (dump_func)dump_get_handle_generations_reply,
     (dump_func)dump_dup_handle_reply,
     (dump_func)dump_open_process_reply,
     (dump_func)dump_open_thread_reply,
@@ -4878,6 +4962,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_release_semaphore_reply,
     (dump_func)dump_query_semaphore_reply,
     (dump_func)dump_open_semaphore_reply,
+    (dump_func)dump_get_fast_sync_shm_reply,
+    (dump_func)dump_get_fast_sync_obj_reply,
     (dump_func)dump_create_file_reply,
     (dump_func)dump_open_file_object_reply,
     (dump_func)dump_alloc_file_handle_reply,
@@ -5106,6 +5192,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_open_completion_reply,
     NULL,
     (dump_func)dump_remove_completion_reply,
+    (dump_func)dump_remove_completions_reply,
     (dump_func)dump_query_completion_reply,
     NULL,
     NULL,
@@ -5153,7 +5240,9 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "queue_apc",
     "get_apc_result",
     "close_handle",
+    "close_handles",
     "set_handle_info",
+    "get_handle_generations",
     "dup_handle",
     "open_process",
     "open_thread",
@@ -5172,6 +5261,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "release_semaphore",
     "query_semaphore",
     "open_semaphore",
+    "get_fast_sync_shm",
+    "get_fast_sync_obj",
     "create_file",
     "open_file_object",
     "alloc_file_handle",
@@ -5400,6 +5491,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "open_completion",
     "add_completion",
     "remove_completion",
+    "remove_completions",
     "query_completion",
     "set_completion_info",
     "add_fd_completion",
@@ -5612,6 +5704,12 @@ static const char *get_status_name( unsigned int status )
     return buffer;
 }
 
+const char *get_req_name( enum request req )
+{
+    if (req < REQ_NB_REQUESTS) return req_names[req];
+    return "?";
+}
+
 void trace_request(void)
 {
     enum request req = current->req.request_header.req;